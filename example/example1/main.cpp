@@ -1,28 +1,30 @@
 #include <Arduino.h>
 #include "max485ttl.h"
+#include "max485ttl_line.hpp"
 
 RS485 *rs;
+RS485LineReader *reader;
+char line[32];
 int correct = 0;
 int wrong = 0;
 
 void setup()
 {
     rs = new RS485(2, 3, &Serial1);
+    reader = new RS485LineReader(*rs, line, sizeof(line));
 
     Serial1.begin(115200);
 }
 
 void loop()
 {
-    String input = "AAAABBBBCCCC\n";
-    rs->print(input);
-    rs->SetMode(INPUT);
-    delay(1000);
+    const char input[] = "AAAABBBBCCCC\n";
+    rs->Send(input, sizeof(input) - 1);
 
-    if (rs->available())
+    // Returns as soon as the echo of the whole line arrived
+    if (reader->ReadLine(1000))
     {
-        String output = rs->readString();
-        if (input == output)
+        if (strcmp(reader->GetLine(), "AAAABBBBCCCC") == 0)
         {
             correct++;
         }
@@ -30,6 +32,7 @@ void loop()
         {
             wrong++;
         }
+        reader->ReleaseLine();
     }
 
     if (correct + wrong % 50 == 0)
@@ -1,25 +1,32 @@
 #include <Arduino.h>
 #include <MAX485TTL.h>
+#include "max485ttl_frame.hpp"
 
 #define RS485_DE_PIN 2
 #define RS485_RE_PIN 3
 
 RS485 *rs;
-String output;
+RS485FrameReceiver *receiver;
+uint8_t frame[256];
 
 void setup()
 {
     Serial.begin(9600);
     Serial1.begin(115200);
     rs = new RS485(2, 3, &Serial1);
+    rs->SetFrameFormat(115200);
+
+    // Frame ends after 10 ms without input
+    receiver = new RS485FrameReceiver(*rs, frame, sizeof(frame));
+    receiver->SetInterFrameTimeout(0, 10000);
+    receiver->SetInterCharacterTimeout(0);
 }
 
 void loop()
 {
-    rs->WaitForInput();
-    if (rs->available())
+    if (receiver->Poll())
     {
-        String s = rs->readString();
-        rs->print(s);
+        rs->Send(receiver->GetFrame(), receiver->GetFrameLength());
+        receiver->ReleaseFrame();
     }
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include "MAX485TTL.hpp"
+#include "max485ttl_fixed.hpp"
 
 #define RS485_DE_PIN 2
 #define RS485_RE_PIN 2
@@ -10,17 +11,15 @@ const int string_length = sizeof(s) / sizeof(s[0]);
 
 void send_message()
 {
-    rs->SetMode(OUTPUT);
-    rs->write(s, string_length);
-    rs->flush();
-    rs->SetMode(INPUT);
+    rs->Send(s, string_length);
 }
 
 void setup()
 {
     Serial.begin(9600);
     Serial1.begin(115200, SERIAL_8N1);
-    rs = new RS485(2, 2, &Serial1);
+    rs = new RS485Fixed<RS485_DE_PIN, RS485_RE_PIN>(&Serial1);
+    rs->SetFrameFormat(115200);
     rs->SetMode(INPUT);
 
     send_message();
@@ -33,19 +32,10 @@ size_t cursor = 0;
 void loop()
 {
     rs->WaitForInput();
-    while (rs->available())
+    // Every read waits at most 20 ms from its start for the buffer to fill, keep reading while data is left and the buffer has room
+    while (rs->available() && cursor < buffer_size)
     {
-        delay(20);
-        int length = rs->available();
-        for (int i = 0; i < length; i++)
-        {
-            uint32_t c = rs->read();
-            if (c)
-            {
-                buffer[i] = (uint8_t)c;
-            }
-        }
-        cursor += length;
+        cursor += rs->read(buffer + cursor, buffer_size - cursor, 20);
     }
 
     if (cursor)
@@ -12,11 +12,73 @@
 #ifndef RS485_H
 #define RS485_H
 
-#include <Arduino.h>
+#include "max485ttl_platform.hpp"
+#include "max485ttl_crc.hpp"
+#include "max485ttl_capture.hpp"
+#ifdef MAX485TTL_INSTRUMENTATION
+#include "max485ttl_statistics.hpp"
+#endif
 
-class RS485
+class RS485;
+
+/**
+ * @brief Callback used by the receive engine of RS485.
+ *
+ * @param rs485 the module which caused the callback.
+ * @param context pointer given when the callback was set.
+ */
+typedef void (*RS485Callback)(RS485 &rs485, void *context);
+
+#ifndef MAX485TTL_TRANSMIT_BUFFER_SIZE
+/**
+ * @brief Size of the transmit buffer of every RS485 module, define it before including to change it.
+ * Writes of a transmission are collected in this buffer and passed to the stream in one call.
+ */
+#define MAX485TTL_TRANSMIT_BUFFER_SIZE 32
+#endif
+
+/**
+ * @brief MAX485TTL module usable as Stream, so print(), println() and the Stream read functions work on it.
+ * Bytes written between BeginTransmission() and EndTransmission() are collected in a transmit buffer
+ * and passed to the stream in one call when the buffer is full or the transmission ends.
+ * Writing while the module is in input mode starts a transmission, it ends at flush(), SetMode(INPUT),
+ * StartReceive() or when the application starts reading, so a formatted message is sent with a single direction switch.
+ * After SetMode(OUTPUT) by hand bytes are written to the stream directly.
+ * 4-wire transceivers (MAX490, MAX491) can run in full duplex, see SetFullDuplex().
+ */
+class RS485 : public Stream
 {
 public:
+    /**
+     * @brief Pin number for a DE or RE pin which is not connected, for example on a MAX490 without enable pins.
+     *
+     */
+    static const uint8_t kNoPin = 0xFF;
+
+    /**
+     * @brief State of the non-blocking receive engine, see StartReceive() and Poll().
+     *
+     */
+    enum class ReceiveState : uint8_t
+    {
+        kIdle,
+        kWaiting,
+        kReceiving,
+        kComplete,
+        kTimeout,
+    };
+
+    /**
+     * @brief CRC calculated over the received bytes, see SetReceiveCrc().
+     *
+     */
+    enum class CrcType : uint8_t
+    {
+        kNone,
+        kCrc16Modbus,
+        kCrc8,
+    };
+
     /**
      * @brief Constructor using only the necessary.
      *
@@ -38,53 +100,299 @@ public:
      * @brief Destroy the RS485 object.
      * Delete buffer and remove pointers.
      */
-    ~RS485(void);
+    virtual ~RS485(void);
 
     /**
      * @brief Function used to toggle the DE and RE pin to let the module accept incomming data.
+     * SetMode(INPUT) during a transmission ends it like EndTransmission(), so no staged byte is sent with the driver disabled.
      *
-     * @param mode INPUT(0) or OUTPUT(1).
+     * @param mode INPUT(0) or OUTPUT(1), other values are ignored.
      */
     void SetMode(uint8_t mode);
 
+    /**
+     * @brief Switch between half duplex (2-wire, default) and full duplex (4-wire transceivers).
+     * In full duplex DE stays high and RE stays low, so sending and receiving happen at the same time on the two pairs.
+     * SetMode() then does nothing and EndTransmission() only passes the transmit buffer to the stream,
+     * it does not wait for the last stop bit as there is no direction to switch.
+     * A module with DE and RE tied together can not run in full duplex, only DE is set then.
+     *
+     * @param full_duplex true for full duplex.
+     */
+    void SetFullDuplex(const bool full_duplex);
+
+    /**
+     * @brief Check if the module runs in full duplex.
+     *
+     * @return true if full duplex.
+     */
+    bool IsFullDuplex(void)
+    {
+        return full_duplex_;
+    }
+
     /**
      * @brief Function used to get the number of bytes available in de input buffer which holds 64 bytes.
      *
      * @return Number of bytes available, if stream not available -1.
      */
-    int32_t available(void);
+    int available(void) override;
 
     /**
      * @brief Function used to read the first byte of the incomming data.
      *
      * @return first byte or -1 if not available.
      */
-    int32_t read(void);
+    int read(void) override;
+
+    /**
+     * @brief Function used to copy all bytes currently available into a buffer, does not wait for more data.
+     *
+     * @param buffer destination of the received bytes.
+     * @param length maximum amount of bytes to copy into buffer.
+     * @return amount of bytes copied, 0 if nothing available or stream not available.
+     */
+    size_t read(uint8_t *const buffer, const size_t length);
+
+    /**
+     * @brief Function used to copy bytes into a buffer until it is full or the timeout has passed.
+     *
+     * @param buffer destination of the received bytes.
+     * @param length maximum amount of bytes to copy into buffer.
+     * @param timeout_in_millisecond maximum duration of the wait in milliseconds.
+     * @return amount of bytes copied.
+     */
+    size_t read(uint8_t *const buffer, const size_t length, const unsigned long timeout_in_millisecond);
 
     /**
      * @brief Function used to look at the first byte of the input buffer without taking it out.
      *
      * @return First character of the buffer, if stream not available -1.
      */
-    int32_t peek(void);
+    int peek(void) override;
 
     /**
-     * @brief Function to send a single byte.
+     * @brief Function to send a single byte, in a transmission it is added to the transmit buffer.
      *
      * @param data the byte that will be sent.
-     * @return true if succesfull, if stream not available -1.
+     * @return 1 if succesfull, 0 if stream not available.
      */
-    size_t write(const uint8_t data);
+    size_t write(const uint8_t data) override;
     size_t write(const char data);
 
-    size_t write(const uint8_t *const buffer, const size_t length);
+    /**
+     * @brief Function to send a buffer in one call to the stream instead of byte by byte.
+     * In a transmission a buffer which fits is added to the transmit buffer, larger buffers are passed on directly.
+     * When the stream accepts only part of the buffer the rest is offered again in chunks until the stream stops accepting.
+     *
+     * @param buffer the bytes that will be sent.
+     * @param length amount of bytes in buffer.
+     * @return amount of bytes accepted, 0 if stream not available.
+     */
+    size_t write(const uint8_t *const buffer, const size_t length) override;
     size_t write(const char *const buffer, const size_t length);
+    using Print::write;
+
+    /**
+     * @brief Passes the transmit buffer to the stream and flushes it.
+     * A transmission started by writing in input mode is ended, like EndTransmission().
+     *
+     */
+    void flush(void) override;
 
     /**
-     * @brief Flushes the write buffer.
+     * @brief Function used to set the frame format of the stream, this is used to calculate how long the transmission of data takes.
+     * Without a frame format EndTransmission() only waits for flush().
      *
+     * @param baudrate baudrate the stream was opened with.
+     * @param bits_per_character bits on the wire per character including start, parity and stop bits (8N1 is 10).
      */
-    void flush(void);
+    void SetFrameFormat(const unsigned long baudrate, const uint8_t bits_per_character = 10);
+
+    /**
+     * @brief Get the duration of a single character on the wire.
+     *
+     * @return duration in microseconds, 0 if no frame format is set.
+     */
+    unsigned long GetCharacterTime(void);
+
+    /**
+     * @brief Function used to start a transmission, sets the module to output.
+     * All data written until EndTransmission() is timed so the module is switched back the moment the last stop bit has left.
+     *
+     */
+    void BeginTransmission(void);
+
+    /**
+     * @brief Function used to end a transmission, waits until the last stop bit has been sent and sets the module to input.
+     *
+     */
+    void EndTransmission(void);
+
+    /**
+     * @brief Pass the bytes in the transmit buffer to the stream without waiting for them to be sent, the transmission continues.
+     *
+     */
+    void FlushTransmitBuffer(void);
+
+    /**
+     * @brief Get the time until the last stop bit of the bytes written in this transmission has left the wire.
+     * Together with FlushTransmitBuffer() this lets a transmission continue without blocking.
+     *
+     * @return unsigned long remaining time in microseconds, 0 outside a transmission or without a frame format.
+     */
+    unsigned long GetRemainingTransmissionTime(void);
+
+    /**
+     * @brief Keep the line silent within a transmission, the next byte starts no earlier than the gap after the last stop bit
+     * of the bytes written before. The driver stays enabled, so frames separated by silence (Modbus t3.5) share one transmission.
+     * Without a frame format the gap starts when flush() returns.
+     *
+     * @param gap_in_microsecond duration of the silence in microseconds.
+     */
+    void InsertGap(const unsigned long gap_in_microsecond);
+
+    /**
+     * @brief Function used to send a buffer in a single transmission, the module is set back to input afterwards.
+     *
+     * @param buffer the bytes that will be sent.
+     * @param length amount of bytes in buffer.
+     * @return amount of bytes accepted by the stream.
+     */
+    size_t Send(const uint8_t *const buffer, const size_t length);
+    size_t Send(const char *const buffer, const size_t length);
+
+    /**
+     * @brief Function used to start waiting for input without blocking, the progress is handled by Poll().
+     *
+     * @param timeout_in_millisecond duration of the maximum wait for the first byte in milliseconds.
+     */
+    void StartReceive(const unsigned long timeout_in_millisecond);
+
+    /**
+     * @brief Function used to drive the receive engine, call it from loop() or a timer.
+     * Fires the first byte callback when data arrives, the frame complete callback when no new byte arrived
+     * for the frame gap and the timeout callback when no data arrived in time.
+     * The received data stays in the stream so it can be read in the callbacks or after Poll() returned kComplete.
+     *
+     * @return ReceiveState state after handling.
+     */
+    ReceiveState Poll(void);
+
+    /**
+     * @brief Get the state of the receive engine without handling it.
+     *
+     * @return ReceiveState current state.
+     */
+    ReceiveState GetReceiveState(void);
+
+    /**
+     * @brief Set the duration without new data after which a frame is complete.
+     *
+     * @param gap_in_microsecond duration of the gap in microseconds, default 10000.
+     */
+    void SetFrameGap(const unsigned long gap_in_microsecond);
+
+    /**
+     * @brief Set the callbacks of the receive engine, nullptr to disable.
+     *
+     * @param callback function to call.
+     * @param context pointer passed to the callback.
+     */
+    void SetFirstByteCallback(RS485Callback callback, void *context = nullptr);
+    void SetFrameCompleteCallback(RS485Callback callback, void *context = nullptr);
+    void SetTimeoutCallback(RS485Callback callback, void *context = nullptr);
+
+    /**
+     * @brief Select the CRC which is updated with every byte read from the stream, so a frame can be checked
+     * without a second pass over its data. The CRC is restarted by ResetReceiveCrc().
+     *
+     * @param type CRC to calculate, default kNone.
+     */
+    void SetReceiveCrc(const CrcType type);
+
+    /**
+     * @brief Get the type of the CRC calculated over the received bytes.
+     *
+     * @return CrcType type set with SetReceiveCrc().
+     */
+    CrcType GetReceiveCrcType(void);
+
+    /**
+     * @brief Restart the CRC, call it before the first byte of a frame is read.
+     *
+     */
+    void ResetReceiveCrc(void);
+
+    /**
+     * @brief Get the CRC over the bytes read since ResetReceiveCrc().
+     *
+     * @return uint16_t CRC, for CRC-8 only the low byte is used.
+     */
+    uint16_t GetReceiveCrc(void);
+
+    /**
+     * @brief Check the CRC of a frame which ends with its own CRC (CRC-16/MODBUS low byte first),
+     * the CRC over such a frame is 0. Takes constant time.
+     *
+     * @return true if the bytes read since ResetReceiveCrc() form a frame with a correct CRC, false if no CRC is selected.
+     */
+    bool IsReceiveCrcValid(void);
+
+    /**
+     * @brief Record every byte read and written into a capture, see max485ttl_capture.hpp.
+     * Without a capture this costs a single check per read or write call.
+     *
+     * @param capture capture to add to, nullptr to stop capturing.
+     */
+    void SetCapture(RS485Capture *capture);
+
+    /**
+     * @brief Mark the end of a received frame, used by frame receivers so the frame size and idle gap are counted.
+     * Without MAX485TTL_INSTRUMENTATION this does nothing.
+     *
+     * @param end_time time of the last byte of the frame in microseconds.
+     */
+    void RecordFrameEnd(const unsigned long end_time)
+    {
+#ifdef MAX485TTL_INSTRUMENTATION
+        if (frame_bytes_)
+        {
+            statistics_.frame_size.Add(frame_bytes_);
+            frame_bytes_ = 0;
+            last_activity_time_ = end_time;
+        }
+#else
+        (void)end_time;
+#endif
+    }
+
+    /**
+     * @brief Count a frame which did not fit into the receive buffer.
+     * Without MAX485TTL_INSTRUMENTATION this does nothing.
+     *
+     */
+    void RecordReceiveOverflow(void)
+    {
+#ifdef MAX485TTL_INSTRUMENTATION
+        statistics_.receive_overflows++;
+#endif
+    }
+
+#ifdef MAX485TTL_INSTRUMENTATION
+    /**
+     * @brief Get a copy of the counters and histograms, only available with MAX485TTL_INSTRUMENTATION.
+     *
+     * @return RS485Statistics statistics since construction or ResetStatistics().
+     */
+    RS485Statistics GetStatistics(void);
+
+    /**
+     * @brief Clear the counters and histograms.
+     *
+     */
+    void ResetStatistics(void);
+#endif
 
     /**
      * @brief Function used to wait for a input signal
@@ -101,13 +409,175 @@ public:
      */
     RS485 &operator=(const RS485 &otherRS485);
 
-private:
-    Stream *serial_;
+protected:
+    /**
+     * @brief Add bytes to the transmit buffer, a transmission is started when the module is in input mode.
+     * Passes the buffer to the stream first when the bytes do not fit.
+     *
+     * @param data the bytes.
+     * @param length amount of bytes.
+     * @return true if the bytes were added, false if they must be written to the stream directly.
+     */
+    bool Stage(const uint8_t *const data, const size_t length);
+
+    /**
+     * @brief Copy the bytes the stream has available into a buffer, does not wait.
+     * Stream has no bulk read, so this reads byte by byte; a backend which has one overrides it.
+     *
+     * @param buffer destination of the bytes.
+     * @param length maximum amount of bytes.
+     * @return size_t amount of bytes copied.
+     */
+    virtual size_t ReadStream(uint8_t *const buffer, const size_t length);
+
+    /**
+     * @brief Write the bytes to the stream and account for them, used for the transmit buffer and for direct writes.
+     * When the stream accepts only part of the buffer the rest is offered again until the stream stops accepting.
+     *
+     * @param buffer the bytes.
+     * @param length amount of bytes.
+     * @return size_t amount of bytes accepted by the stream.
+     */
+    virtual size_t WriteStream(const uint8_t *const buffer, const size_t length);
+
+    /**
+     * @brief Drive DE and RE, called by SetMode() only when the direction really changes.
+     * Override it to switch the direction another way, SetMode() keeps the checks and the counting.
+     *
+     * @param value HIGH to enable the driver, LOW to receive.
+     */
+    virtual void WriteDirection(const uint8_t value);
+
+    /**
+     * @brief End a transmission which was started by writing in input mode, called before reading.
+     *
+     */
+    void EndImplicitTransmission(void)
+    {
+        if (implicit_transmission_)
+        {
+            EndTransmission();
+        }
+    }
+
+    /**
+     * @brief Add the transmission time of the written bytes to the expected end of the transmission.
+     *
+     * @param length amount of bytes written.
+     * @param write_time micros() before the bytes were passed to the stream, a blocking write returns after the UART started.
+     */
+    void AddTransmissionTime(const size_t length, const unsigned long write_time);
+
+    /**
+     * @brief Add received bytes to the receive CRC.
+     *
+     * @param data bytes read from the stream.
+     * @param length amount of bytes.
+     */
+    void UpdateReceiveCrc(const uint8_t *const data, const size_t length);
+
+    /**
+     * @brief Add bytes to the capture if one is set.
+     *
+     * @param direction direction of the bytes.
+     * @param data the bytes.
+     * @param length amount of bytes.
+     */
+    void Capture(const RS485CaptureDirection direction, const uint8_t *const data, const size_t length)
+    {
+        if (capture_)
+        {
+            capture_->Add(direction, data, length);
+        }
+    }
+
+    /**
+     * @brief Count received bytes, inline so it costs nothing without MAX485TTL_INSTRUMENTATION.
+     *
+     * @param length amount of bytes read from the stream.
+     */
+    void RecordReceived(const size_t length)
+    {
+#ifdef MAX485TTL_INSTRUMENTATION
+        if (length)
+        {
+            // Only the first byte after a transmission reads the clock, the rest costs two additions
+            statistics_.bytes_received += length;
+            frame_bytes_ += length;
+            if (awaiting_response_)
+            {
+                statistics_.response_latency.Add(micros() - response_start_time_);
+                awaiting_response_ = false;
+            }
+        }
+#else
+        (void)length;
+#endif
+    }
 
     uint8_t de_pin_;
     uint8_t re_pin_;
 
     uint8_t mode_;
+
+private:
+    static const unsigned long kDefaultFrameGap = 10000;
+    static const size_t kTransmitBufferSize = MAX485TTL_TRANSMIT_BUFFER_SIZE;
+
+    /**
+     * @brief Write a pin, pins set to kNoPin are skipped.
+     *
+     */
+    static void WritePin(const uint8_t pin, const uint8_t value);
+
+    /**
+     * @brief Set the receive engine to idle and remove the callbacks.
+     *
+     */
+    void InitialiseReceive(void);
+
+    Stream *serial_;
+
+    unsigned long character_time_;
+    unsigned long baudrate_;
+    uint8_t bits_per_character_;
+    bool full_duplex_;
+    bool in_transmission_;
+    bool implicit_transmission_;
+    // Bits written since the line became busy at the start time, the end time follows from them
+    unsigned long transmission_start_time_;
+    uint32_t transmission_bits_;
+    unsigned long transmission_end_time_;
+
+    uint8_t transmit_buffer_[kTransmitBufferSize];
+    size_t transmit_length_;
+
+    ReceiveState receive_state_;
+    unsigned long receive_start_time_;
+    unsigned long receive_timeout_;
+    unsigned long last_byte_time_;
+    unsigned long frame_gap_;
+    int last_available_;
+
+    CrcType receive_crc_type_;
+    uint16_t receive_crc_;
+
+    RS485Capture *capture_;
+
+    RS485Callback first_byte_callback_;
+    void *first_byte_context_;
+    RS485Callback frame_complete_callback_;
+    void *frame_complete_context_;
+    RS485Callback timeout_callback_;
+    void *timeout_context_;
+
+#ifdef MAX485TTL_INSTRUMENTATION
+    RS485Statistics statistics_;
+    uint32_t frame_bytes_;
+    unsigned long last_activity_time_;
+    unsigned long response_start_time_;
+    bool awaiting_response_;
+#endif
 };
 
 #endif
\ No newline at end of file
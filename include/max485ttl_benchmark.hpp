@@ -0,0 +1,165 @@
+/**
+ * @file max485ttl_benchmark.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Throughput, latency and CPU benchmarks for RS485, runnable on hardware and on the simulated bus
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_BENCHMARK_HPP_
+#define MAX485TTL_BENCHMARK_HPP_
+
+#include "max485ttl.hpp"
+
+/**
+ * @brief Function called with every result line, for example to print it with Serial.println() or TEST_MESSAGE().
+ * Every line has the form "BENCHMARK <name> baud=<baudrate> value=<value> unit=<unit>", so results can be collected
+ * from the test output with a script and compared between runs.
+ *
+ * @param line result line without line ending.
+ * @param context pointer given to the benchmark.
+ */
+typedef void (*RS485BenchmarkReport)(const char *line, void *context);
+
+/**
+ * @brief Function called while waiting for the echo, on the host it runs the simulated echo module.
+ *
+ * @param context pointer given with the function.
+ */
+typedef void (*RS485BenchmarkPoll)(void *context);
+
+/**
+ * @brief Stream which accepts every write and always has data, used to measure the CPU time of the RS485 paths only.
+ *
+ */
+class RS485NullStream : public Stream
+{
+public:
+    RS485NullStream(void) : counter_(0) {}
+
+    int available(void) override { return 0x7FFF; }
+    int read(void) override { return counter_++; }
+    int peek(void) override { return counter_; }
+    size_t write(uint8_t data) override
+    {
+        counter_ ^= data;
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        counter_ ^= size ? buffer[0] : 0;
+        return size;
+    }
+    using Print::write;
+
+private:
+    uint8_t counter_;
+};
+
+/**
+ * @brief Benchmarks measured against a module echoing every frame (example2 on hardware).
+ *
+ */
+class RS485Benchmark
+{
+public:
+    /**
+     * @brief Construct a new benchmark
+     *
+     * @param rs485 module under test, its frame format must be set.
+     * @param baudrate baudrate of the bus, only used in the result lines.
+     * @param report function called with every result line.
+     * @param context pointer passed to report.
+     */
+    RS485Benchmark(RS485 &rs485, const unsigned long baudrate, RS485BenchmarkReport report, void *context = nullptr);
+
+    /**
+     * @brief Set the function called while waiting for the echo.
+     *
+     * @param poll function to call, nullptr when the echo module runs on its own.
+     * @param context pointer passed to poll.
+     */
+    void SetPeerPoll(RS485BenchmarkPoll poll, void *context = nullptr);
+
+    /**
+     * @brief Set the time to wait for the echo of a frame.
+     *
+     * @param timeout_in_millisecond timeout in milliseconds, default 1000.
+     */
+    void SetTimeout(const unsigned long timeout_in_millisecond);
+
+    /**
+     * @brief Send a block and receive its echo, reports the payload bytes per second in both directions
+     * and the efficiency compared with the baudrate.
+     *
+     * @param buffer buffer of at least length bytes used for the data and the echo.
+     * @param length size of the block.
+     * @return true if the echo was correct.
+     */
+    bool MeasureThroughput(uint8_t *const buffer, const size_t length);
+
+    /**
+     * @brief Send small frames and measure the time until the echo is complete, reports p50, p90, p99 and maximum.
+     *
+     * @param samples buffer for the measured round trip times.
+     * @param count amount of round trips.
+     * @param frame_length length of every frame, at most 32.
+     * @return true if every echo arrived.
+     */
+    bool MeasureRoundTrip(unsigned long *const samples, const size_t count, const size_t frame_length);
+
+    /**
+     * @brief Measure the time of switching to output and back and the time EndTransmission() takes
+     * after the last stop bit has left. The echo of every character sent is awaited and dropped.
+     *
+     * @param iterations amount of switches.
+     */
+    void MeasureDirectionSwitch(const unsigned long iterations);
+
+    /**
+     * @brief Measure the CPU cycles per byte of the read and write paths without waiting for the wire.
+     *
+     * @param rs485 module on a RS485NullStream.
+     * @param length bytes per iteration.
+     * @param iterations amount of iterations.
+     */
+    void MeasureCpu(RS485 &rs485, const size_t length, const unsigned long iterations);
+
+    /**
+     * @brief Get a cycle counter, the clock cycles on AVR and the time stamp counter on x86.
+     * On AVR the first call sets Timer1 to count every clock cycle, PWM on its pins and libraries using it (Servo) stop working.
+     *
+     * @return uint32_t cycles, wraps around.
+     */
+    static uint32_t ReadCycles(void);
+
+private:
+    static const size_t kMaxRoundTripFrame = 32;
+
+    /**
+     * @brief Report a result, the value is given in hundredths so no floating point printing is needed on AVR.
+     *
+     */
+    void Report(const char *name, const uint32_t value_hundredths, const char *unit);
+
+    /**
+     * @brief Wait until length bytes are received or the timeout passed.
+     *
+     * @return size_t amount of bytes received.
+     */
+    size_t Receive(uint8_t *const buffer, const size_t length);
+
+    RS485 &rs485_;
+    unsigned long baudrate_;
+    unsigned long timeout_;
+
+    RS485BenchmarkReport report_;
+    void *report_context_;
+    RS485BenchmarkPoll poll_;
+    void *poll_context_;
+};
+
+#endif // MAX485TTL_BENCHMARK_HPP_
@@ -1,81 +1,447 @@
+/**
+ * @file max485ttl_buffer.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Receive buffer used to store input of the MAX485TTL modules while the stream buffer of 64 bytes is too small
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
 #ifndef MAX485TTL_BUFFER_HPP_
 #define MAX485TTL_BUFFER_HPP_
+
 #include "max485ttl.hpp"
 
-// class RS485_Buffer : public RS485
-// {
-//
-//     /**
-//      * @brief Construct a new rs485 buffer object
-//      *
-//      * @param buffer_size size of buffer used to store input, any input string exceeding this will be terminated on buffersize.
-//      * @param use_end_marker true if buffer must be \0 terminated on end_marker
-//      * @param end_marker Token which is used to determine end of input.
-//      * So make sure the buffer is big enough to store even the longest input.
-//      */
-//     RS485_Buffer(uint8_t buffer_size = 64, bool use_end_marker = true, char end_marker = '\n');
-
-//     RS485_Buffer operator=(const RS485_Buffer &otherRS485);
-
-//     /**
-//      * @brief Function to check if full message is stored in buffer. This is toggled when end marker is found.
-//      *
-//      * @return true when data is stored.
-//      * @return false when buffer is empty.
-//      */
-//     bool IsDataInBuffer(void);
-
-//     /**
-//      * @brief Function used to read all available bytes
-//      *
-//      * @return int amount of bytes in buffer
-//      */
-//     int BufferAvailable(void);
-
-//     /**
-//      * @brief Function used to peek ar first character in buffer
-//      *
-//      * @return char first character in buffer
-//      */
-//     char BufferPeek(void);
-
-//     /**
-//      * @brief Function used to read first character of buffer
-//      *
-//      * @return char first character in buffer
-//      */
-//     char BufferRead(void);
-
-//     /**
-//      * @brief Function used to read the data out of the buffer.
-//      *
-//      * @return const char* data in buffer to end marker.
-//      */
-//     const char *ReadStringBuffer(void);
-
-//     /**
-//      * @brief Function used to read the stream and put the data into the buffer.
-//      * This function should be called often when large amount of data is expected so the stream buffer doesn't overflow.
-//      *
-//      * @return int Amount of bytes received
-//      */
-//     int ReadIntoBuffer(void);
-
-//     /**
-//      * @brief Get the Buffer pointer
-//      *
-//      * @return const char* pointing to the buffer
-//      */
-//     const char *GetBuffer(void);
-
-// private:
-//     bool use_end_marker_;
-//     char end_marker_;
-//     bool data_in_buffer_;
-//     bool use_buffer_;
-//     uint8_t buffer_size_;
-//     uint8_t buffer_write_cursor_;
-//     uint8_t buffer_read_cursor_;
-//     char *buffer_;
-// };
+#ifdef __AVR__
+#include <util/atomic.h>
+#endif
+
+/**
+ * @brief Selects the smallest index type for a ring buffer, single byte indexes can be read by an ISR without locking on AVR.
+ *
+ * @tparam kSmall true when the size fits in a single byte index.
+ */
+template <bool kSmall>
+struct RS485RingBufferIndex
+{
+    typedef uint16_t type;
+};
+
+template <>
+struct RS485RingBufferIndex<true>
+{
+    typedef uint8_t type;
+};
+
+/**
+ * @brief Lock-free single producer, single consumer ring buffer without heap usage.
+ * One side (for example an ISR or ReadIntoBuffer()) may only use the producer functions,
+ * the other side may only use the consumer functions.
+ * The cursors run freely and are masked on access, so all kSize bytes can be used.
+ *
+ * @tparam kSize capacity in bytes, must be a power of two.
+ */
+template <uint16_t kSize>
+class RS485RingBuffer
+{
+    static_assert(kSize >= 2 && (kSize & (kSize - 1)) == 0, "Size of the ring buffer must be a power of two");
+    static_assert(kSize <= 32768, "Size of the ring buffer must fit a 16 bit cursor");
+
+    typedef typename RS485RingBufferIndex<(kSize <= 128)>::type Index;
+
+public:
+    RS485RingBuffer(void) : buffer_(), head_(0), tail_(0), overflow_count_(0) {}
+
+    /**
+     * @brief Get the capacity of the buffer.
+     *
+     * @return uint16_t amount of bytes the buffer can hold.
+     */
+    static uint16_t Capacity(void)
+    {
+        return kSize;
+    }
+
+    /**
+     * @brief Get the amount of bytes that can be read.
+     *
+     * @return uint16_t amount of bytes stored.
+     */
+    uint16_t Available(void) const
+    {
+        return static_cast<Index>(Load(&head_) - Load(&tail_));
+    }
+
+    /**
+     * @brief Get the amount of bytes that can be written.
+     *
+     * @return uint16_t amount of free bytes.
+     */
+    uint16_t Free(void) const
+    {
+        return kSize - Available();
+    }
+
+    /**
+     * @brief Producer: store a single byte.
+     *
+     * @param data the byte to store.
+     * @return true if stored, false if the buffer was full and the byte was counted as overflow.
+     */
+    bool Push(const uint8_t data)
+    {
+        Index head = head_;
+        if (static_cast<Index>(head - Load(&tail_)) == kSize)
+        {
+            AddOverflow(1);
+            return false;
+        }
+
+        buffer_[head & kMask] = data;
+        Store(&head_, static_cast<Index>(head + 1));
+        return true;
+    }
+
+    /**
+     * @brief Producer: store a buffer, bytes which do not fit are counted as overflow.
+     *
+     * @param data the bytes to store.
+     * @param length amount of bytes in data.
+     * @return size_t amount of bytes stored.
+     */
+    size_t Write(const uint8_t *data, const size_t length)
+    {
+        size_t written = 0;
+        while (written < length)
+        {
+            uint8_t *region;
+            size_t region_length = GetWriteRegion(&region);
+            if (region_length == 0)
+            {
+                break;
+            }
+
+            if (region_length > length - written)
+            {
+                region_length = length - written;
+            }
+            memcpy(region, data + written, region_length);
+            Commit(region_length);
+            written += region_length;
+        }
+
+        if (written < length)
+        {
+            AddOverflow(length - written);
+        }
+
+        return written;
+    }
+
+    /**
+     * @brief Producer: get the contiguous free region so data can be written in place.
+     *
+     * @param region set to the start of the free region.
+     * @return size_t amount of bytes that can be written in the region.
+     */
+    size_t GetWriteRegion(uint8_t **region)
+    {
+        Index head = head_;
+        uint16_t free_bytes = kSize - static_cast<Index>(head - Load(&tail_));
+        uint16_t until_end = kSize - (head & kMask);
+
+        *region = &buffer_[head & kMask];
+        return free_bytes < until_end ? free_bytes : until_end;
+    }
+
+    /**
+     * @brief Producer: publish bytes written into the region of GetWriteRegion().
+     *
+     * @param length amount of bytes written.
+     */
+    void Commit(const size_t length)
+    {
+        Store(&head_, static_cast<Index>(head_ + length));
+    }
+
+    /**
+     * @brief Producer: count bytes which were lost because the buffer was full.
+     *
+     * @param length amount of bytes lost.
+     */
+    void AddOverflow(const size_t length)
+    {
+        uint32_t total = static_cast<uint32_t>(overflow_count_) + length;
+        overflow_count_ = total > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(total);
+    }
+
+    /**
+     * @brief Consumer: look at the first byte without taking it out.
+     *
+     * @return int first byte or -1 if empty.
+     */
+    int Peek(void) const
+    {
+        Index tail = tail_;
+        if (Load(&head_) == tail)
+        {
+            return -1;
+        }
+
+        return buffer_[tail & kMask];
+    }
+
+    /**
+     * @brief Consumer: take the first byte out of the buffer.
+     *
+     * @return int first byte or -1 if empty.
+     */
+    int Pop(void)
+    {
+        Index tail = tail_;
+        if (Load(&head_) == tail)
+        {
+            return -1;
+        }
+
+        uint8_t data = buffer_[tail & kMask];
+        Store(&tail_, static_cast<Index>(tail + 1));
+        return data;
+    }
+
+    /**
+     * @brief Consumer: copy bytes out of the buffer.
+     *
+     * @param data destination of the bytes.
+     * @param length maximum amount of bytes to copy.
+     * @return size_t amount of bytes copied.
+     */
+    size_t Read(uint8_t *data, const size_t length)
+    {
+        size_t read = 0;
+        while (read < length)
+        {
+            const uint8_t *region;
+            size_t region_length = GetReadRegion(&region);
+            if (region_length == 0)
+            {
+                break;
+            }
+
+            if (region_length > length - read)
+            {
+                region_length = length - read;
+            }
+            memcpy(data + read, region, region_length);
+            Consume(region_length);
+            read += region_length;
+        }
+
+        return read;
+    }
+
+    /**
+     * @brief Consumer: get the contiguous readable region so data can be used without copying.
+     * When the data wraps around the end of the buffer, the rest is returned after Consume().
+     *
+     * @param region set to the start of the readable region.
+     * @return size_t amount of bytes in the region.
+     */
+    size_t GetReadRegion(const uint8_t **region) const
+    {
+        Index tail = tail_;
+        uint16_t stored = static_cast<Index>(Load(&head_) - tail);
+        uint16_t until_end = kSize - (tail & kMask);
+
+        *region = &buffer_[tail & kMask];
+        return stored < until_end ? stored : until_end;
+    }
+
+    /**
+     * @brief Consumer: release bytes of the region of GetReadRegion().
+     *
+     * @param length amount of bytes released.
+     */
+    void Consume(const size_t length)
+    {
+        Store(&tail_, static_cast<Index>(tail_ + length));
+    }
+
+    /**
+     * @brief Consumer: drop all stored bytes.
+     *
+     */
+    void Clear(void)
+    {
+        Store(&tail_, Load(&head_));
+    }
+
+    /**
+     * @brief Get the amount of bytes lost because the buffer was full.
+     *
+     * @return uint16_t amount of bytes lost, saturates at 65535.
+     */
+    uint16_t GetOverflowCount(void) const
+    {
+        return Load(&overflow_count_);
+    }
+
+private:
+    static const uint16_t kMask = kSize - 1;
+
+    template <typename T>
+    static T Load(const volatile T *value)
+    {
+#ifdef __AVR__
+        if (sizeof(T) == 1)
+        {
+            T copy = *value;
+            // Keep the buffer reads after the index load, the compiler may not move them up
+            __asm__ __volatile__("" ::: "memory");
+            return copy;
+        }
+
+        T copy;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            copy = *value;
+        }
+        return copy;
+#else
+        return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+    }
+
+    template <typename T>
+    static void Store(volatile T *destination, const T value)
+    {
+#ifdef __AVR__
+        if (sizeof(T) == 1)
+        {
+            // Keep the buffer writes before the index store, the compiler may not move them down
+            __asm__ __volatile__("" ::: "memory");
+            *destination = value;
+            return;
+        }
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            *destination = value;
+        }
+#else
+        __atomic_store_n(destination, value, __ATOMIC_RELEASE);
+#endif
+    }
+
+    uint8_t buffer_[kSize];
+    volatile Index head_;
+    volatile Index tail_;
+    volatile uint16_t overflow_count_;
+};
+
+/**
+ * @brief RS485 module with a receive buffer larger than the 64 bytes of the stream.
+ * Call ReadIntoBuffer() often while a long message is received, so the stream buffer doesn't overflow.
+ *
+ * @tparam kBufferSize size of the receive buffer, must be a power of two.
+ */
+template <uint16_t kBufferSize = 64>
+class RS485_Buffer : public RS485
+{
+public:
+    /**
+     * @brief Constructor using only the necessary.
+     *
+     * @param de_pin Driver output enable pin number.
+     * @param re_pin Receiver output enable pin number.
+     * @param serial Stream to which the data needs to be send.
+     * Stream must be opened before passing to this object (Serial.begin(Baudrate))..
+     */
+    RS485_Buffer(const uint8_t de_pin, const uint8_t re_pin, Stream *const serial) : RS485(de_pin, re_pin, serial) {}
+
+    /**
+     * @brief Function used to read the stream and put the data into the buffer.
+     * This function should be called often when large amount of data is expected so the stream buffer doesn't overflow.
+     * When the buffer is full the rest stays in the stream until the buffer has room again, nothing is dropped.
+     *
+     * @return int Amount of bytes received
+     */
+    int ReadIntoBuffer(void)
+    {
+        int received = 0;
+        uint8_t *region;
+        size_t region_length;
+        // Read directly into the buffer, at most two regions when the free space wraps around
+        while ((region_length = buffer_.GetWriteRegion(&region)) > 0)
+        {
+            size_t read_length = read(region, region_length);
+            buffer_.Commit(read_length);
+            received += read_length;
+            if (read_length < region_length)
+            {
+                break;
+            }
+        }
+
+        return received;
+    }
+
+    /**
+     * @brief Function used to get the amount of bytes in the buffer.
+     *
+     * @return int amount of bytes in buffer
+     */
+    int BufferAvailable(void)
+    {
+        return buffer_.Available();
+    }
+
+    /**
+     * @brief Function used to peek at first character in buffer
+     *
+     * @return int first character in buffer, -1 if empty
+     */
+    int BufferPeek(void)
+    {
+        return buffer_.Peek();
+    }
+
+    /**
+     * @brief Function used to read first character of buffer
+     *
+     * @return int first character in buffer, -1 if empty
+     */
+    int BufferRead(void)
+    {
+        return buffer_.Pop();
+    }
+
+    /**
+     * @brief Function used to copy data out of the buffer.
+     *
+     * @param data destination of the bytes.
+     * @param length maximum amount of bytes to copy.
+     * @return size_t amount of bytes copied.
+     */
+    size_t BufferRead(uint8_t *data, const size_t length)
+    {
+        return buffer_.Read(data, length);
+    }
+
+    /**
+     * @brief Get the buffer, can be used for reading without copying using GetReadRegion() and Consume().
+     *
+     * @return RS485RingBuffer<kBufferSize>& the receive buffer.
+     */
+    RS485RingBuffer<kBufferSize> &GetBuffer(void)
+    {
+        return buffer_;
+    }
+
+private:
+    RS485RingBuffer<kBufferSize> buffer_;
+};
+
 #endif // MAX485TTL_BUFFER_HPP_
\ No newline at end of file
@@ -0,0 +1,245 @@
+/**
+ * @file max485ttl_capture.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Binary capture of the bytes sent and received by RS485, with decoders to CSV and pcap and a replay
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_CAPTURE_HPP_
+#define MAX485TTL_CAPTURE_HPP_
+
+#include "max485ttl_platform.hpp"
+
+#ifndef ARDUINO
+#include <stdio.h>
+#endif
+
+class RS485;
+
+/**
+ * @brief Direction of a captured run of bytes.
+ *
+ */
+enum class RS485CaptureDirection : uint8_t
+{
+    kReceive,
+    kTransmit,
+};
+
+/**
+ * @brief Run of bytes in one direction as stored in a capture.
+ * A record is a header of 6 bytes (time in microseconds as 32 bit little endian, direction, length)
+ * followed by the data.
+ *
+ */
+struct RS485CaptureRecord
+{
+    static const uint8_t kHeaderLength = 6;
+
+    uint32_t time;
+    RS485CaptureDirection direction;
+    uint8_t length;
+    const uint8_t *data;
+};
+
+/**
+ * @brief Fixed size ring of records, the oldest records are dropped when it is full.
+ * Set it with RS485::SetCapture(), every read and write is then added with the time it passed RS485.
+ * Bytes in the same direction within the merge gap of the previous ones extend its record,
+ * so a frame costs one header and a copy of its bytes.
+ *
+ */
+class RS485Capture
+{
+public:
+    /**
+     * @brief Construct a new capture
+     *
+     * @param buffer storage of the ring.
+     * @param size size of the buffer, at least one header and one byte.
+     */
+    RS485Capture(uint8_t *const buffer, const size_t size);
+
+    /**
+     * @brief Set the time after which bytes in the same direction start a new record.
+     *
+     * @param gap_in_microsecond gap in microseconds, default 500.
+     */
+    void SetMergeGap(const unsigned long gap_in_microsecond);
+
+    /**
+     * @brief Add bytes to the capture.
+     *
+     * @param direction direction of the bytes.
+     * @param data the bytes.
+     * @param length amount of bytes.
+     */
+    void Add(const RS485CaptureDirection direction, const uint8_t *const data, const size_t length);
+
+    /**
+     * @brief Copy all records, oldest first, into a linear buffer which can be sent to a host or read with RS485CaptureReader.
+     *
+     * @param destination buffer to copy to.
+     * @param size size of the destination, records which do not fit are left out.
+     * @return size_t amount of bytes copied.
+     */
+    size_t Export(uint8_t *const destination, const size_t size);
+
+    /**
+     * @brief Get the amount of bytes used by the records.
+     *
+     * @return size_t used bytes, the size needed by Export().
+     */
+    size_t GetLength(void);
+
+    /**
+     * @brief Get the amount of records dropped to make room for new ones.
+     *
+     * @return unsigned long dropped records.
+     */
+    unsigned long GetDroppedCount(void);
+
+    /**
+     * @brief Remove all records.
+     *
+     */
+    void Clear(void);
+
+private:
+    static const unsigned long kDefaultMergeGap = 500;
+
+    size_t Wrap(const size_t offset);
+    uint8_t ByteAt(const size_t offset);
+    void Put(const size_t offset, const uint8_t data);
+    void Copy(const size_t offset, const uint8_t *const data, const size_t length);
+
+    /**
+     * @brief Drop the oldest records until the amount of bytes is free.
+     *
+     */
+    void MakeRoom(const size_t length);
+
+    uint8_t *buffer_;
+    size_t size_;
+    // Offset of the oldest record and amount of bytes used, both in the ring
+    size_t tail_;
+    size_t length_;
+
+    // Offset of the newest record, valid when has_last_ is set
+    size_t last_;
+    bool has_last_;
+    unsigned long last_time_;
+    unsigned long merge_gap_;
+    unsigned long dropped_count_;
+};
+
+/**
+ * @brief Walks over the records of an exported capture.
+ *
+ */
+class RS485CaptureReader
+{
+public:
+    RS485CaptureReader(const uint8_t *const data, const size_t length);
+
+    /**
+     * @brief Get the next record.
+     *
+     * @param record filled with the record, its data points into the capture.
+     * @return true if a complete record was read.
+     */
+    bool Next(RS485CaptureRecord &record);
+
+    /**
+     * @brief Start again at the first record.
+     *
+     */
+    void Rewind(void);
+
+private:
+    const uint8_t *data_;
+    size_t length_;
+    size_t offset_;
+};
+
+/**
+ * @brief Sends the records of one direction of a capture again with their original timing,
+ * for example the requests of a master into a simulated bus to benchmark a slave with real traffic.
+ *
+ */
+class RS485CaptureReplay
+{
+public:
+    /**
+     * @brief Construct a new replay
+     *
+     * @param rs485 module sending the records.
+     * @param data exported capture.
+     * @param length length of the capture.
+     * @param direction records to send, the others are skipped.
+     */
+    RS485CaptureReplay(RS485 &rs485, const uint8_t *const data, const size_t length, const RS485CaptureDirection direction);
+
+    /**
+     * @brief Restart the replay, the first record is sent at the next Poll().
+     *
+     */
+    void Start(void);
+
+    /**
+     * @brief Send the records which are due, call it from loop().
+     *
+     * @return true while records are left.
+     */
+    bool Poll(void);
+
+    /**
+     * @brief Get the amount of records sent since Start().
+     *
+     * @return size_t sent records.
+     */
+    size_t GetSentCount(void);
+
+private:
+    bool NextRecord(void);
+
+    RS485 &rs485_;
+    RS485CaptureReader reader_;
+    RS485CaptureDirection direction_;
+
+    RS485CaptureRecord record_;
+    bool has_record_;
+    bool started_;
+    uint32_t first_time_;
+    unsigned long start_time_;
+    size_t sent_count_;
+};
+
+#ifndef ARDUINO
+/**
+ * @brief Write an exported capture as CSV with the columns time_us, direction, length and data (hexadecimal).
+ *
+ * @param data exported capture.
+ * @param length length of the capture.
+ * @param file file to write to.
+ * @return true if the capture was complete and written.
+ */
+bool RS485CaptureWriteCsv(const uint8_t *const data, const size_t length, FILE *file);
+
+/**
+ * @brief Write an exported capture as pcap file with link type USER0 (147), every record is a packet
+ * starting with its direction (0 receive, 1 transmit) followed by the data.
+ *
+ * @param data exported capture.
+ * @param length length of the capture.
+ * @param file file to write to.
+ * @return true if the capture was complete and written.
+ */
+bool RS485CaptureWritePcap(const uint8_t *const data, const size_t length, FILE *file);
+#endif // ARDUINO
+
+#endif // MAX485TTL_CAPTURE_HPP_
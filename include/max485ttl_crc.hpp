@@ -0,0 +1,220 @@
+/**
+ * @file max485ttl_crc.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Table driven CRC-16/MODBUS and CRC-8 (SMBus, polynomial 0x07) with lookup tables generated at compile time
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_CRC_HPP_
+#define MAX485TTL_CRC_HPP_
+
+#include "max485ttl_platform.hpp"
+
+/**
+ * Every CRC has a bitwise version (no table), a nibble table version (16 entries, 32 bytes of flash for CRC-16)
+ * and a full table version (256 entries, 512 bytes of flash for CRC-16). On the host CRC-16 also has a slicing-by-4 version.
+ * Crc16Modbus() and Crc8() use the full table, define MAX485TTL_CRC_NIBBLE_TABLE to use the nibble table to save flash.
+ * The tables are placed in PROGMEM on AVR.
+ */
+
+const uint16_t kCrc16ModbusInitial = 0xFFFF;
+const uint8_t kCrc8Initial = 0x00;
+
+/**
+ * @brief Compile time generators of the table entries, written as C++11 constexpr so they work with avr-gcc.
+ *
+ */
+struct Crc16ModbusGenerator
+{
+    typedef uint16_t value_type;
+
+    static constexpr uint16_t Step(const uint16_t crc)
+    {
+        return (crc & 1) ? static_cast<uint16_t>((crc >> 1) ^ 0xA001) : static_cast<uint16_t>(crc >> 1);
+    }
+
+    static constexpr uint16_t Bits(const uint16_t crc, const uint8_t bits)
+    {
+        return bits == 0 ? crc : Bits(Step(crc), bits - 1);
+    }
+};
+
+struct Crc16ModbusFullGenerator : Crc16ModbusGenerator
+{
+    static constexpr uint16_t Entry(const uint16_t index)
+    {
+        return Bits(index, 8);
+    }
+};
+
+struct Crc16ModbusNibbleGenerator : Crc16ModbusGenerator
+{
+    static constexpr uint16_t Entry(const uint16_t index)
+    {
+        return Bits(index, 4);
+    }
+};
+
+/**
+ * @brief Entry of slicing table kSlice, which is the CRC of a byte followed by kSlice zero bytes.
+ *
+ * @tparam kSlice index of the slicing table.
+ */
+template <uint8_t kSlice>
+struct Crc16ModbusSliceGenerator : Crc16ModbusGenerator
+{
+    static constexpr uint16_t Entry(const uint16_t index)
+    {
+        return Slice(kSlice, index);
+    }
+
+    static constexpr uint16_t Slice(const uint8_t slice, const uint16_t index)
+    {
+        return slice == 0 ? Bits(index, 8) : static_cast<uint16_t>((Slice(slice - 1, index) >> 8) ^ Bits(Slice(slice - 1, index) & 0xFF, 8));
+    }
+};
+
+struct Crc8Generator
+{
+    typedef uint8_t value_type;
+
+    static constexpr uint8_t Step(const uint8_t crc)
+    {
+        return (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+    }
+
+    static constexpr uint8_t Bits(const uint8_t crc, const uint8_t bits)
+    {
+        return bits == 0 ? crc : Bits(Step(crc), bits - 1);
+    }
+};
+
+struct Crc8FullGenerator : Crc8Generator
+{
+    static constexpr uint8_t Entry(const uint16_t index)
+    {
+        return Bits(static_cast<uint8_t>(index), 8);
+    }
+};
+
+struct Crc8NibbleGenerator : Crc8Generator
+{
+    static constexpr uint8_t Entry(const uint16_t index)
+    {
+        return Bits(static_cast<uint8_t>(index << 4), 4);
+    }
+};
+
+/**
+ * @brief List of indexes 0 to kCount - 1, used to expand the generator over a table.
+ *
+ */
+template <uint16_t... kIndex>
+struct CrcIndexList
+{
+};
+
+template <uint16_t kCount, uint16_t... kIndex>
+struct CrcMakeIndexList : CrcMakeIndexList<kCount - 1, kCount - 1, kIndex...>
+{
+};
+
+template <uint16_t... kIndex>
+struct CrcMakeIndexList<0, kIndex...>
+{
+    typedef CrcIndexList<kIndex...> type;
+};
+
+/**
+ * @brief Lookup table filled by the generator at compile time.
+ *
+ * @tparam Generator generator of the entries.
+ * @tparam kCount amount of entries.
+ */
+template <class Generator, class IndexList>
+struct CrcTableStorage;
+
+template <class Generator, uint16_t... kIndex>
+struct CrcTableStorage<Generator, CrcIndexList<kIndex...>>
+{
+    static const typename Generator::value_type kValues[sizeof...(kIndex)];
+};
+
+template <class Generator, uint16_t... kIndex>
+const typename Generator::value_type CrcTableStorage<Generator, CrcIndexList<kIndex...>>::kValues[sizeof...(kIndex)] PROGMEM = {Generator::Entry(kIndex)...};
+
+template <class Generator, uint16_t kCount>
+struct CrcTable : CrcTableStorage<Generator, typename CrcMakeIndexList<kCount>::type>
+{
+};
+
+typedef CrcTable<Crc16ModbusFullGenerator, 256> Crc16ModbusTable;
+typedef CrcTable<Crc16ModbusNibbleGenerator, 16> Crc16ModbusNibbleTable;
+typedef CrcTable<Crc8FullGenerator, 256> Crc8Table;
+typedef CrcTable<Crc8NibbleGenerator, 16> Crc8NibbleTable;
+
+/**
+ * @brief Add a single byte to a CRC using the full table.
+ *
+ * @param crc CRC so far.
+ * @param data byte to add.
+ * @return uint16_t new CRC.
+ */
+inline uint16_t Crc16ModbusUpdate(const uint16_t crc, const uint8_t data)
+{
+    return static_cast<uint16_t>((crc >> 8) ^ pgm_read_word(&Crc16ModbusTable::kValues[(crc ^ data) & 0xFF]));
+}
+
+inline uint16_t Crc16ModbusNibbleUpdate(uint16_t crc, const uint8_t data)
+{
+    crc ^= data;
+    crc = static_cast<uint16_t>((crc >> 4) ^ pgm_read_word(&Crc16ModbusNibbleTable::kValues[crc & 0x0F]));
+    return static_cast<uint16_t>((crc >> 4) ^ pgm_read_word(&Crc16ModbusNibbleTable::kValues[crc & 0x0F]));
+}
+
+inline uint8_t Crc8Update(const uint8_t crc, const uint8_t data)
+{
+    return pgm_read_byte(&Crc8Table::kValues[crc ^ data]);
+}
+
+inline uint8_t Crc8NibbleUpdate(uint8_t crc, const uint8_t data)
+{
+    crc ^= data;
+    crc = static_cast<uint8_t>((crc << 4) ^ pgm_read_byte(&Crc8NibbleTable::kValues[crc >> 4]));
+    return static_cast<uint8_t>((crc << 4) ^ pgm_read_byte(&Crc8NibbleTable::kValues[crc >> 4]));
+}
+
+/**
+ * @brief Calculate the CRC-16/MODBUS of a buffer, the result is sent low byte first.
+ *
+ * @param data bytes to calculate the CRC over.
+ * @param length amount of bytes.
+ * @param crc CRC to continue from, kCrc16ModbusInitial for a new calculation.
+ * @return uint16_t CRC.
+ */
+uint16_t Crc16ModbusBitwise(const uint8_t *data, size_t length, uint16_t crc = kCrc16ModbusInitial);
+uint16_t Crc16ModbusNibble(const uint8_t *data, size_t length, uint16_t crc = kCrc16ModbusInitial);
+uint16_t Crc16ModbusFull(const uint8_t *data, size_t length, uint16_t crc = kCrc16ModbusInitial);
+#ifndef __AVR__
+uint16_t Crc16ModbusSlicing(const uint8_t *data, size_t length, uint16_t crc = kCrc16ModbusInitial);
+#endif
+uint16_t Crc16Modbus(const uint8_t *data, size_t length, uint16_t crc = kCrc16ModbusInitial);
+
+/**
+ * @brief Calculate the CRC-8 (polynomial 0x07, initial value 0) of a buffer.
+ *
+ * @param data bytes to calculate the CRC over.
+ * @param length amount of bytes.
+ * @param crc CRC to continue from, kCrc8Initial for a new calculation.
+ * @return uint8_t CRC.
+ */
+uint8_t Crc8Bitwise(const uint8_t *data, size_t length, uint8_t crc = kCrc8Initial);
+uint8_t Crc8Nibble(const uint8_t *data, size_t length, uint8_t crc = kCrc8Initial);
+uint8_t Crc8Full(const uint8_t *data, size_t length, uint8_t crc = kCrc8Initial);
+uint8_t Crc8(const uint8_t *data, size_t length, uint8_t crc = kCrc8Initial);
+
+#endif // MAX485TTL_CRC_HPP_
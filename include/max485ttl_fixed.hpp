@@ -0,0 +1,109 @@
+/**
+ * @file max485ttl_fixed.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief RS485 variant with the DE and RE pins known at compile time so direction changes are direct port register writes
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_FIXED_HPP_
+#define MAX485TTL_FIXED_HPP_
+
+#include "max485ttl.hpp"
+
+/**
+ * @brief RS485 module with fixed DE and RE pins.
+ * On AVR the port register and bit mask of the pins are looked up once at construction,
+ * after that a direction change is a single register write (or two when DE and RE are on different ports).
+ * On other platforms digitalWrite is used.
+ *
+ * @tparam kDePin Driver output enable pin number.
+ * @tparam kRePin Receiver output enable pin number, may be the same as kDePin.
+ */
+template <uint8_t kDePin, uint8_t kRePin>
+class RS485Fixed : public RS485
+{
+public:
+    /**
+     * @brief Constructor using only the necessary.
+     *
+     * @param serial Stream to which the data needs to be send.
+     * Stream must be opened before passing to this object (Serial.begin(Baudrate))..
+     */
+    explicit RS485Fixed(Stream *const serial) : RS485(kDePin, kRePin, serial)
+    {
+#ifdef __AVR__
+        // The pin tables of the Arduino core are stored in PROGMEM, so they are read once here instead of on every switch
+        de_register_ = portOutputRegister(digitalPinToPort(kDePin));
+        de_mask_ = digitalPinToBitMask(kDePin);
+        re_register_ = de_register_;
+        re_mask_ = 0;
+
+        if (kDePin != kRePin)
+        {
+            volatile uint8_t *re_register = portOutputRegister(digitalPinToPort(kRePin));
+            if (re_register == de_register_)
+            {
+                // Same port, both pins are set with one write
+                de_mask_ |= digitalPinToBitMask(kRePin);
+            }
+            else
+            {
+                re_register_ = re_register;
+                re_mask_ = digitalPinToBitMask(kRePin);
+            }
+        }
+#endif
+    }
+
+protected:
+    /**
+     * @brief Drive DE and RE with the fixed pins.
+     *
+     * @param value HIGH to enable the driver, LOW to receive.
+     */
+    void WriteDirection(const uint8_t value) override
+    {
+#ifdef __AVR__
+        // Interrupts are disabled because the read-modify-write of the port could collide with an ISR using the same port
+        uint8_t old_sreg = SREG;
+        cli();
+        if (value == HIGH)
+        {
+            *de_register_ |= de_mask_;
+            if (re_mask_)
+            {
+                *re_register_ |= re_mask_;
+            }
+        }
+        else
+        {
+            *de_register_ &= ~de_mask_;
+            if (re_mask_)
+            {
+                *re_register_ &= ~re_mask_;
+            }
+        }
+        SREG = old_sreg;
+#else
+        digitalWrite(kDePin, value);
+        if (kDePin != kRePin)
+        {
+            digitalWrite(kRePin, value);
+        }
+#endif
+    }
+
+private:
+#ifdef __AVR__
+    volatile uint8_t *de_register_;
+    uint8_t de_mask_;
+    volatile uint8_t *re_register_;
+    uint8_t re_mask_;
+#endif
+};
+
+#endif // MAX485TTL_FIXED_HPP_
@@ -0,0 +1,149 @@
+/**
+ * @file max485ttl_frame.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Frame detection for the MAX485TTL modules using the silent interval between frames (t1.5 / t3.5)
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_FRAME_HPP_
+#define MAX485TTL_FRAME_HPP_
+
+#include "max485ttl.hpp"
+
+/**
+ * @brief Receiver which collects incomming bytes into a frame and closes the frame when the line has been idle
+ * for a number of character times. The character time is taken from RS485::SetFrameFormat().
+ * Poll() must be called at least once per inter-frame timeout for an accurate end of frame.
+ */
+class RS485FrameReceiver
+{
+public:
+    /**
+     * @brief Construct a new frame receiver
+     *
+     * @param rs485 module from which the data is read.
+     * @param buffer buffer used to store the frame.
+     * @param size size of the buffer, bytes of a longer frame are dropped and the frame is marked as overflowed.
+     */
+    RS485FrameReceiver(RS485 &rs485, uint8_t *const buffer, const size_t size);
+
+    /**
+     * @brief Set the idle time which ends a frame.
+     *
+     * @param half_characters idle time in half character times, default 7 (t3.5).
+     * @param minimum_in_microsecond lower limit of the idle time, Modbus uses 1750 above 19200 baud.
+     */
+    void SetInterFrameTimeout(const uint8_t half_characters, const unsigned long minimum_in_microsecond = 0);
+
+    /**
+     * @brief Set the maximum idle time between two bytes of the same frame, a longer gap marks the frame as broken.
+     * The check needs the frame format of the module (SetFrameFormat()), without it no frame is marked as broken.
+     *
+     * @param half_characters idle time in half character times, default 3 (t1.5), 0 disables the check.
+     * @param minimum_in_microsecond lower limit of the idle time, Modbus uses 750 above 19200 baud.
+     */
+    void SetInterCharacterTimeout(const uint8_t half_characters, const unsigned long minimum_in_microsecond = 0);
+
+    /**
+     * @brief Function used to read new bytes and detect the end of the frame.
+     *
+     * @return true when a complete frame is available.
+     */
+    bool Poll(void);
+
+    /**
+     * @brief Function used to check if a complete frame is available without reading new data.
+     *
+     * @return true when a complete frame is available.
+     */
+    bool IsFrameComplete(void);
+
+    /**
+     * @brief Get the received frame, only complete after Poll() returned true.
+     *
+     * @return const uint8_t* pointer to the start of the frame.
+     */
+    const uint8_t *GetFrame(void);
+
+    /**
+     * @brief Get the length of the received frame.
+     *
+     * @return size_t amount of bytes stored.
+     */
+    size_t GetFrameLength(void);
+
+    /**
+     * @brief Check if the frame was longer than the buffer.
+     *
+     * @return true if bytes were dropped.
+     */
+    bool IsFrameOverflowed(void);
+
+    /**
+     * @brief Check if a gap longer than the inter-character timeout occured inside the frame.
+     *
+     * @return true if the frame is broken.
+     */
+    bool IsFrameBroken(void);
+
+    /**
+     * @brief Check the CRC at the end of the frame using the CRC RS485 calculated while the bytes were read,
+     * so no second pass over the frame is needed. The CRC type is selected with RS485::SetReceiveCrc().
+     *
+     * @return true if the frame ends with a correct CRC, false if no CRC type is selected.
+     */
+    bool IsFrameCrcValid(void);
+
+    /**
+     * @brief Get the time the last byte of the frame was seen.
+     *
+     * @return unsigned long time in microseconds (micros()).
+     */
+    unsigned long GetFrameEndTime(void);
+
+    /**
+     * @brief Release the frame so the next frame can be received.
+     *
+     */
+    void ReleaseFrame(void);
+
+    /**
+     * @brief Get the inter-frame timeout currently in use.
+     *
+     * @return unsigned long timeout in microseconds.
+     */
+    unsigned long GetInterFrameTimeout(void);
+
+private:
+    static const unsigned long kDefaultInterFrameTimeout = 1750;
+
+    /**
+     * @brief Calculate a timeout from half character times.
+     *
+     * @param half_characters amount of half character times.
+     * @param minimum lower limit in microseconds.
+     * @return unsigned long timeout in microseconds.
+     */
+    unsigned long CalculateTimeout(const uint8_t half_characters, const unsigned long minimum);
+
+    RS485 &rs485_;
+    uint8_t *buffer_;
+    size_t size_;
+    size_t length_;
+
+    uint8_t inter_frame_half_characters_;
+    unsigned long inter_frame_minimum_;
+    uint8_t inter_character_half_characters_;
+    unsigned long inter_character_minimum_;
+
+    unsigned long last_byte_time_;
+    bool frame_complete_;
+    bool overflowed_;
+    bool broken_;
+};
+
+#endif // MAX485TTL_FRAME_HPP_
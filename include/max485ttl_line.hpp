@@ -0,0 +1,119 @@
+/**
+ * @file max485ttl_line.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Heap-free reader of lines (or other delimited messages) received by the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_LINE_HPP_
+#define MAX485TTL_LINE_HPP_
+
+#include "max485ttl.hpp"
+
+/**
+ * @brief Find the first occurrence of a byte. On the host buffers of 16 bytes and more are searched a word at a time,
+ * on AVR the bytes are compared one by one.
+ *
+ * @param data bytes to search.
+ * @param length amount of bytes.
+ * @param value byte to find.
+ * @return const uint8_t* pointer to the first occurrence, nullptr if not found.
+ */
+const uint8_t *RS485FindByte(const uint8_t *data, size_t length, const uint8_t value);
+
+/**
+ * @brief Collects incomming bytes into a caller supplied buffer until the end marker arrives,
+ * a replacement for readString() which uses no heap and does not wait for the stream timeout.
+ * With the default end marker '\n' a '\r' in front of it is removed as well, so "\r\n" and "\n" both end a line.
+ * The line is terminated with '\0', longer lines are cut at the buffer size and marked as truncated.
+ * Bytes after the end marker are kept for the next line.
+ */
+class RS485LineReader
+{
+public:
+    /**
+     * @brief Construct a new line reader
+     *
+     * @param rs485 module from which the data is read.
+     * @param buffer buffer used to store the line, one byte is used for the terminating '\0'.
+     * @param size size of the buffer, at least 2.
+     * @param end_marker byte ending a line, default '\n'.
+     */
+    RS485LineReader(RS485 &rs485, char *const buffer, const size_t size, const char end_marker = '\n');
+
+    /**
+     * @brief Read the available bytes, does not wait for more data.
+     *
+     * @return true if a complete line is in the buffer.
+     */
+    bool Poll(void);
+
+    /**
+     * @brief Wait until a line is complete or the timeout has passed, returns as soon as the end marker arrives.
+     *
+     * @param timeout_in_millisecond maximum duration of the wait in milliseconds.
+     * @return true if a complete line is in the buffer.
+     */
+    bool ReadLine(const unsigned long timeout_in_millisecond);
+
+    /**
+     * @brief Get the line, valid until ReleaseLine().
+     *
+     * @return const char* the line without end marker, terminated with '\0'.
+     */
+    const char *GetLine(void);
+
+    /**
+     * @brief Get the length of the line.
+     *
+     * @return size_t amount of characters without the '\0'.
+     */
+    size_t GetLineLength(void);
+
+    /**
+     * @brief Check if bytes of the line were dropped because the buffer was full.
+     *
+     * @return true if the line was cut off.
+     */
+    bool IsLineTruncated(void);
+
+    /**
+     * @brief Remove the line so the next one can be read.
+     *
+     */
+    void ReleaseLine(void);
+
+private:
+    /**
+     * @brief Look for the end marker in the bytes which are not searched yet.
+     *
+     * @return true if the line is complete.
+     */
+    bool Scan(void);
+
+    /**
+     * @brief End the line at the given position.
+     *
+     * @param position position of the end marker, or the length when the marker was dropped.
+     */
+    void CompleteLine(size_t position);
+
+    RS485 &rs485_;
+    char *buffer_;
+    size_t size_;
+    char end_marker_;
+
+    // Bytes in the buffer, the line plus the bytes of the next line when complete
+    size_t length_;
+    // Bytes already searched for the end marker
+    size_t scanned_;
+    size_t line_length_;
+    bool line_complete_;
+    bool truncated_;
+};
+
+#endif // MAX485TTL_LINE_HPP_
@@ -0,0 +1,128 @@
+/**
+ * @file max485ttl_modbus.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Definitions shared by the Modbus RTU master and slave
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_MODBUS_HPP_
+#define MAX485TTL_MODBUS_HPP_
+
+#include "max485ttl.hpp"
+#include "max485ttl_crc.hpp"
+
+/**
+ * @brief Maximum length of a Modbus RTU frame including address and CRC.
+ *
+ */
+const size_t kModbusMaxFrameLength = 256;
+
+/**
+ * @brief Address used to send a request to all slaves, slaves do not respond to it.
+ *
+ */
+const uint8_t kModbusBroadcastAddress = 0;
+
+/**
+ * @brief Minimum inter-character (t1.5) and inter-frame (t3.5) timeouts in microseconds, used above 19200 baud.
+ *
+ */
+const unsigned long kModbusMinimumInterCharacterTimeout = 750;
+const unsigned long kModbusMinimumInterFrameTimeout = 1750;
+
+/**
+ * @brief Supported function codes.
+ *
+ */
+enum class ModbusFunction : uint8_t
+{
+    kReadCoils = 0x01,
+    kReadDiscreteInputs = 0x02,
+    kReadHoldingRegisters = 0x03,
+    kReadInputRegisters = 0x04,
+    kWriteSingleCoil = 0x05,
+    kWriteSingleRegister = 0x06,
+    kWriteMultipleCoils = 0x0F,
+    kWriteMultipleRegisters = 0x10,
+    kReadWriteMultipleRegisters = 0x17,
+};
+
+/**
+ * @brief Exception codes returned by a slave.
+ *
+ */
+enum class ModbusException : uint8_t
+{
+    kNone = 0x00,
+    kIllegalFunction = 0x01,
+    kIllegalDataAddress = 0x02,
+    kIllegalDataValue = 0x03,
+    kSlaveDeviceFailure = 0x04,
+};
+
+/**
+ * @brief Result of a Modbus request.
+ *
+ */
+enum class ModbusStatus : uint8_t
+{
+    kOk,
+    kBusy,
+    kIdle,
+    kTimeout,
+    kCrcError,
+    kInvalidResponse,
+    kException,
+    kInvalidArgument,
+    kBufferTooSmall,
+    // The stream did not accept the whole request
+    kTransmitError,
+};
+
+/**
+ * @brief Calculate the Modbus CRC-16 (polynomial 0xA001 reflected, initial value 0xFFFF).
+ *
+ * @param data bytes to calculate the CRC over.
+ * @param length amount of bytes.
+ * @return uint16_t CRC, sent low byte first.
+ */
+uint16_t ModbusCrc16(const uint8_t *data, size_t length);
+
+/**
+ * @brief Helpers to read and write the big endian 16 bit values of Modbus.
+ *
+ */
+inline uint16_t ModbusGetWord(const uint8_t *data)
+{
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+inline void ModbusSetWord(uint8_t *data, const uint16_t value)
+{
+    data[0] = static_cast<uint8_t>(value >> 8);
+    data[1] = static_cast<uint8_t>(value);
+}
+
+/**
+ * @brief Append the CRC to a frame.
+ *
+ * @param frame frame starting with the address.
+ * @param length length of the frame without CRC, the buffer must hold 2 more bytes.
+ * @return size_t length of the frame with CRC.
+ */
+size_t ModbusAppendCrc(uint8_t *frame, const size_t length);
+
+/**
+ * @brief Check the CRC at the end of a frame.
+ *
+ * @param frame frame starting with the address.
+ * @param length length of the frame including CRC.
+ * @return true if the CRC is correct.
+ */
+bool ModbusCheckCrc(const uint8_t *frame, const size_t length);
+
+#endif // MAX485TTL_MODBUS_HPP_
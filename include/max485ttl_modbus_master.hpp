@@ -0,0 +1,210 @@
+/**
+ * @file max485ttl_modbus_master.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Modbus RTU master using the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_MODBUS_MASTER_HPP_
+#define MAX485TTL_MODBUS_MASTER_HPP_
+
+#include "max485ttl_frame.hpp"
+#include "max485ttl_modbus.hpp"
+#include "max485ttl_rtt.hpp"
+
+/**
+ * @brief Modbus RTU master supporting function codes 1-6, 15, 16 and 23.
+ * Requests are built in the buffer given to the constructor, which is also used to receive the response, so no heap is used.
+ * Every request has a non-blocking version (Begin...() followed by Poll() until it is no longer kBusy)
+ * and a blocking version which waits for the response.
+ * The frame format must be set on the RS485 module (SetFrameFormat()) so t3.5 can be calculated.
+ * A request is only sent after the bus has been silent for t3.5, and after a broadcast also for the turnaround delay.
+ * Until then Poll() keeps returning kBusy and sends the request as soon as the bus is silent.
+ */
+class ModbusMaster
+{
+public:
+    /**
+     * @brief Construct a new Modbus master
+     *
+     * @param rs485 module used for the bus.
+     * @param buffer buffer used for requests and responses, kModbusMaxFrameLength supports every request.
+     * @param size size of buffer.
+     */
+    ModbusMaster(RS485 &rs485, uint8_t *const buffer, const size_t size);
+
+    /**
+     * @brief Set the maximum time to wait for the first byte of a response.
+     *
+     * @param timeout_in_millisecond timeout in milliseconds, default 1000.
+     */
+    void SetResponseTimeout(const unsigned long timeout_in_millisecond);
+
+    /**
+     * @brief Set the time the slaves get to process a broadcast before the next request is sent.
+     *
+     * @param delay_in_millisecond turnaround delay in milliseconds, default 100.
+     */
+    void SetTurnaroundDelay(const unsigned long delay_in_millisecond);
+
+    /**
+     * @brief Take the response timeout of every slave from its measured response times instead of the fixed timeout.
+     * The time from the end of a request until the first byte of its response is added to the estimator, a timeout doubles it.
+     *
+     * @param estimator estimator of the slaves, nullptr to use the fixed timeout again.
+     */
+    void SetRttEstimator(RS485RttEstimator *const estimator);
+
+    /**
+     * @brief Start a request without waiting for the response.
+     *
+     * @return ModbusStatus kBusy if the request was accepted, otherwise the reason it was not.
+     * The request is sent right away when the bus is silent, otherwise by a later Poll().
+     */
+    ModbusStatus BeginReadCoils(const uint8_t slave, const uint16_t address, const uint16_t quantity);
+    ModbusStatus BeginReadDiscreteInputs(const uint8_t slave, const uint16_t address, const uint16_t quantity);
+    ModbusStatus BeginReadHoldingRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity);
+    ModbusStatus BeginReadInputRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity);
+    ModbusStatus BeginWriteSingleCoil(const uint8_t slave, const uint16_t address, const bool value);
+    ModbusStatus BeginWriteSingleRegister(const uint8_t slave, const uint16_t address, const uint16_t value);
+    ModbusStatus BeginWriteMultipleCoils(const uint8_t slave, const uint16_t address, const uint16_t quantity, const uint8_t *const values);
+    ModbusStatus BeginWriteMultipleRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity, const uint16_t *const values);
+    ModbusStatus BeginReadWriteMultipleRegisters(const uint8_t slave, const uint16_t read_address, const uint16_t read_quantity,
+                                                 const uint16_t write_address, const uint16_t write_quantity, const uint16_t *const values);
+
+    /**
+     * @brief Function used to drive the request, call it from loop() until it no longer returns kBusy.
+     *
+     * @return ModbusStatus kBusy while waiting, kIdle if no request was started, otherwise the result of the request.
+     * kTimeout is also returned when the bus did not become silent within the response timeout, so the request was never sent.
+     */
+    ModbusStatus Poll(void);
+
+    /**
+     * @brief Send a request and wait for the response.
+     * Read results are copied into the given array, coils and discrete inputs are packed 8 per byte, first coil in the lowest bit.
+     *
+     * @return ModbusStatus result of the request.
+     */
+    ModbusStatus ReadCoils(const uint8_t slave, const uint16_t address, const uint16_t quantity, uint8_t *const coils);
+    ModbusStatus ReadDiscreteInputs(const uint8_t slave, const uint16_t address, const uint16_t quantity, uint8_t *const inputs);
+    ModbusStatus ReadHoldingRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity, uint16_t *const registers);
+    ModbusStatus ReadInputRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity, uint16_t *const registers);
+    ModbusStatus WriteSingleCoil(const uint8_t slave, const uint16_t address, const bool value);
+    ModbusStatus WriteSingleRegister(const uint8_t slave, const uint16_t address, const uint16_t value);
+    ModbusStatus WriteMultipleCoils(const uint8_t slave, const uint16_t address, const uint16_t quantity, const uint8_t *const values);
+    ModbusStatus WriteMultipleRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity, const uint16_t *const values);
+    ModbusStatus ReadWriteMultipleRegisters(const uint8_t slave, const uint16_t read_address, const uint16_t read_quantity,
+                                            const uint16_t write_address, const uint16_t write_quantity, const uint16_t *const values,
+                                            uint16_t *const registers);
+
+    /**
+     * @brief Get the exception code of the last response, only valid when the request returned kException.
+     *
+     * @return ModbusException exception code.
+     */
+    ModbusException GetException(void);
+
+    /**
+     * @brief Get a register of the last read response.
+     *
+     * @param index index of the register in the response.
+     * @return uint16_t value of the register.
+     */
+    uint16_t GetRegister(const size_t index);
+
+    /**
+     * @brief Get a coil or discrete input of the last read response.
+     *
+     * @param index index of the coil in the response.
+     * @return true if the coil is on.
+     */
+    bool GetCoil(const size_t index);
+
+    /**
+     * @brief Get the data of the last read response, without address, function and byte count.
+     *
+     * @return const uint8_t* data of the response.
+     */
+    const uint8_t *GetResponseData(void);
+
+    /**
+     * @brief Get the length of the data of the last read response.
+     *
+     * @return size_t amount of bytes.
+     */
+    size_t GetResponseDataLength(void);
+
+private:
+    static const unsigned long kDefaultResponseTimeout = 1000;
+    static const unsigned long kDefaultTurnaroundDelay = 100;
+
+    /**
+     * @brief Send the request once the bus has been silent for t3.5, or for the turnaround delay after a broadcast.
+     * Bytes arriving in the meantime (a late response) are dropped and restart the wait.
+     *
+     * @return ModbusStatus kBusy while waiting or when sent, kOk if a broadcast was sent, kTransmitError if the stream did not take the whole request,
+     * kTimeout if the bus did not become silent in time.
+     */
+    ModbusStatus SendWhenIdle(void);
+
+    /**
+     * @brief Write the header of a request which consists of address, function and two words.
+     *
+     * @return ModbusStatus kOk or kBufferTooSmall.
+     */
+    ModbusStatus BuildHeader(const uint8_t slave, const ModbusFunction function, const uint16_t first, const uint16_t second);
+
+    /**
+     * @brief Append the CRC and send the request, right away if the bus is silent, otherwise from Poll().
+     *
+     * @param length length of the request without CRC.
+     * @param expected_length length of a correct response including CRC, 0 if the response echoes the request.
+     * @return ModbusStatus result of SendWhenIdle().
+     */
+    ModbusStatus Start(const size_t length, const size_t expected_length);
+
+    /**
+     * @brief Check the received frame against the request.
+     *
+     * @return ModbusStatus result of the request.
+     */
+    ModbusStatus Validate(void);
+
+    /**
+     * @brief Poll until the request is done.
+     *
+     * @param status status of the Begin function.
+     * @return ModbusStatus result of the request.
+     */
+    ModbusStatus Wait(ModbusStatus status);
+
+    RS485 &rs485_;
+    RS485FrameReceiver receiver_;
+    uint8_t *buffer_;
+    size_t size_;
+
+    unsigned long response_timeout_;
+    unsigned long turnaround_delay_;
+    RS485RttEstimator *estimator_;
+    // Time the request was started or, once sent, the time it was sent and the timeout of the request, in microseconds
+    unsigned long request_time_;
+    unsigned long request_timeout_;
+    bool request_sent_;
+    bool response_started_;
+    bool busy_;
+    // Time of the last byte sent or received in microseconds, and if that was the end of a broadcast
+    unsigned long last_activity_time_;
+    bool broadcast_sent_;
+
+    uint8_t request_header_[6];
+    size_t frame_length_;
+    size_t expected_length_;
+    ModbusException exception_;
+};
+
+#endif // MAX485TTL_MODBUS_MASTER_HPP_
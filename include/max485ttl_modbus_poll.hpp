@@ -0,0 +1,183 @@
+/**
+ * @file max485ttl_modbus_poll.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Poll scheduler of a Modbus RTU master serving many slaves using the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_MODBUS_POLL_HPP_
+#define MAX485TTL_MODBUS_POLL_HPP_
+
+#include "max485ttl_modbus_master.hpp"
+
+/**
+ * @brief Read request polled by a ModbusPollScheduler, the table of these is given to the scheduler.
+ * The result is copied into the registers or bits given to the constructor, like ModbusBlock.
+ * Example:
+ *     ModbusPollEntry table[] = {
+ *         ModbusPollEntry(1, ModbusFunction::kReadHoldingRegisters, 0, 10, holding, 100, 1),
+ *         ModbusPollEntry(2, ModbusFunction::kReadCoils, 100, 16, coils, 1000),
+ *     };
+ */
+struct ModbusPollEntry
+{
+    ModbusPollEntry(const uint8_t slave, const ModbusFunction function, const uint16_t address, const uint16_t quantity,
+                    uint16_t *const registers, const unsigned long interval, const uint8_t priority = 0)
+        : slave(slave), function(function), address(address), quantity(quantity), data(registers), interval(interval), priority(priority),
+          next_time(0), failures(0), status(ModbusStatus::kIdle) {}
+    ModbusPollEntry(const uint8_t slave, const ModbusFunction function, const uint16_t address, const uint16_t quantity,
+                    uint8_t *const bits, const unsigned long interval, const uint8_t priority = 0)
+        : slave(slave), function(function), address(address), quantity(quantity), data(bits), interval(interval), priority(priority),
+          next_time(0), failures(0), status(ModbusStatus::kIdle) {}
+
+    uint8_t slave;
+    // One of the read functions 1-4
+    ModbusFunction function;
+    uint16_t address;
+    uint16_t quantity;
+    void *data;
+    // Time between the starts of two requests in milliseconds, 0 polls whenever the bus is free
+    unsigned long interval;
+    // Due entries with a higher priority go first
+    uint8_t priority;
+
+    // Kept by the scheduler: time the entry is due, timeouts in a row of its slave and result of the last request
+    unsigned long next_time;
+    uint8_t failures;
+    ModbusStatus status;
+};
+
+/**
+ * @brief Counters of a ModbusPollScheduler.
+ *
+ */
+struct ModbusPollStatistics
+{
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t timeouts;
+    // Requests ending in an exception, a CRC error, an invalid response or a request the stream did not take
+    uint32_t errors;
+};
+
+/**
+ * @brief Callback called when a polled request is done, the data of the entry is updated when the status is kOk.
+ *
+ * @param entry entry which was polled.
+ * @param status result of the request.
+ * @param context pointer given when the callback was set.
+ */
+typedef void (*ModbusPollCallback)(ModbusPollEntry &entry, const ModbusStatus status, void *context);
+
+/**
+ * @brief Polls a table of slaves with the non-blocking requests of a ModbusMaster.
+ * Poll() starts the next due entry in the call after the one that finished the previous request, and the master sends it right away
+ * because t3.5 counts from the last byte of the response, so the bus only stays silent for t3.5 and one pass of loop() between a response
+ * and the next request. Of the due entries the one with the highest priority goes first,
+ * then the one waiting longest. A slave which does not answer is backed off: the wait before its entries are due again
+ * doubles with every timeout in a row up to a maximum, so a dead slave costs one response timeout per backoff
+ * instead of one per cycle. Set a short response timeout on the master (SetResponseTimeout()) or let the master
+ * measure one for every slave (SetRttEstimator()).
+ */
+class ModbusPollScheduler
+{
+public:
+    /**
+     * @brief Construct a new poll scheduler, all entries are due immediately.
+     *
+     * @param master master used to send the requests, do not start other requests on it while the scheduler is used.
+     * @param entries table of requests.
+     * @param count amount of entries.
+     */
+    ModbusPollScheduler(ModbusMaster &master, ModbusPollEntry *const entries, const size_t count);
+
+    /**
+     * @brief Set the backoff of slaves which do not answer.
+     *
+     * @param first_in_millisecond wait after the first timeout, default 100.
+     * @param maximum_in_millisecond longest wait, default 10000.
+     */
+    void SetBackoff(const unsigned long first_in_millisecond, const unsigned long maximum_in_millisecond);
+
+    /**
+     * @brief Set the callback called when a request is done.
+     *
+     * @param callback function to call, nullptr to remove it.
+     * @param context pointer passed to the callback.
+     */
+    void SetCallback(const ModbusPollCallback callback, void *const context = nullptr);
+
+    /**
+     * @brief Drive the current request or start the next due entry, call it from loop().
+     *
+     * @return true if a request was done, its entry and the callback are updated.
+     */
+    bool Poll(void);
+
+    /**
+     * @brief Check if the slave of an entry answered its last request.
+     *
+     * @param index index of the entry in the table.
+     * @return true if the last request did not time out.
+     */
+    bool IsResponsive(const size_t index);
+
+    /**
+     * @brief Get the counters of the scheduler.
+     *
+     * @return const ModbusPollStatistics& counters since construction or ResetStatistics().
+     */
+    const ModbusPollStatistics &GetStatistics(void);
+
+    /**
+     * @brief Clear the counters.
+     *
+     */
+    void ResetStatistics(void);
+
+private:
+    static const unsigned long kDefaultFirstBackoff = 100;
+    static const unsigned long kDefaultMaximumBackoff = 10000;
+
+    /**
+     * @brief Start the request of an entry.
+     *
+     * @return ModbusStatus kBusy if sent, otherwise the reason it was not sent.
+     */
+    ModbusStatus Begin(ModbusPollEntry &entry);
+
+    /**
+     * @brief Store the result of the current request and schedule its entry again.
+     *
+     */
+    void Complete(const ModbusStatus status);
+
+    /**
+     * @brief Get the due entry which goes first.
+     *
+     * @return size_t index of the entry, count_ when none is due.
+     */
+    size_t SelectNext(const unsigned long now);
+
+    ModbusMaster &master_;
+    ModbusPollEntry *entries_;
+    size_t count_;
+
+    unsigned long first_backoff_;
+    unsigned long maximum_backoff_;
+
+    ModbusPollCallback callback_;
+    void *callback_context_;
+
+    // Entry waiting for its response, count_ when idle
+    size_t current_;
+    unsigned long start_time_;
+
+    ModbusPollStatistics statistics_;
+};
+
+#endif // MAX485TTL_MODBUS_POLL_HPP_
@@ -0,0 +1,172 @@
+/**
+ * @file max485ttl_modbus_slave.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Modbus RTU slave using the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_MODBUS_SLAVE_HPP_
+#define MAX485TTL_MODBUS_SLAVE_HPP_
+
+#include "max485ttl_frame.hpp"
+#include "max485ttl_modbus.hpp"
+
+/**
+ * @brief Data tables of a Modbus slave.
+ *
+ */
+enum class ModbusTable : uint8_t
+{
+    kCoils,
+    kDiscreteInputs,
+    kHoldingRegisters,
+    kInputRegisters,
+};
+
+/**
+ * @brief Block of consecutive addresses in the register map of a slave.
+ * Coils and discrete inputs point to bytes holding 8 bits each (first address in the lowest bit),
+ * registers point to uint16_t values. The map is a constant table so it can be declared at compile time:
+ *
+ *     uint16_t holding[10];
+ *     uint8_t coils[2];
+ *     constexpr ModbusBlock kMap[] = {
+ *         ModbusBlock(ModbusTable::kHoldingRegisters, 0, 10, holding),
+ *         ModbusBlock(ModbusTable::kCoils, 100, 16, coils),
+ *     };
+ */
+struct ModbusBlock
+{
+    constexpr ModbusBlock(const ModbusTable table, const uint16_t start, const uint16_t count, uint16_t *const registers)
+        : table(table), start(start), count(count), data(registers) {}
+    constexpr ModbusBlock(const ModbusTable table, const uint16_t start, const uint16_t count, uint8_t *const bits)
+        : table(table), start(start), count(count), data(bits) {}
+
+    ModbusTable table;
+    uint16_t start;
+    uint16_t count;
+    void *data;
+};
+
+/**
+ * @brief Callback called after the master wrote to the register map.
+ *
+ * @param table table which was written.
+ * @param address first address written.
+ * @param quantity amount of addresses written.
+ * @param context pointer given when the callback was set.
+ */
+typedef void (*ModbusWriteCallback)(const ModbusTable table, const uint16_t address, const uint16_t quantity, void *context);
+
+/**
+ * @brief Modbus RTU slave supporting function codes 1-6, 15, 16 and 23 on a statically declared register map.
+ * Frames for other addresses are dropped on the address byte before any other check.
+ * The response is built in place in the receive buffer and sent with RS485::Send().
+ */
+class ModbusSlave
+{
+public:
+    /**
+     * @brief Construct a new Modbus slave
+     *
+     * @param rs485 module used for the bus.
+     * @param address address of this slave (1-247).
+     * @param map register map.
+     * @param map_length amount of blocks in map.
+     * @param buffer buffer used for requests and responses, kModbusMaxFrameLength supports every request.
+     * @param size size of buffer.
+     */
+    ModbusSlave(RS485 &rs485, const uint8_t address, const ModbusBlock *const map, const size_t map_length, uint8_t *const buffer, const size_t size);
+
+    /**
+     * @brief Set the address of this slave.
+     *
+     * @param address address (1-247).
+     */
+    void SetAddress(const uint8_t address);
+
+    /**
+     * @brief Handle a request as soon as its length (known from the header) is received and the CRC is correct,
+     * instead of waiting t3.5 after the last byte. Enabled by default.
+     *
+     * @param enabled false to always wait for t3.5.
+     */
+    void SetEarlyCompletion(const bool enabled);
+
+    /**
+     * @brief Set the callback called after the master wrote to the register map.
+     *
+     * @param callback function to call, nullptr to disable.
+     * @param context pointer passed to the callback.
+     */
+    void SetWriteCallback(ModbusWriteCallback callback, void *context = nullptr);
+
+    /**
+     * @brief Function used to receive and handle requests, call it from loop() as often as possible.
+     *
+     * @return true if a request for this slave was handled.
+     */
+    bool Poll(void);
+
+    /**
+     * @brief Get the time between the last byte of the last request and the start of the response.
+     * It counts from the Poll() which read the last byte, so the time the byte waited in the stream before is not included.
+     *
+     * @return unsigned long latency in microseconds.
+     */
+    unsigned long GetResponseLatency(void);
+
+private:
+    /**
+     * @brief Get the length of the request from its header.
+     *
+     * @return size_t length including CRC, 0 if not yet known.
+     */
+    size_t GetExpectedLength(void);
+
+    /**
+     * @brief Handle the request in the buffer and build the response in place.
+     *
+     * @param length length of the request including CRC.
+     * @return size_t length of the response without CRC, 0 if nothing must be sent.
+     */
+    size_t Handle(const size_t length);
+
+    /**
+     * @brief Build an exception response.
+     *
+     * @return size_t length of the response without CRC.
+     */
+    size_t Exception(const ModbusException exception);
+
+    /**
+     * @brief Find the block holding the addresses.
+     *
+     * @return ModbusBlock* block or nullptr if the addresses are not in a single block.
+     */
+    const ModbusBlock *FindBlock(const ModbusTable table, const uint16_t address, const uint16_t quantity);
+
+    size_t ReadBits(const ModbusBlock *block, const uint16_t address, const uint16_t quantity);
+    size_t ReadRegisters(const ModbusBlock *block, const uint16_t address, const uint16_t quantity);
+
+    RS485 &rs485_;
+    RS485FrameReceiver receiver_;
+    uint8_t *buffer_;
+    size_t size_;
+
+    uint8_t address_;
+    const ModbusBlock *map_;
+    size_t map_length_;
+    bool early_completion_;
+
+    ModbusWriteCallback write_callback_;
+    void *write_context_;
+
+    unsigned long response_latency_;
+};
+
+#endif // MAX485TTL_MODBUS_SLAVE_HPP_
@@ -0,0 +1,164 @@
+/**
+ * @file max485ttl_pipeline.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Pipelined requests over a full-duplex (4-wire) link using the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_PIPELINE_HPP_
+#define MAX485TTL_PIPELINE_HPP_
+
+#include "max485ttl.hpp"
+
+/**
+ * @brief Request waiting for its response, the storage of these is given to RS485Pipeline.
+ *
+ */
+struct RS485PipelineRequest
+{
+    uint16_t tag;
+    size_t response_length;
+};
+
+/**
+ * @brief Keeps several requests in flight on a full-duplex link instead of waiting for every response before the next request.
+ * The peer must answer every request in order with a response of the length given to Send(),
+ * so the responses can be separated by their length instead of by silence on the line.
+ * Use it with RS485::SetFullDuplex(true), on a half-duplex bus the requests would collide with the responses.
+ * Like RS485FrameReceiver the oldest response stays available until ReleaseResponse(), no heap is used.
+ */
+class RS485Pipeline
+{
+public:
+    /**
+     * @brief Construct a new pipeline
+     *
+     * @param rs485 module used for the link.
+     * @param requests storage of the requests in flight, its length is the depth of the pipeline.
+     * @param depth amount of requests, at least 1.
+     * @param buffer buffer used to receive the oldest response.
+     * @param size size of the buffer, the longest response.
+     */
+    RS485Pipeline(RS485 &rs485, RS485PipelineRequest *const requests, const size_t depth, uint8_t *const buffer, const size_t size);
+
+    /**
+     * @brief Set the maximum time a response may take, counted from the sending of its request
+     * or from the release of the previous response when that came later.
+     *
+     * @param timeout_in_millisecond timeout in milliseconds, default 1000.
+     */
+    void SetResponseTimeout(const unsigned long timeout_in_millisecond);
+
+    /**
+     * @brief Send a request, does not wait for its response.
+     *
+     * @param request bytes of the request.
+     * @param length length of the request.
+     * @param response_length length of the response.
+     * @param tag value returned by GetTag() with the response, to match it with its request.
+     * @return true if sent, false if the pipeline is full or the response does not fit in the buffer.
+     */
+    bool Send(const uint8_t *const request, const size_t length, const size_t response_length, const uint16_t tag = 0);
+
+    /**
+     * @brief Read the available bytes of the oldest response, does not wait for more data.
+     *
+     * @return true if the oldest response is complete or timed out.
+     */
+    bool Poll(void);
+
+    /**
+     * @brief Check if the oldest request got no (complete) response in time, its received bytes are dropped.
+     * After a timeout the input is dropped until the line has been silent for t3.5,
+     * so the rest of a late or partial response is not taken as the start of the next one.
+     * Responses sent back-to-back after the late one are dropped with it, counted by their length their requests
+     * time out right away instead of each waiting for the response timeout.
+     *
+     * @return true if timed out.
+     */
+    bool IsTimedOut(void);
+
+    /**
+     * @brief Get the tag of the oldest request.
+     *
+     * @return uint16_t tag given to Send().
+     */
+    uint16_t GetTag(void);
+
+    /**
+     * @brief Get the response of the oldest request, valid until ReleaseResponse().
+     *
+     * @return const uint8_t* the response.
+     */
+    const uint8_t *GetResponse(void);
+
+    /**
+     * @brief Get the length of the response.
+     *
+     * @return size_t length, 0 when timed out.
+     */
+    size_t GetResponseLength(void);
+
+    /**
+     * @brief Remove the oldest request and its response, so the next one can be received.
+     *
+     */
+    void ReleaseResponse(void);
+
+    /**
+     * @brief Get the amount of requests sent which are not released yet.
+     *
+     * @return size_t requests in flight.
+     */
+    size_t GetOutstandingCount(void);
+
+    /**
+     * @brief Check if a request can be sent.
+     *
+     * @return true if the pipeline is full.
+     */
+    bool IsFull(void);
+
+private:
+    static const unsigned long kDefaultResponseTimeout = 1000;
+    // t3.5 of 19200 baud and up, used without frame format
+    static const unsigned long kDefaultSilence = 1750;
+
+    /**
+     * @brief Drop the input until the line has been silent for t3.5, then the responses are in step again.
+     * Dropped bytes beyond the rest of the late response are counted as lost bytes of the next responses.
+     *
+     */
+    void Resynchronise(void);
+
+    RS485 &rs485_;
+    RS485PipelineRequest *requests_;
+    size_t depth_;
+    uint8_t *buffer_;
+    size_t size_;
+
+    unsigned long response_timeout_;
+
+    // Oldest request and amount of requests in flight
+    size_t head_;
+    size_t count_;
+
+    // Bytes of the oldest response and the time its wait started
+    size_t received_;
+    unsigned long head_start_time_;
+    bool complete_;
+    bool timed_out_;
+
+    // Set after a timeout until the line is silent, time of the last dropped byte
+    bool resynchronising_;
+    unsigned long last_byte_time_;
+    // Bytes of the late response still to be dropped, and dropped bytes which belonged to the next responses
+    size_t skip_;
+    size_t lost_;
+};
+
+#endif // MAX485TTL_PIPELINE_HPP_
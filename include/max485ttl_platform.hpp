@@ -0,0 +1,151 @@
+/**
+ * @file max485ttl_platform.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Platform layer so the library can be compiled for Arduino targets and for the host (native) environment.
+ * On Arduino this only includes Arduino.h, on the host it provides the small part of the Arduino API the library uses.
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_PLATFORM_HPP_
+#define MAX485TTL_PLATFORM_HPP_
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef INPUT
+#define INPUT 0x0
+#define OUTPUT 0x1
+#endif
+
+#ifndef LOW
+#define LOW 0x0
+#define HIGH 0x1
+#endif
+
+#ifndef DEC
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+#endif
+
+#ifndef PROGMEM
+#define PROGMEM
+#define pgm_read_byte(address) (*reinterpret_cast<const uint8_t *>(address))
+#define pgm_read_word(address) (*reinterpret_cast<const uint16_t *>(address))
+#endif
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/**
+ * @brief Host only: get the time a pin last changed value through digitalWrite, used by the simulated bus.
+ *
+ * @param pin pin number.
+ * @return unsigned long time in microseconds (micros()).
+ */
+unsigned long GetPinChangeTime(uint8_t pin);
+
+/**
+ * @brief Host version of the Arduino Print class, holding the write interface and the print functions used by the tests.
+ * Like on Arduino a number is formatted into a local buffer and written with a single write call.
+ *
+ */
+class Print
+{
+public:
+    virtual ~Print(void) {}
+
+    virtual size_t write(uint8_t data) = 0;
+
+    /**
+     * @brief Write a buffer, the default implementation writes byte by byte like the Arduino core does.
+     *
+     * @param buffer data to write.
+     * @param size amount of bytes in buffer.
+     * @return size_t amount of bytes accepted.
+     */
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size--)
+        {
+            if (write(*buffer++))
+            {
+                n++;
+            }
+            else
+            {
+                break;
+            }
+        }
+        return n;
+    }
+
+    size_t write(const char *buffer, size_t size)
+    {
+        return write(reinterpret_cast<const uint8_t *>(buffer), size);
+    }
+
+    size_t write(const char *str)
+    {
+        if (str == nullptr)
+        {
+            return 0;
+        }
+        return write(reinterpret_cast<const uint8_t *>(str), strlen(str));
+    }
+
+    size_t print(const char *str);
+    size_t print(char c);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println(void);
+    size_t println(const char *str);
+    size_t println(char c);
+    size_t println(int n, int base = DEC);
+    size_t println(unsigned int n, int base = DEC);
+    size_t println(long n, int base = DEC);
+    size_t println(unsigned long n, int base = DEC);
+    size_t println(double n, int digits = 2);
+
+    virtual int availableForWrite(void) { return 0; }
+
+    virtual void flush(void) {}
+
+private:
+    size_t PrintNumber(unsigned long n, uint8_t base);
+    size_t PrintFloat(double n, uint8_t digits);
+};
+
+/**
+ * @brief Host version of the Arduino Stream class, only holding the read interface.
+ *
+ */
+class Stream : public Print
+{
+public:
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int peek(void) = 0;
+};
+#endif // ARDUINO
+
+#endif // MAX485TTL_PLATFORM_HPP_
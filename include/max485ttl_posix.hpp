@@ -0,0 +1,199 @@
+/**
+ * @file max485ttl_posix.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief POSIX backend so RS485 can be used on a termios serial port, for example a USB-RS485 adapter on a Linux gateway
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_POSIX_HPP_
+#define MAX485TTL_POSIX_HPP_
+
+#if !defined(ARDUINO) && (defined(__unix__) || defined(__APPLE__))
+#define MAX485TTL_POSIX
+
+#include "max485ttl.hpp"
+
+/**
+ * @brief Parity of the characters on the serial port.
+ *
+ */
+enum class PosixParity : uint8_t
+{
+    kNone,
+    kEven,
+    kOdd,
+};
+
+/**
+ * @brief How the direction of the transceiver is switched.
+ * kNone: the adapter switches by itself (most USB-RS485 adapters do).
+ * kRts: RTS is set while sending and cleared when the transmission ended.
+ * kKernel: the kernel RS485 mode (TIOCSRS485, Linux only) switches RTS, RS485 only keeps track of the mode.
+ */
+enum class PosixDirectionControl : uint8_t
+{
+    kNone,
+    kRts,
+    kKernel,
+};
+
+/**
+ * @brief Stream on a termios file descriptor using non-blocking I/O, only a write waits when the kernel buffer is full.
+ * Received data is read from the file descriptor in blocks, so reading byte by byte does not cost a system call per byte.
+ */
+class PosixSerial : public Stream
+{
+public:
+    PosixSerial(void);
+    ~PosixSerial(void) override;
+
+    // The port owns its file descriptor and closes it when destroyed, so it cannot be copied
+    PosixSerial(const PosixSerial &) = delete;
+    PosixSerial &operator=(const PosixSerial &) = delete;
+
+    /**
+     * @brief Open a serial port in raw mode with 8 data bits.
+     *
+     * @param path path of the device, for example /dev/ttyUSB0.
+     * @param baudrate baudrate, must be one of the standard baudrates.
+     * @param parity parity of the characters.
+     * @param stop_bits 1 or 2.
+     * @return true if the port was opened and configured.
+     */
+    bool Open(const char *const path, const unsigned long baudrate, const PosixParity parity = PosixParity::kNone, const uint8_t stop_bits = 1);
+
+    /**
+     * @brief Use a file descriptor which is already open, for example the master side of a pseudo-terminal.
+     * The file descriptor is configured like Open() does and closed by Close().
+     * When configuring fails it is left open, it still belongs to the caller then.
+     *
+     * @return true if the file descriptor was configured.
+     */
+    bool Open(const int file_descriptor, const unsigned long baudrate, const PosixParity parity = PosixParity::kNone, const uint8_t stop_bits = 1);
+
+    /**
+     * @brief Close the port.
+     *
+     */
+    void Close(void);
+
+    bool IsOpen(void);
+    int GetFileDescriptor(void);
+    unsigned long GetBaudrate(void);
+
+    /**
+     * @brief Get the bits on the wire per character, used for RS485::SetFrameFormat().
+     *
+     * @return uint8_t start, data, parity and stop bits.
+     */
+    uint8_t GetBitsPerCharacter(void);
+
+    /**
+     * @brief Select how the direction of the transceiver is switched.
+     *
+     * @param control direction control.
+     * @return true if the port supports the direction control.
+     */
+    bool SetDirectionControl(const PosixDirectionControl control);
+    PosixDirectionControl GetDirectionControl(void);
+
+    /**
+     * @brief Set or clear RTS.
+     *
+     * @return true if succesfull.
+     */
+    bool SetRts(const bool enabled);
+
+    int available(void) override;
+    int read(void) override;
+    int peek(void) override;
+
+    /**
+     * @brief Read up to length bytes without blocking.
+     *
+     * @return size_t amount of bytes read.
+     */
+    size_t read(uint8_t *const buffer, const size_t length);
+
+    size_t write(uint8_t data) override;
+
+    /**
+     * @brief Write a buffer, waiting for room when the kernel buffer is full like Arduino's HardwareSerial does.
+     *
+     * @return size_t amount of bytes accepted by the kernel, less than size when there was no room for kWriteTimeout milliseconds.
+     */
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+    /**
+     * @brief Wait until all written data has been sent (tcdrain).
+     *
+     */
+    void flush(void) override;
+
+private:
+    static const size_t kReceiveBufferSize = 256;
+    static const int kWriteTimeout = 1000;
+
+    /**
+     * @brief Move data from the file descriptor into the receive buffer when it is empty.
+     *
+     * @return size_t amount of bytes in the receive buffer.
+     */
+    size_t Fill(void);
+
+    int file_descriptor_;
+    unsigned long baudrate_;
+    uint8_t bits_per_character_;
+    PosixDirectionControl direction_control_;
+
+    uint8_t receive_buffer_[kReceiveBufferSize];
+    size_t receive_head_;
+    size_t receive_tail_;
+};
+
+/**
+ * @brief RS485 on a PosixSerial port, the direction is switched with the control set on the port instead of pins.
+ * The frame format is taken from the port, so the port must be opened before construction.
+ */
+class RS485Posix : public RS485
+{
+public:
+    /**
+     * @brief Construct a new RS485 on a serial port
+     *
+     * @param serial opened port.
+     * @param control how the direction is switched.
+     */
+    explicit RS485Posix(PosixSerial &serial, const PosixDirectionControl control = PosixDirectionControl::kNone);
+
+    PosixSerial &GetSerial(void);
+
+protected:
+    /**
+     * @brief Read with a single read(2) of the port instead of one call per byte.
+     *
+     * @param buffer destination of the bytes.
+     * @param length maximum amount of bytes.
+     * @return size_t amount of bytes copied.
+     */
+    size_t ReadStream(uint8_t *const buffer, const size_t length) override;
+
+    /**
+     * @brief Switch the direction using the direction control of the port.
+     *
+     * @param value HIGH to enable the driver, LOW to receive.
+     */
+    void WriteDirection(const uint8_t value) override;
+
+private:
+    PosixSerial &posix_serial_;
+};
+
+#endif // !ARDUINO && (__unix__ || __APPLE__)
+
+#endif // MAX485TTL_POSIX_HPP_
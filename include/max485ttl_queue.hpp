@@ -0,0 +1,135 @@
+/**
+ * @file max485ttl_queue.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Transmit queue which sends small frames back-to-back in one transmission of the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_QUEUE_HPP_
+#define MAX485TTL_QUEUE_HPP_
+
+#include "max485ttl.hpp"
+
+#ifndef MAX485TTL_QUEUE_FRAME_SIZE
+/**
+ * @brief Size of the data of a queue slot, define it before including to change it.
+ */
+#define MAX485TTL_QUEUE_FRAME_SIZE 32
+#endif
+
+/**
+ * @brief Frame waiting in a RS485TransmitQueue, the storage of these is given to the queue.
+ *
+ */
+struct RS485QueueSlot
+{
+    unsigned long gap;
+    size_t length;
+    uint8_t data[MAX485TTL_QUEUE_FRAME_SIZE];
+};
+
+/**
+ * @brief Counters of a RS485TransmitQueue.
+ *
+ */
+struct RS485QueueStatistics
+{
+    // Frames accepted by Enqueue() and frames refused because the queue was full or the frame too long
+    uint32_t frames_queued;
+    uint32_t frames_dropped;
+    // Frames sent and the transmissions they were sent in, frames_sent / transmissions is the average batch
+    uint32_t frames_sent;
+    uint32_t transmissions;
+    size_t max_batch;
+    size_t max_depth;
+};
+
+/**
+ * @brief Queue of frames which are sent back-to-back in a single transmission, so many small frames
+ * (broadcast setpoints, acknowledgements) pay one direction switch and one wait for the last stop bit together.
+ * A frame can require silence before it (for example t3.5 between Modbus RTU frames), the driver stays enabled during the gap.
+ * Frames are copied into the slots given to the constructor, no heap is used.
+ */
+class RS485TransmitQueue
+{
+public:
+    /**
+     * @brief Construct a new transmit queue
+     *
+     * @param rs485 module used to send the frames.
+     * @param slots storage of the queued frames, its length is the depth of the queue.
+     * @param depth amount of slots, at least 1.
+     */
+    RS485TransmitQueue(RS485 &rs485, RS485QueueSlot *const slots, const size_t depth);
+
+    /**
+     * @brief Set how long the oldest frame may wait for more frames to join its transmission.
+     *
+     * @param delay_in_microsecond delay in microseconds, default 0: Poll() sends everything queued since the previous Poll().
+     */
+    void SetCoalescingDelay(const unsigned long delay_in_microsecond);
+
+    /**
+     * @brief Add a frame to the queue, it is sent by Poll() or Flush().
+     *
+     * @param frame bytes of the frame.
+     * @param length length of the frame, at most MAX485TTL_QUEUE_FRAME_SIZE.
+     * @param gap_in_microsecond silence before the frame when it follows another frame in the same transmission.
+     * @return true if queued, false if the queue is full or the frame too long.
+     */
+    bool Enqueue(const uint8_t *const frame, const size_t length, const unsigned long gap_in_microsecond = 0);
+
+    /**
+     * @brief Send the queued frames when the queue is full or the oldest frame waited the coalescing delay, call it from loop().
+     *
+     * @return size_t amount of frames sent.
+     */
+    size_t Poll(void);
+
+    /**
+     * @brief Send all queued frames in one transmission.
+     *
+     * @return size_t amount of frames sent.
+     */
+    size_t Flush(void);
+
+    /**
+     * @brief Get the amount of queued frames.
+     *
+     * @return size_t frames waiting.
+     */
+    size_t GetDepth(void);
+
+    /**
+     * @brief Get the counters of the queue.
+     *
+     * @return const RS485QueueStatistics& counters since construction or ResetStatistics().
+     */
+    const RS485QueueStatistics &GetStatistics(void);
+
+    /**
+     * @brief Clear the counters.
+     *
+     */
+    void ResetStatistics(void);
+
+private:
+    RS485 &rs485_;
+    RS485QueueSlot *slots_;
+    size_t depth_;
+
+    // Oldest frame and amount of frames queued
+    size_t head_;
+    size_t count_;
+
+    unsigned long coalescing_delay_;
+    unsigned long oldest_time_;
+
+    RS485QueueStatistics statistics_;
+};
+
+#endif // MAX485TTL_QUEUE_HPP_
@@ -0,0 +1,148 @@
+/**
+ * @file max485ttl_reactor.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Event loop servicing many RS485 ports on Linux from one thread using epoll and timerfd
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_REACTOR_HPP_
+#define MAX485TTL_REACTOR_HPP_
+
+#include "max485ttl_posix.hpp"
+
+#if defined(MAX485TTL_POSIX) && defined(__linux__)
+#define MAX485TTL_REACTOR
+
+#include "max485ttl_frame.hpp"
+
+class RS485Reactor;
+
+/**
+ * @brief Events dispatched by the reactor.
+ *
+ */
+enum class RS485ReactorEvent : uint8_t
+{
+    kFrameComplete,
+    kResponseTimeout,
+};
+
+/**
+ * @brief Callback called by the reactor for a port.
+ *
+ * @param reactor reactor which dispatched the event.
+ * @param port index of the port returned by AddPort().
+ * @param event what happened, for kFrameComplete the frame is in the receiver of the port.
+ * @param context pointer given when the port was added.
+ */
+typedef void (*RS485ReactorCallback)(RS485Reactor &reactor, const size_t port, const RS485ReactorEvent event, void *context);
+
+/**
+ * @brief Reactor which waits on all ports with one epoll instance.
+ * Readable ports are read into their frame receiver, a timerfd per port fires when the inter-frame timeout (t3.5)
+ * after the last byte or the response timeout has passed, so the thread sleeps until there is work.
+ * The frame is released after the frame complete callback returned, so the callback can use it or send a response.
+ */
+class RS485Reactor
+{
+public:
+    static const size_t kMaxPorts = 32;
+
+    RS485Reactor(void);
+    ~RS485Reactor(void);
+
+    /**
+     * @brief Add a port to the reactor.
+     *
+     * @param rs485 port, the PosixSerial must be open.
+     * @param receiver frame receiver reading from rs485.
+     * @param callback function called for the events of this port.
+     * @param context pointer passed to the callback.
+     * @return int index of the port, -1 if the port could not be added.
+     */
+    int AddPort(RS485Posix &rs485, RS485FrameReceiver &receiver, RS485ReactorCallback callback, void *context = nullptr);
+
+    /**
+     * @brief Remove a port from the reactor.
+     *
+     * @param port index returned by AddPort().
+     */
+    void RemovePort(const size_t port);
+
+    /**
+     * @brief Start the response timeout of a port, for example after a request was sent.
+     * The kResponseTimeout event is dispatched when no byte arrived within the timeout.
+     *
+     * @param port index returned by AddPort().
+     * @param timeout_in_millisecond timeout in milliseconds.
+     */
+    void StartResponseTimeout(const size_t port, const unsigned long timeout_in_millisecond);
+
+    /**
+     * @brief Wait for events once and dispatch them.
+     *
+     * @param timeout_in_millisecond maximum wait, -1 to wait until an event happens.
+     * @return int amount of events handled, -1 on error.
+     */
+    int RunOnce(const int timeout_in_millisecond = -1);
+
+    /**
+     * @brief Dispatch events until Stop() is called.
+     *
+     */
+    void Run(void);
+
+    /**
+     * @brief Let Run() return after the current events, can be called from a callback.
+     *
+     */
+    void Stop(void);
+
+    RS485Posix &GetRS485(const size_t port);
+    RS485FrameReceiver &GetReceiver(const size_t port);
+
+private:
+    static const int kMaxEvents = 64;
+
+    enum class PortState : uint8_t
+    {
+        kUnused,
+        kIdle,
+        kWaitingForResponse,
+        kReceiving,
+    };
+
+    struct Port
+    {
+        RS485Posix *rs485;
+        RS485FrameReceiver *receiver;
+        RS485ReactorCallback callback;
+        void *context;
+        int file_descriptor;
+        int timer;
+        PortState state;
+    };
+
+    void HandleReadable(const size_t port);
+    void HandleTimer(const size_t port);
+
+    /**
+     * @brief Arm the timer of a port once.
+     *
+     * @param port index of the port.
+     * @param timeout_in_microsecond time until the timer fires, 0 disarms the timer.
+     */
+    void ArmTimer(const size_t port, const unsigned long timeout_in_microsecond);
+
+    int epoll_;
+    bool running_;
+    Port ports_[kMaxPorts];
+};
+
+#endif // MAX485TTL_POSIX && __linux__
+
+#endif // MAX485TTL_REACTOR_HPP_
@@ -0,0 +1,124 @@
+/**
+ * @file max485ttl_rtt.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Response timeouts from the measured round trip time of every peer on a bus of MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_RTT_HPP_
+#define MAX485TTL_RTT_HPP_
+
+#include "max485ttl.hpp"
+
+/**
+ * @brief Round trip state of one peer, the storage of these is given to RS485RttEstimator.
+ *
+ */
+struct RS485RttPeer
+{
+    uint8_t address;
+    // Timeouts in a row, every one doubles the timeout
+    uint8_t backoff;
+    uint16_t samples;
+    // Smoothed round trip time times 8 and its variation times 4, in microseconds
+    unsigned long srtt;
+    unsigned long rttvar;
+};
+
+/**
+ * @brief Estimates the response timeout of every peer from its measured round trip times, like TCP (RFC 6298):
+ * the smoothed round trip time follows every sample by 1/8, its mean variation by 1/4 and the timeout is
+ * the smoothed round trip time plus 4 times the variation, kept between a floor and a ceiling.
+ * Every timeout in a row doubles it (up to the ceiling) until the peer answers again.
+ * A peer without samples gets the ceiling. Peers are added to the table given to the constructor on their first use,
+ * when the table is full the other peers get the ceiling. Integer math only.
+ */
+class RS485RttEstimator
+{
+public:
+    /**
+     * @brief Construct a new round trip estimator
+     *
+     * @param peers storage of the peers.
+     * @param count amount of peers.
+     */
+    RS485RttEstimator(RS485RttPeer *const peers, const size_t count);
+
+    /**
+     * @brief Set the range of the timeout.
+     *
+     * @param floor_in_microsecond shortest timeout, default 2000, protects against a variation of almost 0.
+     * @param ceiling_in_microsecond longest timeout and timeout of a peer without samples, default 1000000.
+     */
+    void SetLimits(const unsigned long floor_in_microsecond, const unsigned long ceiling_in_microsecond);
+
+    /**
+     * @brief Add a measured round trip time, the backoff of the peer is cleared.
+     *
+     * @param address address of the peer.
+     * @param rtt_in_microsecond time from the end of the request until the start of the response.
+     */
+    void AddSample(const uint8_t address, const unsigned long rtt_in_microsecond);
+
+    /**
+     * @brief Record that the peer did not answer in time, its timeout doubles.
+     *
+     * @param address address of the peer.
+     */
+    void AddTimeout(const uint8_t address);
+
+    /**
+     * @brief Get the time to wait for the response of a peer.
+     *
+     * @param address address of the peer.
+     * @return unsigned long timeout in microseconds.
+     */
+    unsigned long GetTimeout(const uint8_t address);
+
+    /**
+     * @brief Get the smoothed round trip time of a peer.
+     *
+     * @param address address of the peer.
+     * @return unsigned long round trip time in microseconds, 0 without samples.
+     */
+    unsigned long GetSmoothedRtt(const uint8_t address);
+
+    /**
+     * @brief Get the mean variation of the round trip time of a peer.
+     *
+     * @param address address of the peer.
+     * @return unsigned long variation in microseconds, 0 without samples.
+     */
+    unsigned long GetRttVariation(const uint8_t address);
+
+    /**
+     * @brief Forget all peers.
+     *
+     */
+    void Reset(void);
+
+private:
+    static const unsigned long kDefaultFloor = 2000;
+    static const unsigned long kDefaultCeiling = 1000000;
+    static const uint8_t kMaximumBackoff = 16;
+
+    /**
+     * @brief Find a peer, a new peer is added when add is true and the table has room.
+     *
+     * @return RS485RttPeer* the peer, nullptr when not found.
+     */
+    RS485RttPeer *Find(const uint8_t address, const bool add);
+
+    RS485RttPeer *peers_;
+    size_t count_;
+    size_t used_;
+
+    unsigned long floor_;
+    unsigned long ceiling_;
+};
+
+#endif // MAX485TTL_RTT_HPP_
@@ -0,0 +1,207 @@
+/**
+ * @file max485ttl_simulated_bus.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Simulated multi-drop RS485 bus for host builds, modelling the timing of the wire
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_SIMULATED_BUS_HPP_
+#define MAX485TTL_SIMULATED_BUS_HPP_
+
+#ifndef ARDUINO
+#define MAX485TTL_SIMULATED_BUS
+
+#include "max485ttl_buffer.hpp"
+
+class RS485SimulatedPort;
+
+/**
+ * @brief Simulated half-duplex bus shared by several RS485SimulatedPort streams.
+ * The DE and RE pins of every port are read with digitalRead(), so RS485 switches the simulated transceiver
+ * exactly like a real one. The model:
+ * - every character occupies the wire for its character time, characters of one port follow each other;
+ * - a character starts no earlier than the driver enable delay after DE went high, without DE it is not sent;
+ * - a character is delivered to every port with RE low when its last stop bit has passed, including the sender (echo);
+ * - when DE goes low before the last stop bit the character is truncated and lost;
+ * - when another driver is enabled or another character is on the wire at the same time, both collide and arrive corrupted.
+ * Time is real time (micros()), so the bus is updated whenever a port is used.
+ * A 4-wire link is modelled with two buses, one per pair, see the second constructor of RS485SimulatedPort.
+ */
+class RS485SimulatedBus
+{
+public:
+    static const size_t kMaxPorts = 16;
+
+    /**
+     * @brief Construct a new simulated bus
+     *
+     * @param baudrate baudrate of the bus.
+     * @param bits_per_character bits on the wire per character including start, parity and stop bits (8N1 is 10).
+     * @param driver_enable_delay_in_microsecond time between DE going high and the driver being able to send.
+     */
+    RS485SimulatedBus(const unsigned long baudrate, const uint8_t bits_per_character = 10, const unsigned long driver_enable_delay_in_microsecond = 0);
+
+    unsigned long GetCharacterTime(void);
+
+    /**
+     * @brief Move the characters which have completely passed the wire to the receiving ports.
+     *
+     */
+    void Update(void);
+
+    /**
+     * @brief Get the amount of characters sent on the bus.
+     *
+     * @return unsigned long characters sent, including collided and truncated characters.
+     */
+    unsigned long GetCharacterCount(void);
+
+    /**
+     * @brief Get the amount of characters which collided with another driver.
+     *
+     * @return unsigned long corrupted characters.
+     */
+    unsigned long GetCollisionCount(void);
+
+    /**
+     * @brief Get the amount of characters lost because DE went low before the last stop bit, or was not high at all.
+     *
+     * @return unsigned long lost characters.
+     */
+    unsigned long GetTruncatedCount(void);
+
+    /**
+     * @brief Clear the statistics.
+     *
+     */
+    void ResetStatistics(void);
+
+private:
+    friend class RS485SimulatedPort;
+
+    static const size_t kMaxCharacters = 256;
+
+    /**
+     * @brief Character on the wire.
+     *
+     */
+    struct Character
+    {
+        RS485SimulatedPort *source;
+        unsigned long start_time;
+        unsigned long end_time;
+        uint8_t data;
+        bool collided;
+    };
+
+    bool Attach(RS485SimulatedPort *port);
+    void Detach(RS485SimulatedPort *port);
+
+    /**
+     * @brief Put a character of a port on the wire.
+     *
+     * @return bool false when the wire is full (more than kMaxCharacters in flight).
+     */
+    bool Transmit(RS485SimulatedPort *port, const uint8_t data);
+
+    /**
+     * @brief Check if another port has its driver enabled.
+     *
+     * @param before only drivers enabled before this time count.
+     */
+    bool IsOtherDriverEnabled(RS485SimulatedPort *port, const unsigned long before);
+
+    unsigned long character_time_;
+    unsigned long baudrate_;
+    // Duration of a character in 1/baudrate microseconds
+    unsigned long bit_time_;
+    unsigned long driver_enable_delay_;
+
+    RS485SimulatedPort *ports_[kMaxPorts];
+    Character characters_[kMaxCharacters];
+    size_t head_;
+    size_t count_;
+
+    unsigned long character_count_;
+    unsigned long collision_count_;
+    unsigned long truncated_count_;
+};
+
+/**
+ * @brief Stream of a transceiver on the simulated bus, pass it to RS485 with the same DE and RE pins.
+ * A port transmits on its transmit bus and receives from its receive bus, for a 2-wire transceiver these are the same.
+ *
+ */
+class RS485SimulatedPort : public Stream
+{
+public:
+    /**
+     * @brief Attach a new transceiver to the bus
+     *
+     * @param bus bus to attach to, must outlive the port.
+     * @param de_pin Driver output enable pin number of the transceiver.
+     * @param re_pin Receiver output enable pin number of the transceiver (active low).
+     */
+    RS485SimulatedPort(RS485SimulatedBus &bus, const uint8_t de_pin, const uint8_t re_pin);
+
+    /**
+     * @brief Attach a new 4-wire transceiver, its driver to one pair and its receiver to the other.
+     *
+     * @param transmit_bus pair driven by this port, must outlive the port.
+     * @param receive_bus pair received by this port, must outlive the port.
+     * @param de_pin Driver output enable pin number of the transceiver.
+     * @param re_pin Receiver output enable pin number of the transceiver (active low).
+     */
+    RS485SimulatedPort(RS485SimulatedBus &transmit_bus, RS485SimulatedBus &receive_bus, const uint8_t de_pin, const uint8_t re_pin);
+    ~RS485SimulatedPort(void) override;
+
+    int available(void) override;
+    int read(void) override;
+    int peek(void) override;
+
+    /**
+     * @brief Write a character, blocks while the wire is full like a full transmit buffer of a UART.
+     *
+     * @return size_t 1.
+     */
+    size_t write(uint8_t data) override;
+    using Print::write;
+
+    /**
+     * @brief Wait until the last written character has left the port.
+     *
+     */
+    void flush(void) override;
+
+    /**
+     * @brief Get the amount of received characters which did not fit in the receive buffer.
+     *
+     * @return uint16_t dropped characters.
+     */
+    uint16_t GetOverflowCount(void);
+
+private:
+    friend class RS485SimulatedBus;
+
+    static const uint16_t kReceiveBufferSize = 256;
+
+    RS485SimulatedBus &bus_;
+    RS485SimulatedBus &receive_bus_;
+    uint8_t de_pin_;
+    uint8_t re_pin_;
+    bool attached_;
+    bool receive_attached_;
+
+    // End of the last character of this port on the wire, rounded up by transmit_credit_ / baudrate microseconds
+    unsigned long transmit_end_time_;
+    unsigned long transmit_credit_;
+    RS485RingBuffer<kReceiveBufferSize> receive_buffer_;
+};
+
+#endif // ARDUINO
+
+#endif // MAX485TTL_SIMULATED_BUS_HPP_
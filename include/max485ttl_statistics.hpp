@@ -0,0 +1,171 @@
+/**
+ * @file max485ttl_statistics.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Counters and histograms kept by RS485 when MAX485TTL_INSTRUMENTATION is defined
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_STATISTICS_HPP_
+#define MAX485TTL_STATISTICS_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Histogram with power of two buckets, bucket 0 holds 0, bucket n holds 2^(n-1) up to 2^n - 1
+ * and the last bucket everything above.
+ *
+ */
+class RS485Histogram
+{
+public:
+    static const uint8_t kBuckets = 16;
+
+    RS485Histogram(void)
+    {
+        Reset();
+    }
+
+    /**
+     * @brief Add a value to its bucket.
+     *
+     * @param value value to count.
+     */
+    void Add(unsigned long value)
+    {
+        uint8_t bucket = 0;
+        while (value && bucket < kBuckets - 1)
+        {
+            value >>= 1;
+            bucket++;
+        }
+        counts_[bucket]++;
+    }
+
+    /**
+     * @brief Get the amount of values in a bucket.
+     *
+     * @param bucket index of the bucket.
+     * @return uint32_t amount of values, 0 for an invalid bucket.
+     */
+    uint32_t GetCount(const uint8_t bucket) const
+    {
+        return bucket < kBuckets ? counts_[bucket] : 0;
+    }
+
+    /**
+     * @brief Get the amount of values in all buckets.
+     *
+     * @return uint32_t amount of values.
+     */
+    uint32_t GetTotal(void) const
+    {
+        uint32_t total = 0;
+        for (uint8_t i = 0; i < kBuckets; i++)
+        {
+            total += counts_[i];
+        }
+        return total;
+    }
+
+    /**
+     * @brief Get the largest value counted in a bucket.
+     *
+     * @param bucket index of the bucket.
+     * @return unsigned long upper limit, the last bucket has no limit and returns the maximum of unsigned long.
+     */
+    static unsigned long GetBucketLimit(const uint8_t bucket)
+    {
+        return bucket < kBuckets - 1 ? (1UL << bucket) - 1 : static_cast<unsigned long>(-1);
+    }
+
+    /**
+     * @brief Get the upper limit of the bucket holding a percentile, an estimate with a factor two resolution.
+     *
+     * @param percent percentile from 0 to 100.
+     * @return unsigned long upper limit of the bucket, 0 if the histogram is empty.
+     */
+    unsigned long GetPercentile(const uint8_t percent) const
+    {
+        uint32_t total = GetTotal();
+        if (total == 0)
+        {
+            return 0;
+        }
+
+        // Rank of the value, rounded up so the 100th percentile is the last value
+        uint32_t rank = static_cast<uint32_t>((static_cast<uint64_t>(total) * percent + 99) / 100);
+        uint32_t seen = 0;
+        for (uint8_t i = 0; i < kBuckets; i++)
+        {
+            seen += counts_[i];
+            if (seen >= rank && seen)
+            {
+                return GetBucketLimit(i);
+            }
+        }
+        return GetBucketLimit(kBuckets - 1);
+    }
+
+    void Reset(void)
+    {
+        for (uint8_t i = 0; i < kBuckets; i++)
+        {
+            counts_[i] = 0;
+        }
+    }
+
+private:
+    uint32_t counts_[kBuckets];
+};
+
+/**
+ * @brief Snapshot of the statistics of a RS485 module, see RS485::GetStatistics().
+ *
+ */
+struct RS485Statistics
+{
+    RS485Statistics(void)
+    {
+        Reset();
+    }
+
+    void Reset(void)
+    {
+        bytes_sent = 0;
+        bytes_received = 0;
+        transmissions = 0;
+        direction_switches = 0;
+        receive_overflows = 0;
+        timeouts = 0;
+        response_latency.Reset();
+        frame_size.Reset();
+        idle_gap.Reset();
+    }
+
+    // Bytes written to the stream
+    uint32_t bytes_sent;
+    // Bytes read from the stream
+    uint32_t bytes_received;
+    // BeginTransmission() calls
+    uint32_t transmissions;
+    // Changes of the DE/RE pins by SetMode()
+    uint32_t direction_switches;
+    // Frames which did not fit into the receive buffer
+    uint32_t receive_overflows;
+    // Receive timeouts of Poll()
+    uint32_t timeouts;
+
+    // Microseconds from the end of a transmission to the first byte read
+    RS485Histogram response_latency;
+    // Bytes per received frame
+    RS485Histogram frame_size;
+    // Microseconds between the end of the last transmission or received frame and the start of a transmission
+    RS485Histogram idle_gap;
+};
+
+#endif // MAX485TTL_STATISTICS_HPP_
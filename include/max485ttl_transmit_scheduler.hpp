@@ -0,0 +1,175 @@
+/**
+ * @file max485ttl_transmit_scheduler.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Transmit scheduler letting urgent frames of the MAX485TTL modules go ahead of a bulk transfer
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_TRANSMIT_SCHEDULER_HPP_
+#define MAX485TTL_TRANSMIT_SCHEDULER_HPP_
+
+#include "max485ttl_queue.hpp"
+
+/**
+ * @brief High priority frame waiting in a RS485TransmitScheduler, the storage of these is given to the scheduler.
+ *
+ */
+struct RS485SchedulerSlot
+{
+    unsigned long enqueue_time;
+    size_t length;
+    uint8_t data[MAX485TTL_QUEUE_FRAME_SIZE];
+};
+
+/**
+ * @brief Counters of a RS485TransmitScheduler.
+ *
+ */
+struct RS485SchedulerStatistics
+{
+    uint32_t frames_sent;
+    uint32_t frames_dropped;
+    uint32_t chunks_sent;
+    // High priority frames sent between two chunks of a bulk transfer
+    uint32_t preemptions;
+    // Longest time from Enqueue() until the frame was passed to the stream, in microseconds
+    unsigned long max_latency;
+};
+
+/**
+ * @brief Transmit scheduler with two priority classes: high priority frames (emergency stop, time sync)
+ * and one bulk transfer (log upload) which is split into chunks.
+ * Poll() never blocks: it passes one frame or chunk to the stream and returns, the next one follows when the last stop bit
+ * of the previous one plus the frame gap has passed. High priority frames are sent first, so they wait for at most
+ * the chunk on the wire, see GetLatencyBound(). The module stays in output until nothing is left to send.
+ * The bulk data is not copied and must stay valid until the transfer is done.
+ * The frame format must be set on the RS485 module (SetFrameFormat()), otherwise every frame waits until it has been sent.
+ */
+class RS485TransmitScheduler
+{
+public:
+    /**
+     * @brief Construct a new transmit scheduler
+     *
+     * @param rs485 module used to send.
+     * @param slots storage of the high priority frames, its length is the depth of the queue.
+     * @param depth amount of slots, at least 1.
+     */
+    RS485TransmitScheduler(RS485 &rs485, RS485SchedulerSlot *const slots, const size_t depth);
+
+    /**
+     * @brief Set the size of the chunks of a bulk transfer, smaller chunks lower the latency of high priority frames.
+     * Keep it at most the size of the transmit buffer of the stream (64 on AVR) so Poll() does not block.
+     *
+     * @param size chunk size in bytes, default 32.
+     */
+    void SetChunkSize(const size_t size);
+
+    /**
+     * @brief Set the silence between two frames or chunks, for example t3.5 when the receiver separates frames by silence.
+     *
+     * @param gap_in_microsecond gap in microseconds, default 0.
+     */
+    void SetFrameGap(const unsigned long gap_in_microsecond);
+
+    /**
+     * @brief Queue a high priority frame, it is sent before the next chunk of the bulk transfer.
+     *
+     * @param frame bytes of the frame.
+     * @param length length of the frame, at most MAX485TTL_QUEUE_FRAME_SIZE.
+     * @return true if queued, false if the queue is full or the frame too long.
+     */
+    bool Enqueue(const uint8_t *const frame, const size_t length);
+
+    /**
+     * @brief Start a bulk transfer.
+     *
+     * @param data bytes to send, must stay valid until IsBulkActive() returns false.
+     * @param length amount of bytes.
+     * @return true if started, false if another transfer is active.
+     */
+    bool StartBulk(const uint8_t *const data, const size_t length);
+
+    /**
+     * @brief Stop the bulk transfer after the chunk on the wire.
+     *
+     */
+    void CancelBulk(void);
+
+    /**
+     * @brief Check if a bulk transfer has bytes left.
+     *
+     * @return true while bytes are left.
+     */
+    bool IsBulkActive(void);
+
+    /**
+     * @brief Get the amount of bytes of the bulk transfer which are not sent yet.
+     *
+     * @return size_t bytes left.
+     */
+    size_t GetBulkRemaining(void);
+
+    /**
+     * @brief Send the next frame or chunk when the wire is free, call it from loop().
+     *
+     * @return true while frames or chunks are waiting or on the wire.
+     */
+    bool Poll(void);
+
+    /**
+     * @brief Get the worst case time from Enqueue() of a high priority frame until it is sent, when Poll() is called
+     * continuously: a full chunk on the wire and a full queue of frames ahead of it, each followed by the frame gap.
+     * The time between two Poll() calls comes on top of it.
+     *
+     * @return unsigned long bound in microseconds.
+     */
+    unsigned long GetLatencyBound(void);
+
+    /**
+     * @brief Get the counters of the scheduler.
+     *
+     * @return const RS485SchedulerStatistics& counters since construction or ResetStatistics().
+     */
+    const RS485SchedulerStatistics &GetStatistics(void);
+
+    /**
+     * @brief Clear the counters.
+     *
+     */
+    void ResetStatistics(void);
+
+private:
+    static const size_t kDefaultChunkSize = 32;
+
+    /**
+     * @brief Start the transmission or wait the gap, then pass bytes to the stream.
+     *
+     */
+    void SendFrame(const uint8_t *const data, const size_t length);
+
+    RS485 &rs485_;
+    RS485SchedulerSlot *slots_;
+    size_t depth_;
+
+    // Oldest high priority frame and amount of frames queued
+    size_t head_;
+    size_t count_;
+
+    const uint8_t *bulk_data_;
+    size_t bulk_remaining_;
+    size_t chunk_size_;
+
+    unsigned long frame_gap_;
+    bool transmitting_;
+    // Time the line is free for the next frame: last stop bit of the previous frame plus the gap
+    unsigned long free_time_;
+
+    RS485SchedulerStatistics statistics_;
+};
+
+#endif // MAX485TTL_TRANSMIT_SCHEDULER_HPP_
@@ -0,0 +1,201 @@
+/**
+ * @file max485ttl_typed.hpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief RS485 variant which knows the concrete type of the stream so the hot path calls can be inlined
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAX485TTL_TYPED_HPP_
+#define MAX485TTL_TYPED_HPP_
+
+#include "max485ttl.hpp"
+
+/**
+ * @brief RS485 module bound to a stream of a known type (HardwareSerial, MemoryStream, PosixSerial).
+ * The available(), read(), peek() and write() functions call the stream with a qualified name,
+ * which skips the virtual call and the null check so the compiler can inline them.
+ * They are final, so calls through a RS485Typed need no virtual call either.
+ * Everything else, including transactions, is inherited from RS485, so it can still be used through a RS485 pointer.
+ *
+ * @tparam SerialType concrete stream type.
+ */
+template <class SerialType>
+class RS485Typed : public RS485
+{
+public:
+    /**
+     * @brief Constructor using only the necessary.
+     *
+     * @param de_pin Driver output enable pin number.
+     * @param re_pin Receiver output enable pin number.
+     * @param serial Stream to which the data needs to be send.
+     * Stream must be opened before passing to this object (Serial.begin(Baudrate))..
+     */
+    RS485Typed(const uint8_t de_pin, const uint8_t re_pin, SerialType &serial) : RS485(de_pin, re_pin, &serial), typed_serial_(serial) {}
+
+    /**
+     * @brief Get the number of bytes available in the input buffer.
+     *
+     * @return Number of bytes available.
+     */
+    int available(void) final
+    {
+        EndImplicitTransmission();
+        return typed_serial_.SerialType::available();
+    }
+
+    /**
+     * @brief Read the first byte of the incomming data.
+     *
+     * @return first byte or -1 if not available.
+     */
+    int read(void) final
+    {
+        EndImplicitTransmission();
+        int c = typed_serial_.SerialType::read();
+        if (c >= 0)
+        {
+            RecordReceived(1);
+            uint8_t data = static_cast<uint8_t>(c);
+            Capture(RS485CaptureDirection::kReceive, &data, 1);
+            if (GetReceiveCrcType() != CrcType::kNone)
+            {
+                UpdateReceiveCrc(&data, 1);
+            }
+        }
+        return c;
+    }
+
+    /**
+     * @brief Copy all bytes currently available into a buffer, does not wait for more data.
+     *
+     * @param buffer destination of the received bytes.
+     * @param length maximum amount of bytes to copy into buffer.
+     * @return amount of bytes copied.
+     */
+    size_t read(uint8_t *const buffer, const size_t length)
+    {
+        EndImplicitTransmission();
+        int available_bytes = typed_serial_.SerialType::available();
+        if (available_bytes <= 0)
+        {
+            return 0;
+        }
+
+        size_t amount = static_cast<size_t>(available_bytes) < length ? static_cast<size_t>(available_bytes) : length;
+        for (size_t i = 0; i < amount; i++)
+        {
+            int c = typed_serial_.SerialType::read();
+            if (c < 0)
+            {
+                amount = i;
+                break;
+            }
+            buffer[i] = static_cast<uint8_t>(c);
+        }
+
+        RecordReceived(amount);
+        Capture(RS485CaptureDirection::kReceive, buffer, amount);
+        UpdateReceiveCrc(buffer, amount);
+        return amount;
+    }
+    using RS485::read;
+
+    /**
+     * @brief Look at the first byte of the input buffer without taking it out.
+     *
+     * @return First character of the buffer, -1 if not available.
+     */
+    int peek(void) final
+    {
+        EndImplicitTransmission();
+        return typed_serial_.SerialType::peek();
+    }
+
+    /**
+     * @brief Send a single byte, in a transmission it is added to the transmit buffer.
+     *
+     * @param data the byte that will be sent.
+     * @return amount of bytes accepted.
+     */
+    size_t write(const uint8_t data) final
+    {
+        if (Stage(&data, 1))
+        {
+            return 1;
+        }
+
+        AddTransmissionTime(1, micros());
+        Capture(RS485CaptureDirection::kTransmit, &data, 1);
+        return typed_serial_.SerialType::write(data);
+    }
+
+    /**
+     * @brief Send a buffer, in a transmission a buffer which fits is added to the transmit buffer.
+     *
+     * @param buffer the bytes that will be sent.
+     * @param length amount of bytes in buffer.
+     * @return amount of bytes accepted.
+     */
+    size_t write(const uint8_t *const buffer, const size_t length) final
+    {
+        if (Stage(buffer, length))
+        {
+            return length;
+        }
+
+        return WriteStream(buffer, length);
+    }
+
+    size_t write(const char *const buffer, const size_t length)
+    {
+        return write(reinterpret_cast<const uint8_t *>(buffer), length);
+    }
+    using RS485::write;
+
+    /**
+     * @brief Get the stream this module is bound to.
+     *
+     * @return SerialType& the stream.
+     */
+    SerialType &GetSerial(void)
+    {
+        return typed_serial_;
+    }
+
+protected:
+    /**
+     * @brief Write to the stream, offering the remainder again when the stream accepts only part of it.
+     *
+     * @param buffer the bytes.
+     * @param length amount of bytes.
+     * @return size_t amount of bytes accepted by the stream.
+     */
+    size_t WriteStream(const uint8_t *const buffer, const size_t length) override
+    {
+        unsigned long write_time = micros();
+        size_t written = 0;
+        while (written < length)
+        {
+            size_t accepted = typed_serial_.SerialType::write(buffer + written, length - written);
+            if (accepted == 0)
+            {
+                break;
+            }
+            written += accepted;
+        }
+
+        AddTransmissionTime(written, write_time);
+        Capture(RS485CaptureDirection::kTransmit, buffer, written);
+        return written;
+    }
+
+private:
+    SerialType &typed_serial_;
+};
+
+#endif // MAX485TTL_TYPED_HPP_
@@ -9,29 +9,72 @@
  *
  */
 
-#include <Arduino.h>
 #include "max485ttl.hpp"
 
+#include <string.h>
+
 RS485::RS485(const uint8_t de_pin, const uint8_t re_pin, Stream *const serial)
 {
     this->de_pin_ = de_pin;
     this->re_pin_ = re_pin;
     this->serial_ = serial;
+    this->character_time_ = 0;
+    this->baudrate_ = 0;
+    this->bits_per_character_ = 0;
+    this->full_duplex_ = false;
+    this->in_transmission_ = false;
+    this->implicit_transmission_ = false;
+    this->transmission_start_time_ = 0;
+    this->transmission_bits_ = 0;
+    this->transmission_end_time_ = 0;
+    this->transmit_length_ = 0;
+    InitialiseReceive();
+    this->frame_gap_ = kDefaultFrameGap;
+    this->receive_crc_type_ = CrcType::kNone;
+    this->receive_crc_ = 0;
+    this->capture_ = nullptr;
 
-    pinMode(de_pin, OUTPUT);
-    pinMode(re_pin, OUTPUT);
+    if (de_pin != kNoPin)
+    {
+        pinMode(de_pin, OUTPUT);
+    }
+    if (re_pin != kNoPin)
+    {
+        pinMode(re_pin, OUTPUT);
+    }
 
     // Initialise as unset
     mode_ = -1;
     SetMode(INPUT);
+#ifdef MAX485TTL_INSTRUMENTATION
+    ResetStatistics();
+#endif
 };
 
-RS485::RS485(const RS485 &rs485)
+RS485::RS485(const RS485 &rs485) : Stream(rs485)
 {
     this->de_pin_ = rs485.de_pin_;
     this->re_pin_ = rs485.re_pin_;
     this->serial_ = rs485.serial_;
     this->mode_ = rs485.mode_;
+    this->character_time_ = rs485.character_time_;
+    this->baudrate_ = rs485.baudrate_;
+    this->bits_per_character_ = rs485.bits_per_character_;
+    this->full_duplex_ = rs485.full_duplex_;
+    this->in_transmission_ = false;
+    this->implicit_transmission_ = false;
+    this->transmission_start_time_ = 0;
+    this->transmission_bits_ = 0;
+    this->transmission_end_time_ = 0;
+    this->transmit_length_ = 0;
+    InitialiseReceive();
+    this->frame_gap_ = rs485.frame_gap_;
+    this->receive_crc_type_ = rs485.receive_crc_type_;
+    ResetReceiveCrc();
+    this->capture_ = nullptr;
+#ifdef MAX485TTL_INSTRUMENTATION
+    ResetStatistics();
+#endif
 };
 
 RS485::~RS485()
@@ -41,39 +84,79 @@ RS485::~RS485()
 
 void RS485::SetMode(uint8_t new_mode)
 {
-    if (mode_ == new_mode)
+    if (new_mode != INPUT && new_mode != OUTPUT)
     {
         return;
     }
 
-    if (new_mode == INPUT)
+    if (new_mode == INPUT && in_transmission_ && !full_duplex_)
     {
-        digitalWrite(de_pin_, LOW);
-        if (re_pin_ != de_pin_)
-        {
-            digitalWrite(re_pin_, LOW);
-        }
+        // Bytes still in the transmit buffer must be on the wire before the driver is disabled, EndTransmission() switches back
+        EndTransmission();
+        return;
+    }
+
+    if (mode_ == new_mode || full_duplex_)
+    {
+        return;
+    }
+
+#ifdef MAX485TTL_INSTRUMENTATION
+    statistics_.direction_switches++;
+#endif
+    WriteDirection(new_mode == OUTPUT ? HIGH : LOW);
+    mode_ = new_mode;
+}
+
+void RS485::WriteDirection(const uint8_t value)
+{
+    WritePin(de_pin_, value);
+    if (re_pin_ != de_pin_)
+    {
+        WritePin(re_pin_, value);
+    }
+}
 
-        mode_ = new_mode;
+void RS485::WritePin(const uint8_t pin, const uint8_t value)
+{
+    if (pin != kNoPin)
+    {
+        digitalWrite(pin, value);
+    }
+}
+
+void RS485::SetFullDuplex(const bool full_duplex)
+{
+    if (full_duplex == full_duplex_)
+    {
         return;
     }
-    else if (new_mode == OUTPUT)
+
+    if (in_transmission_)
+    {
+        EndTransmission();
+    }
+
+    if (full_duplex)
     {
-        digitalWrite(de_pin_, HIGH);
+        // Driver and receiver both stay enabled, they use separate pairs
+        WritePin(de_pin_, HIGH);
         if (re_pin_ != de_pin_)
         {
-            digitalWrite(re_pin_, HIGH);
+            WritePin(re_pin_, LOW);
         }
-
-        mode_ = new_mode;
+        mode_ = OUTPUT;
+        full_duplex_ = true;
         return;
     }
 
-    return;
+    full_duplex_ = false;
+    SetMode(INPUT);
 }
 
-int32_t RS485::available(void)
+int RS485::available(void)
 {
+    EndImplicitTransmission();
     if (serial_)
     {
         return serial_->available();
@@ -82,8 +165,9 @@ int32_t RS485::available(void)
     return -1;
 }
 
-int32_t RS485::peek(void)
+int RS485::peek(void)
 {
+    EndImplicitTransmission();
     if (serial_)
     {
         return serial_->peek();
@@ -92,68 +176,517 @@ int32_t RS485::peek(void)
     return -1;
 }
 
-int32_t RS485::read(void)
+int RS485::read(void)
 {
+    EndImplicitTransmission();
     if (serial_)
     {
-        return serial_->read();
+        int c = serial_->read();
+        if (c >= 0)
+        {
+            RecordReceived(1);
+            uint8_t data = static_cast<uint8_t>(c);
+            Capture(RS485CaptureDirection::kReceive, &data, 1);
+            if (receive_crc_type_ != CrcType::kNone)
+            {
+                UpdateReceiveCrc(&data, 1);
+            }
+        }
+        return c;
     }
 
     return -1;
 }
 
-size_t RS485::write(const uint8_t data)
+size_t RS485::read(uint8_t *const buffer, const size_t length)
 {
-    if (serial_)
+    EndImplicitTransmission();
+    if (!serial_)
     {
-        return serial_->write(data);
+        return 0;
     }
 
-    return -1;
+    size_t amount = ReadStream(buffer, length);
+    RecordReceived(amount);
+    Capture(RS485CaptureDirection::kReceive, buffer, amount);
+    UpdateReceiveCrc(buffer, amount);
+    return amount;
 }
 
-size_t RS485::write(const char data)
+size_t RS485::read(uint8_t *const buffer, const size_t length, const unsigned long timeout_in_millisecond)
 {
-    if (serial_)
+    unsigned long start_time = millis();
+    size_t received = read(buffer, length);
+    while (received < length && (millis() - start_time) < timeout_in_millisecond)
     {
-        return serial_->write(data);
+        received += read(buffer + received, length - received);
     }
 
-    return -1;
+    return received;
+}
+
+size_t RS485::write(const uint8_t data)
+{
+    if (!serial_)
+    {
+        return 0;
+    }
+
+    if (Stage(&data, 1))
+    {
+        return 1;
+    }
+
+    AddTransmissionTime(1, micros());
+    Capture(RS485CaptureDirection::kTransmit, &data, 1);
+    return serial_->write(data);
+}
+
+size_t RS485::write(const char data)
+{
+    return write(static_cast<uint8_t>(data));
 }
 
 size_t RS485::write(const uint8_t *const buffer, const size_t length)
 {
-    for (size_t i = 0; i < length; i++)
+    if (!serial_)
     {
-        write(buffer[i]);
+        return 0;
     }
-    return length;
+
+    if (Stage(buffer, length))
+    {
+        return length;
+    }
+
+    return WriteStream(buffer, length);
 }
 
 size_t RS485::write(const char *const buffer, const size_t length)
 {
-    for (size_t i = 0; i < length; i++)
+    return write(reinterpret_cast<const uint8_t *>(buffer), length);
+}
+
+bool RS485::Stage(const uint8_t *const data, const size_t length)
+{
+    if (!in_transmission_)
+    {
+        // After SetMode(OUTPUT) by hand the bytes go to the stream directly, the application decides when to switch back
+        if (mode_ != INPUT && !full_duplex_)
+        {
+            return false;
+        }
+        BeginTransmission();
+        implicit_transmission_ = true;
+    }
+
+    if (length > kTransmitBufferSize - transmit_length_)
+    {
+        FlushTransmitBuffer();
+        if (length > kTransmitBufferSize)
+        {
+            // Already in one piece, copying it would only cost time
+            return false;
+        }
+    }
+
+    memcpy(transmit_buffer_ + transmit_length_, data, length);
+    transmit_length_ += length;
+    return true;
+}
+
+void RS485::FlushTransmitBuffer(void)
+{
+    if (transmit_length_)
     {
-        write(buffer[i]);
+        WriteStream(transmit_buffer_, transmit_length_);
+        transmit_length_ = 0;
     }
-    return length;
+}
+
+size_t RS485::ReadStream(uint8_t *const buffer, const size_t length)
+{
+    int available_bytes = serial_->available();
+    if (available_bytes <= 0)
+    {
+        return 0;
+    }
+
+    size_t amount = static_cast<size_t>(available_bytes) < length ? static_cast<size_t>(available_bytes) : length;
+    for (size_t i = 0; i < amount; i++)
+    {
+        int c = serial_->read();
+        if (c < 0)
+        {
+            return i;
+        }
+        buffer[i] = static_cast<uint8_t>(c);
+    }
+
+    return amount;
+}
+
+size_t RS485::WriteStream(const uint8_t *const buffer, const size_t length)
+{
+    // A write larger than the transmit buffer of the stream blocks while it drains, the UART started before it returns
+    unsigned long write_time = micros();
+    size_t written = 0;
+    while (written < length)
+    {
+        // Streams may accept less than offered (full transmit buffer), offer the remaining chunk again
+        size_t accepted = serial_->write(buffer + written, length - written);
+        if (accepted == 0)
+        {
+            break;
+        }
+        written += accepted;
+    }
+
+    AddTransmissionTime(written, write_time);
+    Capture(RS485CaptureDirection::kTransmit, buffer, written);
+    return written;
 }
 
 void RS485::flush(void)
 {
+    if (implicit_transmission_)
+    {
+        EndTransmission();
+        return;
+    }
+
+    FlushTransmitBuffer();
+    if (serial_)
+    {
+        serial_->flush();
+    }
+}
+
+void RS485::SetFrameFormat(const unsigned long baudrate, const uint8_t bits_per_character)
+{
+    baudrate_ = baudrate;
+    bits_per_character_ = bits_per_character;
+    if (baudrate == 0)
+    {
+        character_time_ = 0;
+        return;
+    }
+
+    // Round up so the wait is never shorter than the real character
+    character_time_ = (bits_per_character * 1000000UL + baudrate - 1) / baudrate;
+}
+
+unsigned long RS485::GetCharacterTime(void)
+{
+    return character_time_;
+}
+
+void RS485::AddTransmissionTime(const size_t length, const unsigned long write_time)
+{
+#ifdef MAX485TTL_INSTRUMENTATION
+    statistics_.bytes_sent += length;
+#endif
+    if (!in_transmission_ || character_time_ == 0)
+    {
+        return;
+    }
+
+    // The UART starts sending immediately when idle, otherwise the new bytes queue behind the previous ones
+    if ((long)(write_time - transmission_end_time_) > 0)
+    {
+        transmission_start_time_ = write_time;
+        transmission_bits_ = 0;
+    }
+
+    // The bits are counted and divided once, rounding every character up would add up to a microsecond per character
+    transmission_bits_ += length * bits_per_character_;
+    transmission_end_time_ = transmission_start_time_ + static_cast<unsigned long>((static_cast<uint64_t>(transmission_bits_) * 1000000UL + baudrate_ - 1) / baudrate_);
+}
+
+void RS485::BeginTransmission(void)
+{
+    if (in_transmission_)
+    {
+        // Bytes written before belong to the same transmission
+        implicit_transmission_ = false;
+        return;
+    }
+
+#ifdef MAX485TTL_INSTRUMENTATION
+    statistics_.transmissions++;
+    unsigned long now = micros();
+    if (frame_bytes_)
+    {
+        // The end of the bytes read since the last frame is unknown, so the gap is not counted
+        RecordFrameEnd(now);
+    }
+    else
+    {
+        statistics_.idle_gap.Add(now - last_activity_time_);
+    }
+#endif
+    SetMode(OUTPUT);
+    in_transmission_ = true;
+    transmission_end_time_ = micros();
+    transmission_start_time_ = transmission_end_time_;
+    transmission_bits_ = 0;
+}
+
+void RS485::EndTransmission(void)
+{
+    implicit_transmission_ = false;
+    if (full_duplex_)
+    {
+        // The driver stays enabled, so the stream sends the bytes while the application goes on
+        FlushTransmitBuffer();
+    }
+    else
+    {
+        flush();
+
+        // flush() only guarantees the data left the buffer on some cores, wait until the last stop bit is on the wire
+        if (in_transmission_ && character_time_ != 0)
+        {
+            while ((long)(transmission_end_time_ - micros()) > 0)
+            {
+            }
+        }
+    }
+
+    in_transmission_ = false;
+    SetMode(INPUT);
+#ifdef MAX485TTL_INSTRUMENTATION
+    last_activity_time_ = micros();
+    response_start_time_ = last_activity_time_;
+    awaiting_response_ = true;
+#endif
+}
+
+unsigned long RS485::GetRemainingTransmissionTime(void)
+{
+    if (!in_transmission_ || character_time_ == 0)
+    {
+        return 0;
+    }
+
+    long remaining = (long)(transmission_end_time_ - micros());
+    return remaining > 0 ? static_cast<unsigned long>(remaining) : 0;
+}
+
+void RS485::InsertGap(const unsigned long gap_in_microsecond)
+{
+    FlushTransmitBuffer();
     if (serial_)
     {
         serial_->flush();
     }
+
+    // The gap starts at the last stop bit, which can still be ahead when flush() only emptied the buffer
+    unsigned long gap_end = micros();
+    if (in_transmission_ && character_time_ != 0 && (long)(transmission_end_time_ - gap_end) > 0)
+    {
+        gap_end = transmission_end_time_;
+    }
+    gap_end += gap_in_microsecond;
+    while ((long)(gap_end - micros()) > 0)
+    {
+    }
+}
+
+size_t RS485::Send(const uint8_t *const buffer, const size_t length)
+{
+    BeginTransmission();
+    size_t written = write(buffer, length);
+    EndTransmission();
+
+    return written;
+}
+
+size_t RS485::Send(const char *const buffer, const size_t length)
+{
+    return Send(reinterpret_cast<const uint8_t *>(buffer), length);
+}
+
+void RS485::SetCapture(RS485Capture *capture)
+{
+    capture_ = capture;
+}
+
+void RS485::SetReceiveCrc(const CrcType type)
+{
+    receive_crc_type_ = type;
+    ResetReceiveCrc();
+}
+
+RS485::CrcType RS485::GetReceiveCrcType(void)
+{
+    return receive_crc_type_;
+}
+
+void RS485::ResetReceiveCrc(void)
+{
+    receive_crc_ = receive_crc_type_ == CrcType::kCrc16Modbus ? kCrc16ModbusInitial : kCrc8Initial;
+}
+
+uint16_t RS485::GetReceiveCrc(void)
+{
+    return receive_crc_;
+}
+
+bool RS485::IsReceiveCrcValid(void)
+{
+    return receive_crc_type_ != CrcType::kNone && receive_crc_ == 0;
+}
+
+void RS485::UpdateReceiveCrc(const uint8_t *const data, const size_t length)
+{
+    switch (receive_crc_type_)
+    {
+    case CrcType::kCrc16Modbus:
+        receive_crc_ = Crc16Modbus(data, length, receive_crc_);
+        break;
+    case CrcType::kCrc8:
+        receive_crc_ = Crc8(data, length, static_cast<uint8_t>(receive_crc_));
+        break;
+    default:
+        break;
+    }
+}
+
+#ifdef MAX485TTL_INSTRUMENTATION
+RS485Statistics RS485::GetStatistics(void)
+{
+    return statistics_;
+}
+
+void RS485::ResetStatistics(void)
+{
+    statistics_.Reset();
+    frame_bytes_ = 0;
+    last_activity_time_ = micros();
+    response_start_time_ = 0;
+    awaiting_response_ = false;
+}
+#endif
+
+void RS485::InitialiseReceive(void)
+{
+    receive_state_ = ReceiveState::kIdle;
+    receive_start_time_ = 0;
+    receive_timeout_ = 0;
+    last_byte_time_ = 0;
+    last_available_ = 0;
+    first_byte_callback_ = nullptr;
+    first_byte_context_ = nullptr;
+    frame_complete_callback_ = nullptr;
+    frame_complete_context_ = nullptr;
+    timeout_callback_ = nullptr;
+    timeout_context_ = nullptr;
+}
+
+void RS485::StartReceive(const unsigned long timeout_in_millisecond)
+{
+    if (in_transmission_)
+    {
+        EndTransmission();
+    }
+    SetMode(INPUT);
+    RecordFrameEnd(micros());
+    receive_state_ = ReceiveState::kWaiting;
+    receive_start_time_ = millis();
+    receive_timeout_ = timeout_in_millisecond;
+    last_available_ = 0;
+}
+
+RS485::ReceiveState RS485::Poll(void)
+{
+    switch (receive_state_)
+    {
+    case ReceiveState::kWaiting:
+    {
+        int available_bytes = available();
+        if (available_bytes > 0)
+        {
+            receive_state_ = ReceiveState::kReceiving;
+            last_available_ = available_bytes;
+            last_byte_time_ = micros();
+            if (first_byte_callback_)
+            {
+                first_byte_callback_(*this, first_byte_context_);
+            }
+        }
+        else if (millis() - receive_start_time_ >= receive_timeout_)
+        {
+            receive_state_ = ReceiveState::kTimeout;
+#ifdef MAX485TTL_INSTRUMENTATION
+            statistics_.timeouts++;
+#endif
+            if (timeout_callback_)
+            {
+                timeout_callback_(*this, timeout_context_);
+            }
+        }
+        break;
+    }
+    case ReceiveState::kReceiving:
+    {
+        // A changed amount means new data arrived (or the application read some), both restart the gap
+        int available_bytes = available();
+        if (available_bytes != last_available_)
+        {
+            last_available_ = available_bytes;
+            last_byte_time_ = micros();
+        }
+        else if (micros() - last_byte_time_ >= frame_gap_)
+        {
+            receive_state_ = ReceiveState::kComplete;
+            if (frame_complete_callback_)
+            {
+                frame_complete_callback_(*this, frame_complete_context_);
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    return receive_state_;
+}
+
+RS485::ReceiveState RS485::GetReceiveState(void)
+{
+    return receive_state_;
+}
+
+void RS485::SetFrameGap(const unsigned long gap_in_microsecond)
+{
+    frame_gap_ = gap_in_microsecond;
+}
+
+void RS485::SetFirstByteCallback(RS485Callback callback, void *context)
+{
+    first_byte_callback_ = callback;
+    first_byte_context_ = context;
+}
+
+void RS485::SetFrameCompleteCallback(RS485Callback callback, void *context)
+{
+    frame_complete_callback_ = callback;
+    frame_complete_context_ = context;
+}
+
+void RS485::SetTimeoutCallback(RS485Callback callback, void *context)
+{
+    timeout_callback_ = callback;
+    timeout_context_ = context;
 }
 
 void RS485::WaitForInput(const unsigned long TimeOutInMillisecond)
 {
-    unsigned long time = millis();
-    while (((millis() - time) < TimeOutInMillisecond) && !available())
+    StartReceive(TimeOutInMillisecond);
+    while (Poll() == ReceiveState::kWaiting)
     {
-        delay(1);
     }
 }
 
@@ -169,6 +702,24 @@ RS485 &RS485::operator=(const RS485 &otherRS485)
     this->re_pin_ = otherRS485.re_pin_;
     this->serial_ = otherRS485.serial_;
     mode_ = otherRS485.mode_;
+    character_time_ = otherRS485.character_time_;
+    baudrate_ = otherRS485.baudrate_;
+    bits_per_character_ = otherRS485.bits_per_character_;
+    full_duplex_ = otherRS485.full_duplex_;
+    in_transmission_ = false;
+    implicit_transmission_ = false;
+    transmission_start_time_ = 0;
+    transmission_bits_ = 0;
+    transmission_end_time_ = 0;
+    transmit_length_ = 0;
+    InitialiseReceive();
+    frame_gap_ = otherRS485.frame_gap_;
+    receive_crc_type_ = otherRS485.receive_crc_type_;
+    ResetReceiveCrc();
+    capture_ = nullptr;
+#ifdef MAX485TTL_INSTRUMENTATION
+    ResetStatistics();
+#endif
 
     return *this;
 }
\ No newline at end of file
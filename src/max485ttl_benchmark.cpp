@@ -0,0 +1,258 @@
+/**
+ * @file max485ttl_benchmark.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Throughput, latency and CPU benchmarks for RS485, runnable on hardware and on the simulated bus
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_benchmark.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    void Sort(unsigned long *const values, const size_t count)
+    {
+        // Insertion sort, the amount of samples is small and no library sort is available on AVR
+        for (size_t i = 1; i < count; i++)
+        {
+            unsigned long value = values[i];
+            size_t j = i;
+            while (j > 0 && values[j - 1] > value)
+            {
+                values[j] = values[j - 1];
+                j--;
+            }
+            values[j] = value;
+        }
+    }
+
+    uint32_t CyclesPerByteHundredths(const uint32_t cycles, const unsigned long bytes)
+    {
+        return static_cast<uint32_t>((static_cast<uint64_t>(cycles) * 100) / bytes);
+    }
+}
+
+RS485Benchmark::RS485Benchmark(RS485 &rs485, const unsigned long baudrate, RS485BenchmarkReport report, void *context)
+    : rs485_(rs485)
+{
+    this->baudrate_ = baudrate;
+    this->timeout_ = 1000;
+    this->report_ = report;
+    this->report_context_ = context;
+    this->poll_ = nullptr;
+    this->poll_context_ = nullptr;
+}
+
+void RS485Benchmark::SetPeerPoll(RS485BenchmarkPoll poll, void *context)
+{
+    poll_ = poll;
+    poll_context_ = context;
+}
+
+void RS485Benchmark::SetTimeout(const unsigned long timeout_in_millisecond)
+{
+    timeout_ = timeout_in_millisecond;
+}
+
+uint32_t RS485Benchmark::ReadCycles(void)
+{
+#if defined(__AVR__)
+    // micros() only moves in steps of 4 us, Timer1 counts every clock cycle but wraps after 65536 cycles.
+    // The wraps are taken from micros(), the low 16 bits from Timer1, no overflow interrupt is needed
+    static bool timer_started = false;
+    if (!timer_started)
+    {
+        TCCR1A = 0;
+        TCCR1B = _BV(CS10);
+        TCNT1 = static_cast<uint16_t>(micros() * clockCyclesPerMicrosecond());
+        timer_started = true;
+    }
+
+    uint8_t old_sreg = SREG;
+    cli();
+    uint32_t coarse = static_cast<uint32_t>(micros()) * clockCyclesPerMicrosecond();
+    uint16_t fine = TCNT1;
+    SREG = old_sreg;
+    return coarse + static_cast<int16_t>(fine - static_cast<uint16_t>(coarse));
+#elif defined(__x86_64__) || defined(__i386__)
+    return static_cast<uint32_t>(__builtin_ia32_rdtsc());
+#else
+    // Nanoseconds when no cycle counter is known
+    return static_cast<uint32_t>(micros()) * 1000;
+#endif
+}
+
+void RS485Benchmark::Report(const char *name, const uint32_t value_hundredths, const char *unit)
+{
+    char line[96];
+    snprintf(line, sizeof(line), "BENCHMARK %s baud=%lu value=%lu.%02lu unit=%s", name, baudrate_,
+             static_cast<unsigned long>(value_hundredths / 100), static_cast<unsigned long>(value_hundredths % 100), unit);
+    report_(line, report_context_);
+}
+
+size_t RS485Benchmark::Receive(uint8_t *const buffer, const size_t length)
+{
+    size_t received = 0;
+    unsigned long start_time = millis();
+    while (received < length && millis() - start_time < timeout_)
+    {
+        if (poll_)
+        {
+            poll_(poll_context_);
+        }
+        received += rs485_.read(buffer + received, length - received);
+    }
+
+    return received;
+}
+
+bool RS485Benchmark::MeasureThroughput(uint8_t *const buffer, const size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        buffer[i] = static_cast<uint8_t>(i * 31 + 7);
+    }
+
+    unsigned long start_time = micros();
+    rs485_.Send(buffer, length);
+    memset(buffer, 0, length);
+    size_t received = Receive(buffer, length);
+    unsigned long duration = micros() - start_time;
+
+    if (received != length)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        if (buffer[i] != static_cast<uint8_t>(i * 31 + 7))
+        {
+            return false;
+        }
+    }
+
+    // Payload of both directions over the whole exchange, including the turnaround of the echo module
+    uint32_t bytes_per_second = static_cast<uint32_t>((2ULL * length * 1000000ULL * 100) / (duration ? duration : 1));
+    Report("throughput", bytes_per_second, "bytes/s");
+    unsigned long character_time = rs485_.GetCharacterTime();
+    if (character_time)
+    {
+        uint32_t wire_bytes_per_second = 1000000UL / character_time;
+        Report("throughput_efficiency", static_cast<uint32_t>(static_cast<uint64_t>(bytes_per_second) * 100 / wire_bytes_per_second), "%");
+    }
+
+    return true;
+}
+
+bool RS485Benchmark::MeasureRoundTrip(unsigned long *const samples, const size_t count, const size_t frame_length)
+{
+    uint8_t frame[kMaxRoundTripFrame];
+    uint8_t echo[kMaxRoundTripFrame];
+    size_t length = frame_length < kMaxRoundTripFrame ? frame_length : kMaxRoundTripFrame;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        memset(frame, static_cast<int>(i), length);
+        unsigned long start_time = micros();
+        rs485_.Send(frame, length);
+        if (Receive(echo, length) != length || memcmp(frame, echo, length) != 0)
+        {
+            return false;
+        }
+        samples[i] = micros() - start_time;
+    }
+
+    Sort(samples, count);
+    Report("round_trip_p50", samples[count * 50 / 100] * 100, "us");
+    Report("round_trip_p90", samples[count * 90 / 100] * 100, "us");
+    Report("round_trip_p99", samples[count * 99 / 100] * 100, "us");
+    Report("round_trip_max", samples[count - 1] * 100, "us");
+
+    return true;
+}
+
+void RS485Benchmark::MeasureDirectionSwitch(const unsigned long iterations)
+{
+    rs485_.SetMode(INPUT);
+    uint32_t start_cycles = ReadCycles();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        rs485_.SetMode(OUTPUT);
+        rs485_.SetMode(INPUT);
+    }
+    uint32_t cycles = ReadCycles() - start_cycles;
+    Report("direction_switch", CyclesPerByteHundredths(cycles, iterations * 2), "cycles");
+
+    // Time EndTransmission() takes on top of the transmission of a single character
+    unsigned long overshoot = 0;
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        unsigned long start_time = micros();
+        rs485_.BeginTransmission();
+        rs485_.write(static_cast<uint8_t>(0x55));
+        rs485_.EndTransmission();
+        unsigned long duration = micros() - start_time;
+        unsigned long character_time = rs485_.GetCharacterTime();
+        overshoot += duration > character_time ? duration - character_time : 0;
+
+        // The echo of the character is not part of the benchmark, but must not end up in the next one
+        uint8_t echo;
+        Receive(&echo, 1);
+    }
+    Report("end_transmission_overshoot", static_cast<uint32_t>(overshoot * 100 / iterations), "us");
+}
+
+void RS485Benchmark::MeasureCpu(RS485 &rs485, const size_t length, const unsigned long iterations)
+{
+    uint8_t buffer[64];
+    size_t block = length < sizeof(buffer) ? length : sizeof(buffer);
+    unsigned long bytes = static_cast<unsigned long>(block) * iterations;
+
+    uint32_t start_cycles = ReadCycles();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        for (size_t j = 0; j < block; j++)
+        {
+            rs485.write(static_cast<uint8_t>(j));
+        }
+    }
+    // Writing in input mode collects the bytes in the transmit buffer, flush() passes the rest on
+    rs485.flush();
+    Report("cpu_write_byte", CyclesPerByteHundredths(ReadCycles() - start_cycles, bytes), "cycles/byte");
+
+    start_cycles = ReadCycles();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        rs485.write(buffer, block);
+    }
+    rs485.flush();
+    Report("cpu_write_buffer", CyclesPerByteHundredths(ReadCycles() - start_cycles, bytes), "cycles/byte");
+
+    uint8_t sink = 0;
+    start_cycles = ReadCycles();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        for (size_t j = 0; j < block; j++)
+        {
+            sink ^= static_cast<uint8_t>(rs485.read());
+        }
+    }
+    Report("cpu_read_byte", CyclesPerByteHundredths(ReadCycles() - start_cycles, bytes), "cycles/byte");
+
+    start_cycles = ReadCycles();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        rs485.read(buffer, block);
+        sink ^= buffer[0];
+    }
+    Report("cpu_read_buffer", CyclesPerByteHundredths(ReadCycles() - start_cycles, bytes), "cycles/byte");
+
+    // Keeps the reads from being optimised away
+    buffer[0] = sink;
+}
@@ -0,0 +1,334 @@
+/**
+ * @file max485ttl_capture.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Binary capture of the bytes sent and received by RS485, with decoders to CSV and pcap and a replay
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_capture.hpp"
+#include "max485ttl.hpp"
+
+#include <string.h>
+
+namespace
+{
+    const uint8_t kMaxRecordLength = 0xFF;
+
+    uint32_t ReadUint32(const uint8_t *const data)
+    {
+        return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 |
+               static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+    }
+}
+
+RS485Capture::RS485Capture(uint8_t *const buffer, const size_t size)
+{
+    this->buffer_ = buffer;
+    this->size_ = size;
+    this->merge_gap_ = kDefaultMergeGap;
+    Clear();
+}
+
+void RS485Capture::SetMergeGap(const unsigned long gap_in_microsecond)
+{
+    merge_gap_ = gap_in_microsecond;
+}
+
+void RS485Capture::Clear(void)
+{
+    tail_ = 0;
+    length_ = 0;
+    last_ = 0;
+    has_last_ = false;
+    last_time_ = 0;
+    dropped_count_ = 0;
+}
+
+size_t RS485Capture::Wrap(const size_t offset)
+{
+    // Offsets stay below twice the size, a subtraction is much cheaper than a division on AVR
+    size_t index = tail_ + offset;
+    return index < size_ ? index : index - size_;
+}
+
+uint8_t RS485Capture::ByteAt(const size_t offset)
+{
+    return buffer_[Wrap(offset)];
+}
+
+void RS485Capture::Put(const size_t offset, const uint8_t data)
+{
+    buffer_[Wrap(offset)] = data;
+}
+
+void RS485Capture::Copy(const size_t offset, const uint8_t *const data, const size_t length)
+{
+    size_t index = Wrap(offset);
+    size_t first = size_ - index < length ? size_ - index : length;
+    memcpy(buffer_ + index, data, first);
+    memcpy(buffer_, data + first, length - first);
+}
+
+void RS485Capture::MakeRoom(const size_t length)
+{
+    while (size_ - length_ < length && length_)
+    {
+        size_t record_length = RS485CaptureRecord::kHeaderLength + ByteAt(5);
+        if (has_last_ && last_ == 0)
+        {
+            has_last_ = false;
+        }
+        tail_ = Wrap(record_length);
+        length_ -= record_length;
+        if (has_last_)
+        {
+            last_ -= record_length;
+        }
+        dropped_count_++;
+    }
+}
+
+void RS485Capture::Add(const RS485CaptureDirection direction, const uint8_t *const data, const size_t length)
+{
+    unsigned long now = micros();
+    size_t added = 0;
+    while (added < length)
+    {
+        // Extend the newest record while it is the same run
+        if (has_last_ && static_cast<RS485CaptureDirection>(ByteAt(last_ + 4)) == direction &&
+            now - last_time_ <= merge_gap_ && ByteAt(last_ + 5) < kMaxRecordLength && length_ < size_)
+        {
+            uint8_t record_length = ByteAt(last_ + 5);
+            size_t amount = length - added;
+            amount = amount < static_cast<size_t>(kMaxRecordLength - record_length) ? amount : kMaxRecordLength - record_length;
+            amount = amount < size_ - length_ ? amount : size_ - length_;
+            Copy(length_, data + added, amount);
+            Put(last_ + 5, static_cast<uint8_t>(record_length + amount));
+            length_ += amount;
+            added += amount;
+            last_time_ = now;
+            continue;
+        }
+
+        size_t amount = length - added;
+        amount = amount < kMaxRecordLength ? amount : kMaxRecordLength;
+        if (RS485CaptureRecord::kHeaderLength + amount > size_)
+        {
+            // A run larger than the whole ring keeps its newest bytes
+            amount = size_ - RS485CaptureRecord::kHeaderLength;
+            added = length - amount;
+        }
+
+        // The header is written first so a record of the newest run never has to be dropped for its own data
+        MakeRoom(RS485CaptureRecord::kHeaderLength + amount);
+        last_ = length_;
+        has_last_ = true;
+        uint32_t time = static_cast<uint32_t>(now);
+        Put(last_, static_cast<uint8_t>(time));
+        Put(last_ + 1, static_cast<uint8_t>(time >> 8));
+        Put(last_ + 2, static_cast<uint8_t>(time >> 16));
+        Put(last_ + 3, static_cast<uint8_t>(time >> 24));
+        Put(last_ + 4, static_cast<uint8_t>(direction));
+        Put(last_ + 5, static_cast<uint8_t>(amount));
+        Copy(last_ + RS485CaptureRecord::kHeaderLength, data + added, amount);
+        length_ += RS485CaptureRecord::kHeaderLength + amount;
+        added += amount;
+        last_time_ = now;
+    }
+}
+
+size_t RS485Capture::Export(uint8_t *const destination, const size_t size)
+{
+    size_t offset = 0;
+    while (offset < length_)
+    {
+        size_t record_length = RS485CaptureRecord::kHeaderLength + ByteAt(offset + 5);
+        if (offset + record_length > size)
+        {
+            break;
+        }
+
+        size_t index = Wrap(offset);
+        size_t first = size_ - index < record_length ? size_ - index : record_length;
+        memcpy(destination + offset, buffer_ + index, first);
+        memcpy(destination + offset + first, buffer_, record_length - first);
+        offset += record_length;
+    }
+
+    return offset;
+}
+
+size_t RS485Capture::GetLength(void)
+{
+    return length_;
+}
+
+unsigned long RS485Capture::GetDroppedCount(void)
+{
+    return dropped_count_;
+}
+
+RS485CaptureReader::RS485CaptureReader(const uint8_t *const data, const size_t length)
+{
+    this->data_ = data;
+    this->length_ = length;
+    this->offset_ = 0;
+}
+
+bool RS485CaptureReader::Next(RS485CaptureRecord &record)
+{
+    if (length_ - offset_ < RS485CaptureRecord::kHeaderLength)
+    {
+        return false;
+    }
+
+    const uint8_t *header = data_ + offset_;
+    if (length_ - offset_ - RS485CaptureRecord::kHeaderLength < header[5])
+    {
+        return false;
+    }
+
+    record.time = ReadUint32(header);
+    record.direction = static_cast<RS485CaptureDirection>(header[4]);
+    record.length = header[5];
+    record.data = header + RS485CaptureRecord::kHeaderLength;
+    offset_ += RS485CaptureRecord::kHeaderLength + record.length;
+    return true;
+}
+
+void RS485CaptureReader::Rewind(void)
+{
+    offset_ = 0;
+}
+
+RS485CaptureReplay::RS485CaptureReplay(RS485 &rs485, const uint8_t *const data, const size_t length, const RS485CaptureDirection direction)
+    : rs485_(rs485), reader_(data, length)
+{
+    this->direction_ = direction;
+    Start();
+}
+
+void RS485CaptureReplay::Start(void)
+{
+    reader_.Rewind();
+    started_ = false;
+    sent_count_ = 0;
+    has_record_ = NextRecord();
+}
+
+bool RS485CaptureReplay::NextRecord(void)
+{
+    while (reader_.Next(record_))
+    {
+        if (record_.direction == direction_)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool RS485CaptureReplay::Poll(void)
+{
+    if (!has_record_)
+    {
+        return false;
+    }
+
+    unsigned long now = micros();
+    if (!started_)
+    {
+        started_ = true;
+        start_time_ = now;
+        first_time_ = record_.time;
+    }
+
+    if (now - start_time_ < static_cast<uint32_t>(record_.time - first_time_))
+    {
+        return true;
+    }
+
+    // A full record followed by one with the same time was split from a longer run, the rest follows in the same transmission
+    rs485_.BeginTransmission();
+    uint8_t length;
+    uint32_t time;
+    do
+    {
+        length = record_.length;
+        time = record_.time;
+        rs485_.write(record_.data, record_.length);
+        sent_count_++;
+        has_record_ = NextRecord();
+    } while (has_record_ && length == kMaxRecordLength && record_.time == time);
+    rs485_.EndTransmission();
+
+    return has_record_;
+}
+
+size_t RS485CaptureReplay::GetSentCount(void)
+{
+    return sent_count_;
+}
+
+#ifndef ARDUINO
+bool RS485CaptureWriteCsv(const uint8_t *const data, const size_t length, FILE *file)
+{
+    if (fprintf(file, "time_us,direction,length,data\n") < 0)
+    {
+        return false;
+    }
+
+    RS485CaptureReader reader(data, length);
+    RS485CaptureRecord record;
+    size_t offset = 0;
+    while (reader.Next(record))
+    {
+        fprintf(file, "%lu,%s,%u,", static_cast<unsigned long>(record.time),
+                record.direction == RS485CaptureDirection::kTransmit ? "tx" : "rx", static_cast<unsigned>(record.length));
+        for (uint8_t i = 0; i < record.length; i++)
+        {
+            fprintf(file, "%02X", record.data[i]);
+        }
+        if (fprintf(file, "\n") < 0)
+        {
+            return false;
+        }
+        offset += RS485CaptureRecord::kHeaderLength + record.length;
+    }
+
+    return offset == length;
+}
+
+bool RS485CaptureWritePcap(const uint8_t *const data, const size_t length, FILE *file)
+{
+    // pcap 2.4 header with microsecond timestamps, link type USER0
+    const uint32_t header[] = {0xA1B2C3D4, 0x00040002, 0, 0, 0xFFFF, 147};
+    if (fwrite(header, sizeof(header), 1, file) != 1)
+    {
+        return false;
+    }
+
+    RS485CaptureReader reader(data, length);
+    RS485CaptureRecord record;
+    size_t offset = 0;
+    while (reader.Next(record))
+    {
+        const uint32_t packet_header[] = {record.time / 1000000, record.time % 1000000,
+                                          static_cast<uint32_t>(record.length + 1), static_cast<uint32_t>(record.length + 1)};
+        uint8_t direction = static_cast<uint8_t>(record.direction);
+        if (fwrite(packet_header, sizeof(packet_header), 1, file) != 1 || fwrite(&direction, 1, 1, file) != 1 ||
+            fwrite(record.data, 1, record.length, file) != record.length)
+        {
+            return false;
+        }
+        offset += RS485CaptureRecord::kHeaderLength + record.length;
+    }
+
+    return offset == length;
+}
+#endif // ARDUINO
@@ -0,0 +1,129 @@
+/**
+ * @file max485ttl_crc.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Table driven CRC-16/MODBUS and CRC-8 (SMBus, polynomial 0x07) with lookup tables generated at compile time
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_crc.hpp"
+
+#ifndef __AVR__
+namespace
+{
+    typedef CrcTable<Crc16ModbusSliceGenerator<1>, 256> Crc16ModbusSlice1Table;
+    typedef CrcTable<Crc16ModbusSliceGenerator<2>, 256> Crc16ModbusSlice2Table;
+    typedef CrcTable<Crc16ModbusSliceGenerator<3>, 256> Crc16ModbusSlice3Table;
+}
+#endif
+
+uint16_t Crc16ModbusBitwise(const uint8_t *data, size_t length, uint16_t crc)
+{
+    while (length--)
+    {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+
+    return crc;
+}
+
+uint16_t Crc16ModbusNibble(const uint8_t *data, size_t length, uint16_t crc)
+{
+    while (length--)
+    {
+        crc = Crc16ModbusNibbleUpdate(crc, *data++);
+    }
+
+    return crc;
+}
+
+uint16_t Crc16ModbusFull(const uint8_t *data, size_t length, uint16_t crc)
+{
+    while (length--)
+    {
+        crc = Crc16ModbusUpdate(crc, *data++);
+    }
+
+    return crc;
+}
+
+#ifndef __AVR__
+uint16_t Crc16ModbusSlicing(const uint8_t *data, size_t length, uint16_t crc)
+{
+    // Four bytes per step: the two bytes holding the CRC are moved over three and two zero bytes,
+    // the two other bytes over one and no zero bytes, so the four lookups are independent
+    while (length >= 4)
+    {
+        crc ^= static_cast<uint16_t>(data[0] | (data[1] << 8));
+        crc = Crc16ModbusSlice3Table::kValues[crc & 0xFF] ^
+              Crc16ModbusSlice2Table::kValues[crc >> 8] ^
+              Crc16ModbusSlice1Table::kValues[data[2]] ^
+              Crc16ModbusTable::kValues[data[3]];
+        data += 4;
+        length -= 4;
+    }
+
+    return Crc16ModbusFull(data, length, crc);
+}
+#endif
+
+uint16_t Crc16Modbus(const uint8_t *data, size_t length, uint16_t crc)
+{
+#if defined(MAX485TTL_CRC_NIBBLE_TABLE)
+    return Crc16ModbusNibble(data, length, crc);
+#elif defined(__AVR__)
+    return Crc16ModbusFull(data, length, crc);
+#else
+    return Crc16ModbusSlicing(data, length, crc);
+#endif
+}
+
+uint8_t Crc8Bitwise(const uint8_t *data, size_t length, uint8_t crc)
+{
+    while (length--)
+    {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+uint8_t Crc8Nibble(const uint8_t *data, size_t length, uint8_t crc)
+{
+    while (length--)
+    {
+        crc = Crc8NibbleUpdate(crc, *data++);
+    }
+
+    return crc;
+}
+
+uint8_t Crc8Full(const uint8_t *data, size_t length, uint8_t crc)
+{
+    while (length--)
+    {
+        crc = Crc8Update(crc, *data++);
+    }
+
+    return crc;
+}
+
+uint8_t Crc8(const uint8_t *data, size_t length, uint8_t crc)
+{
+#ifdef MAX485TTL_CRC_NIBBLE_TABLE
+    return Crc8Nibble(data, length, crc);
+#else
+    return Crc8Full(data, length, crc);
+#endif
+}
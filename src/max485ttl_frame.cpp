@@ -0,0 +1,157 @@
+/**
+ * @file max485ttl_frame.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Frame detection for the MAX485TTL modules using the silent interval between frames (t1.5 / t3.5)
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_frame.hpp"
+
+RS485FrameReceiver::RS485FrameReceiver(RS485 &rs485, uint8_t *const buffer, const size_t size) : rs485_(rs485)
+{
+    this->buffer_ = buffer;
+    this->size_ = size;
+    this->length_ = 0;
+
+    this->inter_frame_half_characters_ = 7;
+    this->inter_frame_minimum_ = 0;
+    this->inter_character_half_characters_ = 3;
+    this->inter_character_minimum_ = 0;
+
+    this->last_byte_time_ = 0;
+    this->frame_complete_ = false;
+    this->overflowed_ = false;
+    this->broken_ = false;
+
+    rs485_.ResetReceiveCrc();
+}
+
+void RS485FrameReceiver::SetInterFrameTimeout(const uint8_t half_characters, const unsigned long minimum_in_microsecond)
+{
+    inter_frame_half_characters_ = half_characters;
+    inter_frame_minimum_ = minimum_in_microsecond;
+}
+
+void RS485FrameReceiver::SetInterCharacterTimeout(const uint8_t half_characters, const unsigned long minimum_in_microsecond)
+{
+    inter_character_half_characters_ = half_characters;
+    inter_character_minimum_ = minimum_in_microsecond;
+}
+
+unsigned long RS485FrameReceiver::CalculateTimeout(const uint8_t half_characters, const unsigned long minimum)
+{
+    unsigned long timeout = (half_characters * rs485_.GetCharacterTime() + 1) / 2;
+    return timeout > minimum ? timeout : minimum;
+}
+
+unsigned long RS485FrameReceiver::GetInterFrameTimeout(void)
+{
+    unsigned long timeout = CalculateTimeout(inter_frame_half_characters_, inter_frame_minimum_);
+    // Without frame format there is no character time, use t3.5 of 19200 baud and up
+    return timeout ? timeout : kDefaultInterFrameTimeout;
+}
+
+bool RS485FrameReceiver::Poll(void)
+{
+    if (frame_complete_)
+    {
+        return true;
+    }
+
+    size_t received;
+    if (length_ < size_)
+    {
+        received = rs485_.read(buffer_ + length_, size_ - length_);
+    }
+    else
+    {
+        // Buffer is full, keep reading so the end of the frame is still detected
+        uint8_t dropped[16];
+        received = rs485_.read(dropped, sizeof(dropped));
+        if (received && !overflowed_)
+        {
+            overflowed_ = true;
+            rs485_.RecordReceiveOverflow();
+        }
+    }
+
+    unsigned long now = micros();
+    if (received)
+    {
+        // Without frame format the transmission time of the new bytes is unknown, so a gap cannot be told apart from them
+        unsigned long character_time = rs485_.GetCharacterTime();
+        if (length_ && inter_character_half_characters_ && character_time)
+        {
+            // The new bytes took their own transmission time, anything above that was silence on the line
+            unsigned long allowed_gap = received * character_time +
+                                        CalculateTimeout(inter_character_half_characters_, inter_character_minimum_);
+            if (now - last_byte_time_ > allowed_gap)
+            {
+                broken_ = true;
+            }
+        }
+
+        if (length_ < size_)
+        {
+            length_ += received;
+        }
+        last_byte_time_ = now;
+        return false;
+    }
+
+    if ((length_ || overflowed_) && now - last_byte_time_ >= GetInterFrameTimeout())
+    {
+        frame_complete_ = true;
+        rs485_.RecordFrameEnd(last_byte_time_);
+    }
+
+    return frame_complete_;
+}
+
+bool RS485FrameReceiver::IsFrameComplete(void)
+{
+    return frame_complete_;
+}
+
+const uint8_t *RS485FrameReceiver::GetFrame(void)
+{
+    return buffer_;
+}
+
+size_t RS485FrameReceiver::GetFrameLength(void)
+{
+    return length_;
+}
+
+bool RS485FrameReceiver::IsFrameOverflowed(void)
+{
+    return overflowed_;
+}
+
+bool RS485FrameReceiver::IsFrameBroken(void)
+{
+    return broken_;
+}
+
+bool RS485FrameReceiver::IsFrameCrcValid(void)
+{
+    return !overflowed_ && length_ && rs485_.IsReceiveCrcValid();
+}
+
+unsigned long RS485FrameReceiver::GetFrameEndTime(void)
+{
+    return last_byte_time_;
+}
+
+void RS485FrameReceiver::ReleaseFrame(void)
+{
+    length_ = 0;
+    frame_complete_ = false;
+    overflowed_ = false;
+    broken_ = false;
+    rs485_.ResetReceiveCrc();
+}
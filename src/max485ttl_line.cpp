@@ -0,0 +1,172 @@
+/**
+ * @file max485ttl_line.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Heap-free reader of lines (or other delimited messages) received by the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_line.hpp"
+
+#include <string.h>
+
+const uint8_t *RS485FindByte(const uint8_t *data, size_t length, const uint8_t value)
+{
+#ifndef __AVR__
+    if (length >= 16)
+    {
+        // A byte of the word equal to value becomes zero after the xor, (x - 0x01..) & ~x & 0x80.. finds zero bytes
+        const uint64_t kOnes = 0x0101010101010101ULL;
+        const uint64_t kHighs = 0x8080808080808080ULL;
+        const uint64_t pattern = kOnes * value;
+        while (length >= sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, data, sizeof(word));
+            word ^= pattern;
+            if ((word - kOnes) & ~word & kHighs)
+            {
+                break;
+            }
+            data += sizeof(word);
+            length -= sizeof(word);
+        }
+    }
+#endif
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (data[i] == value)
+        {
+            return data + i;
+        }
+    }
+
+    return nullptr;
+}
+
+RS485LineReader::RS485LineReader(RS485 &rs485, char *const buffer, const size_t size, const char end_marker) : rs485_(rs485)
+{
+    this->buffer_ = buffer;
+    this->size_ = size;
+    this->end_marker_ = end_marker;
+    this->length_ = 0;
+    this->scanned_ = 0;
+    this->line_length_ = 0;
+    this->line_complete_ = false;
+    this->truncated_ = false;
+}
+
+void RS485LineReader::CompleteLine(size_t position)
+{
+    // "\r\n" ends a line the same as "\n"
+    if (end_marker_ == '\n' && position > 0 && buffer_[position - 1] == '\r')
+    {
+        position--;
+    }
+
+    buffer_[position] = '\0';
+    line_length_ = position;
+    line_complete_ = true;
+}
+
+bool RS485LineReader::Scan(void)
+{
+    const uint8_t *found = RS485FindByte(reinterpret_cast<const uint8_t *>(buffer_) + scanned_, length_ - scanned_,
+                                         static_cast<uint8_t>(end_marker_));
+    if (found)
+    {
+        scanned_ = static_cast<size_t>(reinterpret_cast<const char *>(found) - buffer_);
+        CompleteLine(scanned_);
+        return true;
+    }
+
+    scanned_ = length_;
+    return false;
+}
+
+bool RS485LineReader::Poll(void)
+{
+    if (line_complete_)
+    {
+        return true;
+    }
+
+    if (!truncated_)
+    {
+        // One byte stays free for the '\0'
+        length_ += rs485_.read(reinterpret_cast<uint8_t *>(buffer_) + length_, size_ - 1 - length_);
+        if (Scan())
+        {
+            return true;
+        }
+        if (length_ < size_ - 1)
+        {
+            return false;
+        }
+        truncated_ = true;
+    }
+
+    // Buffer is full, drop the rest of the line byte by byte so nothing of the next line is taken
+    int c;
+    while ((c = rs485_.read()) >= 0)
+    {
+        if (static_cast<char>(c) == end_marker_)
+        {
+            scanned_ = length_;
+            CompleteLine(length_);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool RS485LineReader::ReadLine(const unsigned long timeout_in_millisecond)
+{
+    unsigned long start_time = millis();
+    while (!Poll())
+    {
+        if (millis() - start_time >= timeout_in_millisecond)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const char *RS485LineReader::GetLine(void)
+{
+    return buffer_;
+}
+
+size_t RS485LineReader::GetLineLength(void)
+{
+    return line_length_;
+}
+
+bool RS485LineReader::IsLineTruncated(void)
+{
+    return truncated_;
+}
+
+void RS485LineReader::ReleaseLine(void)
+{
+    if (!line_complete_)
+    {
+        return;
+    }
+
+    // Bytes after the end marker belong to the next line
+    size_t next = scanned_ < length_ ? scanned_ + 1 : length_;
+    memmove(buffer_, buffer_ + next, length_ - next);
+    length_ -= next;
+    scanned_ = 0;
+    line_length_ = 0;
+    line_complete_ = false;
+    truncated_ = false;
+}
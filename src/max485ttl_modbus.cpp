@@ -0,0 +1,37 @@
+/**
+ * @file max485ttl_modbus.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Definitions shared by the Modbus RTU master and slave
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_modbus.hpp"
+
+uint16_t ModbusCrc16(const uint8_t *data, size_t length)
+{
+    return Crc16Modbus(data, length);
+}
+
+size_t ModbusAppendCrc(uint8_t *frame, const size_t length)
+{
+    uint16_t crc = ModbusCrc16(frame, length);
+    frame[length] = static_cast<uint8_t>(crc);
+    frame[length + 1] = static_cast<uint8_t>(crc >> 8);
+
+    return length + 2;
+}
+
+bool ModbusCheckCrc(const uint8_t *frame, const size_t length)
+{
+    if (length < 2)
+    {
+        return false;
+    }
+
+    // The CRC over a frame including its own CRC is 0
+    return ModbusCrc16(frame, length) == 0;
+}
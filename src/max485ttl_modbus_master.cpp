@@ -0,0 +1,527 @@
+/**
+ * @file max485ttl_modbus_master.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Modbus RTU master using the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_modbus_master.hpp"
+
+ModbusMaster::ModbusMaster(RS485 &rs485, uint8_t *const buffer, const size_t size) : rs485_(rs485), receiver_(rs485, buffer, size)
+{
+    this->buffer_ = buffer;
+    this->size_ = size;
+    this->response_timeout_ = kDefaultResponseTimeout;
+    this->turnaround_delay_ = kDefaultTurnaroundDelay;
+    this->estimator_ = nullptr;
+    this->request_time_ = 0;
+    this->request_timeout_ = 0;
+    this->response_started_ = false;
+    this->request_sent_ = false;
+    this->busy_ = false;
+    this->last_activity_time_ = micros();
+    this->broadcast_sent_ = false;
+    this->frame_length_ = 0;
+    this->expected_length_ = 0;
+    this->exception_ = ModbusException::kNone;
+    memset(this->request_header_, 0, sizeof(this->request_header_));
+
+    receiver_.SetInterCharacterTimeout(3, kModbusMinimumInterCharacterTimeout);
+    receiver_.SetInterFrameTimeout(7, kModbusMinimumInterFrameTimeout);
+
+    // The CRC is calculated while the bytes are read, checking a response takes no extra pass
+    rs485_.SetReceiveCrc(RS485::CrcType::kCrc16Modbus);
+    receiver_.ReleaseFrame();
+}
+
+void ModbusMaster::SetResponseTimeout(const unsigned long timeout_in_millisecond)
+{
+    response_timeout_ = timeout_in_millisecond;
+}
+
+void ModbusMaster::SetTurnaroundDelay(const unsigned long delay_in_millisecond)
+{
+    turnaround_delay_ = delay_in_millisecond;
+}
+
+void ModbusMaster::SetRttEstimator(RS485RttEstimator *const estimator)
+{
+    estimator_ = estimator;
+}
+
+ModbusStatus ModbusMaster::BuildHeader(const uint8_t slave, const ModbusFunction function, const uint16_t first, const uint16_t second)
+{
+    if (busy_)
+    {
+        return ModbusStatus::kBusy;
+    }
+
+    if (size_ < 8)
+    {
+        return ModbusStatus::kBufferTooSmall;
+    }
+
+    buffer_[0] = slave;
+    buffer_[1] = static_cast<uint8_t>(function);
+    ModbusSetWord(&buffer_[2], first);
+    ModbusSetWord(&buffer_[4], second);
+    memcpy(request_header_, buffer_, sizeof(request_header_));
+
+    return ModbusStatus::kOk;
+}
+
+ModbusStatus ModbusMaster::Start(const size_t length, const size_t expected_length)
+{
+    if (length + 2 > size_ || expected_length > size_)
+    {
+        return ModbusStatus::kBufferTooSmall;
+    }
+
+    ModbusAppendCrc(buffer_, length);
+    frame_length_ = length + 2;
+    expected_length_ = expected_length;
+    exception_ = ModbusException::kNone;
+    request_timeout_ = estimator_ ? estimator_->GetTimeout(request_header_[0]) : response_timeout_ * 1000UL;
+    request_time_ = micros();
+    request_sent_ = false;
+    busy_ = true;
+
+    // Sent right away when the bus is already silent, otherwise by a later Poll()
+    return SendWhenIdle();
+}
+
+ModbusStatus ModbusMaster::SendWhenIdle(void)
+{
+    unsigned long silence = receiver_.GetInterFrameTimeout();
+    if (broadcast_sent_ && turnaround_delay_ * 1000UL > silence)
+    {
+        silence = turnaround_delay_ * 1000UL;
+    }
+
+    // Anything still arriving (the end of a late response) is dropped so it is not taken as the response
+    uint8_t stale[16];
+    if (rs485_.read(stale, sizeof(stale)))
+    {
+        last_activity_time_ = micros();
+    }
+
+    unsigned long now = micros();
+    if (now - last_activity_time_ < silence)
+    {
+        // A bus that never becomes silent fails the request instead of blocking it forever
+        if (now - request_time_ >= silence + request_timeout_)
+        {
+            busy_ = false;
+            return ModbusStatus::kTimeout;
+        }
+
+        return ModbusStatus::kBusy;
+    }
+
+    size_t sent = rs485_.Send(buffer_, frame_length_);
+    last_activity_time_ = micros();
+    broadcast_sent_ = request_header_[0] == kModbusBroadcastAddress;
+    if (sent != frame_length_)
+    {
+        busy_ = false;
+        return ModbusStatus::kTransmitError;
+    }
+
+    receiver_.ReleaseFrame();
+    request_time_ = last_activity_time_;
+    request_sent_ = true;
+    response_started_ = false;
+    busy_ = !broadcast_sent_;
+
+    return busy_ ? ModbusStatus::kBusy : ModbusStatus::kOk;
+}
+
+ModbusStatus ModbusMaster::BeginReadCoils(const uint8_t slave, const uint16_t address, const uint16_t quantity)
+{
+    if (quantity < 1 || quantity > 2000 || slave == kModbusBroadcastAddress)
+    {
+        return ModbusStatus::kInvalidArgument;
+    }
+
+    ModbusStatus status = BuildHeader(slave, ModbusFunction::kReadCoils, address, quantity);
+    if (status != ModbusStatus::kOk)
+    {
+        return status;
+    }
+
+    return Start(6, 5 + (quantity + 7) / 8);
+}
+
+ModbusStatus ModbusMaster::BeginReadDiscreteInputs(const uint8_t slave, const uint16_t address, const uint16_t quantity)
+{
+    if (quantity < 1 || quantity > 2000 || slave == kModbusBroadcastAddress)
+    {
+        return ModbusStatus::kInvalidArgument;
+    }
+
+    ModbusStatus status = BuildHeader(slave, ModbusFunction::kReadDiscreteInputs, address, quantity);
+    if (status != ModbusStatus::kOk)
+    {
+        return status;
+    }
+
+    return Start(6, 5 + (quantity + 7) / 8);
+}
+
+ModbusStatus ModbusMaster::BeginReadHoldingRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity)
+{
+    if (quantity < 1 || quantity > 125 || slave == kModbusBroadcastAddress)
+    {
+        return ModbusStatus::kInvalidArgument;
+    }
+
+    ModbusStatus status = BuildHeader(slave, ModbusFunction::kReadHoldingRegisters, address, quantity);
+    if (status != ModbusStatus::kOk)
+    {
+        return status;
+    }
+
+    return Start(6, 5 + quantity * 2);
+}
+
+ModbusStatus ModbusMaster::BeginReadInputRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity)
+{
+    if (quantity < 1 || quantity > 125 || slave == kModbusBroadcastAddress)
+    {
+        return ModbusStatus::kInvalidArgument;
+    }
+
+    ModbusStatus status = BuildHeader(slave, ModbusFunction::kReadInputRegisters, address, quantity);
+    if (status != ModbusStatus::kOk)
+    {
+        return status;
+    }
+
+    return Start(6, 5 + quantity * 2);
+}
+
+ModbusStatus ModbusMaster::BeginWriteSingleCoil(const uint8_t slave, const uint16_t address, const bool value)
+{
+    ModbusStatus status = BuildHeader(slave, ModbusFunction::kWriteSingleCoil, address, value ? 0xFF00 : 0x0000);
+    if (status != ModbusStatus::kOk)
+    {
+        return status;
+    }
+
+    return Start(6, 0);
+}
+
+ModbusStatus ModbusMaster::BeginWriteSingleRegister(const uint8_t slave, const uint16_t address, const uint16_t value)
+{
+    ModbusStatus status = BuildHeader(slave, ModbusFunction::kWriteSingleRegister, address, value);
+    if (status != ModbusStatus::kOk)
+    {
+        return status;
+    }
+
+    return Start(6, 0);
+}
+
+ModbusStatus ModbusMaster::BeginWriteMultipleCoils(const uint8_t slave, const uint16_t address, const uint16_t quantity, const uint8_t *const values)
+{
+    if (quantity < 1 || quantity > 1968)
+    {
+        return ModbusStatus::kInvalidArgument;
+    }
+
+    ModbusStatus status = BuildHeader(slave, ModbusFunction::kWriteMultipleCoils, address, quantity);
+    if (status != ModbusStatus::kOk)
+    {
+        return status;
+    }
+
+    uint8_t byte_count = static_cast<uint8_t>((quantity + 7) / 8);
+    if (7U + byte_count + 2 > size_)
+    {
+        return ModbusStatus::kBufferTooSmall;
+    }
+
+    buffer_[6] = byte_count;
+    memcpy(&buffer_[7], values, byte_count);
+    // Unused bits of the last byte must be zero
+    if (quantity % 8)
+    {
+        buffer_[6 + byte_count] &= static_cast<uint8_t>((1 << (quantity % 8)) - 1);
+    }
+
+    return Start(7 + byte_count, 0);
+}
+
+ModbusStatus ModbusMaster::BeginWriteMultipleRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity, const uint16_t *const values)
+{
+    if (quantity < 1 || quantity > 123)
+    {
+        return ModbusStatus::kInvalidArgument;
+    }
+
+    ModbusStatus status = BuildHeader(slave, ModbusFunction::kWriteMultipleRegisters, address, quantity);
+    if (status != ModbusStatus::kOk)
+    {
+        return status;
+    }
+
+    uint8_t byte_count = static_cast<uint8_t>(quantity * 2);
+    if (7U + byte_count + 2 > size_)
+    {
+        return ModbusStatus::kBufferTooSmall;
+    }
+
+    buffer_[6] = byte_count;
+    for (uint16_t i = 0; i < quantity; i++)
+    {
+        ModbusSetWord(&buffer_[7 + i * 2], values[i]);
+    }
+
+    return Start(7 + byte_count, 0);
+}
+
+ModbusStatus ModbusMaster::BeginReadWriteMultipleRegisters(const uint8_t slave, const uint16_t read_address, const uint16_t read_quantity,
+                                                           const uint16_t write_address, const uint16_t write_quantity, const uint16_t *const values)
+{
+    if (read_quantity < 1 || read_quantity > 125 || write_quantity < 1 || write_quantity > 121 || slave == kModbusBroadcastAddress)
+    {
+        return ModbusStatus::kInvalidArgument;
+    }
+
+    ModbusStatus status = BuildHeader(slave, ModbusFunction::kReadWriteMultipleRegisters, read_address, read_quantity);
+    if (status != ModbusStatus::kOk)
+    {
+        return status;
+    }
+
+    uint8_t byte_count = static_cast<uint8_t>(write_quantity * 2);
+    if (11U + byte_count + 2 > size_)
+    {
+        return ModbusStatus::kBufferTooSmall;
+    }
+
+    ModbusSetWord(&buffer_[6], write_address);
+    ModbusSetWord(&buffer_[8], write_quantity);
+    buffer_[10] = byte_count;
+    for (uint16_t i = 0; i < write_quantity; i++)
+    {
+        ModbusSetWord(&buffer_[11 + i * 2], values[i]);
+    }
+
+    return Start(11 + byte_count, 5 + read_quantity * 2);
+}
+
+ModbusStatus ModbusMaster::Poll(void)
+{
+    if (!busy_)
+    {
+        return ModbusStatus::kIdle;
+    }
+
+    if (!request_sent_)
+    {
+        return SendWhenIdle();
+    }
+
+    bool complete = receiver_.Poll();
+    if (!response_started_ && receiver_.GetFrameLength())
+    {
+        response_started_ = true;
+        if (estimator_)
+        {
+            estimator_->AddSample(request_header_[0], micros() - request_time_);
+        }
+    }
+
+    if (complete)
+    {
+        busy_ = false;
+        // t3.5 has already passed since the last byte of the response, the next request need not wait it again
+        last_activity_time_ = receiver_.GetFrameEndTime();
+        return Validate();
+    }
+
+    if (!response_started_ && micros() - request_time_ >= request_timeout_)
+    {
+        busy_ = false;
+        last_activity_time_ = micros();
+        if (estimator_)
+        {
+            estimator_->AddTimeout(request_header_[0]);
+        }
+        return ModbusStatus::kTimeout;
+    }
+
+    return ModbusStatus::kBusy;
+}
+
+ModbusStatus ModbusMaster::Validate(void)
+{
+    size_t length = receiver_.GetFrameLength();
+    if (receiver_.IsFrameOverflowed() || receiver_.IsFrameBroken() || length < 4)
+    {
+        return ModbusStatus::kInvalidResponse;
+    }
+
+    if (!receiver_.IsFrameCrcValid())
+    {
+        return ModbusStatus::kCrcError;
+    }
+
+    if (buffer_[0] != request_header_[0])
+    {
+        return ModbusStatus::kInvalidResponse;
+    }
+
+    if (buffer_[1] == (request_header_[1] | 0x80) && length == 5)
+    {
+        exception_ = static_cast<ModbusException>(buffer_[2]);
+        return ModbusStatus::kException;
+    }
+
+    if (buffer_[1] != request_header_[1])
+    {
+        return ModbusStatus::kInvalidResponse;
+    }
+
+    if (expected_length_ == 0)
+    {
+        // Write functions echo address and value or quantity
+        if (length != 8 || memcmp(&buffer_[2], &request_header_[2], 4) != 0)
+        {
+            return ModbusStatus::kInvalidResponse;
+        }
+    }
+    else if (length != expected_length_ || buffer_[2] != expected_length_ - 5)
+    {
+        return ModbusStatus::kInvalidResponse;
+    }
+
+    return ModbusStatus::kOk;
+}
+
+ModbusStatus ModbusMaster::Wait(ModbusStatus status)
+{
+    while (status == ModbusStatus::kBusy)
+    {
+        status = Poll();
+    }
+
+    return status;
+}
+
+ModbusStatus ModbusMaster::ReadCoils(const uint8_t slave, const uint16_t address, const uint16_t quantity, uint8_t *const coils)
+{
+    ModbusStatus status = Wait(BeginReadCoils(slave, address, quantity));
+    if (status == ModbusStatus::kOk)
+    {
+        memcpy(coils, GetResponseData(), GetResponseDataLength());
+    }
+
+    return status;
+}
+
+ModbusStatus ModbusMaster::ReadDiscreteInputs(const uint8_t slave, const uint16_t address, const uint16_t quantity, uint8_t *const inputs)
+{
+    ModbusStatus status = Wait(BeginReadDiscreteInputs(slave, address, quantity));
+    if (status == ModbusStatus::kOk)
+    {
+        memcpy(inputs, GetResponseData(), GetResponseDataLength());
+    }
+
+    return status;
+}
+
+ModbusStatus ModbusMaster::ReadHoldingRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity, uint16_t *const registers)
+{
+    ModbusStatus status = Wait(BeginReadHoldingRegisters(slave, address, quantity));
+    if (status == ModbusStatus::kOk)
+    {
+        for (uint16_t i = 0; i < quantity; i++)
+        {
+            registers[i] = GetRegister(i);
+        }
+    }
+
+    return status;
+}
+
+ModbusStatus ModbusMaster::ReadInputRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity, uint16_t *const registers)
+{
+    ModbusStatus status = Wait(BeginReadInputRegisters(slave, address, quantity));
+    if (status == ModbusStatus::kOk)
+    {
+        for (uint16_t i = 0; i < quantity; i++)
+        {
+            registers[i] = GetRegister(i);
+        }
+    }
+
+    return status;
+}
+
+ModbusStatus ModbusMaster::WriteSingleCoil(const uint8_t slave, const uint16_t address, const bool value)
+{
+    return Wait(BeginWriteSingleCoil(slave, address, value));
+}
+
+ModbusStatus ModbusMaster::WriteSingleRegister(const uint8_t slave, const uint16_t address, const uint16_t value)
+{
+    return Wait(BeginWriteSingleRegister(slave, address, value));
+}
+
+ModbusStatus ModbusMaster::WriteMultipleCoils(const uint8_t slave, const uint16_t address, const uint16_t quantity, const uint8_t *const values)
+{
+    return Wait(BeginWriteMultipleCoils(slave, address, quantity, values));
+}
+
+ModbusStatus ModbusMaster::WriteMultipleRegisters(const uint8_t slave, const uint16_t address, const uint16_t quantity, const uint16_t *const values)
+{
+    return Wait(BeginWriteMultipleRegisters(slave, address, quantity, values));
+}
+
+ModbusStatus ModbusMaster::ReadWriteMultipleRegisters(const uint8_t slave, const uint16_t read_address, const uint16_t read_quantity,
+                                                      const uint16_t write_address, const uint16_t write_quantity, const uint16_t *const values,
+                                                      uint16_t *const registers)
+{
+    ModbusStatus status = Wait(BeginReadWriteMultipleRegisters(slave, read_address, read_quantity, write_address, write_quantity, values));
+    if (status == ModbusStatus::kOk)
+    {
+        for (uint16_t i = 0; i < read_quantity; i++)
+        {
+            registers[i] = GetRegister(i);
+        }
+    }
+
+    return status;
+}
+
+ModbusException ModbusMaster::GetException(void)
+{
+    return exception_;
+}
+
+uint16_t ModbusMaster::GetRegister(const size_t index)
+{
+    return ModbusGetWord(&buffer_[3 + index * 2]);
+}
+
+bool ModbusMaster::GetCoil(const size_t index)
+{
+    return (buffer_[3 + index / 8] >> (index % 8)) & 1;
+}
+
+const uint8_t *ModbusMaster::GetResponseData(void)
+{
+    return &buffer_[3];
+}
+
+size_t ModbusMaster::GetResponseDataLength(void)
+{
+    size_t length = receiver_.GetFrameLength();
+    return length > 5 ? length - 5 : 0;
+}
@@ -0,0 +1,212 @@
+/**
+ * @file max485ttl_modbus_poll.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Poll scheduler of a Modbus RTU master serving many slaves using the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_modbus_poll.hpp"
+
+ModbusPollScheduler::ModbusPollScheduler(ModbusMaster &master, ModbusPollEntry *const entries, const size_t count) : master_(master)
+{
+    this->entries_ = entries;
+    this->count_ = count;
+    this->first_backoff_ = kDefaultFirstBackoff;
+    this->maximum_backoff_ = kDefaultMaximumBackoff;
+    this->callback_ = nullptr;
+    this->callback_context_ = nullptr;
+    this->current_ = count;
+    this->start_time_ = 0;
+    ResetStatistics();
+
+    unsigned long now = millis();
+    for (size_t i = 0; i < count; i++)
+    {
+        entries[i].next_time = now;
+        entries[i].failures = 0;
+        entries[i].status = ModbusStatus::kIdle;
+    }
+}
+
+void ModbusPollScheduler::SetBackoff(const unsigned long first_in_millisecond, const unsigned long maximum_in_millisecond)
+{
+    first_backoff_ = first_in_millisecond;
+    maximum_backoff_ = maximum_in_millisecond;
+}
+
+void ModbusPollScheduler::SetCallback(const ModbusPollCallback callback, void *const context)
+{
+    callback_ = callback;
+    callback_context_ = context;
+}
+
+bool ModbusPollScheduler::Poll(void)
+{
+    if (current_ < count_)
+    {
+        ModbusStatus status = master_.Poll();
+        if (status == ModbusStatus::kBusy)
+        {
+            return false;
+        }
+        Complete(status);
+        return true;
+    }
+
+    unsigned long now = millis();
+    size_t index = SelectNext(now);
+    if (index == count_)
+    {
+        return false;
+    }
+
+    current_ = index;
+    start_time_ = now;
+    ModbusStatus status = Begin(entries_[index]);
+    if (status != ModbusStatus::kBusy)
+    {
+        // Refused, the entry is rescheduled like a completed request
+        Complete(status);
+        return true;
+    }
+
+    statistics_.requests++;
+    return false;
+}
+
+size_t ModbusPollScheduler::SelectNext(const unsigned long now)
+{
+    size_t selected = count_;
+    for (size_t i = 0; i < count_; i++)
+    {
+        ModbusPollEntry &entry = entries_[i];
+        if ((long)(now - entry.next_time) < 0)
+        {
+            continue;
+        }
+
+        if (selected == count_ || entry.priority > entries_[selected].priority ||
+            (entry.priority == entries_[selected].priority && (long)(entry.next_time - entries_[selected].next_time) < 0))
+        {
+            selected = i;
+        }
+    }
+
+    return selected;
+}
+
+ModbusStatus ModbusPollScheduler::Begin(ModbusPollEntry &entry)
+{
+    switch (entry.function)
+    {
+    case ModbusFunction::kReadCoils:
+        return master_.BeginReadCoils(entry.slave, entry.address, entry.quantity);
+    case ModbusFunction::kReadDiscreteInputs:
+        return master_.BeginReadDiscreteInputs(entry.slave, entry.address, entry.quantity);
+    case ModbusFunction::kReadHoldingRegisters:
+        return master_.BeginReadHoldingRegisters(entry.slave, entry.address, entry.quantity);
+    case ModbusFunction::kReadInputRegisters:
+        return master_.BeginReadInputRegisters(entry.slave, entry.address, entry.quantity);
+    default:
+        return ModbusStatus::kInvalidArgument;
+    }
+}
+
+void ModbusPollScheduler::Complete(const ModbusStatus status)
+{
+    ModbusPollEntry &entry = entries_[current_];
+    current_ = count_;
+    entry.status = status;
+    // Keep the cadence of the interval, a slot missed while the bus was busy is not caught up
+    entry.next_time += entry.interval;
+    if ((long)(start_time_ - entry.next_time) >= 0)
+    {
+        entry.next_time = start_time_ + entry.interval;
+    }
+
+    if (status == ModbusStatus::kOk)
+    {
+        statistics_.responses++;
+        if (entry.function == ModbusFunction::kReadHoldingRegisters || entry.function == ModbusFunction::kReadInputRegisters)
+        {
+            uint16_t *registers = static_cast<uint16_t *>(entry.data);
+            for (uint16_t i = 0; registers && i < entry.quantity; i++)
+            {
+                registers[i] = master_.GetRegister(i);
+            }
+        }
+        else if (entry.data)
+        {
+            memcpy(entry.data, master_.GetResponseData(), master_.GetResponseDataLength());
+        }
+    }
+    else if (status == ModbusStatus::kException || status == ModbusStatus::kCrcError || status == ModbusStatus::kInvalidResponse ||
+             status == ModbusStatus::kTransmitError)
+    {
+        statistics_.errors++;
+    }
+
+    if (status == ModbusStatus::kTimeout)
+    {
+        statistics_.timeouts++;
+        uint8_t failures = entry.failures < 31 ? entry.failures + 1 : entry.failures;
+        unsigned long backoff = first_backoff_ << (failures - 1);
+        if (failures > 16 || backoff > maximum_backoff_)
+        {
+            backoff = maximum_backoff_;
+        }
+        backoff = backoff > entry.interval ? backoff : entry.interval;
+
+        // Every entry of the slave waits, the slave is dead for all of them
+        unsigned long now = millis();
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (entries_[i].slave == entry.slave)
+            {
+                entries_[i].failures = failures;
+                entries_[i].next_time = now + backoff;
+            }
+        }
+    }
+    else if (entry.failures && status != ModbusStatus::kInvalidArgument && status != ModbusStatus::kBufferTooSmall &&
+             status != ModbusStatus::kTransmitError)
+    {
+        // The slave answered again, its other entries no longer wait for the backoff
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (entries_[i].slave == entry.slave && &entries_[i] != &entry)
+            {
+                entries_[i].failures = 0;
+                entries_[i].next_time = start_time_;
+            }
+        }
+        entry.failures = 0;
+    }
+
+    if (callback_)
+    {
+        callback_(entry, status, callback_context_);
+    }
+}
+
+bool ModbusPollScheduler::IsResponsive(const size_t index)
+{
+    return entries_[index].failures == 0;
+}
+
+const ModbusPollStatistics &ModbusPollScheduler::GetStatistics(void)
+{
+    return statistics_;
+}
+
+void ModbusPollScheduler::ResetStatistics(void)
+{
+    statistics_.requests = 0;
+    statistics_.responses = 0;
+    statistics_.timeouts = 0;
+    statistics_.errors = 0;
+}
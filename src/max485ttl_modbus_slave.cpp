@@ -0,0 +1,385 @@
+/**
+ * @file max485ttl_modbus_slave.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Modbus RTU slave using the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_modbus_slave.hpp"
+
+namespace
+{
+    bool GetBit(const uint8_t *bits, const uint16_t index)
+    {
+        return (bits[index / 8] >> (index % 8)) & 1;
+    }
+
+    void SetBit(uint8_t *bits, const uint16_t index, const bool value)
+    {
+        if (value)
+        {
+            bits[index / 8] |= static_cast<uint8_t>(1 << (index % 8));
+        }
+        else
+        {
+            bits[index / 8] &= static_cast<uint8_t>(~(1 << (index % 8)));
+        }
+    }
+}
+
+ModbusSlave::ModbusSlave(RS485 &rs485, const uint8_t address, const ModbusBlock *const map, const size_t map_length, uint8_t *const buffer, const size_t size)
+    : rs485_(rs485), receiver_(rs485, buffer, size)
+{
+    this->buffer_ = buffer;
+    this->size_ = size;
+    this->address_ = address;
+    this->map_ = map;
+    this->map_length_ = map_length;
+    this->early_completion_ = true;
+    this->write_callback_ = nullptr;
+    this->write_context_ = nullptr;
+    this->response_latency_ = 0;
+
+    receiver_.SetInterCharacterTimeout(3, kModbusMinimumInterCharacterTimeout);
+    receiver_.SetInterFrameTimeout(7, kModbusMinimumInterFrameTimeout);
+
+    // The CRC is calculated while the bytes are read, checking a response takes no extra pass
+    rs485_.SetReceiveCrc(RS485::CrcType::kCrc16Modbus);
+    receiver_.ReleaseFrame();
+}
+
+void ModbusSlave::SetAddress(const uint8_t address)
+{
+    address_ = address;
+}
+
+void ModbusSlave::SetEarlyCompletion(const bool enabled)
+{
+    early_completion_ = enabled;
+}
+
+void ModbusSlave::SetWriteCallback(ModbusWriteCallback callback, void *context)
+{
+    write_callback_ = callback;
+    write_context_ = context;
+}
+
+unsigned long ModbusSlave::GetResponseLatency(void)
+{
+    return response_latency_;
+}
+
+bool ModbusSlave::Poll(void)
+{
+    bool complete = receiver_.Poll();
+    size_t length = receiver_.GetFrameLength();
+    if (length == 0)
+    {
+        if (complete)
+        {
+            receiver_.ReleaseFrame();
+        }
+        return false;
+    }
+
+    // Drop frames for other slaves on the first byte, no CRC or decoding needed
+    if (buffer_[0] != address_ && buffer_[0] != kModbusBroadcastAddress)
+    {
+        if (complete)
+        {
+            receiver_.ReleaseFrame();
+        }
+        return false;
+    }
+
+    if (!complete)
+    {
+        // The length of a request is known from its header, a matching CRC means the request is complete
+        size_t expected_length = early_completion_ ? GetExpectedLength() : 0;
+        if (expected_length == 0 || length != expected_length || !receiver_.IsFrameCrcValid())
+        {
+            return false;
+        }
+    }
+    else if (receiver_.IsFrameOverflowed() || receiver_.IsFrameBroken() || !receiver_.IsFrameCrcValid())
+    {
+        receiver_.ReleaseFrame();
+        return false;
+    }
+
+    size_t response_length = Handle(length);
+    if (response_length && buffer_[0] != kModbusBroadcastAddress)
+    {
+        response_length = ModbusAppendCrc(buffer_, response_length);
+        response_latency_ = micros() - receiver_.GetFrameEndTime();
+        rs485_.Send(buffer_, response_length);
+    }
+
+    receiver_.ReleaseFrame();
+    return true;
+}
+
+size_t ModbusSlave::GetExpectedLength(void)
+{
+    size_t length = receiver_.GetFrameLength();
+    if (length < 2)
+    {
+        return 0;
+    }
+
+    switch (static_cast<ModbusFunction>(buffer_[1]))
+    {
+    case ModbusFunction::kReadCoils:
+    case ModbusFunction::kReadDiscreteInputs:
+    case ModbusFunction::kReadHoldingRegisters:
+    case ModbusFunction::kReadInputRegisters:
+    case ModbusFunction::kWriteSingleCoil:
+    case ModbusFunction::kWriteSingleRegister:
+        return 8;
+    case ModbusFunction::kWriteMultipleCoils:
+    case ModbusFunction::kWriteMultipleRegisters:
+        return length > 6 ? 9 + buffer_[6] : 0;
+    case ModbusFunction::kReadWriteMultipleRegisters:
+        return length > 10 ? 13 + buffer_[10] : 0;
+    default:
+        return 0;
+    }
+}
+
+const ModbusBlock *ModbusSlave::FindBlock(const ModbusTable table, const uint16_t address, const uint16_t quantity)
+{
+    for (size_t i = 0; i < map_length_; i++)
+    {
+        const ModbusBlock *block = &map_[i];
+        if (block->table == table && address >= block->start &&
+            static_cast<uint32_t>(address) + quantity <= static_cast<uint32_t>(block->start) + block->count)
+        {
+            return block;
+        }
+    }
+
+    return nullptr;
+}
+
+size_t ModbusSlave::Exception(const ModbusException exception)
+{
+    buffer_[1] |= 0x80;
+    buffer_[2] = static_cast<uint8_t>(exception);
+
+    return 3;
+}
+
+size_t ModbusSlave::ReadBits(const ModbusBlock *block, const uint16_t address, const uint16_t quantity)
+{
+    uint8_t byte_count = static_cast<uint8_t>((quantity + 7) / 8);
+    if (3U + byte_count + 2 > size_)
+    {
+        return Exception(ModbusException::kSlaveDeviceFailure);
+    }
+
+    const uint8_t *bits = static_cast<const uint8_t *>(block->data);
+    uint16_t offset = address - block->start;
+    buffer_[2] = byte_count;
+    memset(&buffer_[3], 0, byte_count);
+    for (uint16_t i = 0; i < quantity; i++)
+    {
+        if (GetBit(bits, offset + i))
+        {
+            SetBit(&buffer_[3], i, true);
+        }
+    }
+
+    return 3 + byte_count;
+}
+
+size_t ModbusSlave::ReadRegisters(const ModbusBlock *block, const uint16_t address, const uint16_t quantity)
+{
+    uint8_t byte_count = static_cast<uint8_t>(quantity * 2);
+    if (3U + byte_count + 2 > size_)
+    {
+        return Exception(ModbusException::kSlaveDeviceFailure);
+    }
+
+    const uint16_t *registers = static_cast<const uint16_t *>(block->data) + (address - block->start);
+    buffer_[2] = byte_count;
+    for (uint16_t i = 0; i < quantity; i++)
+    {
+        ModbusSetWord(&buffer_[3 + i * 2], registers[i]);
+    }
+
+    return 3 + byte_count;
+}
+
+size_t ModbusSlave::Handle(const size_t length)
+{
+    ModbusFunction function = static_cast<ModbusFunction>(buffer_[1]);
+    uint16_t address = ModbusGetWord(&buffer_[2]);
+    uint16_t quantity = ModbusGetWord(&buffer_[4]);
+    const ModbusBlock *block;
+
+    switch (function)
+    {
+    case ModbusFunction::kReadCoils:
+    case ModbusFunction::kReadDiscreteInputs:
+    {
+        if (length != 8 || quantity < 1 || quantity > 2000)
+        {
+            return Exception(ModbusException::kIllegalDataValue);
+        }
+
+        ModbusTable table = function == ModbusFunction::kReadCoils ? ModbusTable::kCoils : ModbusTable::kDiscreteInputs;
+        if (!(block = FindBlock(table, address, quantity)))
+        {
+            return Exception(ModbusException::kIllegalDataAddress);
+        }
+
+        return ReadBits(block, address, quantity);
+    }
+    case ModbusFunction::kReadHoldingRegisters:
+    case ModbusFunction::kReadInputRegisters:
+    {
+        if (length != 8 || quantity < 1 || quantity > 125)
+        {
+            return Exception(ModbusException::kIllegalDataValue);
+        }
+
+        ModbusTable table = function == ModbusFunction::kReadHoldingRegisters ? ModbusTable::kHoldingRegisters : ModbusTable::kInputRegisters;
+        if (!(block = FindBlock(table, address, quantity)))
+        {
+            return Exception(ModbusException::kIllegalDataAddress);
+        }
+
+        return ReadRegisters(block, address, quantity);
+    }
+    case ModbusFunction::kWriteSingleCoil:
+    {
+        if (length != 8 || (quantity != 0xFF00 && quantity != 0x0000))
+        {
+            return Exception(ModbusException::kIllegalDataValue);
+        }
+
+        if (!(block = FindBlock(ModbusTable::kCoils, address, 1)))
+        {
+            return Exception(ModbusException::kIllegalDataAddress);
+        }
+
+        SetBit(static_cast<uint8_t *>(block->data), address - block->start, quantity == 0xFF00);
+        if (write_callback_)
+        {
+            write_callback_(ModbusTable::kCoils, address, 1, write_context_);
+        }
+
+        // Response is the echo of the request, which is already in the buffer
+        return 6;
+    }
+    case ModbusFunction::kWriteSingleRegister:
+    {
+        if (length != 8)
+        {
+            return Exception(ModbusException::kIllegalDataValue);
+        }
+
+        if (!(block = FindBlock(ModbusTable::kHoldingRegisters, address, 1)))
+        {
+            return Exception(ModbusException::kIllegalDataAddress);
+        }
+
+        static_cast<uint16_t *>(block->data)[address - block->start] = quantity;
+        if (write_callback_)
+        {
+            write_callback_(ModbusTable::kHoldingRegisters, address, 1, write_context_);
+        }
+
+        return 6;
+    }
+    case ModbusFunction::kWriteMultipleCoils:
+    {
+        if (quantity < 1 || quantity > 1968 || buffer_[6] != (quantity + 7) / 8 || length != 9U + buffer_[6])
+        {
+            return Exception(ModbusException::kIllegalDataValue);
+        }
+
+        if (!(block = FindBlock(ModbusTable::kCoils, address, quantity)))
+        {
+            return Exception(ModbusException::kIllegalDataAddress);
+        }
+
+        uint8_t *bits = static_cast<uint8_t *>(block->data);
+        uint16_t offset = address - block->start;
+        for (uint16_t i = 0; i < quantity; i++)
+        {
+            SetBit(bits, offset + i, GetBit(&buffer_[7], i));
+        }
+        if (write_callback_)
+        {
+            write_callback_(ModbusTable::kCoils, address, quantity, write_context_);
+        }
+
+        return 6;
+    }
+    case ModbusFunction::kWriteMultipleRegisters:
+    {
+        if (quantity < 1 || quantity > 123 || buffer_[6] != quantity * 2 || length != 9U + buffer_[6])
+        {
+            return Exception(ModbusException::kIllegalDataValue);
+        }
+
+        if (!(block = FindBlock(ModbusTable::kHoldingRegisters, address, quantity)))
+        {
+            return Exception(ModbusException::kIllegalDataAddress);
+        }
+
+        uint16_t *registers = static_cast<uint16_t *>(block->data) + (address - block->start);
+        for (uint16_t i = 0; i < quantity; i++)
+        {
+            registers[i] = ModbusGetWord(&buffer_[7 + i * 2]);
+        }
+        if (write_callback_)
+        {
+            write_callback_(ModbusTable::kHoldingRegisters, address, quantity, write_context_);
+        }
+
+        return 6;
+    }
+    case ModbusFunction::kReadWriteMultipleRegisters:
+    {
+        if (length < 13)
+        {
+            return Exception(ModbusException::kIllegalDataValue);
+        }
+
+        uint16_t write_address = ModbusGetWord(&buffer_[6]);
+        uint16_t write_quantity = ModbusGetWord(&buffer_[8]);
+        if (quantity < 1 || quantity > 125 || write_quantity < 1 || write_quantity > 121 ||
+            buffer_[10] != write_quantity * 2 || length != 13U + buffer_[10])
+        {
+            return Exception(ModbusException::kIllegalDataValue);
+        }
+
+        const ModbusBlock *write_block = FindBlock(ModbusTable::kHoldingRegisters, write_address, write_quantity);
+        if (!(block = FindBlock(ModbusTable::kHoldingRegisters, address, quantity)) || !write_block)
+        {
+            return Exception(ModbusException::kIllegalDataAddress);
+        }
+
+        // The write is done before the read, the response overwrites the written values in the buffer
+        uint16_t *registers = static_cast<uint16_t *>(write_block->data) + (write_address - write_block->start);
+        for (uint16_t i = 0; i < write_quantity; i++)
+        {
+            registers[i] = ModbusGetWord(&buffer_[11 + i * 2]);
+        }
+        if (write_callback_)
+        {
+            write_callback_(ModbusTable::kHoldingRegisters, write_address, write_quantity, write_context_);
+        }
+
+        return ReadRegisters(block, address, quantity);
+    }
+    default:
+        return Exception(ModbusException::kIllegalFunction);
+    }
+}
@@ -0,0 +1,199 @@
+/**
+ * @file max485ttl_pipeline.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Pipelined requests over a full-duplex (4-wire) link using the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_pipeline.hpp"
+
+RS485Pipeline::RS485Pipeline(RS485 &rs485, RS485PipelineRequest *const requests, const size_t depth, uint8_t *const buffer, const size_t size)
+    : rs485_(rs485)
+{
+    this->requests_ = requests;
+    this->depth_ = depth;
+    this->buffer_ = buffer;
+    this->size_ = size;
+    this->response_timeout_ = kDefaultResponseTimeout;
+    this->head_ = 0;
+    this->count_ = 0;
+    this->received_ = 0;
+    this->head_start_time_ = 0;
+    this->complete_ = false;
+    this->timed_out_ = false;
+    this->resynchronising_ = false;
+    this->last_byte_time_ = 0;
+    this->skip_ = 0;
+    this->lost_ = 0;
+}
+
+void RS485Pipeline::SetResponseTimeout(const unsigned long timeout_in_millisecond)
+{
+    response_timeout_ = timeout_in_millisecond;
+}
+
+bool RS485Pipeline::Send(const uint8_t *const request, const size_t length, const size_t response_length, const uint16_t tag)
+{
+    if (count_ == depth_ || response_length > size_)
+    {
+        return false;
+    }
+
+    size_t index = head_ + count_;
+    index = index < depth_ ? index : index - depth_;
+    RS485PipelineRequest &slot = requests_[index];
+    slot.tag = tag;
+    slot.response_length = response_length;
+    if (count_ == 0)
+    {
+        head_start_time_ = millis();
+    }
+    count_++;
+
+    rs485_.Send(request, length);
+    return true;
+}
+
+bool RS485Pipeline::Poll(void)
+{
+    if (complete_ || timed_out_)
+    {
+        return true;
+    }
+
+    // Also without requests in flight, so a late tail is dropped when it arrives instead of when the next request is sent
+    if (resynchronising_)
+    {
+        Resynchronise();
+    }
+
+    if (count_ == 0)
+    {
+        // Nobody waits for these bytes, they were noise
+        lost_ = 0;
+        return false;
+    }
+
+    if (lost_)
+    {
+        // Bytes of this response were dropped, it fails now instead of waiting for the timeout
+        size_t response_length = requests_[head_].response_length;
+        size_t taken = lost_ < response_length ? lost_ : response_length;
+        lost_ -= taken;
+        if (resynchronising_)
+        {
+            // The rest of it is still to come
+            skip_ += response_length - taken;
+        }
+        timed_out_ = true;
+        received_ = 0;
+        return true;
+    }
+
+    if (resynchronising_)
+    {
+        return false;
+    }
+
+    // Only the bytes of the oldest response are taken, the next responses wait in the stream
+    size_t response_length = requests_[head_].response_length;
+    received_ += rs485_.read(buffer_ + received_, response_length - received_);
+    if (received_ == response_length)
+    {
+        complete_ = true;
+        return true;
+    }
+
+    if (millis() - head_start_time_ >= response_timeout_)
+    {
+        timed_out_ = true;
+        // Bytes of this response may still arrive, the next responses are only in step after silence
+        skip_ = response_length - received_;
+        received_ = 0;
+        resynchronising_ = true;
+        last_byte_time_ = micros();
+        return true;
+    }
+
+    return false;
+}
+
+void RS485Pipeline::Resynchronise(void)
+{
+    uint8_t dropped[16];
+    size_t length = rs485_.read(dropped, sizeof(dropped));
+    if (length > 0)
+    {
+        // The peer answers in order, what exceeds the rest of the late response belongs to the next responses
+        size_t skipped = length < skip_ ? length : skip_;
+        skip_ -= skipped;
+        lost_ += length - skipped;
+        last_byte_time_ = micros();
+        return;
+    }
+
+    unsigned long silence = (7 * rs485_.GetCharacterTime() + 1) / 2;
+    silence = silence ? silence : kDefaultSilence;
+    if (micros() - last_byte_time_ < silence)
+    {
+        return;
+    }
+
+    resynchronising_ = false;
+    // A response which did not arrive completely before the silence will not be completed anymore
+    skip_ = 0;
+    // The wait for the next response starts when it can be received
+    head_start_time_ = millis();
+}
+
+bool RS485Pipeline::IsTimedOut(void)
+{
+    return timed_out_;
+}
+
+uint16_t RS485Pipeline::GetTag(void)
+{
+    return requests_[head_].tag;
+}
+
+const uint8_t *RS485Pipeline::GetResponse(void)
+{
+    return buffer_;
+}
+
+size_t RS485Pipeline::GetResponseLength(void)
+{
+    return received_;
+}
+
+void RS485Pipeline::ReleaseResponse(void)
+{
+    if (!complete_ && !timed_out_)
+    {
+        return;
+    }
+
+    head_++;
+    head_ = head_ < depth_ ? head_ : 0;
+    count_--;
+    received_ = 0;
+    complete_ = false;
+    timed_out_ = false;
+
+    // The peer answers in order, so the wait for the next response only starts now
+    head_start_time_ = millis();
+}
+
+size_t RS485Pipeline::GetOutstandingCount(void)
+{
+    return count_;
+}
+
+bool RS485Pipeline::IsFull(void)
+{
+    return count_ == depth_;
+}
@@ -0,0 +1,220 @@
+/**
+ * @file max485ttl_platform.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Host implementation of the Arduino functions declared in max485ttl_platform.hpp
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef ARDUINO
+#include "max485ttl_platform.hpp"
+
+#include <chrono>
+#include <thread>
+
+namespace
+{
+    const std::chrono::steady_clock::time_point kStart = std::chrono::steady_clock::now();
+
+    // Pin states are stored so digitalRead returns what was written, like on a real pin set to OUTPUT
+    uint8_t pin_states[256];
+    unsigned long pin_change_times[256];
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    uint8_t state = value ? HIGH : LOW;
+    if (pin_states[pin] != state)
+    {
+        pin_states[pin] = state;
+        pin_change_times[pin] = micros();
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pin_states[pin];
+}
+
+unsigned long GetPinChangeTime(uint8_t pin)
+{
+    return pin_change_times[pin];
+}
+
+unsigned long millis(void)
+{
+    return static_cast<unsigned long>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - kStart).count());
+}
+
+unsigned long micros(void)
+{
+    return static_cast<unsigned long>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - kStart).count());
+}
+
+void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    // Busy wait like the Arduino core does, sleeping is far too coarse for microseconds
+    unsigned long start = micros();
+    while (micros() - start < us)
+    {
+    }
+}
+
+size_t Print::PrintNumber(unsigned long n, uint8_t base)
+{
+    // Longest number is a 64 bit value in binary
+    char buffer[8 * sizeof(long)];
+    char *cursor = buffer + sizeof(buffer);
+    if (base < 2)
+    {
+        base = 10;
+    }
+
+    do
+    {
+        char digit = static_cast<char>(n % base);
+        n /= base;
+        *--cursor = digit < 10 ? digit + '0' : digit + 'A' - 10;
+    } while (n);
+
+    return write(cursor, static_cast<size_t>(buffer + sizeof(buffer) - cursor));
+}
+
+size_t Print::PrintFloat(double n, uint8_t digits)
+{
+    size_t written = 0;
+    if (n < 0.0)
+    {
+        written += print('-');
+        n = -n;
+    }
+
+    // Round at the last printed digit
+    double rounding = 0.5;
+    for (uint8_t i = 0; i < digits; i++)
+    {
+        rounding /= 10.0;
+    }
+    n += rounding;
+
+    unsigned long integer = static_cast<unsigned long>(n);
+    written += PrintNumber(integer, 10);
+    if (digits > 0)
+    {
+        written += print('.');
+    }
+
+    double remainder = n - static_cast<double>(integer);
+    while (digits-- > 0)
+    {
+        remainder *= 10.0;
+        unsigned int digit = static_cast<unsigned int>(remainder);
+        written += print(static_cast<char>('0' + digit));
+        remainder -= digit;
+    }
+
+    return written;
+}
+
+size_t Print::print(const char *str)
+{
+    return write(str);
+}
+
+size_t Print::print(char c)
+{
+    return write(static_cast<uint8_t>(c));
+}
+
+size_t Print::print(int n, int base)
+{
+    return print(static_cast<long>(n), base);
+}
+
+size_t Print::print(unsigned int n, int base)
+{
+    return print(static_cast<unsigned long>(n), base);
+}
+
+size_t Print::print(long n, int base)
+{
+    if (base == 10 && n < 0)
+    {
+        size_t written = print('-');
+        return written + PrintNumber(0UL - static_cast<unsigned long>(n), 10);
+    }
+
+    return PrintNumber(static_cast<unsigned long>(n), static_cast<uint8_t>(base));
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    return PrintNumber(n, static_cast<uint8_t>(base));
+}
+
+size_t Print::print(double n, int digits)
+{
+    return PrintFloat(n, static_cast<uint8_t>(digits));
+}
+
+size_t Print::println(void)
+{
+    return write("\r\n");
+}
+
+size_t Print::println(const char *str)
+{
+    size_t written = print(str);
+    return written + println();
+}
+
+size_t Print::println(char c)
+{
+    size_t written = print(c);
+    return written + println();
+}
+
+size_t Print::println(int n, int base)
+{
+    size_t written = print(n, base);
+    return written + println();
+}
+
+size_t Print::println(unsigned int n, int base)
+{
+    size_t written = print(n, base);
+    return written + println();
+}
+
+size_t Print::println(long n, int base)
+{
+    size_t written = print(n, base);
+    return written + println();
+}
+
+size_t Print::println(unsigned long n, int base)
+{
+    size_t written = print(n, base);
+    return written + println();
+}
+
+size_t Print::println(double n, int digits)
+{
+    size_t written = print(n, digits);
+    return written + println();
+}
+#endif // ARDUINO
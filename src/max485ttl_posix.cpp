@@ -0,0 +1,395 @@
+/**
+ * @file max485ttl_posix.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief POSIX backend so RS485 can be used on a termios serial port, for example a USB-RS485 adapter on a Linux gateway
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_posix.hpp"
+
+#ifdef MAX485TTL_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+namespace
+{
+    bool ToSpeed(const unsigned long baudrate, speed_t *speed)
+    {
+        switch (baudrate)
+        {
+        case 1200:
+            *speed = B1200;
+            return true;
+        case 2400:
+            *speed = B2400;
+            return true;
+        case 4800:
+            *speed = B4800;
+            return true;
+        case 9600:
+            *speed = B9600;
+            return true;
+        case 19200:
+            *speed = B19200;
+            return true;
+        case 38400:
+            *speed = B38400;
+            return true;
+        case 57600:
+            *speed = B57600;
+            return true;
+        case 115200:
+            *speed = B115200;
+            return true;
+        case 230400:
+            *speed = B230400;
+            return true;
+#ifdef B460800
+        case 460800:
+            *speed = B460800;
+            return true;
+#endif
+#ifdef B921600
+        case 921600:
+            *speed = B921600;
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+}
+
+PosixSerial::PosixSerial(void)
+{
+    this->file_descriptor_ = -1;
+    this->baudrate_ = 0;
+    this->bits_per_character_ = 10;
+    this->direction_control_ = PosixDirectionControl::kNone;
+    this->receive_head_ = 0;
+    this->receive_tail_ = 0;
+}
+
+PosixSerial::~PosixSerial(void)
+{
+    Close();
+}
+
+bool PosixSerial::Open(const char *const path, const unsigned long baudrate, const PosixParity parity, const uint8_t stop_bits)
+{
+    int file_descriptor = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (file_descriptor < 0)
+    {
+        return false;
+    }
+
+    if (!Open(file_descriptor, baudrate, parity, stop_bits))
+    {
+        close(file_descriptor);
+        return false;
+    }
+
+    return true;
+}
+
+bool PosixSerial::Open(const int file_descriptor, const unsigned long baudrate, const PosixParity parity, const uint8_t stop_bits)
+{
+    Close();
+
+    speed_t speed;
+    struct termios options;
+    if (file_descriptor < 0 || !ToSpeed(baudrate, &speed) || (stop_bits != 1 && stop_bits != 2) ||
+        tcgetattr(file_descriptor, &options) != 0)
+    {
+        return false;
+    }
+
+    cfmakeraw(&options);
+    cfsetispeed(&options, speed);
+    cfsetospeed(&options, speed);
+    options.c_cflag |= CLOCAL | CREAD;
+    options.c_cflag &= ~(PARENB | PARODD | CSTOPB);
+#ifdef CRTSCTS
+    options.c_cflag &= ~CRTSCTS;
+#endif
+    if (parity != PosixParity::kNone)
+    {
+        options.c_cflag |= PARENB;
+        if (parity == PosixParity::kOdd)
+        {
+            options.c_cflag |= PARODD;
+        }
+    }
+    if (stop_bits == 2)
+    {
+        options.c_cflag |= CSTOPB;
+    }
+    options.c_cc[VMIN] = 0;
+    options.c_cc[VTIME] = 0;
+
+    if (tcsetattr(file_descriptor, TCSANOW, &options) != 0 ||
+        fcntl(file_descriptor, F_SETFL, fcntl(file_descriptor, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        return false;
+    }
+
+    file_descriptor_ = file_descriptor;
+    baudrate_ = baudrate;
+    bits_per_character_ = static_cast<uint8_t>(1 + 8 + (parity != PosixParity::kNone ? 1 : 0) + stop_bits);
+    receive_head_ = 0;
+    receive_tail_ = 0;
+
+    return true;
+}
+
+void PosixSerial::Close(void)
+{
+    if (file_descriptor_ >= 0)
+    {
+        close(file_descriptor_);
+    }
+    file_descriptor_ = -1;
+    direction_control_ = PosixDirectionControl::kNone;
+    receive_head_ = 0;
+    receive_tail_ = 0;
+}
+
+bool PosixSerial::IsOpen(void)
+{
+    return file_descriptor_ >= 0;
+}
+
+int PosixSerial::GetFileDescriptor(void)
+{
+    return file_descriptor_;
+}
+
+unsigned long PosixSerial::GetBaudrate(void)
+{
+    return baudrate_;
+}
+
+uint8_t PosixSerial::GetBitsPerCharacter(void)
+{
+    return bits_per_character_;
+}
+
+bool PosixSerial::SetDirectionControl(const PosixDirectionControl control)
+{
+    if (file_descriptor_ < 0)
+    {
+        return false;
+    }
+
+#ifdef __linux__
+    // Leave the kernel RS485 mode when switching to another control, ports without RS485 support fail this with ENOTTY
+    if (direction_control_ == PosixDirectionControl::kKernel || control == PosixDirectionControl::kKernel)
+    {
+        struct serial_rs485 rs485;
+        memset(&rs485, 0, sizeof(rs485));
+        if (control == PosixDirectionControl::kKernel)
+        {
+            rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+        }
+        if (ioctl(file_descriptor_, TIOCSRS485, &rs485) != 0 && control == PosixDirectionControl::kKernel)
+        {
+            return false;
+        }
+    }
+#else
+    if (control == PosixDirectionControl::kKernel)
+    {
+        return false;
+    }
+#endif
+
+    // Ports without modem control lines (like pseudo-terminals) can not use RTS
+    if (control == PosixDirectionControl::kRts && !SetRts(false))
+    {
+        return false;
+    }
+
+    direction_control_ = control;
+    return true;
+}
+
+PosixDirectionControl PosixSerial::GetDirectionControl(void)
+{
+    return direction_control_;
+}
+
+bool PosixSerial::SetRts(const bool enabled)
+{
+    int flag = TIOCM_RTS;
+    return ioctl(file_descriptor_, enabled ? TIOCMBIS : TIOCMBIC, &flag) == 0;
+}
+
+size_t PosixSerial::Fill(void)
+{
+    if (receive_head_ == receive_tail_ && file_descriptor_ >= 0)
+    {
+        ssize_t received = ::read(file_descriptor_, receive_buffer_, sizeof(receive_buffer_));
+        receive_head_ = 0;
+        receive_tail_ = received > 0 ? static_cast<size_t>(received) : 0;
+    }
+
+    return receive_tail_ - receive_head_;
+}
+
+int PosixSerial::available(void)
+{
+    if (file_descriptor_ < 0)
+    {
+        return 0;
+    }
+
+    int pending = 0;
+    if (ioctl(file_descriptor_, FIONREAD, &pending) != 0)
+    {
+        pending = 0;
+    }
+
+    return static_cast<int>(receive_tail_ - receive_head_) + pending;
+}
+
+int PosixSerial::read(void)
+{
+    if (!Fill())
+    {
+        return -1;
+    }
+
+    return receive_buffer_[receive_head_++];
+}
+
+int PosixSerial::peek(void)
+{
+    if (!Fill())
+    {
+        return -1;
+    }
+
+    return receive_buffer_[receive_head_];
+}
+
+size_t PosixSerial::read(uint8_t *const buffer, const size_t length)
+{
+    size_t buffered = receive_tail_ - receive_head_;
+    if (buffered > length)
+    {
+        buffered = length;
+    }
+    memcpy(buffer, &receive_buffer_[receive_head_], buffered);
+    receive_head_ += buffered;
+
+    if (buffered == length || file_descriptor_ < 0)
+    {
+        return buffered;
+    }
+
+    // The rest goes straight into the buffer of the caller
+    ssize_t received = ::read(file_descriptor_, buffer + buffered, length - buffered);
+    return buffered + (received > 0 ? static_cast<size_t>(received) : 0);
+}
+
+size_t PosixSerial::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+size_t PosixSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (file_descriptor_ < 0 || size == 0)
+    {
+        return 0;
+    }
+
+    size_t total = 0;
+    while (total < size)
+    {
+        ssize_t written = ::write(file_descriptor_, buffer + total, size - total);
+        if (written > 0)
+        {
+            total += static_cast<size_t>(written);
+        }
+        else if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (written < 0 && errno == EAGAIN)
+        {
+            // The kernel buffer is full, wait until it has room like the Arduino transmit buffer does
+            struct pollfd descriptor = {file_descriptor_, POLLOUT, 0};
+            int ready;
+            do
+            {
+                ready = poll(&descriptor, 1, kWriteTimeout);
+            } while (ready < 0 && errno == EINTR);
+            if (ready <= 0 || !(descriptor.revents & POLLOUT))
+            {
+                break;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return total;
+}
+
+void PosixSerial::flush(void)
+{
+    if (file_descriptor_ >= 0)
+    {
+        tcdrain(file_descriptor_);
+    }
+}
+
+RS485Posix::RS485Posix(PosixSerial &serial, const PosixDirectionControl control)
+    : RS485(kNoPin, kNoPin, &serial), posix_serial_(serial)
+{
+    if (serial.IsOpen())
+    {
+        SetFrameFormat(serial.GetBaudrate(), serial.GetBitsPerCharacter());
+    }
+    serial.SetDirectionControl(control);
+}
+
+size_t RS485Posix::ReadStream(uint8_t *const buffer, const size_t length)
+{
+    return posix_serial_.read(buffer, length);
+}
+
+void RS485Posix::WriteDirection(const uint8_t value)
+{
+    if (posix_serial_.GetDirectionControl() != PosixDirectionControl::kRts)
+    {
+        return;
+    }
+
+    if (value == LOW)
+    {
+        // Data still in the kernel or adapter must leave before the driver is disabled
+        posix_serial_.flush();
+    }
+    posix_serial_.SetRts(value == HIGH);
+}
+
+PosixSerial &RS485Posix::GetSerial(void)
+{
+    return posix_serial_;
+}
+#endif // MAX485TTL_POSIX
@@ -0,0 +1,125 @@
+/**
+ * @file max485ttl_queue.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Transmit queue which sends small frames back-to-back in one transmission of the MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_queue.hpp"
+
+#include <string.h>
+
+RS485TransmitQueue::RS485TransmitQueue(RS485 &rs485, RS485QueueSlot *const slots, const size_t depth) : rs485_(rs485)
+{
+    this->slots_ = slots;
+    this->depth_ = depth;
+    this->head_ = 0;
+    this->count_ = 0;
+    this->coalescing_delay_ = 0;
+    this->oldest_time_ = 0;
+    ResetStatistics();
+}
+
+void RS485TransmitQueue::SetCoalescingDelay(const unsigned long delay_in_microsecond)
+{
+    coalescing_delay_ = delay_in_microsecond;
+}
+
+bool RS485TransmitQueue::Enqueue(const uint8_t *const frame, const size_t length, const unsigned long gap_in_microsecond)
+{
+    if (count_ == depth_ || length > MAX485TTL_QUEUE_FRAME_SIZE)
+    {
+        statistics_.frames_dropped++;
+        return false;
+    }
+
+    size_t index = head_ + count_;
+    index = index < depth_ ? index : index - depth_;
+    RS485QueueSlot &slot = slots_[index];
+    memcpy(slot.data, frame, length);
+    slot.length = length;
+    slot.gap = gap_in_microsecond;
+    if (count_ == 0)
+    {
+        oldest_time_ = micros();
+    }
+    count_++;
+
+    statistics_.frames_queued++;
+    if (count_ > statistics_.max_depth)
+    {
+        statistics_.max_depth = count_;
+    }
+    return true;
+}
+
+size_t RS485TransmitQueue::Poll(void)
+{
+    if (count_ == 0)
+    {
+        return 0;
+    }
+
+    if (count_ < depth_ && micros() - oldest_time_ < coalescing_delay_)
+    {
+        return 0;
+    }
+
+    return Flush();
+}
+
+size_t RS485TransmitQueue::Flush(void)
+{
+    if (count_ == 0)
+    {
+        return 0;
+    }
+
+    size_t batch = count_;
+    rs485_.BeginTransmission();
+    for (size_t i = 0; i < batch; i++)
+    {
+        RS485QueueSlot &slot = slots_[head_];
+        if (i > 0 && slot.gap)
+        {
+            rs485_.InsertGap(slot.gap);
+        }
+        rs485_.write(slot.data, slot.length);
+        head_++;
+        head_ = head_ < depth_ ? head_ : 0;
+    }
+    count_ = 0;
+    rs485_.EndTransmission();
+
+    statistics_.frames_sent += batch;
+    statistics_.transmissions++;
+    if (batch > statistics_.max_batch)
+    {
+        statistics_.max_batch = batch;
+    }
+    return batch;
+}
+
+size_t RS485TransmitQueue::GetDepth(void)
+{
+    return count_;
+}
+
+const RS485QueueStatistics &RS485TransmitQueue::GetStatistics(void)
+{
+    return statistics_;
+}
+
+void RS485TransmitQueue::ResetStatistics(void)
+{
+    statistics_.frames_queued = 0;
+    statistics_.frames_dropped = 0;
+    statistics_.frames_sent = 0;
+    statistics_.transmissions = 0;
+    statistics_.max_batch = 0;
+    statistics_.max_depth = 0;
+}
@@ -0,0 +1,267 @@
+/**
+ * @file max485ttl_reactor.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Event loop servicing many RS485 ports on Linux from one thread using epoll and timerfd
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_reactor.hpp"
+
+#ifdef MAX485TTL_REACTOR
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace
+{
+    // The port index and the kind of file descriptor are stored in the epoll data
+    const uint64_t kTimerFlag = 1;
+
+    uint64_t ToEventData(const size_t port, const bool timer)
+    {
+        return (static_cast<uint64_t>(port) << 1) | (timer ? kTimerFlag : 0);
+    }
+}
+
+RS485Reactor::RS485Reactor(void)
+{
+    this->epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    this->running_ = false;
+    for (size_t i = 0; i < kMaxPorts; i++)
+    {
+        this->ports_[i].rs485 = nullptr;
+        this->ports_[i].receiver = nullptr;
+        this->ports_[i].callback = nullptr;
+        this->ports_[i].context = nullptr;
+        this->ports_[i].file_descriptor = -1;
+        this->ports_[i].timer = -1;
+        this->ports_[i].state = PortState::kUnused;
+    }
+}
+
+RS485Reactor::~RS485Reactor(void)
+{
+    for (size_t i = 0; i < kMaxPorts; i++)
+    {
+        RemovePort(i);
+    }
+    if (epoll_ >= 0)
+    {
+        close(epoll_);
+    }
+}
+
+int RS485Reactor::AddPort(RS485Posix &rs485, RS485FrameReceiver &receiver, RS485ReactorCallback callback, void *context)
+{
+    int file_descriptor = rs485.GetSerial().GetFileDescriptor();
+    if (epoll_ < 0 || file_descriptor < 0)
+    {
+        return -1;
+    }
+
+    size_t port = 0;
+    while (port < kMaxPorts && ports_[port].state != PortState::kUnused)
+    {
+        port++;
+    }
+    if (port == kMaxPorts)
+    {
+        return -1;
+    }
+
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer < 0)
+    {
+        return -1;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = ToEventData(port, false);
+    if (epoll_ctl(epoll_, EPOLL_CTL_ADD, file_descriptor, &event) != 0)
+    {
+        close(timer);
+        return -1;
+    }
+    event.data.u64 = ToEventData(port, true);
+    if (epoll_ctl(epoll_, EPOLL_CTL_ADD, timer, &event) != 0)
+    {
+        epoll_ctl(epoll_, EPOLL_CTL_DEL, file_descriptor, nullptr);
+        close(timer);
+        return -1;
+    }
+
+    Port &entry = ports_[port];
+    entry.rs485 = &rs485;
+    entry.receiver = &receiver;
+    entry.callback = callback;
+    entry.context = context;
+    entry.file_descriptor = file_descriptor;
+    entry.timer = timer;
+    entry.state = PortState::kIdle;
+
+    return static_cast<int>(port);
+}
+
+void RS485Reactor::RemovePort(const size_t port)
+{
+    if (port >= kMaxPorts || ports_[port].state == PortState::kUnused)
+    {
+        return;
+    }
+
+    Port &entry = ports_[port];
+    // The port itself may already be destroyed, so only the stored file descriptor is used
+    epoll_ctl(epoll_, EPOLL_CTL_DEL, entry.file_descriptor, nullptr);
+    epoll_ctl(epoll_, EPOLL_CTL_DEL, entry.timer, nullptr);
+    close(entry.timer);
+    entry.rs485 = nullptr;
+    entry.receiver = nullptr;
+    entry.callback = nullptr;
+    entry.context = nullptr;
+    entry.file_descriptor = -1;
+    entry.timer = -1;
+    entry.state = PortState::kUnused;
+}
+
+void RS485Reactor::StartResponseTimeout(const size_t port, const unsigned long timeout_in_millisecond)
+{
+    if (port >= kMaxPorts || ports_[port].state != PortState::kIdle)
+    {
+        return;
+    }
+
+    ports_[port].state = PortState::kWaitingForResponse;
+    ArmTimer(port, timeout_in_millisecond * 1000);
+}
+
+int RS485Reactor::RunOnce(const int timeout_in_millisecond)
+{
+    struct epoll_event events[kMaxEvents];
+    int amount = epoll_wait(epoll_, events, kMaxEvents, timeout_in_millisecond);
+    for (int i = 0; i < amount; i++)
+    {
+        size_t port = static_cast<size_t>(events[i].data.u64 >> 1);
+        // A callback of an earlier event may have removed the port
+        if (ports_[port].state == PortState::kUnused)
+        {
+            continue;
+        }
+
+        if (events[i].data.u64 & kTimerFlag)
+        {
+            HandleTimer(port);
+        }
+        else
+        {
+            HandleReadable(port);
+        }
+    }
+
+    return amount;
+}
+
+void RS485Reactor::Run(void)
+{
+    running_ = true;
+    while (running_)
+    {
+        if (RunOnce() < 0 && errno != EINTR)
+        {
+            break;
+        }
+    }
+}
+
+void RS485Reactor::Stop(void)
+{
+    running_ = false;
+}
+
+RS485Posix &RS485Reactor::GetRS485(const size_t port)
+{
+    return *ports_[port].rs485;
+}
+
+RS485FrameReceiver &RS485Reactor::GetReceiver(const size_t port)
+{
+    return *ports_[port].receiver;
+}
+
+void RS485Reactor::HandleReadable(const size_t port)
+{
+    Port &entry = ports_[port];
+    if (entry.receiver->Poll())
+    {
+        // The previous frame is not released yet, this only happens when the timer is late
+        HandleTimer(port);
+        return;
+    }
+
+    if (entry.receiver->GetFrameLength() || entry.receiver->IsFrameOverflowed())
+    {
+        // Every new byte restarts t3.5
+        entry.state = PortState::kReceiving;
+        ArmTimer(port, entry.receiver->GetInterFrameTimeout());
+    }
+}
+
+void RS485Reactor::HandleTimer(const size_t port)
+{
+    Port &entry = ports_[port];
+    uint64_t expirations;
+    ssize_t result = read(entry.timer, &expirations, sizeof(expirations));
+    (void)result;
+
+    if (entry.state == PortState::kWaitingForResponse)
+    {
+        entry.state = PortState::kIdle;
+        entry.callback(*this, port, RS485ReactorEvent::kResponseTimeout, entry.context);
+        return;
+    }
+
+    if (entry.state != PortState::kReceiving)
+    {
+        return;
+    }
+
+    if (!entry.receiver->Poll())
+    {
+        // The timer fired a little before t3.5 had passed according to micros(), wait for the rest
+        unsigned long elapsed = micros() - entry.receiver->GetFrameEndTime();
+        unsigned long timeout = entry.receiver->GetInterFrameTimeout();
+        ArmTimer(port, elapsed < timeout ? timeout - elapsed : 1);
+        return;
+    }
+
+    entry.state = PortState::kIdle;
+    ArmTimer(port, 0);
+    entry.callback(*this, port, RS485ReactorEvent::kFrameComplete, entry.context);
+
+    // The callback may have removed the port
+    if (entry.state != PortState::kUnused)
+    {
+        entry.receiver->ReleaseFrame();
+        if (entry.rs485->available() > 0)
+        {
+            // Bytes of the next frame which were already read from the file descriptor do not wake up epoll
+            HandleReadable(port);
+        }
+    }
+}
+
+void RS485Reactor::ArmTimer(const size_t port, const unsigned long timeout_in_microsecond)
+{
+    struct itimerspec timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_nsec = 0;
+    timer.it_value.tv_sec = static_cast<time_t>(timeout_in_microsecond / 1000000);
+    timer.it_value.tv_nsec = static_cast<long>(timeout_in_microsecond % 1000000) * 1000;
+    timerfd_settime(ports_[port].timer, 0, &timer, nullptr);
+}
+#endif // MAX485TTL_REACTOR
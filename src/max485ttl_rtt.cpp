@@ -0,0 +1,127 @@
+/**
+ * @file max485ttl_rtt.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Response timeouts from the measured round trip time of every peer on a bus of MAX485TTL modules
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_rtt.hpp"
+
+RS485RttEstimator::RS485RttEstimator(RS485RttPeer *const peers, const size_t count)
+{
+    this->peers_ = peers;
+    this->count_ = count;
+    this->used_ = 0;
+    this->floor_ = kDefaultFloor;
+    this->ceiling_ = kDefaultCeiling;
+}
+
+void RS485RttEstimator::SetLimits(const unsigned long floor_in_microsecond, const unsigned long ceiling_in_microsecond)
+{
+    floor_ = floor_in_microsecond;
+    ceiling_ = ceiling_in_microsecond;
+}
+
+RS485RttPeer *RS485RttEstimator::Find(const uint8_t address, const bool add)
+{
+    for (size_t i = 0; i < used_; i++)
+    {
+        if (peers_[i].address == address)
+        {
+            return &peers_[i];
+        }
+    }
+
+    if (!add || used_ == count_)
+    {
+        return nullptr;
+    }
+
+    RS485RttPeer &peer = peers_[used_++];
+    peer.address = address;
+    peer.backoff = 0;
+    peer.samples = 0;
+    peer.srtt = 0;
+    peer.rttvar = 0;
+    return &peer;
+}
+
+void RS485RttEstimator::AddSample(const uint8_t address, const unsigned long rtt_in_microsecond)
+{
+    RS485RttPeer *peer = Find(address, true);
+    if (!peer)
+    {
+        return;
+    }
+
+    if (peer->samples == 0)
+    {
+        // First sample: srtt = r and rttvar = r / 2
+        peer->srtt = rtt_in_microsecond << 3;
+        peer->rttvar = rtt_in_microsecond << 1;
+    }
+    else
+    {
+        // srtt += (r - srtt) / 8 and rttvar += (|r - srtt| - rttvar) / 4, on the scaled values
+        long delta = (long)rtt_in_microsecond - (long)(peer->srtt >> 3);
+        peer->srtt += delta;
+        delta = delta < 0 ? -delta : delta;
+        peer->rttvar -= peer->rttvar >> 2;
+        peer->rttvar += delta;
+    }
+
+    if (peer->samples < UINT16_MAX)
+    {
+        peer->samples++;
+    }
+    peer->backoff = 0;
+}
+
+void RS485RttEstimator::AddTimeout(const uint8_t address)
+{
+    RS485RttPeer *peer = Find(address, true);
+    if (peer && peer->backoff < kMaximumBackoff)
+    {
+        peer->backoff++;
+    }
+}
+
+unsigned long RS485RttEstimator::GetTimeout(const uint8_t address)
+{
+    RS485RttPeer *peer = Find(address, false);
+    if (!peer || peer->samples == 0)
+    {
+        return ceiling_;
+    }
+
+    // srtt + 4 * rttvar
+    unsigned long timeout = (peer->srtt >> 3) + peer->rttvar;
+    timeout = timeout > floor_ ? timeout : floor_;
+    for (uint8_t i = 0; i < peer->backoff && timeout < ceiling_; i++)
+    {
+        timeout <<= 1;
+    }
+
+    return timeout < ceiling_ ? timeout : ceiling_;
+}
+
+unsigned long RS485RttEstimator::GetSmoothedRtt(const uint8_t address)
+{
+    RS485RttPeer *peer = Find(address, false);
+    return peer ? peer->srtt >> 3 : 0;
+}
+
+unsigned long RS485RttEstimator::GetRttVariation(const uint8_t address)
+{
+    RS485RttPeer *peer = Find(address, false);
+    return peer ? peer->rttvar >> 2 : 0;
+}
+
+void RS485RttEstimator::Reset(void)
+{
+    used_ = 0;
+}
@@ -0,0 +1,295 @@
+/**
+ * @file max485ttl_simulated_bus.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Simulated multi-drop RS485 bus for host builds, modelling the timing of the wire
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_simulated_bus.hpp"
+
+#ifdef MAX485TTL_SIMULATED_BUS
+
+namespace
+{
+    // Times are compared with wrapping arithmetic like micros() on Arduino
+    bool IsBefore(const unsigned long a, const unsigned long b)
+    {
+        return static_cast<long>(a - b) < 0;
+    }
+}
+
+RS485SimulatedBus::RS485SimulatedBus(const unsigned long baudrate, const uint8_t bits_per_character, const unsigned long driver_enable_delay_in_microsecond)
+{
+    this->baudrate_ = baudrate;
+    this->bit_time_ = bits_per_character * 1000000UL;
+    this->character_time_ = (bit_time_ + baudrate - 1) / baudrate;
+    this->driver_enable_delay_ = driver_enable_delay_in_microsecond;
+    for (size_t i = 0; i < kMaxPorts; i++)
+    {
+        this->ports_[i] = nullptr;
+    }
+    this->head_ = 0;
+    this->count_ = 0;
+    ResetStatistics();
+}
+
+unsigned long RS485SimulatedBus::GetCharacterTime(void)
+{
+    return character_time_;
+}
+
+unsigned long RS485SimulatedBus::GetCharacterCount(void)
+{
+    return character_count_;
+}
+
+unsigned long RS485SimulatedBus::GetCollisionCount(void)
+{
+    return collision_count_;
+}
+
+unsigned long RS485SimulatedBus::GetTruncatedCount(void)
+{
+    return truncated_count_;
+}
+
+void RS485SimulatedBus::ResetStatistics(void)
+{
+    character_count_ = 0;
+    collision_count_ = 0;
+    truncated_count_ = 0;
+}
+
+bool RS485SimulatedBus::Attach(RS485SimulatedPort *port)
+{
+    for (size_t i = 0; i < kMaxPorts; i++)
+    {
+        if (!ports_[i])
+        {
+            ports_[i] = port;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void RS485SimulatedBus::Detach(RS485SimulatedPort *port)
+{
+    for (size_t i = 0; i < kMaxPorts; i++)
+    {
+        if (ports_[i] == port)
+        {
+            ports_[i] = nullptr;
+        }
+    }
+
+    // Characters of the port which are still on the wire are lost
+    for (size_t i = 0; i < count_; i++)
+    {
+        Character &character = characters_[(head_ + i) % kMaxCharacters];
+        if (character.source == port)
+        {
+            character.source = nullptr;
+        }
+    }
+}
+
+bool RS485SimulatedBus::IsOtherDriverEnabled(RS485SimulatedPort *port, const unsigned long before)
+{
+    for (size_t i = 0; i < kMaxPorts; i++)
+    {
+        RS485SimulatedPort *other = ports_[i];
+        if (other && other != port && &other->bus_ == this && digitalRead(other->de_pin_) == HIGH &&
+            IsBefore(GetPinChangeTime(other->de_pin_), before))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool RS485SimulatedBus::Transmit(RS485SimulatedPort *port, const uint8_t data)
+{
+    Update();
+    if (count_ == kMaxCharacters)
+    {
+        return false;
+    }
+
+    unsigned long now = micros();
+    character_count_++;
+    if (digitalRead(port->de_pin_) != HIGH)
+    {
+        // Without driver the character only goes into the UART, not onto the wire
+        truncated_count_++;
+        return true;
+    }
+
+    // A character starts after the previous one of this port and after the driver is enabled
+    unsigned long start_time = now;
+    if (IsBefore(start_time, port->transmit_end_time_))
+    {
+        start_time = port->transmit_end_time_;
+    }
+    unsigned long enabled_time = GetPinChangeTime(port->de_pin_) + driver_enable_delay_;
+    if (IsBefore(start_time, enabled_time))
+    {
+        start_time = enabled_time;
+    }
+
+    Character &character = characters_[(head_ + count_) % kMaxCharacters];
+    character.source = port;
+    character.start_time = start_time;
+    // Back-to-back characters keep the exact bit rate, only their sum is rounded up to microseconds
+    unsigned long credit = start_time == port->transmit_end_time_ ? port->transmit_credit_ : 0;
+    unsigned long scaled = bit_time_ - credit;
+    unsigned long duration = (scaled + baudrate_ - 1) / baudrate_;
+    port->transmit_credit_ = duration * baudrate_ - scaled;
+    character.end_time = start_time + duration;
+    character.data = data;
+    character.collided = IsOtherDriverEnabled(port, character.end_time);
+
+    // Characters of other ports on the wire at the same time collide with this one
+    for (size_t i = 0; i < count_; i++)
+    {
+        Character &other = characters_[(head_ + i) % kMaxCharacters];
+        if (other.source != port && IsBefore(other.start_time, character.end_time) &&
+            IsBefore(character.start_time, other.end_time))
+        {
+            other.collided = true;
+            character.collided = true;
+        }
+    }
+
+    count_++;
+    port->transmit_end_time_ = character.end_time;
+    return true;
+}
+
+void RS485SimulatedBus::Update(void)
+{
+    unsigned long now = micros();
+    while (count_ && !IsBefore(now, characters_[head_].end_time))
+    {
+        Character &character = characters_[head_];
+        head_ = (head_ + 1) % kMaxCharacters;
+        count_--;
+
+        RS485SimulatedPort *source = character.source;
+        if (!source)
+        {
+            continue;
+        }
+
+        // DE released before the last stop bit cuts the character off
+        if (digitalRead(source->de_pin_) != HIGH && IsBefore(GetPinChangeTime(source->de_pin_), character.end_time))
+        {
+            truncated_count_++;
+            continue;
+        }
+
+        uint8_t data = character.data;
+        if (character.collided || IsOtherDriverEnabled(source, character.end_time))
+        {
+            // Two drivers fighting, the low (dominant) bits of both win
+            collision_count_++;
+            data &= 0x5A;
+        }
+
+        for (size_t i = 0; i < kMaxPorts; i++)
+        {
+            RS485SimulatedPort *port = ports_[i];
+            if (port && &port->receive_bus_ == this && digitalRead(port->re_pin_) == LOW)
+            {
+                port->receive_buffer_.Push(data);
+            }
+        }
+    }
+}
+
+RS485SimulatedPort::RS485SimulatedPort(RS485SimulatedBus &bus, const uint8_t de_pin, const uint8_t re_pin)
+    : bus_(bus), receive_bus_(bus)
+{
+    this->de_pin_ = de_pin;
+    this->re_pin_ = re_pin;
+    this->transmit_end_time_ = micros();
+    this->transmit_credit_ = 0;
+    this->attached_ = bus.Attach(this);
+    this->receive_attached_ = false;
+}
+
+RS485SimulatedPort::RS485SimulatedPort(RS485SimulatedBus &transmit_bus, RS485SimulatedBus &receive_bus, const uint8_t de_pin, const uint8_t re_pin)
+    : bus_(transmit_bus), receive_bus_(receive_bus)
+{
+    this->de_pin_ = de_pin;
+    this->re_pin_ = re_pin;
+    this->transmit_end_time_ = micros();
+    this->transmit_credit_ = 0;
+    this->attached_ = transmit_bus.Attach(this);
+    this->receive_attached_ = &receive_bus != &transmit_bus && receive_bus.Attach(this);
+}
+
+RS485SimulatedPort::~RS485SimulatedPort(void)
+{
+    if (attached_)
+    {
+        bus_.Detach(this);
+    }
+    if (receive_attached_)
+    {
+        receive_bus_.Detach(this);
+    }
+}
+
+int RS485SimulatedPort::available(void)
+{
+    receive_bus_.Update();
+    return receive_buffer_.Available();
+}
+
+int RS485SimulatedPort::read(void)
+{
+    receive_bus_.Update();
+    return receive_buffer_.Pop();
+}
+
+int RS485SimulatedPort::peek(void)
+{
+    receive_bus_.Update();
+    return receive_buffer_.Peek();
+}
+
+size_t RS485SimulatedPort::write(uint8_t data)
+{
+    if (!attached_)
+    {
+        return 0;
+    }
+
+    while (!bus_.Transmit(this, data))
+    {
+        // Wire is full, wait for the oldest character to pass like a UART with a full transmit buffer
+    }
+
+    return 1;
+}
+
+void RS485SimulatedPort::flush(void)
+{
+    while (IsBefore(micros(), transmit_end_time_))
+    {
+    }
+    bus_.Update();
+}
+
+uint16_t RS485SimulatedPort::GetOverflowCount(void)
+{
+    return receive_buffer_.GetOverflowCount();
+}
+#endif // MAX485TTL_SIMULATED_BUS
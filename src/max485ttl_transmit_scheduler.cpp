@@ -0,0 +1,166 @@
+/**
+ * @file max485ttl_transmit_scheduler.cpp
+ * @author Rik Vos (rpvos.nl)
+ * @brief Transmit scheduler letting urgent frames of the MAX485TTL modules go ahead of a bulk transfer
+ * @version 0.1
+ * @date 2023-09-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "max485ttl_transmit_scheduler.hpp"
+
+#include <string.h>
+
+RS485TransmitScheduler::RS485TransmitScheduler(RS485 &rs485, RS485SchedulerSlot *const slots, const size_t depth) : rs485_(rs485)
+{
+    this->slots_ = slots;
+    this->depth_ = depth;
+    this->head_ = 0;
+    this->count_ = 0;
+    this->bulk_data_ = nullptr;
+    this->bulk_remaining_ = 0;
+    this->chunk_size_ = kDefaultChunkSize;
+    this->frame_gap_ = 0;
+    this->transmitting_ = false;
+    this->free_time_ = 0;
+    ResetStatistics();
+}
+
+void RS485TransmitScheduler::SetChunkSize(const size_t size)
+{
+    chunk_size_ = size ? size : 1;
+}
+
+void RS485TransmitScheduler::SetFrameGap(const unsigned long gap_in_microsecond)
+{
+    frame_gap_ = gap_in_microsecond;
+}
+
+bool RS485TransmitScheduler::Enqueue(const uint8_t *const frame, const size_t length)
+{
+    if (count_ == depth_ || length > MAX485TTL_QUEUE_FRAME_SIZE)
+    {
+        statistics_.frames_dropped++;
+        return false;
+    }
+
+    size_t index = head_ + count_;
+    index = index < depth_ ? index : index - depth_;
+    RS485SchedulerSlot &slot = slots_[index];
+    memcpy(slot.data, frame, length);
+    slot.length = length;
+    slot.enqueue_time = micros();
+    count_++;
+    return true;
+}
+
+bool RS485TransmitScheduler::StartBulk(const uint8_t *const data, const size_t length)
+{
+    if (bulk_remaining_)
+    {
+        return false;
+    }
+
+    bulk_data_ = data;
+    bulk_remaining_ = length;
+    return true;
+}
+
+void RS485TransmitScheduler::CancelBulk(void)
+{
+    bulk_remaining_ = 0;
+}
+
+bool RS485TransmitScheduler::IsBulkActive(void)
+{
+    return bulk_remaining_ > 0;
+}
+
+size_t RS485TransmitScheduler::GetBulkRemaining(void)
+{
+    return bulk_remaining_;
+}
+
+bool RS485TransmitScheduler::Poll(void)
+{
+    if (transmitting_ && (long)(micros() - free_time_) < 0)
+    {
+        return true;
+    }
+
+    if (count_)
+    {
+        RS485SchedulerSlot &slot = slots_[head_];
+        unsigned long latency = micros() - slot.enqueue_time;
+        SendFrame(slot.data, slot.length);
+        head_++;
+        head_ = head_ < depth_ ? head_ : 0;
+        count_--;
+
+        statistics_.frames_sent++;
+        if (bulk_remaining_)
+        {
+            statistics_.preemptions++;
+        }
+        if (latency > statistics_.max_latency)
+        {
+            statistics_.max_latency = latency;
+        }
+        return true;
+    }
+
+    if (bulk_remaining_)
+    {
+        size_t length = bulk_remaining_ < chunk_size_ ? bulk_remaining_ : chunk_size_;
+        SendFrame(bulk_data_, length);
+        bulk_data_ += length;
+        bulk_remaining_ -= length;
+        statistics_.chunks_sent++;
+        return true;
+    }
+
+    if (transmitting_)
+    {
+        // The last stop bit has left, so this does not wait
+        rs485_.EndTransmission();
+        transmitting_ = false;
+    }
+    return false;
+}
+
+void RS485TransmitScheduler::SendFrame(const uint8_t *const data, const size_t length)
+{
+    if (!transmitting_)
+    {
+        rs485_.BeginTransmission();
+        transmitting_ = true;
+    }
+
+    rs485_.write(data, length);
+    rs485_.FlushTransmitBuffer();
+    free_time_ = micros() + rs485_.GetRemainingTransmissionTime() + frame_gap_;
+}
+
+unsigned long RS485TransmitScheduler::GetLatencyBound(void)
+{
+    // Waiting for the longest frame on the wire, then for the frames queued before this one
+    size_t longest = chunk_size_ > MAX485TTL_QUEUE_FRAME_SIZE ? chunk_size_ : MAX485TTL_QUEUE_FRAME_SIZE;
+    unsigned long character_time = rs485_.GetCharacterTime();
+    return (longest + (depth_ - 1) * MAX485TTL_QUEUE_FRAME_SIZE) * character_time + depth_ * frame_gap_;
+}
+
+const RS485SchedulerStatistics &RS485TransmitScheduler::GetStatistics(void)
+{
+    return statistics_;
+}
+
+void RS485TransmitScheduler::ResetStatistics(void)
+{
+    statistics_.frames_sent = 0;
+    statistics_.frames_dropped = 0;
+    statistics_.chunks_sent = 0;
+    statistics_.preemptions = 0;
+    statistics_.max_latency = 0;
+}
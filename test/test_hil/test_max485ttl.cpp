@@ -12,8 +12,14 @@
 #include <Arduino.h>
 #include <unity.h>
 #include "max485ttl.h"
-
-const long kPerformaceTestAmount = 1000000;
+#include "max485ttl_benchmark.hpp"
+#include "max485ttl_line.hpp"
+
+const unsigned long kBaudrate = 115200;
+const size_t kThroughputLength = 200;
+const size_t kRoundTripCount = 100;
+const size_t kRoundTripLength = 8;
+const unsigned long kDirectionSwitchCount = 100;
 const uint8_t de_port = 2;
 const uint8_t re_port = 3;
 HardwareSerial *serial = &Serial1;
@@ -30,7 +36,7 @@ RS485 *rs;
  */
 void setUp(void)
 {
-    serial->begin(115200);
+    serial->begin(kBaudrate);
     rs = new RS485(de_port, re_port, serial);
 };
 
@@ -73,65 +79,55 @@ void test_Write(void)
  */
 void test_Print(void)
 {
-    String input = "AAAABBBBCCCCDDDD";
-    rs->print(input);
-    rs->flush();
-    rs->SetMode(INPUT);
-    // Wait for the byte to be sent back
-    rs->WaitForInput();
+    const char input[] = "AAAABBBBCCCCDDDD\n";
+    rs->Send(input, sizeof(input) - 1);
 
-    if (rs->available())
+    char line[32];
+    RS485LineReader reader(*rs, line, sizeof(line));
+    if (reader.ReadLine(1000))
     {
-        String output = rs->readString();
-        TEST_ASSERT_EQUAL_STRING_MESSAGE(input.c_str(), output.c_str(), "Byte not received correctly");
+        TEST_ASSERT_EQUAL_STRING_MESSAGE("AAAABBBBCCCCDDDD", reader.GetLine(), "Line not received correctly");
     }
     else
     {
-        TEST_FAIL_MESSAGE("No string in response");
+        TEST_FAIL_MESSAGE("No line in response");
     }
 };
 
 /**
- * @brief Test for using the read buffer
+ * @brief Test for a line longer than the stream buffer, ending with \r\n
  *
  */
 void test_Buffer(void)
 {
-    String input = "AAAABBBBCCCCDDDDEEEEFFFFGGGGHHHHIIIIJJJJ\n";
-    rs->print(input);
-    rs->flush();
-
-    int time = millis();
-    while (millis() - time < 5000)
-    {
-        rs->ReadIntoBuffer();
-    }
-
-    TEST_ASSERT_TRUE_MESSAGE(rs->IsDataInBuffer(), "Data was not put into buffer");
-
-    if (rs->IsDataInBuffer())
-    {
-        String output = rs->ReadStringBuffer();
-        // \n is removed because it is the end marker
-        output += "\n";
-        TEST_ASSERT_EQUAL_STRING_MESSAGE(input.c_str(), output.c_str(), "String was not put correctly into buffer or retrieved from buffer");
-    }
+    const char input[] = "AAAABBBBCCCCDDDDEEEEFFFFGGGGHHHHIIIIJJJJKKKKLLLLMMMMNNNNOOOOPPPPQQQQ\r\n";
+    rs->Send(input, sizeof(input) - 1);
+
+    char line[80];
+    RS485LineReader reader(*rs, line, sizeof(line));
+    TEST_ASSERT_TRUE_MESSAGE(reader.ReadLine(5000), "Line was not received");
+    // \r\n is removed because it is the end marker
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(input) - 3, reader.GetLineLength(), "Line was not received completely");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(input, reader.GetLine(), sizeof(input) - 3, "Line was not put correctly into buffer");
+    TEST_ASSERT_FALSE(reader.IsLineTruncated());
 };
 
 /**
- * @brief Test to determine if 2000000 messages could be send and received without error
+ * @brief Test to determine if a number can be sent and received without error
  *
  */
 void test_SendReceive(void)
 {
     int number = rand();
-    rs->println(number);
-    rs->flush();
+    char output[16];
+    int length = snprintf(output, sizeof(output), "%d\r\n", number);
+    rs->Send(output, length);
 
-    rs->WaitForInput();
-    if (rs->available())
+    char line[16];
+    RS485LineReader reader(*rs, line, sizeof(line));
+    if (reader.ReadLine(1000))
     {
-        int read_count = strtol(rs->readString().c_str(), nullptr, 10);
+        int read_count = strtol(reader.GetLine(), nullptr, 10);
         if (read_count == 0)
         {
             TEST_FAIL_MESSAGE("No number was received");
@@ -145,22 +141,32 @@ void test_SendReceive(void)
     }
 }
 
-void test_PerformanceTest(void)
+void Report(const char *line, void *context)
 {
-#ifndef PERFORMANCE_TEST
-    TEST_IGNORE_MESSAGE("Ignored performance, to turn on define PERFORMANCE_TEST");
-#endif
-    unsigned long start_time = millis();
+    (void)context;
+    TEST_MESSAGE(line);
+}
 
-    for (long i = 0; i < kPerformaceTestAmount; i++)
-    {
-        test_SendReceive();
-    }
+/**
+ * @brief Benchmark throughput, round trip latency, direction switching and CPU time against the echo module
+ *
+ */
+void test_Benchmark(void)
+{
+    rs->SetFrameFormat(kBaudrate);
+    RS485Benchmark benchmark(*rs, kBaudrate, Report);
+
+    uint8_t buffer[kThroughputLength];
+    TEST_ASSERT_TRUE_MESSAGE(benchmark.MeasureThroughput(buffer, sizeof(buffer)), "Block was not echoed correctly");
+
+    unsigned long samples[kRoundTripCount];
+    TEST_ASSERT_TRUE_MESSAGE(benchmark.MeasureRoundTrip(samples, kRoundTripCount, kRoundTripLength), "Frame was not echoed");
+
+    benchmark.MeasureDirectionSwitch(kDirectionSwitchCount);
 
-    unsigned long end_time = millis();
-    String output = String("Performance test completed in: ");
-    output += (end_time - start_time);
-    TEST_MESSAGE(output.c_str());
+    RS485NullStream stream;
+    RS485 null_rs485(de_port, re_port, &stream);
+    benchmark.MeasureCpu(null_rs485, 64, 100);
 }
 
 /**
@@ -179,7 +185,7 @@ void setup()
     RUN_TEST(test_Print);
     RUN_TEST(test_Buffer);
     RUN_TEST(test_SendReceive);
-    RUN_TEST(test_PerformanceTest);
+    RUN_TEST(test_Benchmark);
 
     UNITY_END(); // Stop unit testing
 };
@@ -0,0 +1,183 @@
+/**
+ * @file test_instrumentation.cpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Unit tests of the RS485 statistics (pio test -e native_instrumentation)
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <unity.h>
+#include "max485ttl_benchmark.hpp"
+#include "max485ttl_fixed.hpp"
+#include "max485ttl_frame.hpp"
+#include "max485ttl_simulated_bus.hpp"
+
+#define A_DE_PORT 10
+#define A_RE_PORT 11
+#define B_DE_PORT 12
+#define B_RE_PORT 13
+
+void Report(const char *line, void *context)
+{
+    (void)context;
+    TEST_MESSAGE(line);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/**
+ * @brief Testing the histogram buckets and percentiles
+ *
+ */
+void test_Histogram(void)
+{
+    RS485Histogram histogram;
+    TEST_ASSERT_EQUAL(0, histogram.GetPercentile(50));
+
+    histogram.Add(0);
+    histogram.Add(1);
+    histogram.Add(3);
+    histogram.Add(1000);
+    histogram.Add(0xFFFFFFFFUL);
+    TEST_ASSERT_EQUAL(1, histogram.GetCount(0));
+    TEST_ASSERT_EQUAL(1, histogram.GetCount(1));
+    TEST_ASSERT_EQUAL(1, histogram.GetCount(2));
+    TEST_ASSERT_EQUAL_MESSAGE(1, histogram.GetCount(10), "1000 should be in the bucket up to 1023");
+    TEST_ASSERT_EQUAL_MESSAGE(1, histogram.GetCount(RS485Histogram::kBuckets - 1), "Large values should be in the last bucket");
+    TEST_ASSERT_EQUAL(5, histogram.GetTotal());
+    TEST_ASSERT_EQUAL(1023, RS485Histogram::GetBucketLimit(10));
+    TEST_ASSERT_EQUAL(3, histogram.GetPercentile(60));
+    TEST_ASSERT_EQUAL(1023, histogram.GetPercentile(80));
+
+    histogram.Reset();
+    TEST_ASSERT_EQUAL(0, histogram.GetTotal());
+}
+
+/**
+ * @brief Testing the counters and histograms of a request and its response
+ *
+ */
+void test_Counters(void)
+{
+    RS485SimulatedBus bus(115200);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(bus, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(115200);
+    b.SetFrameFormat(115200);
+    uint8_t buffer[8];
+    RS485FrameReceiver receiver(b, buffer, sizeof(buffer));
+
+    RS485Statistics statistics = a.GetStatistics();
+    TEST_ASSERT_EQUAL_MESSAGE(0, statistics.direction_switches, "Construction should not be counted");
+
+    a.Send("request", 7);
+    while (!receiver.Poll())
+    {
+    }
+    b.Send("response", 8);
+    receiver.ReleaseFrame();
+    uint8_t response[8];
+    TEST_ASSERT_EQUAL(8, a.read(response, sizeof(response), 100));
+    a.StartReceive(0);
+    TEST_ASSERT_TRUE(a.Poll() == RS485::ReceiveState::kTimeout);
+
+    statistics = a.GetStatistics();
+    TEST_ASSERT_EQUAL(7, statistics.bytes_sent);
+    TEST_ASSERT_EQUAL(8, statistics.bytes_received);
+    TEST_ASSERT_EQUAL(1, statistics.transmissions);
+    TEST_ASSERT_EQUAL(2, statistics.direction_switches);
+    TEST_ASSERT_EQUAL(1, statistics.timeouts);
+    TEST_ASSERT_EQUAL_MESSAGE(1, statistics.response_latency.GetTotal(), "Only the first byte of the response should be timed");
+    TEST_ASSERT_TRUE(statistics.response_latency.GetPercentile(100) >= 8 * a.GetCharacterTime());
+    TEST_ASSERT_EQUAL_MESSAGE(1, statistics.frame_size.GetCount(4), "StartReceive() should close the frame of 8 bytes");
+    TEST_ASSERT_EQUAL(1, statistics.idle_gap.GetTotal());
+
+    statistics = b.GetStatistics();
+    TEST_ASSERT_EQUAL(7, statistics.bytes_received);
+    TEST_ASSERT_EQUAL_MESSAGE(1, statistics.frame_size.GetCount(3), "Frame receiver should close the frame of 7 bytes");
+    TEST_ASSERT_EQUAL(0, statistics.receive_overflows);
+
+    a.ResetStatistics();
+    TEST_ASSERT_EQUAL(0, a.GetStatistics().bytes_sent);
+}
+
+/**
+ * @brief Testing if the direction switches of the fixed pin variant are counted and invalid modes are ignored
+ *
+ */
+void test_FixedDirectionSwitches(void)
+{
+    RS485NullStream stream;
+    RS485Fixed<A_DE_PORT, A_RE_PORT> fixed(&stream);
+
+    fixed.SetMode(OUTPUT);
+    fixed.SetMode(OUTPUT);
+    TEST_ASSERT_EQUAL(HIGH, digitalRead(A_DE_PORT));
+    fixed.SetMode(7);
+    TEST_ASSERT_EQUAL_MESSAGE(HIGH, digitalRead(A_DE_PORT), "Invalid mode should be ignored");
+    fixed.SetMode(INPUT);
+    TEST_ASSERT_EQUAL(LOW, digitalRead(A_DE_PORT));
+    TEST_ASSERT_EQUAL(2, fixed.GetStatistics().direction_switches);
+}
+
+/**
+ * @brief Testing if a frame longer than the receive buffer is counted once
+ *
+ */
+void test_ReceiveOverflow(void)
+{
+    RS485SimulatedBus bus(115200);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(bus, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(115200);
+    b.SetFrameFormat(115200);
+    uint8_t buffer[4];
+    RS485FrameReceiver receiver(b, buffer, sizeof(buffer));
+
+    a.Send("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ", 36);
+    while (!receiver.Poll())
+    {
+    }
+    TEST_ASSERT_TRUE(receiver.IsFrameOverflowed());
+    TEST_ASSERT_EQUAL(1, b.GetStatistics().receive_overflows);
+}
+
+/**
+ * @brief Measure the CPU cycles per byte with the statistics enabled, compare with test_native_benchmark
+ *
+ */
+void test_Overhead(void)
+{
+    RS485NullStream stream;
+    RS485 rs485(A_DE_PORT, A_RE_PORT, &stream);
+    RS485Benchmark benchmark(rs485, 0, Report);
+    benchmark.MeasureCpu(rs485, 64, 10000);
+    TEST_ASSERT_EQUAL(64UL * 10000 * 2, rs485.GetStatistics().bytes_sent);
+    TEST_ASSERT_EQUAL(64UL * 10000 * 2, rs485.GetStatistics().bytes_received);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_Histogram);
+    RUN_TEST(test_Counters);
+    RUN_TEST(test_FixedDirectionSwitches);
+    RUN_TEST(test_ReceiveOverflow);
+    RUN_TEST(test_Overhead);
+
+    return UNITY_END();
+}
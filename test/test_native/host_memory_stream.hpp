@@ -0,0 +1,113 @@
+/**
+ * @file host_memory_stream.hpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Stream mock for the native tests, written data can be read back like the MemoryStream library on Arduino
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef HOST_MEMORY_STREAM_HPP_
+#define HOST_MEMORY_STREAM_HPP_
+
+#include <vector>
+#include "max485ttl_platform.hpp"
+
+class HostMemoryStream : public Stream
+{
+public:
+    /**
+     * @brief Construct a new stream
+     *
+     * @param capacity maximum amount of unread bytes, further writes are refused like a full transmit buffer
+     */
+    explicit HostMemoryStream(size_t capacity = 4096) : buffer_(capacity), read_cursor_(0), write_cursor_(0), write_count_(0) {}
+
+    int available(void) override
+    {
+        return static_cast<int>(write_cursor_ - read_cursor_);
+    }
+
+    int read(void) override
+    {
+        if (read_cursor_ == write_cursor_)
+        {
+            return -1;
+        }
+        int c = buffer_[read_cursor_++];
+        Compact();
+        return c;
+    }
+
+    int peek(void) override
+    {
+        if (read_cursor_ == write_cursor_)
+        {
+            return -1;
+        }
+        return buffer_[read_cursor_];
+    }
+
+    size_t write(uint8_t data) override
+    {
+        write_count_++;
+        if (write_cursor_ == buffer_.size())
+        {
+            return 0;
+        }
+        buffer_[write_cursor_++] = data;
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        write_count_++;
+        size_t free_space = buffer_.size() - write_cursor_;
+        if (size > free_space)
+        {
+            size = free_space;
+        }
+        memcpy(&buffer_[write_cursor_], buffer, size);
+        write_cursor_ += size;
+        return size;
+    }
+
+    /**
+     * @brief Drop all data in the stream
+     *
+     */
+    void Clear(void)
+    {
+        read_cursor_ = 0;
+        write_cursor_ = 0;
+    }
+
+    /**
+     * @brief Get the amount of write calls, a buffer counts as one call
+     *
+     * @return size_t write calls since construction
+     */
+    size_t GetWriteCount(void)
+    {
+        return write_count_;
+    }
+
+private:
+    void Compact(void)
+    {
+        if (read_cursor_ == write_cursor_)
+        {
+            read_cursor_ = 0;
+            write_cursor_ = 0;
+        }
+    }
+
+    std::vector<uint8_t> buffer_;
+    size_t read_cursor_;
+    size_t write_cursor_;
+    size_t write_count_;
+};
+
+#endif // HOST_MEMORY_STREAM_HPP_
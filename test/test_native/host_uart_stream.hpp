@@ -0,0 +1,86 @@
+/**
+ * @file host_uart_stream.hpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Stream mock for the native tests which sends like a UART with a small transmit buffer, writes block while it is full
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef HOST_UART_STREAM_HPP_
+#define HOST_UART_STREAM_HPP_
+
+#include "max485ttl_platform.hpp"
+
+class HostUartStream : public Stream
+{
+public:
+    /**
+     * @brief Construct a new stream
+     *
+     * @param baudrate baudrate of the simulated UART, 8N1.
+     * @param buffer_size size of the transmit buffer, 64 like HardwareSerial on AVR
+     */
+    explicit HostUartStream(const unsigned long baudrate, const size_t buffer_size = 64)
+        : character_time_(10000000UL / baudrate), buffer_size_(buffer_size), transmit_end_time_(micros()) {}
+
+    int available(void) override
+    {
+        return 0;
+    }
+
+    int read(void) override
+    {
+        return -1;
+    }
+
+    int peek(void) override
+    {
+        return -1;
+    }
+
+    size_t write(uint8_t data) override
+    {
+        // Wait until the buffer has room, the character being shifted out counts as well
+        while ((long)(transmit_end_time_ - micros()) > static_cast<long>(buffer_size_ * character_time_))
+        {
+        }
+
+        unsigned long now = micros();
+        if ((long)(now - transmit_end_time_) > 0)
+        {
+            transmit_end_time_ = now;
+        }
+        transmit_end_time_ += character_time_;
+        (void)data;
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            write(buffer[i]);
+        }
+        return size;
+    }
+
+    /**
+     * @brief Get the time the last stop bit of the written bytes leaves the UART
+     *
+     * @return unsigned long time in microseconds
+     */
+    unsigned long GetTransmitEndTime(void)
+    {
+        return transmit_end_time_;
+    }
+
+private:
+    unsigned long character_time_;
+    size_t buffer_size_;
+    unsigned long transmit_end_time_;
+};
+
+#endif // HOST_UART_STREAM_HPP_
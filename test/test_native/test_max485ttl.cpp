@@ -0,0 +1,920 @@
+/**
+ * @file test_max485ttl.cpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Unit tests and benchmarks for the max485ttl library that run on the host (pio test -e native)
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <thread>
+#include <unity.h>
+#include "max485ttl.hpp"
+#include "max485ttl_fixed.hpp"
+#include "max485ttl_typed.hpp"
+#include "max485ttl_buffer.hpp"
+#include "max485ttl_frame.hpp"
+#include "max485ttl_line.hpp"
+#include "host_memory_stream.hpp"
+#include "host_uart_stream.hpp"
+
+#define DE_PORT 2
+#define RE_PORT 3
+
+const size_t kTelegramLength = 256;
+const long kBenchmarkIterations = 20000;
+
+/**
+ * @brief Read the cycle counter of the host, falls back to nanoseconds when there is none
+ *
+ * @return uint64_t cycles
+ */
+static uint64_t ReadCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return static_cast<uint64_t>(micros()) * 1000;
+#endif
+}
+
+/**
+ * @brief Stream used as mock for serial stream
+ *
+ */
+HostMemoryStream *stream;
+
+/**
+ * @brief The object that is being tested
+ *
+ */
+RS485 *rs;
+
+void setUp(void)
+{
+    stream = new HostMemoryStream();
+    rs = new RS485(DE_PORT, RE_PORT, stream);
+}
+
+void tearDown(void)
+{
+    delete rs;
+    delete stream;
+}
+
+/**
+ * @brief Testing if a buffer is written completely and the amount is returned
+ *
+ */
+void test_WriteBuffer(void)
+{
+    uint8_t input[kTelegramLength];
+    for (size_t i = 0; i < kTelegramLength; i++)
+    {
+        input[i] = static_cast<uint8_t>(i);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(kTelegramLength, rs->write(input, kTelegramLength), "Not all bytes were accepted");
+    TEST_ASSERT_EQUAL_MESSAGE(kTelegramLength, rs->available(), "Not all bytes were written to the stream");
+
+    for (size_t i = 0; i < kTelegramLength; i++)
+    {
+        TEST_ASSERT_EQUAL_MESSAGE(input[i], rs->read(), "Byte is not written correctly");
+    }
+}
+
+/**
+ * @brief Testing if a stream that stops accepting data results in the accepted amount instead of the requested amount
+ *
+ */
+void test_WriteBufferPartial(void)
+{
+    HostMemoryStream small_stream(10);
+    RS485 small_rs(DE_PORT, RE_PORT, &small_stream);
+
+    // Switched by hand the bytes are written directly instead of collected in the transmit buffer
+    small_rs.SetMode(OUTPUT);
+    const char input[] = "AAAABBBBCCCCDDDD";
+    TEST_ASSERT_EQUAL_MESSAGE(10, small_rs.write(input, sizeof(input) - 1), "Accepted amount is not returned");
+}
+
+/**
+ * @brief Testing writing without a stream
+ *
+ */
+void test_WriteBufferNoStream(void)
+{
+    RS485 no_stream(DE_PORT, RE_PORT, nullptr);
+    const char input[] = "AAAA";
+    TEST_ASSERT_EQUAL_MESSAGE(0, no_stream.write(input, sizeof(input) - 1), "Nothing can be accepted without stream");
+}
+
+/**
+ * @brief Testing if read drains all available bytes without waiting
+ *
+ */
+void test_ReadBuffer(void)
+{
+    const char input[] = "Hello world!";
+    const size_t input_length = sizeof(input) - 1;
+    rs->write(input, input_length);
+
+    uint8_t output[32];
+    TEST_ASSERT_EQUAL_MESSAGE(input_length, rs->read(output, sizeof(output)), "Not all available bytes were read");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(input, output, input_length, "Bytes are not read correctly");
+    TEST_ASSERT_EQUAL_MESSAGE(0, rs->available(), "Stream should be empty after reading");
+    TEST_ASSERT_EQUAL_MESSAGE(0, rs->read(output, sizeof(output)), "Nothing should be read from an empty stream");
+
+    // Only length bytes are taken out of the stream
+    rs->write(input, input_length);
+    TEST_ASSERT_EQUAL_MESSAGE(5, rs->read(output, 5), "Read should stop at length");
+    TEST_ASSERT_EQUAL_MESSAGE(input_length - 5, rs->available(), "Remaining bytes should stay in the stream");
+}
+
+/**
+ * @brief Testing if read with timeout returns after the timeout when the buffer is not filled
+ *
+ */
+void test_ReadBufferTimeout(void)
+{
+    const char input[] = "AAAA";
+    rs->write(input, 4);
+
+    uint8_t output[8];
+    unsigned long start_time = millis();
+    TEST_ASSERT_EQUAL_MESSAGE(4, rs->read(output, sizeof(output), 20), "Available bytes were not read");
+    unsigned long duration = millis() - start_time;
+    TEST_ASSERT_TRUE_MESSAGE(duration >= 20, "Read returned before timeout while buffer was not full");
+
+    rs->write(input, 4);
+    start_time = millis();
+    TEST_ASSERT_EQUAL_MESSAGE(4, rs->read(output, 4, 1000), "Available bytes were not read");
+    TEST_ASSERT_TRUE_MESSAGE(millis() - start_time < 1000, "Read should return as soon as the buffer is full");
+}
+
+/**
+ * @brief Testing the character time calculation
+ *
+ */
+void test_FrameFormat(void)
+{
+    TEST_ASSERT_EQUAL_MESSAGE(0, rs->GetCharacterTime(), "No character time should be set on initialisation");
+
+    rs->SetFrameFormat(9600);
+    TEST_ASSERT_EQUAL_MESSAGE(1042, rs->GetCharacterTime(), "Character time of 8N1 at 9600 baud is not rounded up");
+
+    rs->SetFrameFormat(115200, 11);
+    TEST_ASSERT_EQUAL_MESSAGE(96, rs->GetCharacterTime(), "Character time of 8E1 at 115200 baud is not correct");
+}
+
+/**
+ * @brief Testing if a transmission switches the pins and waits until all characters are on the wire
+ *
+ */
+void test_Send(void)
+{
+    rs->SetFrameFormat(9600);
+
+    rs->BeginTransmission();
+    TEST_ASSERT_EQUAL_MESSAGE(HIGH, digitalRead(DE_PORT), "DE is not set for sending data");
+    TEST_ASSERT_EQUAL_MESSAGE(HIGH, digitalRead(RE_PORT), "RE is not set for sending data");
+    rs->EndTransmission();
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(DE_PORT), "DE is not set for receiving data");
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(RE_PORT), "RE is not set for receiving data");
+
+    const char input[] = "AAAABBBBCC";
+    unsigned long start_time = micros();
+    TEST_ASSERT_EQUAL_MESSAGE(10, rs->Send(input, 10), "Not all bytes were sent");
+    unsigned long duration = micros() - start_time;
+
+    // 100 bits at 9600 baud take 10416.7 microseconds, rounding every character up would wait 10420
+    TEST_ASSERT_TRUE_MESSAGE(duration >= 10417UL, "Module was set to input before the last character was sent");
+    // Upper bounds only catch waits far too long, a loaded machine may be late by milliseconds
+    TEST_ASSERT_TRUE_MESSAGE(duration < 10 * 10417UL, "Module waited far longer than the transmission takes");
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(DE_PORT), "DE is not set back for receiving data");
+    TEST_ASSERT_EQUAL_MESSAGE(10, rs->available(), "Data was not written to the stream");
+}
+
+/**
+ * @brief Testing if a write which blocks while the transmit buffer of the UART drains is not counted twice
+ *
+ */
+void test_BlockingWrite(void)
+{
+    // 100000 baud gives exactly 100 us per character on both sides
+    HostUartStream uart(100000);
+    RS485 uart_rs(DE_PORT, RE_PORT, &uart);
+    uart_rs.SetFrameFormat(100000);
+
+    uint8_t data[200] = {};
+    uart_rs.BeginTransmission();
+    TEST_ASSERT_EQUAL(sizeof(data), uart_rs.write(data, sizeof(data)));
+
+    // The end of RS485 lies between the two clock reads plus the remaining time, compare both with the end of the UART
+    unsigned long before = micros();
+    unsigned long remaining = uart_rs.GetRemainingTransmissionTime();
+    unsigned long after = micros();
+    long uart_end = static_cast<long>(uart.GetTransmitEndTime());
+    if (remaining)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(static_cast<long>(before + remaining) - uart_end < 500, "Bytes of a blocking write were counted from its return");
+    }
+    TEST_ASSERT_TRUE_MESSAGE(static_cast<long>(after + remaining) - uart_end > -500, "Transmission ends before the UART is done");
+
+    // The module counts from just before the first byte reached the UART, allow the same margin as above
+    uart_rs.EndTransmission();
+    TEST_ASSERT_TRUE_MESSAGE((long)(micros() - uart.GetTransmitEndTime()) > -500, "Module was set to input before the last character was sent");
+}
+
+/**
+ * @brief Testing if printed bytes are collected and passed to the stream in one call within one transmission
+ *
+ */
+void test_Print(void)
+{
+    rs->print("T=");
+    rs->print(23);
+    rs->print(',');
+    rs->println(4.5);
+    TEST_ASSERT_EQUAL_MESSAGE(HIGH, digitalRead(DE_PORT), "Writing in input mode should set the module to output");
+    TEST_ASSERT_EQUAL_MESSAGE(0, stream->GetWriteCount(), "Printed bytes should wait in the transmit buffer");
+    rs->flush();
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(DE_PORT), "flush() should end the transmission");
+    TEST_ASSERT_EQUAL_MESSAGE(1, stream->GetWriteCount(), "Message should be passed to the stream in one call");
+
+    char output[16] = {};
+    TEST_ASSERT_EQUAL(11, rs->read(reinterpret_cast<uint8_t *>(output), sizeof(output) - 1));
+    TEST_ASSERT_EQUAL_STRING("T=23,4.50\r\n", output);
+
+    // Reading ends the transmission as well
+    rs->print(-7);
+    TEST_ASSERT_EQUAL_MESSAGE('-', rs->read(), "Printed bytes were not sent before reading");
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(DE_PORT), "Reading should end the transmission");
+    rs->read();
+
+    // A full transmit buffer is passed on, a buffer larger than the transmit buffer is written directly
+    const char input[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    size_t write_count = stream->GetWriteCount();
+    rs->BeginTransmission();
+    for (size_t i = 0; i < 40; i++)
+    {
+        rs->write(input[i]);
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(write_count + 1, stream->GetWriteCount(), "Full transmit buffer was not passed on");
+    rs->write(input, sizeof(input) - 1);
+    TEST_ASSERT_EQUAL_MESSAGE(write_count + 3, stream->GetWriteCount(), "Large buffer was not written directly");
+    rs->EndTransmission();
+    TEST_ASSERT_EQUAL_MESSAGE(40 + sizeof(input) - 1, rs->available(), "Not all bytes were written to the stream");
+}
+
+/**
+ * @brief Testing if full duplex keeps the driver and receiver enabled, also without pins
+ *
+ */
+void test_FullDuplex(void)
+{
+    rs->SetFrameFormat(9600);
+    rs->SetFullDuplex(true);
+    TEST_ASSERT_TRUE(rs->IsFullDuplex());
+    TEST_ASSERT_EQUAL_MESSAGE(HIGH, digitalRead(DE_PORT), "DE is not set in full duplex");
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(RE_PORT), "RE is not set in full duplex");
+
+    // 100 characters take 104 ms at 9600 baud
+    uint8_t data[100] = {};
+    unsigned long start_time = micros();
+    rs->Send(data, sizeof(data));
+    TEST_ASSERT_TRUE_MESSAGE(micros() - start_time < 50000UL, "Send should not wait for the characters in full duplex");
+    rs->SetMode(INPUT);
+    TEST_ASSERT_EQUAL_MESSAGE(HIGH, digitalRead(DE_PORT), "DE should stay set in full duplex");
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(RE_PORT), "RE should stay set in full duplex");
+    TEST_ASSERT_EQUAL(100, rs->available());
+
+    rs->SetFullDuplex(false);
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(DE_PORT), "DE is not set back for receiving data");
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(RE_PORT), "RE is not set back for receiving data");
+
+    RS485 no_pins(RS485::kNoPin, RS485::kNoPin, stream);
+    no_pins.SetFullDuplex(true);
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(RS485::kNoPin), "A pin which is not connected should not be written");
+    TEST_ASSERT_EQUAL(1, no_pins.Send("C", 1));
+}
+
+/**
+ * @brief Testing the pin states of the compile time pin variant, also with DE and RE tied together
+ *
+ */
+void test_FixedPins(void)
+{
+    RS485Fixed<DE_PORT, RE_PORT> fixed(stream);
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(DE_PORT), "DE is not set to LOW on initialisation");
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(RE_PORT), "RE is not set to LOW on initialisation");
+
+    fixed.SetMode(OUTPUT);
+    TEST_ASSERT_EQUAL_MESSAGE(HIGH, digitalRead(DE_PORT), "DE is not set to HIGH");
+    TEST_ASSERT_EQUAL_MESSAGE(HIGH, digitalRead(RE_PORT), "RE is not set to HIGH");
+
+    fixed.SetMode(2);
+    TEST_ASSERT_EQUAL_MESSAGE(HIGH, digitalRead(DE_PORT), "Pins are changed after given wrong command");
+
+    // Transactions of the base class use the fixed pin version
+    RS485 *base = &fixed;
+    base->Send("A", 1);
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(DE_PORT), "DE is not set back to LOW after sending");
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(RE_PORT), "RE is not set back to LOW after sending");
+
+    RS485Fixed<DE_PORT, DE_PORT> tied(stream);
+    tied.SetMode(OUTPUT);
+    TEST_ASSERT_EQUAL_MESSAGE(HIGH, digitalRead(DE_PORT), "Tied pin is not set to HIGH");
+    tied.SetMode(INPUT);
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(DE_PORT), "Tied pin is not set to LOW");
+}
+
+/**
+ * @brief Testing the ring buffer around the wrap of the cursors and when full
+ *
+ */
+void test_RingBuffer(void)
+{
+    RS485RingBuffer<8> ring;
+    TEST_ASSERT_EQUAL_MESSAGE(0, ring.Available(), "Buffer should be empty on initialisation");
+    TEST_ASSERT_EQUAL_MESSAGE(-1, ring.Peek(), "Peek on empty buffer should return -1");
+    TEST_ASSERT_EQUAL_MESSAGE(-1, ring.Pop(), "Pop on empty buffer should return -1");
+
+    // Move the cursors to the middle so the data wraps around the end
+    const uint8_t input[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    ring.Write(input, 5);
+    uint8_t output[10];
+    ring.Read(output, 5);
+
+    TEST_ASSERT_EQUAL_MESSAGE(8, ring.Write(input, 10), "All bytes of the capacity should be usable");
+    TEST_ASSERT_EQUAL_MESSAGE(2, ring.GetOverflowCount(), "Bytes which did not fit are not counted");
+    TEST_ASSERT_FALSE_MESSAGE(ring.Push(11), "Push should fail on a full buffer");
+    TEST_ASSERT_EQUAL_MESSAGE(3, ring.GetOverflowCount(), "Failed push is not counted");
+
+    const uint8_t *region;
+    TEST_ASSERT_EQUAL_MESSAGE(3, ring.GetReadRegion(&region), "First region should end at the end of the buffer");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(input, region, 3, "First region does not hold the first bytes");
+    ring.Consume(3);
+    TEST_ASSERT_EQUAL_MESSAGE(5, ring.GetReadRegion(&region), "Second region should hold the wrapped bytes");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(input + 3, region, 5, "Second region does not hold the wrapped bytes");
+    ring.Consume(5);
+    TEST_ASSERT_EQUAL_MESSAGE(0, ring.Available(), "Buffer should be empty after consuming everything");
+}
+
+/**
+ * @brief Testing the ring buffer with a producer and a consumer running at the same time
+ *
+ */
+void test_RingBufferConcurrent(void)
+{
+    static RS485RingBuffer<64> ring;
+    const uint32_t amount = 100000;
+
+    std::thread producer([&]()
+                         {
+                             for (uint32_t i = 0; i < amount; i++)
+                             {
+                                 while (!ring.Free())
+                                 {
+                                     std::this_thread::yield();
+                                 }
+                                 ring.Push(static_cast<uint8_t>(i));
+                             } });
+
+    uint32_t received = 0;
+    bool in_order = true;
+    while (received < amount)
+    {
+        int c = ring.Pop();
+        if (c >= 0)
+        {
+            in_order &= (static_cast<uint8_t>(received) == c);
+            received++;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    TEST_ASSERT_TRUE_MESSAGE(in_order, "Bytes were not received in order");
+    TEST_ASSERT_EQUAL_MESSAGE(0, ring.GetOverflowCount(), "No byte should be lost");
+}
+
+/**
+ * @brief Testing if messages longer than the stream buffer are gathered in the buffer
+ *
+ */
+void test_ReadIntoBuffer(void)
+{
+    HostMemoryStream small_stream(64);
+    RS485_Buffer<128> buffered(DE_PORT, RE_PORT, &small_stream);
+
+    uint8_t input[100];
+    for (size_t i = 0; i < sizeof(input); i++)
+    {
+        input[i] = static_cast<uint8_t>(i);
+    }
+
+    // Receive the message in parts like the stream buffer would
+    small_stream.write(input, 60);
+    TEST_ASSERT_EQUAL_MESSAGE(60, buffered.ReadIntoBuffer(), "First part is not read into buffer");
+    small_stream.write(input + 60, 40);
+    TEST_ASSERT_EQUAL_MESSAGE(40, buffered.ReadIntoBuffer(), "Second part is not read into buffer");
+
+    TEST_ASSERT_EQUAL_MESSAGE(100, buffered.BufferAvailable(), "Whole message should be in the buffer");
+    TEST_ASSERT_EQUAL_MESSAGE(0, buffered.BufferPeek(), "Peek did not retrieve correct character");
+    TEST_ASSERT_EQUAL_MESSAGE(0, buffered.BufferRead(), "Read did not retrieve correct character");
+
+    uint8_t output[100];
+    TEST_ASSERT_EQUAL_MESSAGE(99, buffered.BufferRead(output, sizeof(output)), "Rest of the message is not read");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(input + 1, output, 99, "Message is not stored correctly");
+
+    // A full buffer leaves the rest in the stream instead of dropping it
+    small_stream.write(input, 64);
+    buffered.ReadIntoBuffer();
+    small_stream.write(input, 64);
+    buffered.ReadIntoBuffer();
+    small_stream.write(input, 10);
+    TEST_ASSERT_EQUAL_MESSAGE(0, buffered.ReadIntoBuffer(), "Nothing fits in a full buffer");
+    TEST_ASSERT_EQUAL_MESSAGE(128, buffered.BufferAvailable(), "Buffer should be full");
+    TEST_ASSERT_EQUAL_MESSAGE(10, small_stream.available(), "Bytes which do not fit should stay in the stream");
+
+    TEST_ASSERT_EQUAL(10, buffered.BufferRead(output, 10));
+    TEST_ASSERT_EQUAL_MESSAGE(10, buffered.ReadIntoBuffer(), "Rest should be read when there is room");
+    TEST_ASSERT_EQUAL(128, buffered.BufferAvailable());
+}
+
+/**
+ * @brief Counts the callbacks of the receive engine
+ *
+ */
+struct ReceiveCallbackCounter
+{
+    int first_byte;
+    int frame_complete;
+    int timeout;
+};
+
+void CountFirstByte(RS485 &rs485, void *context)
+{
+    (void)rs485;
+    static_cast<ReceiveCallbackCounter *>(context)->first_byte++;
+}
+
+void CountFrameComplete(RS485 &rs485, void *context)
+{
+    (void)rs485;
+    static_cast<ReceiveCallbackCounter *>(context)->frame_complete++;
+}
+
+void CountTimeout(RS485 &rs485, void *context)
+{
+    (void)rs485;
+    static_cast<ReceiveCallbackCounter *>(context)->timeout++;
+}
+
+/**
+ * @brief Testing the states and callbacks of the non-blocking receive engine
+ *
+ */
+void test_ReceiveEngine(void)
+{
+    ReceiveCallbackCounter counter = {0, 0, 0};
+    rs->SetFirstByteCallback(CountFirstByte, &counter);
+    rs->SetFrameCompleteCallback(CountFrameComplete, &counter);
+    rs->SetTimeoutCallback(CountTimeout, &counter);
+    rs->SetFrameGap(2000);
+
+    TEST_ASSERT_TRUE_MESSAGE(rs->Poll() == RS485::ReceiveState::kIdle, "Engine should be idle on initialisation");
+
+    rs->StartReceive(100);
+    TEST_ASSERT_TRUE_MESSAGE(rs->Poll() == RS485::ReceiveState::kWaiting, "Engine should wait for the first byte");
+
+    stream->write(reinterpret_cast<const uint8_t *>("AAAA"), 4);
+    TEST_ASSERT_TRUE_MESSAGE(rs->Poll() == RS485::ReceiveState::kReceiving, "First byte was not detected");
+    TEST_ASSERT_EQUAL_MESSAGE(1, counter.first_byte, "First byte callback was not called");
+
+    stream->write(reinterpret_cast<const uint8_t *>("BBBB"), 4);
+    TEST_ASSERT_TRUE_MESSAGE(rs->Poll() == RS485::ReceiveState::kReceiving, "Frame completed while data was arriving");
+
+    unsigned long start_time = micros();
+    while (rs->Poll() == RS485::ReceiveState::kReceiving)
+    {
+    }
+    TEST_ASSERT_TRUE_MESSAGE(micros() - start_time >= 2000, "Frame completed before the gap passed");
+    TEST_ASSERT_TRUE_MESSAGE(rs->GetReceiveState() == RS485::ReceiveState::kComplete, "Frame was not completed");
+    TEST_ASSERT_EQUAL_MESSAGE(1, counter.frame_complete, "Frame complete callback was not called");
+    TEST_ASSERT_EQUAL_MESSAGE(8, rs->available(), "Data should stay in the stream");
+    stream->Clear();
+
+    rs->StartReceive(10);
+    while (rs->Poll() == RS485::ReceiveState::kWaiting)
+    {
+    }
+    TEST_ASSERT_TRUE_MESSAGE(rs->GetReceiveState() == RS485::ReceiveState::kTimeout, "Timeout was not detected");
+    TEST_ASSERT_EQUAL_MESSAGE(1, counter.timeout, "Timeout callback was not called");
+    TEST_ASSERT_EQUAL_MESSAGE(1, counter.first_byte, "First byte callback should not be called on timeout");
+}
+
+/**
+ * @brief Testing if WaitForInput returns as soon as data is available
+ *
+ */
+void test_WaitForInput(void)
+{
+    stream->write('A');
+    unsigned long start_time = millis();
+    rs->WaitForInput(1000);
+    TEST_ASSERT_TRUE_MESSAGE(millis() - start_time < 500, "WaitForInput should return immediately when data is available");
+
+    rs->read();
+    start_time = millis();
+    rs->WaitForInput(20);
+    TEST_ASSERT_TRUE_MESSAGE(millis() - start_time >= 20, "WaitForInput returned before the timeout");
+}
+
+/**
+ * @brief Testing if a frame is closed after t3.5 of silence
+ *
+ */
+void test_FrameReceiver(void)
+{
+    uint8_t buffer[8];
+    RS485FrameReceiver receiver(*rs, buffer, sizeof(buffer));
+    rs->SetFrameFormat(9600);
+    TEST_ASSERT_EQUAL_MESSAGE(3647, receiver.GetInterFrameTimeout(), "t3.5 at 9600 baud is not correct");
+
+    TEST_ASSERT_FALSE_MESSAGE(receiver.Poll(), "No frame should be complete without data");
+
+    stream->write(reinterpret_cast<const uint8_t *>("ABC"), 3);
+    unsigned long start_time = micros();
+    TEST_ASSERT_FALSE_MESSAGE(receiver.Poll(), "Frame should not be complete directly after data arrived");
+    while (!receiver.Poll())
+    {
+    }
+    unsigned long duration = micros() - start_time;
+    TEST_ASSERT_TRUE_MESSAGE(duration >= 3647, "Frame closed before t3.5");
+    TEST_ASSERT_TRUE_MESSAGE(duration < 10 * 3647UL, "Frame closed too long after t3.5");
+    TEST_ASSERT_EQUAL_MESSAGE(3, receiver.GetFrameLength(), "Frame length is not correct");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE("ABC", receiver.GetFrame(), 3, "Frame is not stored correctly");
+    TEST_ASSERT_FALSE_MESSAGE(receiver.IsFrameBroken(), "Frame should not be broken");
+    TEST_ASSERT_FALSE_MESSAGE(receiver.IsFrameOverflowed(), "Frame should not be overflowed");
+
+    // Data of the next frame stays in the stream until the frame is released
+    stream->write(reinterpret_cast<const uint8_t *>("0123456789"), 10);
+    TEST_ASSERT_TRUE_MESSAGE(receiver.Poll(), "Frame should stay complete until released");
+    receiver.ReleaseFrame();
+    while (!receiver.Poll())
+    {
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(8, receiver.GetFrameLength(), "Frame should be cut at the buffer size");
+    TEST_ASSERT_TRUE_MESSAGE(receiver.IsFrameOverflowed(), "Frame should be marked as overflowed");
+    TEST_ASSERT_EQUAL_MESSAGE(0, rs->available(), "Dropped bytes should be taken out of the stream");
+    receiver.ReleaseFrame();
+
+    // A gap above t1.5 in the frame breaks it
+    stream->write('A');
+    receiver.Poll();
+    delayMicroseconds(3000);
+    stream->write('B');
+    receiver.Poll();
+    while (!receiver.Poll())
+    {
+    }
+    TEST_ASSERT_TRUE_MESSAGE(receiver.IsFrameBroken(), "Gap above t1.5 should break the frame");
+}
+
+/**
+ * @brief Testing a frame receiver on a module without frame format
+ *
+ */
+void test_FrameReceiverNoFormat(void)
+{
+    uint8_t buffer[8];
+    RS485FrameReceiver receiver(*rs, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_MESSAGE(1750, receiver.GetInterFrameTimeout(), "Default t3.5 is not correct");
+
+    // Bytes of one frame arriving in different calls of Poll() do not break it
+    stream->write('A');
+    receiver.Poll();
+    delayMicroseconds(500);
+    stream->write('B');
+    receiver.Poll();
+    while (!receiver.Poll())
+    {
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(2, receiver.GetFrameLength(), "Frame length is not correct");
+    TEST_ASSERT_FALSE_MESSAGE(receiver.IsFrameBroken(), "Frame should not be broken without frame format");
+}
+
+/**
+ * @brief Testing if lines are split on the end marker with "\r\n" handling and truncation
+ *
+ */
+void test_LineReader(void)
+{
+    char buffer[8];
+    RS485LineReader reader(*rs, buffer, sizeof(buffer));
+
+    TEST_ASSERT_FALSE_MESSAGE(reader.Poll(), "No line should be complete without data");
+    stream->write(reinterpret_cast<const uint8_t *>("ab"), 2);
+    TEST_ASSERT_FALSE_MESSAGE(reader.Poll(), "Line should not be complete without end marker");
+    stream->write(reinterpret_cast<const uint8_t *>("c\r\nde\nfg"), 8);
+    TEST_ASSERT_TRUE(reader.Poll());
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("abc", reader.GetLine(), "\\r in front of the end marker should be removed");
+    TEST_ASSERT_EQUAL(3, reader.GetLineLength());
+    TEST_ASSERT_FALSE(reader.IsLineTruncated());
+    TEST_ASSERT_TRUE_MESSAGE(reader.Poll(), "Line should stay complete until released");
+
+    reader.ReleaseLine();
+    TEST_ASSERT_TRUE_MESSAGE(reader.Poll(), "Next line was already received");
+    TEST_ASSERT_EQUAL_STRING("de", reader.GetLine());
+    reader.ReleaseLine();
+    TEST_ASSERT_FALSE(reader.Poll());
+
+    // "fg" is kept, the rest of the line does not fit in 7 characters
+    stream->write(reinterpret_cast<const uint8_t *>("hijklmnop\nq\n"), 12);
+    TEST_ASSERT_TRUE(reader.Poll());
+    TEST_ASSERT_EQUAL_STRING("fghijkl", reader.GetLine());
+    TEST_ASSERT_TRUE_MESSAGE(reader.IsLineTruncated(), "Line should be marked as truncated");
+    reader.ReleaseLine();
+    TEST_ASSERT_TRUE_MESSAGE(reader.Poll(), "Line after a truncated line should not be lost");
+    TEST_ASSERT_EQUAL_STRING("q", reader.GetLine());
+    TEST_ASSERT_FALSE(reader.IsLineTruncated());
+    reader.ReleaseLine();
+
+    // Other end markers keep the \r
+    char semicolon_buffer[8];
+    RS485LineReader semicolon_reader(*rs, semicolon_buffer, sizeof(semicolon_buffer), ';');
+    stream->write(reinterpret_cast<const uint8_t *>("x\r;"), 3);
+    TEST_ASSERT_TRUE(semicolon_reader.ReadLine(10));
+    TEST_ASSERT_EQUAL_STRING("x\r", semicolon_reader.GetLine());
+}
+
+/**
+ * @brief Testing if ReadLine() returns as soon as the end marker arrives instead of waiting for the timeout
+ *
+ */
+void test_ReadLineTimeout(void)
+{
+    char buffer[16];
+    RS485LineReader reader(*rs, buffer, sizeof(buffer));
+    unsigned long start_time = millis();
+    TEST_ASSERT_FALSE_MESSAGE(reader.ReadLine(20), "No line should be read without data");
+    TEST_ASSERT_TRUE(millis() - start_time >= 20);
+
+    std::thread writer([]()
+                       {
+                           delay(5);
+                           stream->write(reinterpret_cast<const uint8_t *>("42\n"), 3); });
+    start_time = millis();
+    TEST_ASSERT_TRUE(reader.ReadLine(1000));
+    unsigned long duration = millis() - start_time;
+    writer.join();
+    TEST_ASSERT_TRUE_MESSAGE(duration < 500, "ReadLine() should return when the end marker arrives");
+    TEST_ASSERT_EQUAL_STRING("42", reader.GetLine());
+}
+
+/**
+ * @brief Measure the cycles per byte of the end marker search, byte by byte against a word at a time
+ *
+ */
+void test_BenchmarkFindByte(void)
+{
+    static uint8_t data[4096];
+    memset(data, 'a', sizeof(data));
+    data[sizeof(data) - 1] = '\n';
+
+    const uint8_t *found = nullptr;
+    uint64_t start_cycles = ReadCycles();
+    for (long i = 0; i < 1000; i++)
+    {
+        found = nullptr;
+        for (size_t j = 0; j < sizeof(data) && !found; j++)
+        {
+            if (data[j] == '\n')
+            {
+                found = data + j;
+            }
+        }
+        // Keeps the loop from being folded
+        __asm__ volatile("" : : "r"(found) : "memory");
+    }
+    uint64_t byte_cycles = ReadCycles() - start_cycles;
+    TEST_ASSERT_EQUAL_PTR(data + sizeof(data) - 1, found);
+
+    start_cycles = ReadCycles();
+    for (long i = 0; i < 1000; i++)
+    {
+        found = RS485FindByte(data, sizeof(data), '\n');
+        __asm__ volatile("" : : "r"(found) : "memory");
+    }
+    uint64_t word_cycles = ReadCycles() - start_cycles;
+    TEST_ASSERT_EQUAL_PTR(data + sizeof(data) - 1, found);
+    TEST_ASSERT_NULL(RS485FindByte(data, sizeof(data) - 1, '\n'));
+    const uint8_t short_data[] = "aaa\n";
+    TEST_ASSERT_EQUAL_PTR(short_data + 3, RS485FindByte(short_data, 4, '\n'));
+
+    double bytes = 1000.0 * sizeof(data);
+    char output[128];
+    snprintf(output, sizeof(output), "end marker search byte by byte: %.2f cycles/byte, word at a time: %.2f cycles/byte",
+             byte_cycles / bytes, word_cycles / bytes);
+    TEST_MESSAGE(output);
+}
+
+/**
+ * @brief Testing if the CRC is calculated while bytes are read so the check at the end of a frame is constant time
+ *
+ */
+void test_ReceiveCrc(void)
+{
+    uint8_t frame[12] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    uint8_t received[12];
+
+    TEST_ASSERT_FALSE_MESSAGE(rs->IsReceiveCrcValid(), "Without CRC type the CRC is never valid");
+
+    rs->SetReceiveCrc(RS485::CrcType::kCrc16Modbus);
+    stream->write(frame, 9);
+    TEST_ASSERT_EQUAL_MESSAGE('1', rs->read(), "Single byte read is not correct");
+    TEST_ASSERT_EQUAL_MESSAGE(8, rs->read(received, sizeof(received)), "Bulk read is not correct");
+    TEST_ASSERT_EQUAL_HEX16_MESSAGE(0x4B37, rs->GetReceiveCrc(), "CRC-16 over the read bytes is not correct");
+
+    // Frame followed by its own CRC
+    rs->ResetReceiveCrc();
+    frame[9] = 0x37;
+    frame[10] = 0x4B;
+    stream->write(frame, 11);
+    rs->read(received, sizeof(received));
+    TEST_ASSERT_TRUE_MESSAGE(rs->IsReceiveCrcValid(), "CRC-16 of a correct frame should be valid");
+
+    frame[3] ^= 0x01;
+    rs->ResetReceiveCrc();
+    stream->write(frame, 11);
+    rs->read(received, sizeof(received));
+    TEST_ASSERT_FALSE_MESSAGE(rs->IsReceiveCrcValid(), "CRC-16 of a changed frame should not be valid");
+    frame[3] ^= 0x01;
+
+    rs->SetReceiveCrc(RS485::CrcType::kCrc8);
+    frame[9] = 0xF4;
+    stream->write(frame, 10);
+    rs->read(received, sizeof(received));
+    TEST_ASSERT_TRUE_MESSAGE(rs->IsReceiveCrcValid(), "CRC-8 of a correct frame should be valid");
+
+    // The frame receiver checks the frame without going over it again
+    uint8_t buffer[16];
+    RS485FrameReceiver receiver(*rs, buffer, sizeof(buffer));
+    stream->write(frame, 10);
+    while (!receiver.Poll())
+    {
+    }
+    TEST_ASSERT_TRUE_MESSAGE(receiver.IsFrameCrcValid(), "Frame receiver should report a valid CRC");
+    receiver.ReleaseFrame();
+    frame[0] ^= 0x80;
+    stream->write(frame, 10);
+    while (!receiver.Poll())
+    {
+    }
+    TEST_ASSERT_FALSE_MESSAGE(receiver.IsFrameCrcValid(), "Frame receiver should report an invalid CRC");
+}
+
+/**
+ * @brief Compare bytes per second of writing byte by byte against the bulk write
+ *
+ */
+void test_BenchmarkWrite(void)
+{
+    uint8_t telegram[kTelegramLength];
+    memset(telegram, 0x55, sizeof(telegram));
+
+    unsigned long start_time = micros();
+    for (long i = 0; i < kBenchmarkIterations; i++)
+    {
+        for (size_t j = 0; j < kTelegramLength; j++)
+        {
+            rs->write(telegram[j]);
+        }
+        stream->Clear();
+    }
+    unsigned long byte_loop_time = micros() - start_time;
+
+    start_time = micros();
+    for (long i = 0; i < kBenchmarkIterations; i++)
+    {
+        rs->write(telegram, kTelegramLength);
+        stream->Clear();
+    }
+    unsigned long bulk_time = micros() - start_time;
+
+    double bytes = static_cast<double>(kBenchmarkIterations) * kTelegramLength;
+    char output[128];
+    snprintf(output, sizeof(output), "write byte loop: %.0f bytes/s, bulk write: %.0f bytes/s",
+             bytes * 1e6 / (byte_loop_time ? byte_loop_time : 1), bytes * 1e6 / (bulk_time ? bulk_time : 1));
+    TEST_MESSAGE(output);
+}
+
+/**
+ * @brief Testing if the typed variant behaves the same as RS485
+ *
+ */
+void test_Typed(void)
+{
+    RS485Typed<HostMemoryStream> typed(DE_PORT, RE_PORT, *stream);
+
+    const char input[] = "Hello world!";
+    const size_t input_length = sizeof(input) - 1;
+    TEST_ASSERT_EQUAL_MESSAGE(input_length, typed.write(input, input_length), "Not all bytes were accepted");
+    TEST_ASSERT_EQUAL_MESSAGE(input_length, typed.available(), "Available should return amount of bytes in the read buffer");
+    TEST_ASSERT_EQUAL_MESSAGE('H', typed.peek(), "Peek did not retrieve correct character");
+    TEST_ASSERT_EQUAL_MESSAGE('H', typed.read(), "Read did not retrieve first character correctly");
+
+    uint8_t output[32];
+    TEST_ASSERT_EQUAL_MESSAGE(input_length - 1, typed.read(output, sizeof(output)), "Not all available bytes were read");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(input + 1, output, input_length - 1, "Bytes are not read correctly");
+
+    typed.write(input, input_length);
+    TEST_ASSERT_EQUAL_MESSAGE(input_length, typed.read(output, input_length, 10), "Timed read of the base class is hidden");
+
+    typed.Send(input, input_length);
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(DE_PORT), "DE is not set back to LOW after sending");
+}
+
+/**
+ * @brief Compare cycles per byte of the Stream pointer version against the typed version
+ *
+ */
+void test_BenchmarkTyped(void)
+{
+    RS485Typed<HostMemoryStream> typed(DE_PORT, RE_PORT, *stream);
+
+    uint64_t start_cycles = ReadCycles();
+    for (long i = 0; i < kBenchmarkIterations; i++)
+    {
+        for (size_t j = 0; j < kTelegramLength; j++)
+        {
+            rs->write(static_cast<uint8_t>(j));
+        }
+        while (rs->available() > 0)
+        {
+            rs->read();
+        }
+    }
+    uint64_t virtual_cycles = ReadCycles() - start_cycles;
+
+    start_cycles = ReadCycles();
+    for (long i = 0; i < kBenchmarkIterations; i++)
+    {
+        for (size_t j = 0; j < kTelegramLength; j++)
+        {
+            typed.write(static_cast<uint8_t>(j));
+        }
+        while (typed.available() > 0)
+        {
+            typed.read();
+        }
+    }
+    uint64_t typed_cycles = ReadCycles() - start_cycles;
+
+    double bytes = static_cast<double>(kBenchmarkIterations) * kTelegramLength;
+    char output[128];
+    snprintf(output, sizeof(output), "write+read Stream*: %.2f cycles/byte, typed: %.2f cycles/byte",
+             virtual_cycles / bytes, typed_cycles / bytes);
+    TEST_MESSAGE(output);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_WriteBuffer);
+    RUN_TEST(test_WriteBufferPartial);
+    RUN_TEST(test_WriteBufferNoStream);
+    RUN_TEST(test_ReadBuffer);
+    RUN_TEST(test_ReadBufferTimeout);
+    RUN_TEST(test_FrameFormat);
+    RUN_TEST(test_Send);
+    RUN_TEST(test_BlockingWrite);
+    RUN_TEST(test_Print);
+    RUN_TEST(test_FullDuplex);
+    RUN_TEST(test_FixedPins);
+    RUN_TEST(test_Typed);
+    RUN_TEST(test_RingBuffer);
+    RUN_TEST(test_RingBufferConcurrent);
+    RUN_TEST(test_ReadIntoBuffer);
+    RUN_TEST(test_ReceiveEngine);
+    RUN_TEST(test_WaitForInput);
+    RUN_TEST(test_FrameReceiver);
+    RUN_TEST(test_FrameReceiverNoFormat);
+    RUN_TEST(test_ReceiveCrc);
+    RUN_TEST(test_LineReader);
+    RUN_TEST(test_ReadLineTimeout);
+    RUN_TEST(test_BenchmarkWrite);
+    RUN_TEST(test_BenchmarkTyped);
+    RUN_TEST(test_BenchmarkFindByte);
+
+    return UNITY_END();
+}
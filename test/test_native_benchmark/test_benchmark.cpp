@@ -0,0 +1,162 @@
+/**
+ * @file test_benchmark.cpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Throughput, latency and CPU benchmarks on the simulated RS485 bus (pio test -e native)
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <unity.h>
+#include "max485ttl_benchmark.hpp"
+#include "max485ttl_frame.hpp"
+#include "max485ttl_simulated_bus.hpp"
+
+#define A_DE_PORT 10
+#define A_RE_PORT 11
+#define B_DE_PORT 12
+#define B_RE_PORT 13
+
+const unsigned long kBaudrates[] = {9600, 19200, 115200};
+const size_t kThroughputLength = 200;
+const size_t kRoundTripCount = 100;
+const size_t kRoundTripLength = 8;
+const unsigned long kDirectionSwitchCount = 100;
+
+/**
+ * @brief Module echoing every frame like example2 does on hardware
+ *
+ */
+struct EchoPeer
+{
+    EchoPeer(RS485SimulatedBus &bus, const unsigned long baudrate)
+        : port(bus, B_DE_PORT, B_RE_PORT), rs485(B_DE_PORT, B_RE_PORT, &port), receiver(rs485, frame, sizeof(frame))
+    {
+        rs485.SetFrameFormat(baudrate);
+        receiver.SetInterFrameTimeout(7);
+        receiver.SetInterCharacterTimeout(0);
+    }
+
+    RS485SimulatedPort port;
+    RS485 rs485;
+    uint8_t frame[256];
+    RS485FrameReceiver receiver;
+};
+
+void PollPeer(void *context)
+{
+    EchoPeer *peer = static_cast<EchoPeer *>(context);
+    if (peer->receiver.Poll())
+    {
+        peer->rs485.Send(peer->receiver.GetFrame(), peer->receiver.GetFrameLength());
+        peer->receiver.ReleaseFrame();
+    }
+}
+
+void Report(const char *line, void *context)
+{
+    (void)context;
+    TEST_MESSAGE(line);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/**
+ * @brief Measure bytes per second of an echoed block at each baudrate
+ *
+ */
+void test_Throughput(void)
+{
+    for (unsigned long baudrate : kBaudrates)
+    {
+        RS485SimulatedBus bus(baudrate);
+        RS485SimulatedPort port(bus, A_DE_PORT, A_RE_PORT);
+        RS485 rs485(A_DE_PORT, A_RE_PORT, &port);
+        rs485.SetFrameFormat(baudrate);
+        EchoPeer peer(bus, baudrate);
+
+        RS485Benchmark benchmark(rs485, baudrate, Report);
+        benchmark.SetPeerPoll(PollPeer, &peer);
+        uint8_t buffer[kThroughputLength];
+        TEST_ASSERT_TRUE_MESSAGE(benchmark.MeasureThroughput(buffer, sizeof(buffer)), "Block should be echoed unchanged");
+        TEST_ASSERT_EQUAL(0, bus.GetCollisionCount());
+    }
+}
+
+/**
+ * @brief Measure the round trip latency percentiles of small frames at each baudrate
+ *
+ */
+void test_RoundTrip(void)
+{
+    for (unsigned long baudrate : kBaudrates)
+    {
+        RS485SimulatedBus bus(baudrate);
+        RS485SimulatedPort port(bus, A_DE_PORT, A_RE_PORT);
+        RS485 rs485(A_DE_PORT, A_RE_PORT, &port);
+        rs485.SetFrameFormat(baudrate);
+        EchoPeer peer(bus, baudrate);
+
+        RS485Benchmark benchmark(rs485, baudrate, Report);
+        benchmark.SetPeerPoll(PollPeer, &peer);
+        unsigned long samples[kRoundTripCount];
+        TEST_ASSERT_TRUE_MESSAGE(benchmark.MeasureRoundTrip(samples, kRoundTripCount, kRoundTripLength), "Every frame should be echoed");
+
+        // Two frames and the silent interval of the echo module are the lower bound
+        TEST_ASSERT_TRUE(samples[0] >= 2 * kRoundTripLength * bus.GetCharacterTime());
+        TEST_ASSERT_EQUAL(0, bus.GetCollisionCount());
+    }
+}
+
+/**
+ * @brief Measure switching the direction and the turnaround after the last character
+ *
+ */
+void test_DirectionSwitch(void)
+{
+    for (unsigned long baudrate : kBaudrates)
+    {
+        RS485SimulatedBus bus(baudrate);
+        RS485SimulatedPort port(bus, A_DE_PORT, A_RE_PORT);
+        RS485 rs485(A_DE_PORT, A_RE_PORT, &port);
+        rs485.SetFrameFormat(baudrate);
+        EchoPeer peer(bus, baudrate);
+
+        RS485Benchmark benchmark(rs485, baudrate, Report);
+        benchmark.SetPeerPoll(PollPeer, &peer);
+        benchmark.MeasureDirectionSwitch(kDirectionSwitchCount);
+        TEST_ASSERT_EQUAL_MESSAGE(0, bus.GetTruncatedCount(), "EndTransmission() should never cut off the last character");
+    }
+}
+
+/**
+ * @brief Measure the CPU cycles per byte of the read and write paths
+ *
+ */
+void test_Cpu(void)
+{
+    RS485NullStream stream;
+    RS485 rs485(A_DE_PORT, A_RE_PORT, &stream);
+    RS485Benchmark benchmark(rs485, 0, Report);
+    benchmark.MeasureCpu(rs485, 64, 10000);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_Throughput);
+    RUN_TEST(test_RoundTrip);
+    RUN_TEST(test_DirectionSwitch);
+    RUN_TEST(test_Cpu);
+
+    return UNITY_END();
+}
@@ -0,0 +1,996 @@
+/**
+ * @file test_simulated_bus.cpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Unit tests and benchmarks on the simulated RS485 bus (pio test -e native)
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "max485ttl_simulated_bus.hpp"
+#include "max485ttl_modbus_master.hpp"
+#include "max485ttl_modbus_slave.hpp"
+#include "max485ttl_modbus_poll.hpp"
+#include "max485ttl_pipeline.hpp"
+#include "max485ttl_queue.hpp"
+#include "max485ttl_transmit_scheduler.hpp"
+
+#define A_DE_PORT 10
+#define A_RE_PORT 11
+#define B_DE_PORT 12
+#define B_RE_PORT 13
+#define C_DE_PORT 14
+#define C_RE_PORT 15
+#define SLAVE_ADDRESS 17
+
+const unsigned long kBenchmarkDuration = 1000;
+const size_t kPipelineFrameLength = 8;
+const size_t kPipelineDepth = 4;
+const size_t kQueueDepth = 8;
+const size_t kSchedulerDepth = 2;
+const size_t kChunkSize = 16;
+const size_t kPollSlaves = 10;
+const unsigned long kPollResponseTimeout = 20;
+
+/**
+ * @brief Modbus slave on its own port of a simulated bus, holding register 0 contains its address
+ *
+ */
+struct SimulatedSlave
+{
+    SimulatedSlave(RS485SimulatedBus &bus, const unsigned long baudrate, const uint8_t address)
+        : port(bus, 20 + address * 2, 21 + address * 2), rs485(20 + address * 2, 21 + address * 2, &port),
+          block(ModbusTable::kHoldingRegisters, 0, 2, holding), slave(rs485, address, &block, 1, buffer, sizeof(buffer))
+    {
+        holding[0] = address;
+        holding[1] = 0;
+        rs485.SetFrameFormat(baudrate);
+    }
+
+    RS485SimulatedPort port;
+    RS485 rs485;
+    uint16_t holding[2];
+    ModbusBlock block;
+    uint8_t buffer[kModbusMaxFrameLength];
+    ModbusSlave slave;
+};
+
+/**
+ * @brief Let every slave handle the requests it received.
+ * Polled twice, so the slaves before the one which responded read the response before the master does and see the same silence
+ * after it, on real hardware every slave polls on its own.
+ *
+ */
+void PollSlaves(SimulatedSlave *const *slaves, const size_t count)
+{
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            slaves[i]->slave.Poll();
+        }
+    }
+}
+
+/**
+ * @brief Responses and timeouts per slave address
+ *
+ */
+struct PollCounts
+{
+    unsigned long responses[16];
+    unsigned long timeouts[16];
+};
+
+/**
+ * @brief Count the completed requests per slave address
+ *
+ */
+void CountPoll(ModbusPollEntry &entry, const ModbusStatus status, void *context)
+{
+    PollCounts *counts = static_cast<PollCounts *>(context);
+    if (status == ModbusStatus::kOk)
+    {
+        counts->responses[entry.slave]++;
+    }
+    else if (status == ModbusStatus::kTimeout)
+    {
+        counts->timeouts[entry.slave]++;
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/**
+ * @brief Testing if characters take their transmission time on the wire
+ *
+ */
+void test_Timing(void)
+{
+    RS485SimulatedBus bus(9600);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(bus, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(9600);
+    TEST_ASSERT_EQUAL(1042, bus.GetCharacterTime());
+
+    unsigned long start_time = micros();
+    a.BeginTransmission();
+    a.write(reinterpret_cast<const uint8_t *>("0123456789"), 10);
+    TEST_ASSERT_EQUAL_MESSAGE(0, b.available(), "Nothing should arrive before the first character passed the wire");
+    a.EndTransmission();
+    unsigned long duration = micros() - start_time;
+    TEST_ASSERT_TRUE_MESSAGE(duration >= 10 * 1042, "Transmission should take 10 character times");
+    TEST_ASSERT_EQUAL_MESSAGE(10, b.available(), "All characters should have arrived");
+
+    uint8_t buffer[10];
+    TEST_ASSERT_EQUAL(10, b.read(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_MEMORY("0123456789", buffer, 10);
+    TEST_ASSERT_EQUAL_MESSAGE(0, a.available(), "Sender should not hear itself with RE high");
+    TEST_ASSERT_EQUAL(0, bus.GetCollisionCount());
+    TEST_ASSERT_EQUAL(0, bus.GetTruncatedCount());
+}
+
+/**
+ * @brief Testing the echo of a sender with its receiver enabled
+ *
+ */
+void test_Echo(void)
+{
+    RS485SimulatedBus bus(115200);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+
+    a.SetMode(OUTPUT);
+    digitalWrite(A_RE_PORT, LOW);
+    a.write('E');
+    port_a.flush();
+    TEST_ASSERT_EQUAL_MESSAGE('E', a.read(), "Sender with RE low should receive its own character");
+    a.SetMode(INPUT);
+}
+
+/**
+ * @brief Testing if a printed message arrives complete, flush() waits for the last stop bit before switching back
+ *
+ */
+void test_Print(void)
+{
+    RS485SimulatedBus bus(9600);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(bus, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(9600);
+
+    a.print("ID=");
+    a.print(SLAVE_ADDRESS);
+    a.print(" T=");
+    a.println(21.5, 1);
+    a.flush();
+
+    char output[16] = {};
+    TEST_ASSERT_EQUAL(14, b.read(reinterpret_cast<uint8_t *>(output), sizeof(output) - 1));
+    TEST_ASSERT_EQUAL_STRING("ID=17 T=21.5\r\n", output);
+    TEST_ASSERT_EQUAL(0, bus.GetTruncatedCount());
+
+    // Switching back by hand inside a transmission sends the staged bytes first
+    a.BeginTransmission();
+    a.print("ABC");
+    a.SetMode(INPUT);
+    TEST_ASSERT_EQUAL(LOW, digitalRead(A_DE_PORT));
+    a.EndTransmission();
+    TEST_ASSERT_EQUAL_MESSAGE(3, b.read(reinterpret_cast<uint8_t *>(output), 3), "Staged bytes should be sent before the driver is disabled");
+    TEST_ASSERT_EQUAL_MEMORY("ABC", output, 3);
+    TEST_ASSERT_EQUAL(0, bus.GetTruncatedCount());
+}
+
+/**
+ * @brief Testing if the first character waits for the driver enable delay
+ *
+ */
+void test_DriverEnableDelay(void)
+{
+    RS485SimulatedBus bus(115200, 10, 500);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(bus, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(115200);
+
+    unsigned long start_time = micros();
+    a.Send("D", 1);
+    unsigned long duration = micros() - start_time;
+    TEST_ASSERT_TRUE_MESSAGE(duration >= 500 + bus.GetCharacterTime(), "Character should wait for the driver");
+    TEST_ASSERT_EQUAL('D', b.read());
+}
+
+/**
+ * @brief Testing if releasing DE too early or not enabling it loses the characters
+ *
+ */
+void test_Truncated(void)
+{
+    RS485SimulatedBus bus(9600);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(bus, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+
+    // Switching back without waiting for the last stop bit
+    a.SetMode(OUTPUT);
+    a.write(reinterpret_cast<const uint8_t *>("ABC"), 3);
+    a.SetMode(INPUT);
+    delay(5);
+    TEST_ASSERT_EQUAL_MESSAGE(0, b.available(), "Characters cut off by DE should not arrive");
+    TEST_ASSERT_EQUAL(3, bus.GetTruncatedCount());
+
+    // Writing to the port without enabling the driver at all
+    port_a.write('X');
+    delay(2);
+    TEST_ASSERT_EQUAL(0, b.available());
+    TEST_ASSERT_EQUAL(4, bus.GetTruncatedCount());
+}
+
+/**
+ * @brief Testing if two enabled drivers corrupt the characters
+ *
+ */
+void test_Collision(void)
+{
+    RS485SimulatedBus bus(115200);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(bus, B_DE_PORT, B_RE_PORT);
+    RS485SimulatedPort port_c(bus, C_DE_PORT, C_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    RS485 c(C_DE_PORT, C_RE_PORT, &port_c);
+
+    a.SetMode(OUTPUT);
+    b.SetMode(OUTPUT);
+    a.write(static_cast<uint8_t>(0xFF));
+    b.write(static_cast<uint8_t>(0xFF));
+    port_a.flush();
+    port_b.flush();
+    a.SetMode(INPUT);
+    b.SetMode(INPUT);
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, bus.GetCollisionCount(), "Both characters should collide");
+    TEST_ASSERT_EQUAL(2, c.available());
+    TEST_ASSERT_NOT_EQUAL(0xFF, c.read());
+}
+
+/**
+ * @brief Peer answering every request with the request itself, first byte incremented
+ *
+ * @param peer module of the peer.
+ */
+void AnswerRequests(RS485 &peer)
+{
+    uint8_t request[kPipelineFrameLength];
+    while (peer.available() >= static_cast<int>(kPipelineFrameLength))
+    {
+        peer.read(request, sizeof(request));
+        request[0]++;
+        peer.Send(request, sizeof(request));
+    }
+}
+
+/**
+ * @brief Testing if both ends of a 4-wire link can send at the same time in full duplex
+ *
+ */
+void test_FullDuplex(void)
+{
+    RS485SimulatedBus pair_ab(115200);
+    RS485SimulatedBus pair_ba(115200);
+    RS485SimulatedPort port_a(pair_ab, pair_ba, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(pair_ba, pair_ab, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(115200);
+    b.SetFrameFormat(115200);
+    a.SetFullDuplex(true);
+    b.SetFullDuplex(true);
+
+    unsigned long start_time = micros();
+    a.Send("0123456789", 10);
+    b.Send("ABCDEFGHIJ", 10);
+    TEST_ASSERT_TRUE_MESSAGE(micros() - start_time < 10 * pair_ab.GetCharacterTime(), "Send should not wait for the last stop bit in full duplex");
+    port_a.flush();
+    port_b.flush();
+
+    uint8_t buffer[10];
+    TEST_ASSERT_EQUAL(10, a.read(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_MEMORY("ABCDEFGHIJ", buffer, 10);
+    TEST_ASSERT_EQUAL(10, b.read(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_MEMORY("0123456789", buffer, 10);
+    TEST_ASSERT_EQUAL(0, pair_ab.GetCollisionCount() + pair_ba.GetCollisionCount());
+    TEST_ASSERT_EQUAL(0, pair_ab.GetTruncatedCount() + pair_ba.GetTruncatedCount());
+}
+
+/**
+ * @brief Testing if pipelined responses are matched with their requests and a missing response times out
+ *
+ */
+void test_Pipeline(void)
+{
+    RS485SimulatedBus pair_ab(115200);
+    RS485SimulatedBus pair_ba(115200);
+    RS485SimulatedPort port_a(pair_ab, pair_ba, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(pair_ba, pair_ab, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFullDuplex(true);
+    b.SetFullDuplex(true);
+
+    RS485PipelineRequest requests[kPipelineDepth];
+    uint8_t response[kPipelineFrameLength];
+    RS485Pipeline pipeline(a, requests, kPipelineDepth, response, sizeof(response));
+    TEST_ASSERT_FALSE_MESSAGE(pipeline.Send(response, 1, kPipelineFrameLength + 1), "Response larger than the buffer should be refused");
+
+    uint8_t request[kPipelineFrameLength] = {0};
+    for (uint16_t i = 0; i < kPipelineDepth; i++)
+    {
+        request[0] = static_cast<uint8_t>(i * 10);
+        TEST_ASSERT_TRUE(pipeline.Send(request, sizeof(request), kPipelineFrameLength, i));
+    }
+    TEST_ASSERT_TRUE_MESSAGE(pipeline.IsFull(), "Pipeline should be full");
+    TEST_ASSERT_FALSE(pipeline.Send(request, sizeof(request), kPipelineFrameLength));
+
+    for (uint16_t i = 0; i < kPipelineDepth; i++)
+    {
+        while (!pipeline.Poll())
+        {
+            AnswerRequests(b);
+        }
+        TEST_ASSERT_FALSE(pipeline.IsTimedOut());
+        TEST_ASSERT_EQUAL_MESSAGE(i, pipeline.GetTag(), "Responses should arrive in order");
+        TEST_ASSERT_EQUAL(kPipelineFrameLength, pipeline.GetResponseLength());
+        TEST_ASSERT_EQUAL(i * 10 + 1, pipeline.GetResponse()[0]);
+        pipeline.ReleaseResponse();
+    }
+    TEST_ASSERT_EQUAL(0, pipeline.GetOutstandingCount());
+
+    // Without a peer answering the request times out
+    pipeline.SetResponseTimeout(10);
+    unsigned long start_time = millis();
+    TEST_ASSERT_TRUE(pipeline.Send(request, sizeof(request), kPipelineFrameLength, 7));
+    while (!pipeline.Poll())
+    {
+    }
+    TEST_ASSERT_TRUE_MESSAGE(millis() - start_time >= 10, "Request timed out too early");
+    TEST_ASSERT_TRUE(pipeline.IsTimedOut());
+    TEST_ASSERT_EQUAL(7, pipeline.GetTag());
+    TEST_ASSERT_EQUAL(0, pipeline.GetResponseLength());
+    pipeline.ReleaseResponse();
+    TEST_ASSERT_EQUAL(0, pipeline.GetOutstandingCount());
+}
+
+/**
+ * @brief Testing if the rest of a late response is dropped instead of being taken as the start of the next response
+ *
+ */
+void test_PipelineLateResponse(void)
+{
+    RS485SimulatedBus pair_ab(115200);
+    RS485SimulatedBus pair_ba(115200);
+    RS485SimulatedPort port_a(pair_ab, pair_ba, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(pair_ba, pair_ab, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(115200);
+    b.SetFrameFormat(115200);
+    a.SetFullDuplex(true);
+    b.SetFullDuplex(true);
+
+    RS485PipelineRequest requests[kPipelineDepth];
+    uint8_t response[kPipelineFrameLength];
+    RS485Pipeline pipeline(a, requests, kPipelineDepth, response, sizeof(response));
+    pipeline.SetResponseTimeout(10);
+
+    uint8_t request[kPipelineFrameLength] = {0};
+    TEST_ASSERT_TRUE(pipeline.Send(request, sizeof(request), kPipelineFrameLength, 0));
+    request[0] = 10;
+    TEST_ASSERT_TRUE(pipeline.Send(request, sizeof(request), kPipelineFrameLength, 1));
+
+    // The peer answers the first request partly, the rest comes after the timeout
+    const uint8_t late[kPipelineFrameLength] = {0xEE, 0xEE, 0xEE, 0xEE, 0xEE, 0xEE, 0xEE, 0xEE};
+    b.Send(late, 4);
+    while (!pipeline.Poll())
+    {
+    }
+    TEST_ASSERT_TRUE(pipeline.IsTimedOut());
+    TEST_ASSERT_EQUAL(0, pipeline.GetTag());
+    pipeline.ReleaseResponse();
+    b.Send(late + 4, 4);
+
+    unsigned long start_time = millis();
+    while (millis() - start_time < 3)
+    {
+        TEST_ASSERT_FALSE_MESSAGE(pipeline.Poll(), "No response should be complete while the late bytes are dropped");
+    }
+
+    uint8_t answer[kPipelineFrameLength] = {11};
+    b.Send(answer, sizeof(answer));
+    while (!pipeline.Poll())
+    {
+    }
+    TEST_ASSERT_FALSE(pipeline.IsTimedOut());
+    TEST_ASSERT_EQUAL(1, pipeline.GetTag());
+    TEST_ASSERT_EQUAL(kPipelineFrameLength, pipeline.GetResponseLength());
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(answer, pipeline.GetResponse(), kPipelineFrameLength, "Late bytes should not shift the next response");
+    pipeline.ReleaseResponse();
+}
+
+/**
+ * @brief Testing if the requests whose responses were dropped with a late response back-to-back fail without waiting for the timeout
+ *
+ */
+void test_PipelineBackToBack(void)
+{
+    RS485SimulatedBus pair_ab(115200);
+    RS485SimulatedBus pair_ba(115200);
+    RS485SimulatedPort port_a(pair_ab, pair_ba, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(pair_ba, pair_ab, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(115200);
+    b.SetFrameFormat(115200);
+    a.SetFullDuplex(true);
+    b.SetFullDuplex(true);
+
+    RS485PipelineRequest requests[kPipelineDepth];
+    uint8_t response[kPipelineFrameLength];
+    RS485Pipeline pipeline(a, requests, kPipelineDepth, response, sizeof(response));
+    pipeline.SetResponseTimeout(10);
+
+    uint8_t request[kPipelineFrameLength] = {0};
+    for (uint16_t tag = 0; tag < 4; tag++)
+    {
+        TEST_ASSERT_TRUE(pipeline.Send(request, sizeof(request), kPipelineFrameLength, tag));
+    }
+
+    // The rest of the first response comes after its timeout, the next two responses follow without a gap
+    const uint8_t late[kPipelineFrameLength] = {0xEE, 0xEE, 0xEE, 0xEE, 0xEE, 0xEE, 0xEE, 0xEE};
+    b.Send(late, 4);
+    while (!pipeline.Poll())
+    {
+    }
+    TEST_ASSERT_TRUE(pipeline.IsTimedOut());
+    pipeline.ReleaseResponse();
+    unsigned long start_time = millis();
+    b.BeginTransmission();
+    b.write(late + 4, 4);
+    b.write(late, sizeof(late));
+    b.write(late, sizeof(late));
+    b.EndTransmission();
+
+    for (uint16_t tag = 1; tag < 3; tag++)
+    {
+        while (!pipeline.Poll())
+        {
+        }
+        TEST_ASSERT_TRUE_MESSAGE(pipeline.IsTimedOut(), "Response dropped with the late one should fail");
+        TEST_ASSERT_EQUAL(tag, pipeline.GetTag());
+        TEST_ASSERT_EQUAL(0, pipeline.GetResponseLength());
+        pipeline.ReleaseResponse();
+    }
+    TEST_ASSERT_TRUE_MESSAGE(millis() - start_time < 10, "Dropped responses should fail before the response timeout");
+
+    // After the silence the last request is in step again
+    start_time = millis();
+    while (millis() - start_time < 2)
+    {
+        TEST_ASSERT_FALSE_MESSAGE(pipeline.Poll(), "Last request should wait for its response");
+    }
+    uint8_t answer[kPipelineFrameLength] = {13};
+    b.Send(answer, sizeof(answer));
+    while (!pipeline.Poll())
+    {
+    }
+    TEST_ASSERT_FALSE(pipeline.IsTimedOut());
+    TEST_ASSERT_EQUAL(3, pipeline.GetTag());
+    TEST_ASSERT_EQUAL_MEMORY(answer, pipeline.GetResponse(), kPipelineFrameLength);
+    pipeline.ReleaseResponse();
+}
+
+/**
+ * @brief Compare transactions per second of stop-and-wait on a 2-wire bus with a pipeline on a 4-wire link
+ *
+ */
+void test_BenchmarkPipeline(void)
+{
+    const unsigned long kBaudrate = 115200;
+    uint8_t request[kPipelineFrameLength] = {0};
+    uint8_t response[kPipelineFrameLength];
+
+    // Stop-and-wait, every request waits for the response of the previous one
+    RS485SimulatedBus bus(kBaudrate);
+    RS485SimulatedPort master_port(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort slave_port(bus, B_DE_PORT, B_RE_PORT);
+    RS485 master(A_DE_PORT, A_RE_PORT, &master_port);
+    RS485 slave(B_DE_PORT, B_RE_PORT, &slave_port);
+    master.SetFrameFormat(kBaudrate);
+    slave.SetFrameFormat(kBaudrate);
+
+    unsigned long half_duplex = 0;
+    unsigned long start_time = millis();
+    while (millis() - start_time < kBenchmarkDuration)
+    {
+        master.Send(request, sizeof(request));
+        size_t received = 0;
+        while (received < sizeof(response))
+        {
+            AnswerRequests(slave);
+            received += master.read(response + received, sizeof(response) - received);
+        }
+        half_duplex++;
+    }
+    double half_duplex_rate = half_duplex * 1000.0 / (millis() - start_time);
+
+    // Pipeline, requests and responses are on the wire at the same time
+    RS485SimulatedBus pair_ab(kBaudrate);
+    RS485SimulatedBus pair_ba(kBaudrate);
+    RS485SimulatedPort port_a(pair_ab, pair_ba, C_DE_PORT, C_RE_PORT);
+    RS485SimulatedPort port_b(pair_ba, pair_ab, B_DE_PORT, B_RE_PORT);
+    RS485 a(C_DE_PORT, C_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(kBaudrate);
+    b.SetFrameFormat(kBaudrate);
+    a.SetFullDuplex(true);
+    b.SetFullDuplex(true);
+
+    RS485PipelineRequest requests[kPipelineDepth];
+    RS485Pipeline pipeline(a, requests, kPipelineDepth, response, sizeof(response));
+    unsigned long full_duplex = 0;
+    unsigned long failures = 0;
+    start_time = millis();
+    while (millis() - start_time < kBenchmarkDuration)
+    {
+        while (!pipeline.IsFull())
+        {
+            pipeline.Send(request, sizeof(request), sizeof(response));
+        }
+        AnswerRequests(b);
+        if (pipeline.Poll())
+        {
+            if (pipeline.IsTimedOut())
+            {
+                failures++;
+            }
+            full_duplex++;
+            pipeline.ReleaseResponse();
+        }
+    }
+    double full_duplex_rate = full_duplex * 1000.0 / (millis() - start_time);
+
+    char output[160];
+    snprintf(output, sizeof(output), "%lu baud, %u byte requests and responses: stop-and-wait %.1f transactions/s, pipeline of %u %.1f transactions/s (x%.2f)",
+             kBaudrate, static_cast<unsigned>(kPipelineFrameLength), half_duplex_rate, static_cast<unsigned>(kPipelineDepth), full_duplex_rate,
+             full_duplex_rate / half_duplex_rate);
+    TEST_MESSAGE(output);
+    TEST_ASSERT_EQUAL(0, failures);
+    TEST_ASSERT_TRUE_MESSAGE(full_duplex_rate > 1.5 * half_duplex_rate, "Pipeline should roughly double the transactions");
+    TEST_ASSERT_EQUAL(0, pair_ab.GetCollisionCount() + pair_ba.GetCollisionCount());
+}
+
+/**
+ * @brief Testing if queued frames are sent in one transmission with the requested silence between them
+ *
+ */
+void test_TransmitQueue(void)
+{
+    RS485SimulatedBus bus(19200);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(bus, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(19200);
+
+    RS485QueueSlot slots[kQueueDepth];
+    RS485TransmitQueue queue(a, slots, kQueueDepth);
+    const unsigned long kGap = 2000;
+    TEST_ASSERT_TRUE(queue.Enqueue(reinterpret_cast<const uint8_t *>("ABC"), 3));
+    TEST_ASSERT_TRUE(queue.Enqueue(reinterpret_cast<const uint8_t *>("DEF"), 3, kGap));
+    TEST_ASSERT_TRUE(queue.Enqueue(reinterpret_cast<const uint8_t *>("GHI"), 3, kGap));
+    TEST_ASSERT_EQUAL(3, queue.GetDepth());
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(A_DE_PORT), "Queued frames should not be sent before Poll() or Flush()");
+
+    unsigned long start_time = micros();
+    TEST_ASSERT_EQUAL(3, queue.Poll());
+    unsigned long duration = micros() - start_time;
+    TEST_ASSERT_TRUE_MESSAGE(duration >= 9 * bus.GetCharacterTime() + 2 * kGap, "Gaps between the frames are missing");
+    TEST_ASSERT_TRUE_MESSAGE(duration < 9 * bus.GetCharacterTime() + 2 * kGap + 2000, "Transmission took far longer than needed");
+
+    char output[16] = {};
+    TEST_ASSERT_EQUAL(9, b.read(reinterpret_cast<uint8_t *>(output), sizeof(output) - 1));
+    TEST_ASSERT_EQUAL_STRING("ABCDEFGHI", output);
+    TEST_ASSERT_EQUAL(0, bus.GetTruncatedCount());
+
+    // A full queue refuses frames, Poll() waits for the coalescing delay unless the queue is full
+    queue.SetCoalescingDelay(1000000);
+    uint8_t frame[MAX485TTL_QUEUE_FRAME_SIZE + 1] = {0};
+    TEST_ASSERT_FALSE_MESSAGE(queue.Enqueue(frame, sizeof(frame)), "Frame longer than a slot should be refused");
+    TEST_ASSERT_TRUE(queue.Enqueue(frame, 1));
+    TEST_ASSERT_EQUAL_MESSAGE(0, queue.Poll(), "Frame should wait for the coalescing delay");
+    for (size_t i = 1; i < kQueueDepth; i++)
+    {
+        TEST_ASSERT_TRUE(queue.Enqueue(frame, 1));
+    }
+    TEST_ASSERT_FALSE(queue.Enqueue(frame, 1));
+    TEST_ASSERT_EQUAL_MESSAGE(kQueueDepth, queue.Poll(), "Full queue should be sent without waiting");
+
+    const RS485QueueStatistics &statistics = queue.GetStatistics();
+    TEST_ASSERT_EQUAL(3 + kQueueDepth, statistics.frames_queued);
+    TEST_ASSERT_EQUAL(2, statistics.frames_dropped);
+    TEST_ASSERT_EQUAL(3 + kQueueDepth, statistics.frames_sent);
+    TEST_ASSERT_EQUAL(2, statistics.transmissions);
+    TEST_ASSERT_EQUAL(kQueueDepth, statistics.max_batch);
+    TEST_ASSERT_EQUAL(kQueueDepth, statistics.max_depth);
+}
+
+/**
+ * @brief Testing if a high priority frame goes ahead of a bulk transfer at a chunk boundary within the reported bound
+ *
+ */
+void test_TransmitScheduler(void)
+{
+    const unsigned long kBaudrate = 19200;
+    RS485SimulatedBus bus(kBaudrate);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(bus, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(kBaudrate);
+
+    uint8_t bulk[256];
+    for (size_t i = 0; i < sizeof(bulk); i++)
+    {
+        bulk[i] = 'a' + i % 26;
+    }
+
+    RS485SchedulerSlot slots[kSchedulerDepth];
+    RS485TransmitScheduler scheduler(a, slots, kSchedulerDepth);
+    scheduler.SetChunkSize(kChunkSize);
+    TEST_ASSERT_TRUE(scheduler.StartBulk(bulk, sizeof(bulk)));
+    TEST_ASSERT_FALSE_MESSAGE(scheduler.StartBulk(bulk, sizeof(bulk)), "Second bulk transfer should be refused");
+
+    uint8_t output[sizeof(bulk) + 8];
+    size_t received = 0;
+    bool stop_queued = false;
+    unsigned long start_time = micros();
+    while (scheduler.Poll())
+    {
+        if (!stop_queued && scheduler.GetBulkRemaining() < sizeof(bulk) / 2)
+        {
+            TEST_ASSERT_TRUE(scheduler.Enqueue(reinterpret_cast<const uint8_t *>("STOP"), 4));
+            stop_queued = true;
+        }
+        received += b.read(output + received, sizeof(output) - received);
+        TEST_ASSERT_TRUE_MESSAGE(micros() - start_time < 1000000, "Transfer did not finish");
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(LOW, digitalRead(A_DE_PORT), "Driver should be disabled when nothing is left");
+    received += b.read(output + received, sizeof(output) - received);
+    TEST_ASSERT_EQUAL(sizeof(bulk) + 4, received);
+
+    // The frame sits between two chunks and the bulk data around it is complete and in order
+    size_t position = 0;
+    while (position < sizeof(bulk) && memcmp(output + position, "STOP", 4) != 0)
+    {
+        position++;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(position < sizeof(bulk), "High priority frame is missing");
+    TEST_ASSERT_EQUAL_MESSAGE(0, position % kChunkSize, "High priority frame should be sent at a chunk boundary");
+    TEST_ASSERT_EQUAL_MEMORY(bulk, output, position);
+    TEST_ASSERT_EQUAL_MEMORY(bulk + position, output + position + 4, sizeof(bulk) - position);
+
+    const RS485SchedulerStatistics &statistics = scheduler.GetStatistics();
+    TEST_ASSERT_EQUAL(1, statistics.frames_sent);
+    TEST_ASSERT_EQUAL(1, statistics.preemptions);
+    TEST_ASSERT_EQUAL(sizeof(bulk) / kChunkSize, statistics.chunks_sent);
+    TEST_ASSERT_TRUE_MESSAGE(statistics.max_latency <= scheduler.GetLatencyBound(), "Latency should stay within the reported bound");
+
+    char message[160];
+    snprintf(message, sizeof(message), "%lu baud, %u byte chunks: high priority latency %lu us, bound %lu us, unchunked transfer %lu us",
+             kBaudrate, static_cast<unsigned>(kChunkSize), statistics.max_latency, scheduler.GetLatencyBound(),
+             static_cast<unsigned long>(sizeof(bulk)) * bus.GetCharacterTime());
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, bus.GetTruncatedCount());
+}
+
+/**
+ * @brief Compare frames per second of sending small frames one by one with sending them through the transmit queue
+ *
+ */
+void test_BenchmarkQueue(void)
+{
+    // A transceiver needing 50 us before its driver is enabled, every transmission pays it
+    const unsigned long kBaudrate = 115200;
+    RS485SimulatedBus bus(kBaudrate, 10, 50);
+    RS485SimulatedPort port_a(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort port_b(bus, B_DE_PORT, B_RE_PORT);
+    RS485 a(A_DE_PORT, A_RE_PORT, &port_a);
+    RS485 b(B_DE_PORT, B_RE_PORT, &port_b);
+    a.SetFrameFormat(kBaudrate);
+
+    const uint8_t frame[] = {0x00, 0x06, 0x00, 0x10};
+    uint8_t sink[64];
+    unsigned long single = 0;
+    unsigned long start_time = millis();
+    while (millis() - start_time < kBenchmarkDuration)
+    {
+        for (size_t i = 0; i < kQueueDepth; i++)
+        {
+            a.Send(frame, sizeof(frame));
+        }
+        single += kQueueDepth;
+        while (b.read(sink, sizeof(sink)))
+        {
+        }
+    }
+    double single_rate = single * 1000.0 / (millis() - start_time);
+
+    RS485QueueSlot slots[kQueueDepth];
+    RS485TransmitQueue queue(a, slots, kQueueDepth);
+    unsigned long queued = 0;
+    start_time = millis();
+    while (millis() - start_time < kBenchmarkDuration)
+    {
+        for (size_t i = 0; i < kQueueDepth; i++)
+        {
+            queue.Enqueue(frame, sizeof(frame));
+        }
+        queued += queue.Poll();
+        while (b.read(sink, sizeof(sink)))
+        {
+        }
+    }
+    double queued_rate = queued * 1000.0 / (millis() - start_time);
+
+    const RS485QueueStatistics &statistics = queue.GetStatistics();
+    char output[160];
+    snprintf(output, sizeof(output), "%lu baud, %u byte frames: one by one %.1f frames/s, queued %.1f frames/s (x%.2f), %.1f frames per transmission",
+             kBaudrate, static_cast<unsigned>(sizeof(frame)), single_rate, queued_rate, queued_rate / single_rate,
+             static_cast<double>(statistics.frames_sent) / statistics.transmissions);
+    TEST_MESSAGE(output);
+    TEST_ASSERT_TRUE_MESSAGE(queued_rate > single_rate, "Queue should send more frames per second");
+    TEST_ASSERT_EQUAL(0, bus.GetTruncatedCount());
+}
+
+/**
+ * @brief Testing if the poll scheduler keeps the intervals and priorities and backs off a slave which does not answer
+ *
+ */
+void test_PollScheduler(void)
+{
+    const unsigned long kBaudrate = 115200;
+    RS485SimulatedBus bus(kBaudrate);
+    RS485SimulatedPort master_port(bus, A_DE_PORT, A_RE_PORT);
+    RS485 master_rs485(A_DE_PORT, A_RE_PORT, &master_port);
+    master_rs485.SetFrameFormat(kBaudrate);
+    uint8_t master_buffer[kModbusMaxFrameLength];
+    ModbusMaster master(master_rs485, master_buffer, sizeof(master_buffer));
+    master.SetResponseTimeout(kPollResponseTimeout);
+
+    SimulatedSlave slave_1(bus, kBaudrate, 1);
+    SimulatedSlave slave_2(bus, kBaudrate, 2);
+    SimulatedSlave *const slaves[] = {&slave_1, &slave_2};
+
+    // Slave 1 every 50 ms before anything else, slave 2 whenever the bus is free, nobody answers to address 9
+    uint16_t values[3][2] = {};
+    ModbusPollEntry table[] = {
+        ModbusPollEntry(2, ModbusFunction::kReadHoldingRegisters, 0, 2, values[1], 0),
+        ModbusPollEntry(1, ModbusFunction::kReadHoldingRegisters, 0, 2, values[0], 50, 1),
+        ModbusPollEntry(9, ModbusFunction::kReadHoldingRegisters, 0, 2, values[2], 0),
+    };
+    ModbusPollScheduler scheduler(master, table, 3);
+    scheduler.SetBackoff(100, 400);
+    PollCounts counts = {};
+    scheduler.SetCallback(CountPoll, &counts);
+
+    const unsigned long kDuration = 1000;
+    unsigned long start_time = millis();
+    while (millis() - start_time < kDuration)
+    {
+        PollSlaves(slaves, 2);
+        scheduler.Poll();
+    }
+
+    TEST_ASSERT_EQUAL(1, values[0][0]);
+    TEST_ASSERT_EQUAL(2, values[1][0]);
+    TEST_ASSERT_TRUE_MESSAGE(counts.responses[1] >= kDuration / 50 - 2 && counts.responses[1] <= kDuration / 50 + 1, "Slave 1 should be polled every 50 ms");
+    TEST_ASSERT_TRUE_MESSAGE(counts.responses[2] > 5 * counts.responses[1], "Slave 2 should get the rest of the bus");
+    TEST_ASSERT_EQUAL(ModbusStatus::kOk, table[1].status);
+    TEST_ASSERT_EQUAL(ModbusStatus::kTimeout, table[2].status);
+    TEST_ASSERT_FALSE(scheduler.IsResponsive(2));
+    TEST_ASSERT_TRUE(scheduler.IsResponsive(0));
+
+    // Requests after 0, 120, 340 and 760 ms: 4 timeouts instead of one every cycle
+    TEST_ASSERT_TRUE_MESSAGE(counts.timeouts[9] >= 3 && counts.timeouts[9] <= 5, "Dead slave should be backed off");
+    const ModbusPollStatistics &statistics = scheduler.GetStatistics();
+    TEST_ASSERT_EQUAL(counts.responses[1] + counts.responses[2], statistics.responses);
+    TEST_ASSERT_TRUE_MESSAGE(statistics.requests - statistics.responses - statistics.timeouts <= 1, "Only the request in flight may be open");
+    TEST_ASSERT_EQUAL(0, statistics.errors);
+    TEST_ASSERT_EQUAL(0, bus.GetCollisionCount());
+}
+
+/**
+ * @brief Compare the scan cycle time of a hand-written loop over all slaves with the poll scheduler, 2 of the slaves are dead
+ *
+ */
+void test_BenchmarkPollScheduler(void)
+{
+    const unsigned long kBaudrate = 115200;
+    const size_t kAddresses = kPollSlaves + 2;
+    RS485SimulatedBus bus(kBaudrate);
+    RS485SimulatedPort master_port(bus, A_DE_PORT, A_RE_PORT);
+    RS485 master_rs485(A_DE_PORT, A_RE_PORT, &master_port);
+    master_rs485.SetFrameFormat(kBaudrate);
+    uint8_t master_buffer[kModbusMaxFrameLength];
+    ModbusMaster master(master_rs485, master_buffer, sizeof(master_buffer));
+    master.SetResponseTimeout(kPollResponseTimeout);
+
+    SimulatedSlave *slaves[kPollSlaves];
+    for (size_t i = 0; i < kPollSlaves; i++)
+    {
+        slaves[i] = new SimulatedSlave(bus, kBaudrate, static_cast<uint8_t>(i + 1));
+    }
+
+    // Every address one after the other, addresses kPollSlaves + 1 and + 2 wait for the response timeout every cycle
+    unsigned long cycles = 0;
+    unsigned long start_time = millis();
+    while (millis() - start_time < kBenchmarkDuration)
+    {
+        for (size_t address = 1; address <= kAddresses; address++)
+        {
+            ModbusStatus status = master.BeginReadHoldingRegisters(static_cast<uint8_t>(address), 0, 2);
+            while (status == ModbusStatus::kBusy)
+            {
+                PollSlaves(slaves, kPollSlaves);
+                status = master.Poll();
+            }
+        }
+        cycles++;
+    }
+    double loop_cycle = static_cast<double>(millis() - start_time) / cycles;
+
+    uint16_t values[kAddresses][2];
+    ModbusPollEntry table[] = {
+        ModbusPollEntry(1, ModbusFunction::kReadHoldingRegisters, 0, 2, values[0], 0),
+        ModbusPollEntry(2, ModbusFunction::kReadHoldingRegisters, 0, 2, values[1], 0),
+        ModbusPollEntry(3, ModbusFunction::kReadHoldingRegisters, 0, 2, values[2], 0),
+        ModbusPollEntry(4, ModbusFunction::kReadHoldingRegisters, 0, 2, values[3], 0),
+        ModbusPollEntry(5, ModbusFunction::kReadHoldingRegisters, 0, 2, values[4], 0),
+        ModbusPollEntry(6, ModbusFunction::kReadHoldingRegisters, 0, 2, values[5], 0),
+        ModbusPollEntry(7, ModbusFunction::kReadHoldingRegisters, 0, 2, values[6], 0),
+        ModbusPollEntry(8, ModbusFunction::kReadHoldingRegisters, 0, 2, values[7], 0),
+        ModbusPollEntry(9, ModbusFunction::kReadHoldingRegisters, 0, 2, values[8], 0),
+        ModbusPollEntry(10, ModbusFunction::kReadHoldingRegisters, 0, 2, values[9], 0),
+        ModbusPollEntry(11, ModbusFunction::kReadHoldingRegisters, 0, 2, values[10], 0),
+        ModbusPollEntry(12, ModbusFunction::kReadHoldingRegisters, 0, 2, values[11], 0),
+    };
+    ModbusPollScheduler scheduler(master, table, kAddresses);
+    start_time = millis();
+    while (millis() - start_time < kBenchmarkDuration)
+    {
+        PollSlaves(slaves, kPollSlaves);
+        scheduler.Poll();
+    }
+    const ModbusPollStatistics &statistics = scheduler.GetStatistics();
+    double scheduler_cycle = static_cast<double>(millis() - start_time) * kPollSlaves / statistics.responses;
+
+    for (size_t i = 0; i < kPollSlaves; i++)
+    {
+        TEST_ASSERT_EQUAL(i + 1, values[i][0]);
+        delete slaves[i];
+    }
+
+    char output[160];
+    snprintf(output, sizeof(output), "%lu baud, %u slaves of which 2 dead, %lu ms timeout: loop cycle %.1f ms, scheduler cycle %.1f ms (x%.2f), %lu timeouts",
+             kBaudrate, static_cast<unsigned>(kAddresses), kPollResponseTimeout, loop_cycle, scheduler_cycle, loop_cycle / scheduler_cycle,
+             static_cast<unsigned long>(statistics.timeouts));
+    TEST_MESSAGE(output);
+    TEST_ASSERT_TRUE_MESSAGE(scheduler_cycle < loop_cycle, "Scheduler should scan the slaves faster");
+    TEST_ASSERT_EQUAL(0, bus.GetCollisionCount());
+}
+
+/**
+ * @brief Measure Modbus transactions per second and slave turnaround on the simulated wire
+ *
+ */
+void test_BenchmarkModbus(void)
+{
+    const unsigned long baudrates[] = {9600, 19200, 115200};
+    for (unsigned long baudrate : baudrates)
+    {
+        RS485SimulatedBus bus(baudrate);
+        RS485SimulatedPort master_port(bus, A_DE_PORT, A_RE_PORT);
+        RS485SimulatedPort slave_port(bus, B_DE_PORT, B_RE_PORT);
+        RS485 master_rs485(A_DE_PORT, A_RE_PORT, &master_port);
+        RS485 slave_rs485(B_DE_PORT, B_RE_PORT, &slave_port);
+        master_rs485.SetFrameFormat(baudrate);
+        slave_rs485.SetFrameFormat(baudrate);
+
+        uint16_t holding[10] = {0};
+        const ModbusBlock map[] = {
+            ModbusBlock(ModbusTable::kHoldingRegisters, 0, 10, holding),
+        };
+        uint8_t master_buffer[kModbusMaxFrameLength];
+        uint8_t slave_buffer[kModbusMaxFrameLength];
+        ModbusMaster master(master_rs485, master_buffer, sizeof(master_buffer));
+        ModbusSlave slave(slave_rs485, SLAVE_ADDRESS, map, 1, slave_buffer, sizeof(slave_buffer));
+
+        unsigned long transactions = 0;
+        unsigned long failures = 0;
+        unsigned long turnaround = 0;
+        unsigned long start_time = millis();
+        while (millis() - start_time < kBenchmarkDuration)
+        {
+            ModbusStatus status = master.BeginReadHoldingRegisters(SLAVE_ADDRESS, 0, 10);
+            while (status == ModbusStatus::kBusy)
+            {
+                if (slave.Poll())
+                {
+                    turnaround += slave.GetResponseLatency();
+                }
+                status = master.Poll();
+            }
+            if (status == ModbusStatus::kOk)
+            {
+                transactions++;
+            }
+            else
+            {
+                failures++;
+            }
+        }
+        unsigned long duration = millis() - start_time;
+
+        // Request 8 and response 25 characters, the rest is turnaround and silent intervals
+        unsigned long wire_time = (8 + 25) * bus.GetCharacterTime();
+        char output[160];
+        snprintf(output, sizeof(output), "modbus %6lu baud: %5.1f transactions/s (characters only %5.1f), slave turnaround %.1f us, failures %lu",
+                 baudrate, transactions * 1000.0 / duration, 1000000.0 / wire_time, transactions ? static_cast<double>(turnaround) / transactions : 0.0, failures);
+        TEST_MESSAGE(output);
+        TEST_ASSERT_EQUAL_MESSAGE(0, failures, "No transaction should fail on a clean bus");
+        TEST_ASSERT_EQUAL(0, bus.GetCollisionCount());
+        TEST_ASSERT_EQUAL(0, bus.GetTruncatedCount());
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_Timing);
+    RUN_TEST(test_Echo);
+    RUN_TEST(test_Print);
+    RUN_TEST(test_DriverEnableDelay);
+    RUN_TEST(test_Truncated);
+    RUN_TEST(test_Collision);
+    RUN_TEST(test_FullDuplex);
+    RUN_TEST(test_Pipeline);
+    RUN_TEST(test_PipelineLateResponse);
+    RUN_TEST(test_PipelineBackToBack);
+    RUN_TEST(test_TransmitQueue);
+    RUN_TEST(test_TransmitScheduler);
+    RUN_TEST(test_PollScheduler);
+    RUN_TEST(test_BenchmarkModbus);
+    RUN_TEST(test_BenchmarkPipeline);
+    RUN_TEST(test_BenchmarkQueue);
+    RUN_TEST(test_BenchmarkPollScheduler);
+
+    return UNITY_END();
+}
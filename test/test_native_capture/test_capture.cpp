@@ -0,0 +1,306 @@
+/**
+ * @file test_capture.cpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Unit tests of the bus traffic capture, its decoders and the replay (pio test -e native)
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "max485ttl_benchmark.hpp"
+#include "max485ttl_capture.hpp"
+#include "max485ttl_modbus_master.hpp"
+#include "max485ttl_modbus_slave.hpp"
+#include "max485ttl_simulated_bus.hpp"
+
+#define A_DE_PORT 10
+#define A_RE_PORT 11
+#define B_DE_PORT 12
+#define B_RE_PORT 13
+#define SLAVE_ADDRESS 17
+
+void Report(const char *line, void *context)
+{
+    (void)context;
+    TEST_MESSAGE(line);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/**
+ * @brief Testing if runs are merged into records and the oldest records are dropped
+ *
+ */
+void test_Ring(void)
+{
+    uint8_t buffer[32];
+    RS485Capture capture(buffer, sizeof(buffer));
+
+    capture.Add(RS485CaptureDirection::kTransmit, reinterpret_cast<const uint8_t *>("ab"), 2);
+    capture.Add(RS485CaptureDirection::kTransmit, reinterpret_cast<const uint8_t *>("c"), 1);
+    TEST_ASSERT_EQUAL_MESSAGE(6 + 3, capture.GetLength(), "Bytes of the same run should extend the record");
+    capture.Add(RS485CaptureDirection::kReceive, reinterpret_cast<const uint8_t *>("xyz"), 3);
+    TEST_ASSERT_EQUAL(9 + 9, capture.GetLength());
+
+    uint8_t exported[32];
+    size_t length = capture.Export(exported, sizeof(exported));
+    TEST_ASSERT_EQUAL(18, length);
+    RS485CaptureReader reader(exported, length);
+    RS485CaptureRecord record;
+    TEST_ASSERT_TRUE(reader.Next(record));
+    TEST_ASSERT_TRUE(record.direction == RS485CaptureDirection::kTransmit);
+    TEST_ASSERT_EQUAL(3, record.length);
+    TEST_ASSERT_EQUAL_MEMORY("abc", record.data, 3);
+    uint32_t first_time = record.time;
+    TEST_ASSERT_TRUE(reader.Next(record));
+    TEST_ASSERT_TRUE(record.direction == RS485CaptureDirection::kReceive);
+    TEST_ASSERT_EQUAL_MEMORY("xyz", record.data, 3);
+    TEST_ASSERT_TRUE(record.time - first_time < 1000);
+    TEST_ASSERT_FALSE(reader.Next(record));
+
+    // A new transmit record of 6 + 10 bytes does not fit next to both records
+    capture.Add(RS485CaptureDirection::kTransmit, reinterpret_cast<const uint8_t *>("0123456789"), 10);
+    TEST_ASSERT_EQUAL_MESSAGE(1, capture.GetDroppedCount(), "Oldest record should be dropped");
+    length = capture.Export(exported, sizeof(exported));
+    RS485CaptureReader wrapped(exported, length);
+    TEST_ASSERT_TRUE(wrapped.Next(record));
+    TEST_ASSERT_EQUAL_MEMORY("xyz", record.data, 3);
+    TEST_ASSERT_TRUE(wrapped.Next(record));
+    TEST_ASSERT_EQUAL_MEMORY("0123456789", record.data, 10);
+    TEST_ASSERT_FALSE(wrapped.Next(record));
+
+    // A run longer than the ring keeps its newest bytes
+    uint8_t run[64];
+    for (uint8_t i = 0; i < sizeof(run); i++)
+    {
+        run[i] = i;
+    }
+    capture.Add(RS485CaptureDirection::kReceive, run, sizeof(run));
+    length = capture.Export(exported, sizeof(exported));
+    RS485CaptureReader newest(exported, length);
+    TEST_ASSERT_TRUE(newest.Next(record));
+    TEST_ASSERT_EQUAL(26, record.length);
+    TEST_ASSERT_EQUAL(63, record.data[25]);
+}
+
+/**
+ * @brief Testing the capture of a Modbus transaction and the CSV and pcap decoders
+ *
+ */
+void test_Decoders(void)
+{
+    RS485SimulatedBus bus(115200);
+    RS485SimulatedPort master_port(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort slave_port(bus, B_DE_PORT, B_RE_PORT);
+    RS485 master_rs485(A_DE_PORT, A_RE_PORT, &master_port);
+    RS485 slave_rs485(B_DE_PORT, B_RE_PORT, &slave_port);
+    master_rs485.SetFrameFormat(115200);
+    slave_rs485.SetFrameFormat(115200);
+    uint8_t capture_buffer[256];
+    RS485Capture capture(capture_buffer, sizeof(capture_buffer));
+    master_rs485.SetCapture(&capture);
+
+    uint16_t holding[2] = {0x1234, 0x5678};
+    const ModbusBlock map[] = {
+        ModbusBlock(ModbusTable::kHoldingRegisters, 0, 2, holding),
+    };
+    uint8_t master_buffer[kModbusMaxFrameLength];
+    uint8_t slave_buffer[kModbusMaxFrameLength];
+    ModbusMaster master(master_rs485, master_buffer, sizeof(master_buffer));
+    ModbusSlave slave(slave_rs485, SLAVE_ADDRESS, map, 1, slave_buffer, sizeof(slave_buffer));
+
+    ModbusStatus status = master.BeginReadHoldingRegisters(SLAVE_ADDRESS, 0, 2);
+    while (status == ModbusStatus::kBusy)
+    {
+        slave.Poll();
+        status = master.Poll();
+    }
+    TEST_ASSERT_TRUE(status == ModbusStatus::kOk);
+
+    uint8_t exported[256];
+    size_t length = capture.Export(exported, sizeof(exported));
+    TEST_ASSERT_EQUAL_MESSAGE(6 + 8 + 6 + 9, length, "Request of 8 and response of 9 bytes should be one record each");
+
+    FILE *csv = tmpfile();
+    TEST_ASSERT_TRUE(RS485CaptureWriteCsv(exported, length, csv));
+    rewind(csv);
+    char line[128];
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), csv));
+    TEST_ASSERT_EQUAL_STRING("time_us,direction,length,data\n", line);
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), csv));
+    TEST_ASSERT_NOT_NULL(strstr(line, ",tx,8,110300000002"));
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), csv));
+    TEST_ASSERT_NOT_NULL(strstr(line, ",rx,9,1103041234567890C6"));
+    fclose(csv);
+
+    FILE *pcap = tmpfile();
+    TEST_ASSERT_TRUE(RS485CaptureWritePcap(exported, length, pcap));
+    TEST_ASSERT_EQUAL_MESSAGE(24 + 16 + 9 + 16 + 10, ftell(pcap), "Header and two packets with direction byte");
+    rewind(pcap);
+    uint32_t header[6];
+    TEST_ASSERT_EQUAL(1, fread(header, sizeof(header), 1, pcap));
+    TEST_ASSERT_EQUAL(0xA1B2C3D4, header[0]);
+    TEST_ASSERT_EQUAL(147, header[5]);
+    fclose(pcap);
+
+    FILE *truncated = tmpfile();
+    TEST_ASSERT_FALSE_MESSAGE(RS485CaptureWriteCsv(exported, length - 1, truncated), "Truncated capture should be reported");
+    fclose(truncated);
+}
+
+/**
+ * @brief Testing if a replayed capture drives a slave like the original master did
+ *
+ */
+void test_Replay(void)
+{
+    uint8_t exported[512];
+    size_t length;
+    unsigned long original_duration;
+    {
+        RS485SimulatedBus bus(115200);
+        RS485SimulatedPort master_port(bus, A_DE_PORT, A_RE_PORT);
+        RS485SimulatedPort slave_port(bus, B_DE_PORT, B_RE_PORT);
+        RS485 master_rs485(A_DE_PORT, A_RE_PORT, &master_port);
+        RS485 slave_rs485(B_DE_PORT, B_RE_PORT, &slave_port);
+        master_rs485.SetFrameFormat(115200);
+        slave_rs485.SetFrameFormat(115200);
+        uint8_t capture_buffer[512];
+        RS485Capture capture(capture_buffer, sizeof(capture_buffer));
+        master_rs485.SetCapture(&capture);
+
+        uint16_t holding[4] = {0};
+        const ModbusBlock map[] = {
+            ModbusBlock(ModbusTable::kHoldingRegisters, 0, 4, holding),
+        };
+        uint8_t master_buffer[kModbusMaxFrameLength];
+        uint8_t slave_buffer[kModbusMaxFrameLength];
+        ModbusMaster master(master_rs485, master_buffer, sizeof(master_buffer));
+        ModbusSlave slave(slave_rs485, SLAVE_ADDRESS, map, 1, slave_buffer, sizeof(slave_buffer));
+
+        unsigned long start_time = micros();
+        for (uint16_t i = 0; i < 10; i++)
+        {
+            ModbusStatus status = master.BeginWriteSingleRegister(SLAVE_ADDRESS, i % 4, i);
+            while (status == ModbusStatus::kBusy)
+            {
+                slave.Poll();
+                status = master.Poll();
+            }
+            TEST_ASSERT_TRUE(status == ModbusStatus::kOk);
+        }
+        original_duration = micros() - start_time;
+        length = capture.Export(exported, sizeof(exported));
+    }
+
+    RS485SimulatedBus bus(115200);
+    RS485SimulatedPort replay_port(bus, A_DE_PORT, A_RE_PORT);
+    RS485SimulatedPort slave_port(bus, B_DE_PORT, B_RE_PORT);
+    RS485 replay_rs485(A_DE_PORT, A_RE_PORT, &replay_port);
+    RS485 slave_rs485(B_DE_PORT, B_RE_PORT, &slave_port);
+    replay_rs485.SetFrameFormat(115200);
+    slave_rs485.SetFrameFormat(115200);
+    uint16_t holding[4] = {0};
+    const ModbusBlock map[] = {
+        ModbusBlock(ModbusTable::kHoldingRegisters, 0, 4, holding),
+    };
+    uint8_t slave_buffer[kModbusMaxFrameLength];
+    ModbusSlave slave(slave_rs485, SLAVE_ADDRESS, map, 1, slave_buffer, sizeof(slave_buffer));
+
+    RS485CaptureReplay replay(replay_rs485, exported, length, RS485CaptureDirection::kTransmit);
+    unsigned long start_time = micros();
+    unsigned long responses = 0;
+    while (replay.Poll() || micros() - start_time < original_duration + 5000)
+    {
+        if (slave.Poll())
+        {
+            responses++;
+        }
+    }
+    TEST_ASSERT_EQUAL(10, replay.GetSentCount());
+    TEST_ASSERT_EQUAL_MESSAGE(10, responses, "Slave should answer every replayed request");
+    TEST_ASSERT_EQUAL(9, holding[1]);
+    TEST_ASSERT_EQUAL(0, bus.GetCollisionCount());
+}
+
+/**
+ * @brief Testing if only a full record followed by one with the same time is sent as one run
+ *
+ */
+void test_ReplaySplitRecords(void)
+{
+    // A full record and a later one, then a run split over a full record and its continuation
+    const uint32_t times[] = {0, 100000, 200000, 200000};
+    const uint8_t lengths[] = {255, 3, 255, 3};
+    static uint8_t exported[4 * RS485CaptureRecord::kHeaderLength + 2 * 255 + 2 * 3];
+    size_t length = 0;
+    for (size_t i = 0; i < 4; i++)
+    {
+        for (size_t j = 0; j < 4; j++)
+        {
+            exported[length++] = static_cast<uint8_t>(times[i] >> (8 * j));
+        }
+        exported[length++] = static_cast<uint8_t>(RS485CaptureDirection::kTransmit);
+        exported[length++] = lengths[i];
+        memset(exported + length, static_cast<int>(i), lengths[i]);
+        length += lengths[i];
+    }
+
+    RS485SimulatedBus bus(115200);
+    RS485SimulatedPort replay_port(bus, A_DE_PORT, A_RE_PORT);
+    RS485 replay_rs485(A_DE_PORT, A_RE_PORT, &replay_port);
+    replay_rs485.SetFrameFormat(115200);
+    RS485CaptureReplay replay(replay_rs485, exported, length, RS485CaptureDirection::kTransmit);
+
+    TEST_ASSERT_TRUE(replay.Poll());
+    TEST_ASSERT_EQUAL_MESSAGE(1, replay.GetSentCount(), "A full record with a later successor should be sent alone");
+    while (replay.GetSentCount() == 1)
+    {
+        replay.Poll();
+    }
+    TEST_ASSERT_EQUAL(2, replay.GetSentCount());
+    while (replay.Poll())
+    {
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(4, replay.GetSentCount(), "A continuation with the same time should be sent with its record");
+}
+
+/**
+ * @brief Measure the CPU cycles per byte of the read and write paths while capturing
+ *
+ */
+void test_BenchmarkCapture(void)
+{
+    RS485NullStream stream;
+    RS485 rs485(A_DE_PORT, A_RE_PORT, &stream);
+    uint8_t buffer[1024];
+    RS485Capture capture(buffer, sizeof(buffer));
+    rs485.SetCapture(&capture);
+    RS485Benchmark benchmark(rs485, 0, Report);
+    benchmark.MeasureCpu(rs485, 64, 10000);
+    TEST_ASSERT_TRUE(capture.GetDroppedCount() > 0);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_Ring);
+    RUN_TEST(test_Decoders);
+    RUN_TEST(test_Replay);
+    RUN_TEST(test_ReplaySplitRecords);
+    RUN_TEST(test_BenchmarkCapture);
+
+    return UNITY_END();
+}
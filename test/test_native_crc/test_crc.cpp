@@ -0,0 +1,155 @@
+/**
+ * @file test_crc.cpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Unit tests and benchmarks for the CRC module that run on the host (pio test -e native)
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <unity.h>
+#include "max485ttl_crc.hpp"
+
+const size_t kBenchmarkLength = 256;
+const long kBenchmarkIterations = 4000;
+
+static uint64_t ReadCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return static_cast<uint64_t>(micros()) * 1000;
+#endif
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_Tables(void)
+{
+    // Generated at compile time
+    static_assert(Crc16ModbusFullGenerator::Entry(1) == 0xC0C1, "CRC-16 table entry 1");
+    static_assert(Crc16ModbusFullGenerator::Entry(255) == 0x4040, "CRC-16 table entry 255");
+    static_assert(Crc8FullGenerator::Entry(1) == 0x07, "CRC-8 table entry 1");
+
+    TEST_ASSERT_EQUAL_UINT32(512, sizeof(Crc16ModbusTable::kValues));
+    TEST_ASSERT_EQUAL_UINT32(32, sizeof(Crc16ModbusNibbleTable::kValues));
+    TEST_ASSERT_EQUAL_UINT32(256, sizeof(Crc8Table::kValues));
+    TEST_ASSERT_EQUAL_UINT32(16, sizeof(Crc8NibbleTable::kValues));
+
+    TEST_ASSERT_EQUAL_HEX16(0x0000, Crc16ModbusTable::kValues[0]);
+    TEST_ASSERT_EQUAL_HEX16(0xC0C1, Crc16ModbusTable::kValues[1]);
+    TEST_ASSERT_EQUAL_HEX16(0xCC01, Crc16ModbusNibbleTable::kValues[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x07, Crc8Table::kValues[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x07, Crc8NibbleTable::kValues[1]);
+}
+
+void test_Crc16(void)
+{
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+    TEST_ASSERT_EQUAL_HEX16(0x4B37, Crc16ModbusBitwise(check, sizeof(check)));
+    TEST_ASSERT_EQUAL_HEX16(0x4B37, Crc16ModbusNibble(check, sizeof(check)));
+    TEST_ASSERT_EQUAL_HEX16(0x4B37, Crc16ModbusFull(check, sizeof(check)));
+    TEST_ASSERT_EQUAL_HEX16(0x4B37, Crc16ModbusSlicing(check, sizeof(check)));
+    TEST_ASSERT_EQUAL_HEX16(0x4B37, Crc16Modbus(check, sizeof(check)));
+
+    // Continue from a previous CRC
+    uint16_t crc = Crc16Modbus(check, 5);
+    TEST_ASSERT_EQUAL_HEX16(0x4B37, Crc16Modbus(&check[5], sizeof(check) - 5, crc));
+
+    // Every variant gives the same result for every length
+    uint8_t data[67];
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    for (size_t length = 0; length <= sizeof(data); length++)
+    {
+        uint16_t expected = Crc16ModbusBitwise(data, length);
+        TEST_ASSERT_EQUAL_HEX16(expected, Crc16ModbusNibble(data, length));
+        TEST_ASSERT_EQUAL_HEX16(expected, Crc16ModbusFull(data, length));
+        TEST_ASSERT_EQUAL_HEX16(expected, Crc16ModbusSlicing(data, length));
+    }
+}
+
+void test_Crc8(void)
+{
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+    TEST_ASSERT_EQUAL_HEX8(0xF4, Crc8Bitwise(check, sizeof(check)));
+    TEST_ASSERT_EQUAL_HEX8(0xF4, Crc8Nibble(check, sizeof(check)));
+    TEST_ASSERT_EQUAL_HEX8(0xF4, Crc8Full(check, sizeof(check)));
+    TEST_ASSERT_EQUAL_HEX8(0xF4, Crc8(check, sizeof(check)));
+
+    uint8_t data[67];
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = static_cast<uint8_t>(i * 53 + 7);
+    }
+    for (size_t length = 0; length <= sizeof(data); length++)
+    {
+        uint8_t expected = Crc8Bitwise(data, length);
+        TEST_ASSERT_EQUAL_HEX8(expected, Crc8Nibble(data, length));
+        TEST_ASSERT_EQUAL_HEX8(expected, Crc8Full(data, length));
+    }
+}
+
+/**
+ * @brief Report the cycles per byte of a CRC function
+ *
+ */
+template <class Result>
+static void BenchmarkCrc(const char *name, Result (*crc_function)(const uint8_t *, size_t, Result), const Result initial)
+{
+    uint8_t data[kBenchmarkLength];
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = static_cast<uint8_t>(i);
+    }
+
+    // The result is fed back so the calls can not be optimised away
+    volatile Result sink = initial;
+    uint64_t start_cycles = ReadCycles();
+    for (long i = 0; i < kBenchmarkIterations; i++)
+    {
+        sink = crc_function(data, sizeof(data), sink);
+    }
+    uint64_t cycles = ReadCycles() - start_cycles;
+
+    char output[128];
+    snprintf(output, sizeof(output), "%-20s %6.2f cycles/byte", name,
+             static_cast<double>(cycles) / (static_cast<double>(kBenchmarkIterations) * kBenchmarkLength));
+    TEST_MESSAGE(output);
+}
+
+void test_BenchmarkCrc(void)
+{
+    BenchmarkCrc<uint16_t>("crc16 bitwise", Crc16ModbusBitwise, kCrc16ModbusInitial);
+    BenchmarkCrc<uint16_t>("crc16 nibble table", Crc16ModbusNibble, kCrc16ModbusInitial);
+    BenchmarkCrc<uint16_t>("crc16 full table", Crc16ModbusFull, kCrc16ModbusInitial);
+    BenchmarkCrc<uint16_t>("crc16 slicing-by-4", Crc16ModbusSlicing, kCrc16ModbusInitial);
+    BenchmarkCrc<uint8_t>("crc8 bitwise", Crc8Bitwise, kCrc8Initial);
+    BenchmarkCrc<uint8_t>("crc8 nibble table", Crc8Nibble, kCrc8Initial);
+    BenchmarkCrc<uint8_t>("crc8 full table", Crc8Full, kCrc8Initial);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_Tables);
+    RUN_TEST(test_Crc16);
+    RUN_TEST(test_Crc8);
+    RUN_TEST(test_BenchmarkCrc);
+
+    return UNITY_END();
+}
@@ -0,0 +1,71 @@
+/**
+ * @file crossed_stream.hpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Two streams connected to each other, what is written to one can be read from the other
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef CROSSED_STREAM_HPP_
+#define CROSSED_STREAM_HPP_
+
+#include <deque>
+#include "max485ttl_platform.hpp"
+
+class CrossedStream : public Stream
+{
+public:
+    CrossedStream(void) : other_(nullptr) {}
+
+    /**
+     * @brief Connect two streams to each other
+     *
+     */
+    static void Connect(CrossedStream &a, CrossedStream &b)
+    {
+        a.other_ = &b;
+        b.other_ = &a;
+    }
+
+    int available(void) override
+    {
+        return static_cast<int>(received_.size());
+    }
+
+    int read(void) override
+    {
+        if (received_.empty())
+        {
+            return -1;
+        }
+        int c = received_.front();
+        received_.pop_front();
+        return c;
+    }
+
+    int peek(void) override
+    {
+        return received_.empty() ? -1 : received_.front();
+    }
+
+    size_t write(uint8_t data) override
+    {
+        other_->received_.push_back(data);
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        other_->received_.insert(other_->received_.end(), buffer, buffer + size);
+        return size;
+    }
+
+private:
+    CrossedStream *other_;
+    std::deque<uint8_t> received_;
+};
+
+#endif // CROSSED_STREAM_HPP_
@@ -0,0 +1,209 @@
+/**
+ * @file simulated_slave.hpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Stream which acts as a Modbus RTU slave, the response is made when the master flushes the request
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef SIMULATED_SLAVE_HPP_
+#define SIMULATED_SLAVE_HPP_
+
+#include <vector>
+#include "max485ttl_modbus.hpp"
+
+class SimulatedSlave : public Stream
+{
+public:
+    static const uint16_t kRegisterCount = 64;
+    static const uint16_t kCoilCount = 64;
+
+    explicit SimulatedSlave(uint8_t address) : address_(address), corrupt_crc_(false), silent_(false), read_cursor_(0)
+    {
+        for (uint16_t i = 0; i < kRegisterCount; i++)
+        {
+            registers_[i] = i;
+        }
+        for (uint16_t i = 0; i < kCoilCount; i++)
+        {
+            coils_[i] = (i % 3) == 0;
+        }
+    }
+
+    int available(void) override
+    {
+        return static_cast<int>(response_.size() - read_cursor_);
+    }
+
+    int read(void) override
+    {
+        if (read_cursor_ == response_.size())
+        {
+            return -1;
+        }
+        return response_[read_cursor_++];
+    }
+
+    int peek(void) override
+    {
+        if (read_cursor_ == response_.size())
+        {
+            return -1;
+        }
+        return response_[read_cursor_];
+    }
+
+    size_t write(uint8_t data) override
+    {
+        request_.push_back(data);
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        request_.insert(request_.end(), buffer, buffer + size);
+        return size;
+    }
+
+    /**
+     * @brief The master flushes at the end of the request, so the request is handled here
+     *
+     */
+    void flush(void) override
+    {
+        response_.clear();
+        read_cursor_ = 0;
+        if (!silent_)
+        {
+            Handle();
+        }
+        request_.clear();
+    }
+
+    uint16_t registers_[kRegisterCount];
+    bool coils_[kCoilCount];
+    uint8_t address_;
+    bool corrupt_crc_;
+    bool silent_;
+
+private:
+    void Exception(uint8_t function, ModbusException exception)
+    {
+        response_.push_back(address_);
+        response_.push_back(function | 0x80);
+        response_.push_back(static_cast<uint8_t>(exception));
+    }
+
+    void Handle(void)
+    {
+        if (request_.size() < 4 || !ModbusCheckCrc(request_.data(), request_.size()) || request_[0] != address_)
+        {
+            return;
+        }
+
+        const uint8_t *request = request_.data();
+        uint8_t function = request[1];
+        uint16_t address = ModbusGetWord(&request[2]);
+        uint16_t quantity = ModbusGetWord(&request[4]);
+
+        switch (static_cast<ModbusFunction>(function))
+        {
+        case ModbusFunction::kReadCoils:
+        case ModbusFunction::kReadDiscreteInputs:
+            if (address + quantity > kCoilCount)
+            {
+                Exception(function, ModbusException::kIllegalDataAddress);
+                break;
+            }
+            response_.push_back(address_);
+            response_.push_back(function);
+            response_.push_back(static_cast<uint8_t>((quantity + 7) / 8));
+            for (uint16_t i = 0; i < quantity; i++)
+            {
+                if (i % 8 == 0)
+                {
+                    response_.push_back(0);
+                }
+                response_.back() |= coils_[address + i] << (i % 8);
+            }
+            break;
+        case ModbusFunction::kReadHoldingRegisters:
+        case ModbusFunction::kReadInputRegisters:
+            if (address + quantity > kRegisterCount)
+            {
+                Exception(function, ModbusException::kIllegalDataAddress);
+                break;
+            }
+            response_.push_back(address_);
+            response_.push_back(function);
+            response_.push_back(static_cast<uint8_t>(quantity * 2));
+            PushRegisters(address, quantity);
+            break;
+        case ModbusFunction::kWriteSingleCoil:
+            coils_[address] = quantity == 0xFF00;
+            response_.assign(request, request + 6);
+            break;
+        case ModbusFunction::kWriteSingleRegister:
+            registers_[address] = quantity;
+            response_.assign(request, request + 6);
+            break;
+        case ModbusFunction::kWriteMultipleCoils:
+            for (uint16_t i = 0; i < quantity; i++)
+            {
+                coils_[address + i] = (request[7 + i / 8] >> (i % 8)) & 1;
+            }
+            response_.assign(request, request + 6);
+            break;
+        case ModbusFunction::kWriteMultipleRegisters:
+            for (uint16_t i = 0; i < quantity; i++)
+            {
+                registers_[address + i] = ModbusGetWord(&request[7 + i * 2]);
+            }
+            response_.assign(request, request + 6);
+            break;
+        case ModbusFunction::kReadWriteMultipleRegisters:
+        {
+            uint16_t write_address = ModbusGetWord(&request[6]);
+            uint16_t write_quantity = ModbusGetWord(&request[8]);
+            for (uint16_t i = 0; i < write_quantity; i++)
+            {
+                registers_[write_address + i] = ModbusGetWord(&request[11 + i * 2]);
+            }
+            response_.push_back(address_);
+            response_.push_back(function);
+            response_.push_back(static_cast<uint8_t>(quantity * 2));
+            PushRegisters(address, quantity);
+            break;
+        }
+        default:
+            Exception(function, ModbusException::kIllegalFunction);
+            break;
+        }
+
+        uint16_t crc = ModbusCrc16(response_.data(), response_.size());
+        if (corrupt_crc_)
+        {
+            crc ^= 0x0101;
+        }
+        response_.push_back(static_cast<uint8_t>(crc));
+        response_.push_back(static_cast<uint8_t>(crc >> 8));
+    }
+
+    void PushRegisters(uint16_t address, uint16_t quantity)
+    {
+        for (uint16_t i = 0; i < quantity; i++)
+        {
+            response_.push_back(static_cast<uint8_t>(registers_[address + i] >> 8));
+            response_.push_back(static_cast<uint8_t>(registers_[address + i]));
+        }
+    }
+
+    std::vector<uint8_t> request_;
+    std::vector<uint8_t> response_;
+    size_t read_cursor_;
+};
+
+#endif // SIMULATED_SLAVE_HPP_
@@ -0,0 +1,549 @@
+/**
+ * @file test_modbus.cpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Unit tests and benchmarks for the Modbus RTU master and slave that run on the host (pio test -e native)
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <unity.h>
+#include "max485ttl_modbus_master.hpp"
+#include "max485ttl_modbus_slave.hpp"
+#include "crossed_stream.hpp"
+#include "simulated_slave.hpp"
+
+#define DE_PORT 2
+#define RE_PORT 3
+#define SLAVE_ADDRESS 17
+#define SLAVE_DE_PORT 4
+#define SLAVE_RE_PORT 5
+
+const long kBenchmarkTransactions = 500;
+const long kBenchmarkResponses = 2000;
+
+/**
+ * @brief Stream acting as the slave
+ *
+ */
+SimulatedSlave *slave;
+
+/**
+ * @brief Module of the master
+ *
+ */
+RS485 *rs;
+
+/**
+ * @brief Buffer of the master
+ *
+ */
+uint8_t buffer[kModbusMaxFrameLength];
+
+/**
+ * @brief The object that is being tested
+ *
+ */
+ModbusMaster *master;
+
+void setUp(void)
+{
+    slave = new SimulatedSlave(SLAVE_ADDRESS);
+    rs = new RS485(DE_PORT, RE_PORT, slave);
+    rs->SetFrameFormat(115200);
+    master = new ModbusMaster(*rs, buffer, sizeof(buffer));
+    master->SetResponseTimeout(20);
+}
+
+void tearDown(void)
+{
+    delete master;
+    delete rs;
+    delete slave;
+}
+
+/**
+ * @brief Testing the CRC against the example of the Modbus specification
+ *
+ */
+void test_Crc(void)
+{
+    const uint8_t frame[] = {0x02, 0x07};
+    TEST_ASSERT_EQUAL_HEX16(0x1241, ModbusCrc16(frame, sizeof(frame)));
+
+    uint8_t request[8] = {0x11, 0x03, 0x00, 0x6B, 0x00, 0x03};
+    TEST_ASSERT_EQUAL_MESSAGE(8, ModbusAppendCrc(request, 6), "Length with CRC is not correct");
+    TEST_ASSERT_EQUAL_HEX8(0x76, request[6]);
+    TEST_ASSERT_EQUAL_HEX8(0x87, request[7]);
+    TEST_ASSERT_TRUE_MESSAGE(ModbusCheckCrc(request, 8), "CRC check failed on correct frame");
+    request[3] ^= 1;
+    TEST_ASSERT_FALSE_MESSAGE(ModbusCheckCrc(request, 8), "CRC check passed on corrupted frame");
+}
+
+/**
+ * @brief Testing the read functions
+ *
+ */
+void test_Read(void)
+{
+    uint16_t registers[10];
+    TEST_ASSERT_TRUE(master->ReadHoldingRegisters(SLAVE_ADDRESS, 5, 10, registers) == ModbusStatus::kOk);
+    for (uint16_t i = 0; i < 10; i++)
+    {
+        TEST_ASSERT_EQUAL_MESSAGE(5 + i, registers[i], "Holding register not read correctly");
+    }
+
+    TEST_ASSERT_TRUE(master->ReadInputRegisters(SLAVE_ADDRESS, 0, 2, registers) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL_MESSAGE(1, registers[1], "Input register not read correctly");
+
+    uint8_t coils[2];
+    TEST_ASSERT_TRUE(master->ReadCoils(SLAVE_ADDRESS, 0, 10, coils) == ModbusStatus::kOk);
+    // Every third coil is on: 0, 3, 6, 9
+    TEST_ASSERT_EQUAL_HEX8(0x49, coils[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x02, coils[1]);
+    TEST_ASSERT_TRUE(master->GetCoil(9));
+    TEST_ASSERT_FALSE(master->GetCoil(8));
+
+    TEST_ASSERT_TRUE(master->ReadDiscreteInputs(SLAVE_ADDRESS, 1, 3, coils) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL_HEX8(0x04, coils[0]);
+}
+
+/**
+ * @brief Testing the write functions
+ *
+ */
+void test_Write(void)
+{
+    TEST_ASSERT_TRUE(master->WriteSingleRegister(SLAVE_ADDRESS, 3, 0xBEEF) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL_HEX16(0xBEEF, slave->registers_[3]);
+
+    TEST_ASSERT_TRUE(master->WriteSingleCoil(SLAVE_ADDRESS, 1, true) == ModbusStatus::kOk);
+    TEST_ASSERT_TRUE(slave->coils_[1]);
+
+    const uint16_t values[] = {100, 200, 300};
+    TEST_ASSERT_TRUE(master->WriteMultipleRegisters(SLAVE_ADDRESS, 10, 3, values) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL(300, slave->registers_[12]);
+
+    const uint8_t coils[] = {0xFF, 0x01};
+    TEST_ASSERT_TRUE(master->WriteMultipleCoils(SLAVE_ADDRESS, 20, 9, coils) == ModbusStatus::kOk);
+    TEST_ASSERT_TRUE(slave->coils_[28]);
+    TEST_ASSERT_FALSE(slave->coils_[29]);
+
+    uint16_t registers[2];
+    TEST_ASSERT_TRUE(master->ReadWriteMultipleRegisters(SLAVE_ADDRESS, 10, 2, 11, 3, values, registers) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL_MESSAGE(100, registers[0], "Read part of function 23 is not correct");
+    TEST_ASSERT_EQUAL_MESSAGE(100, registers[1], "Write part of function 23 was not done before the read");
+    TEST_ASSERT_EQUAL(300, slave->registers_[13]);
+}
+
+/**
+ * @brief Testing exception responses, CRC errors and timeouts
+ *
+ */
+void test_Errors(void)
+{
+    uint16_t registers[10];
+    TEST_ASSERT_TRUE(master->ReadHoldingRegisters(SLAVE_ADDRESS, 60, 10, registers) == ModbusStatus::kException);
+    TEST_ASSERT_TRUE(master->GetException() == ModbusException::kIllegalDataAddress);
+
+    TEST_ASSERT_TRUE(master->ReadHoldingRegisters(SLAVE_ADDRESS, 0, 126, registers) == ModbusStatus::kInvalidArgument);
+
+    slave->corrupt_crc_ = true;
+    TEST_ASSERT_TRUE(master->ReadHoldingRegisters(SLAVE_ADDRESS, 0, 1, registers) == ModbusStatus::kCrcError);
+    slave->corrupt_crc_ = false;
+
+    unsigned long start_time = millis();
+    TEST_ASSERT_TRUE(master->ReadHoldingRegisters(SLAVE_ADDRESS + 1, 0, 1, registers) == ModbusStatus::kTimeout);
+    TEST_ASSERT_TRUE_MESSAGE(millis() - start_time >= 20, "Timeout returned too early");
+
+    // Broadcast does not wait for a response, the next request waits for the turnaround delay instead
+    master->SetTurnaroundDelay(5);
+    unsigned long start_micros = micros();
+    TEST_ASSERT_TRUE(master->WriteSingleRegister(kModbusBroadcastAddress, 0, 1) == ModbusStatus::kOk);
+    unsigned long begin_micros = micros();
+    TEST_ASSERT_TRUE(master->BeginReadHoldingRegisters(SLAVE_ADDRESS, 0, 1) == ModbusStatus::kBusy);
+    TEST_ASSERT_TRUE_MESSAGE(micros() - begin_micros < 2500, "Starting a request should not wait for the turnaround delay");
+    ModbusStatus status;
+    while ((status = master->Poll()) == ModbusStatus::kBusy)
+    {
+    }
+    TEST_ASSERT_TRUE(status == ModbusStatus::kOk);
+    TEST_ASSERT_TRUE_MESSAGE(micros() - start_micros >= 5000, "Request after a broadcast should wait for the turnaround delay");
+
+    // A request the stream does not take is not sent
+    RS485 unconnected(DE_PORT, RE_PORT, nullptr);
+    ModbusMaster unconnected_master(unconnected, buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(unconnected_master.WriteSingleRegister(SLAVE_ADDRESS, 0, 1) == ModbusStatus::kTransmitError);
+    TEST_ASSERT_TRUE(unconnected_master.Poll() == ModbusStatus::kIdle);
+}
+
+/**
+ * @brief Testing the non-blocking request
+ *
+ */
+void test_NonBlocking(void)
+{
+    TEST_ASSERT_TRUE(master->Poll() == ModbusStatus::kIdle);
+    TEST_ASSERT_TRUE(master->BeginReadHoldingRegisters(SLAVE_ADDRESS, 0, 4) == ModbusStatus::kBusy);
+    TEST_ASSERT_TRUE_MESSAGE(master->BeginReadHoldingRegisters(SLAVE_ADDRESS, 0, 4) == ModbusStatus::kBusy, "Second request should be refused while busy");
+
+    long polls = 0;
+    ModbusStatus status;
+    while ((status = master->Poll()) == ModbusStatus::kBusy)
+    {
+        polls++;
+    }
+    TEST_ASSERT_TRUE(status == ModbusStatus::kOk);
+    TEST_ASSERT_TRUE_MESSAGE(polls > 0, "Response should only complete after t3.5");
+    TEST_ASSERT_EQUAL(3, master->GetRegister(3));
+}
+
+/**
+ * @brief Testing that a request waits in Poll() for a silent bus and gives up when the bus never becomes silent
+ *
+ */
+void test_IdleBus(void)
+{
+    CrossedStream master_stream;
+    CrossedStream bus_stream;
+    CrossedStream::Connect(master_stream, bus_stream);
+    RS485 master_rs485(DE_PORT, RE_PORT, &master_stream);
+    master_rs485.SetFrameFormat(115200);
+    ModbusMaster bus_master(master_rs485, buffer, sizeof(buffer));
+    bus_master.SetResponseTimeout(5);
+
+    // Another device keeps talking, the request is held back and fails after t3.5 and the response timeout
+    unsigned long start_time = micros();
+    TEST_ASSERT_TRUE(bus_master.BeginReadHoldingRegisters(SLAVE_ADDRESS, 0, 1) == ModbusStatus::kBusy);
+    ModbusStatus status;
+    do
+    {
+        bus_stream.write(0x55);
+        status = bus_master.Poll();
+    } while (status == ModbusStatus::kBusy && micros() - start_time < 1000000UL);
+    TEST_ASSERT_TRUE(status == ModbusStatus::kTimeout);
+    TEST_ASSERT_TRUE_MESSAGE(micros() - start_time >= 5000, "Request should wait the response timeout for a silent bus");
+    TEST_ASSERT_EQUAL_MESSAGE(0, bus_stream.available(), "Request should not be sent on a busy bus");
+
+    // Once the bus is silent the request is sent by Poll()
+    TEST_ASSERT_TRUE(bus_master.BeginReadHoldingRegisters(SLAVE_ADDRESS, 0, 1) == ModbusStatus::kBusy);
+    while (bus_stream.available() == 0 && bus_master.Poll() == ModbusStatus::kBusy)
+    {
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(8, bus_stream.available(), "Request should be sent once the bus is silent");
+    while (bus_master.Poll() == ModbusStatus::kBusy)
+    {
+    }
+}
+
+/**
+ * @brief Testing the round trip estimator against hand calculated values of RFC 6298
+ *
+ */
+void test_RttEstimator(void)
+{
+    RS485RttPeer peers[2];
+    RS485RttEstimator estimator(peers, 2);
+    estimator.SetLimits(2000, 100000);
+    TEST_ASSERT_EQUAL_MESSAGE(100000, estimator.GetTimeout(1), "Peer without samples should get the ceiling");
+
+    // srtt = 4000, rttvar = 2000, timeout = srtt + 4 * rttvar
+    estimator.AddSample(1, 4000);
+    TEST_ASSERT_EQUAL(4000, estimator.GetSmoothedRtt(1));
+    TEST_ASSERT_EQUAL(2000, estimator.GetRttVariation(1));
+    TEST_ASSERT_EQUAL(12000, estimator.GetTimeout(1));
+
+    // srtt = 4000 + (8000 - 4000) / 8, rttvar = 1500 + 4000 / 4
+    estimator.AddSample(1, 4000);
+    estimator.AddSample(1, 8000);
+    TEST_ASSERT_EQUAL(4500, estimator.GetSmoothedRtt(1));
+    TEST_ASSERT_EQUAL(2125, estimator.GetRttVariation(1));
+
+    // A steady peer converges to its round trip time
+    for (int i = 0; i < 100; i++)
+    {
+        estimator.AddSample(1, 4000);
+    }
+    TEST_ASSERT_TRUE(estimator.GetTimeout(1) >= 4000 && estimator.GetTimeout(1) < 4100);
+
+    // Every timeout doubles the timeout up to the ceiling, a response clears it
+    unsigned long timeout = estimator.GetTimeout(1);
+    estimator.AddTimeout(1);
+    TEST_ASSERT_EQUAL(2 * timeout, estimator.GetTimeout(1));
+    estimator.AddTimeout(1);
+    TEST_ASSERT_EQUAL(4 * timeout, estimator.GetTimeout(1));
+    for (int i = 0; i < 20; i++)
+    {
+        estimator.AddTimeout(1);
+    }
+    TEST_ASSERT_EQUAL(100000, estimator.GetTimeout(1));
+    estimator.AddSample(1, 4000);
+    TEST_ASSERT_TRUE(estimator.GetTimeout(1) < 4100);
+
+    // A fast peer is kept at the floor, a full table gives other peers the ceiling
+    for (int i = 0; i < 100; i++)
+    {
+        estimator.AddSample(2, 100);
+    }
+    TEST_ASSERT_EQUAL(2000, estimator.GetTimeout(2));
+    estimator.AddSample(3, 100);
+    TEST_ASSERT_EQUAL(0, estimator.GetSmoothedRtt(3));
+    TEST_ASSERT_EQUAL(100000, estimator.GetTimeout(3));
+
+    estimator.Reset();
+    TEST_ASSERT_EQUAL(100000, estimator.GetTimeout(1));
+}
+
+/**
+ * @brief Testing if a slave which stops answering costs its measured timeout instead of the fixed one
+ *
+ */
+void test_AdaptiveTimeout(void)
+{
+    RS485RttPeer peers[4];
+    RS485RttEstimator estimator(peers, 4);
+    estimator.SetLimits(2000, 50000);
+    master->SetRttEstimator(&estimator);
+
+    uint16_t registers[10];
+    for (int i = 0; i < 20; i++)
+    {
+        TEST_ASSERT_TRUE(master->ReadHoldingRegisters(SLAVE_ADDRESS, 0, 10, registers) == ModbusStatus::kOk);
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(2000, estimator.GetTimeout(SLAVE_ADDRESS), "Slave answering at once should get the floor");
+
+    slave->silent_ = true;
+    unsigned long start_time = micros();
+    TEST_ASSERT_TRUE(master->ReadHoldingRegisters(SLAVE_ADDRESS, 0, 10, registers) == ModbusStatus::kTimeout);
+    unsigned long duration = micros() - start_time;
+    TEST_ASSERT_TRUE_MESSAGE(duration >= 2000, "Timeout returned too early");
+    TEST_ASSERT_TRUE_MESSAGE(duration < 20000, "Timeout should be shorter than the fixed timeout");
+    TEST_ASSERT_EQUAL_MESSAGE(4000, estimator.GetTimeout(SLAVE_ADDRESS), "Timeout should double after a timeout");
+
+    char output[120];
+    snprintf(output, sizeof(output), "dead slave timeout %lu us instead of the fixed 20000 us", duration);
+    TEST_MESSAGE(output);
+
+    // An unknown slave waits for the ceiling
+    start_time = micros();
+    TEST_ASSERT_TRUE(master->ReadHoldingRegisters(SLAVE_ADDRESS + 1, 0, 10, registers) == ModbusStatus::kTimeout);
+    TEST_ASSERT_TRUE(micros() - start_time >= 50000);
+
+    slave->silent_ = false;
+    TEST_ASSERT_TRUE(master->ReadHoldingRegisters(SLAVE_ADDRESS, 0, 10, registers) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL(2000, estimator.GetTimeout(SLAVE_ADDRESS));
+    master->SetRttEstimator(nullptr);
+}
+
+/**
+ * @brief Measure transactions per second against the simulated slave, limited by t3.5 at 115200 baud
+ *
+ */
+void test_BenchmarkTransactions(void)
+{
+    uint16_t registers[10];
+    unsigned long start_time = micros();
+    for (long i = 0; i < kBenchmarkTransactions; i++)
+    {
+        if (master->ReadHoldingRegisters(SLAVE_ADDRESS, 0, 10, registers) != ModbusStatus::kOk)
+        {
+            TEST_FAIL_MESSAGE("Transaction failed");
+        }
+    }
+    unsigned long duration = micros() - start_time;
+
+    char output[96];
+    snprintf(output, sizeof(output), "modbus read 10 registers: %.0f transactions/s", kBenchmarkTransactions * 1e6 / duration);
+    TEST_MESSAGE(output);
+}
+
+/**
+ * @brief Register map of the slave under test
+ *
+ */
+uint16_t holding_registers[16];
+uint16_t input_registers[4] = {10, 11, 12, 13};
+uint8_t coils[2];
+uint8_t discrete_inputs[1] = {0xA5};
+
+constexpr ModbusBlock kMap[] = {
+    ModbusBlock(ModbusTable::kHoldingRegisters, 100, 16, holding_registers),
+    ModbusBlock(ModbusTable::kInputRegisters, 0, 4, input_registers),
+    ModbusBlock(ModbusTable::kCoils, 0, 16, coils),
+    ModbusBlock(ModbusTable::kDiscreteInputs, 0, 8, discrete_inputs),
+};
+
+/**
+ * @brief Counts the writes done by the master
+ *
+ */
+void CountWrite(const ModbusTable table, const uint16_t address, const uint16_t quantity, void *context)
+{
+    (void)table;
+    (void)address;
+    *static_cast<uint16_t *>(context) += quantity;
+}
+
+/**
+ * @brief Master and slave connected by crossed streams, both polled from the same loop
+ *
+ */
+struct SlaveSetup
+{
+    SlaveSetup(void) : master_rs(DE_PORT, RE_PORT, &master_stream), slave_rs(SLAVE_DE_PORT, SLAVE_RE_PORT, &slave_stream),
+                       master(master_rs, master_buffer, sizeof(master_buffer)),
+                       slave(slave_rs, SLAVE_ADDRESS, kMap, sizeof(kMap) / sizeof(kMap[0]), slave_buffer, sizeof(slave_buffer))
+    {
+        CrossedStream::Connect(master_stream, slave_stream);
+        master_rs.SetFrameFormat(115200);
+        slave_rs.SetFrameFormat(115200);
+        master.SetResponseTimeout(20);
+    }
+
+    ModbusStatus Transact(ModbusStatus status)
+    {
+        while (status == ModbusStatus::kBusy)
+        {
+            slave.Poll();
+            status = master.Poll();
+        }
+        return status;
+    }
+
+    CrossedStream master_stream;
+    CrossedStream slave_stream;
+    RS485 master_rs;
+    RS485 slave_rs;
+    uint8_t master_buffer[kModbusMaxFrameLength];
+    uint8_t slave_buffer[kModbusMaxFrameLength];
+    ModbusMaster master;
+    ModbusSlave slave;
+};
+
+/**
+ * @brief Testing the slave with the master for every function code
+ *
+ */
+void test_Slave(void)
+{
+    SlaveSetup setup;
+    uint16_t written = 0;
+    setup.slave.SetWriteCallback(CountWrite, &written);
+
+    const uint16_t values[] = {1000, 2000, 3000};
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginWriteMultipleRegisters(SLAVE_ADDRESS, 101, 3, values)) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL(2000, holding_registers[2]);
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginWriteSingleRegister(SLAVE_ADDRESS, 115, 0x1234)) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL_HEX16(0x1234, holding_registers[15]);
+    TEST_ASSERT_EQUAL_MESSAGE(4, written, "Write callback was not called for every register");
+
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginReadHoldingRegisters(SLAVE_ADDRESS, 101, 3)) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL(3000, setup.master.GetRegister(2));
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginReadInputRegisters(SLAVE_ADDRESS, 2, 2)) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL(13, setup.master.GetRegister(1));
+
+    const uint8_t coil_values[] = {0x0F};
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginWriteMultipleCoils(SLAVE_ADDRESS, 2, 4, coil_values)) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL_HEX8(0x3C, coils[0]);
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginWriteSingleCoil(SLAVE_ADDRESS, 9, true)) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL_HEX8(0x02, coils[1]);
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginReadCoils(SLAVE_ADDRESS, 1, 10)) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL_HEX8(0x1E, setup.master.GetResponseData()[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, setup.master.GetResponseData()[1]);
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginReadDiscreteInputs(SLAVE_ADDRESS, 4, 4)) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL_HEX8(0x0A, setup.master.GetResponseData()[0]);
+
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginReadWriteMultipleRegisters(SLAVE_ADDRESS, 100, 2, 100, 1, values)) == ModbusStatus::kOk);
+    TEST_ASSERT_EQUAL(1000, setup.master.GetRegister(0));
+    TEST_ASSERT_EQUAL(1000, setup.master.GetRegister(1));
+}
+
+/**
+ * @brief Testing exceptions of the slave and if requests for other slaves are ignored
+ *
+ */
+void test_SlaveErrors(void)
+{
+    SlaveSetup setup;
+
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginReadHoldingRegisters(SLAVE_ADDRESS, 110, 10)) == ModbusStatus::kException);
+    TEST_ASSERT_TRUE(setup.master.GetException() == ModbusException::kIllegalDataAddress);
+
+    TEST_ASSERT_TRUE(setup.Transact(setup.master.BeginReadHoldingRegisters(SLAVE_ADDRESS + 1, 100, 1)) == ModbusStatus::kTimeout);
+
+    // Broadcast is handled without response
+    TEST_ASSERT_TRUE(setup.master.WriteSingleRegister(kModbusBroadcastAddress, 100, 42) == ModbusStatus::kOk);
+    while (!setup.slave.Poll())
+    {
+    }
+    TEST_ASSERT_EQUAL(42, holding_registers[0]);
+    TEST_ASSERT_EQUAL_MESSAGE(0, setup.master_stream.available(), "Slave should not respond to a broadcast");
+}
+
+/**
+ * @brief Measure the time between the last byte of a request and the start of the response on the host.
+ * The streams have no wire time and the time counts from the Poll() which read the last byte, so this is the processing time
+ * of the slave only, not the latency on a real bus.
+ *
+ */
+void test_BenchmarkSlaveLatency(void)
+{
+    SlaveSetup setup;
+    uint8_t request[8] = {SLAVE_ADDRESS, 0x03, 0x00, 100, 0x00, 16};
+    ModbusAppendCrc(request, 6);
+
+    for (int early = 1; early >= 0; early--)
+    {
+        setup.slave.SetEarlyCompletion(early);
+        // Without early completion every request waits t3.5, a few are enough
+        long responses = early ? kBenchmarkResponses : 20;
+        unsigned long total = 0;
+        unsigned long worst = 0;
+        for (long i = 0; i < responses; i++)
+        {
+            setup.master_stream.write(request, sizeof(request));
+            while (!setup.slave.Poll())
+            {
+            }
+            while (setup.master_stream.read() >= 0)
+            {
+            }
+
+            unsigned long latency = setup.slave.GetResponseLatency();
+            total += latency;
+            worst = latency > worst ? latency : worst;
+        }
+
+        char output[160];
+        snprintf(output, sizeof(output), "host modbus slave latency from Poll() reading the last byte (early completion %s): average %lu us, worst %lu us",
+                 early ? "on" : "off", total / responses, worst);
+        TEST_MESSAGE(output);
+        if (early)
+        {
+            TEST_ASSERT_TRUE_MESSAGE(worst < 1000, "Response latency should be well under 1 ms");
+        }
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_Crc);
+    RUN_TEST(test_Read);
+    RUN_TEST(test_Write);
+    RUN_TEST(test_Errors);
+    RUN_TEST(test_NonBlocking);
+    RUN_TEST(test_IdleBus);
+    RUN_TEST(test_RttEstimator);
+    RUN_TEST(test_AdaptiveTimeout);
+    RUN_TEST(test_Slave);
+    RUN_TEST(test_SlaveErrors);
+    RUN_TEST(test_BenchmarkTransactions);
+    RUN_TEST(test_BenchmarkSlaveLatency);
+
+    return UNITY_END();
+}
@@ -0,0 +1,224 @@
+/**
+ * @file test_posix.cpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Unit tests for the POSIX backend using pseudo-terminal pairs (pio test -e native)
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <thread>
+#include <unity.h>
+#include "max485ttl_posix.hpp"
+#include "max485ttl_modbus_master.hpp"
+#include "max485ttl_modbus_slave.hpp"
+
+#define SLAVE_ADDRESS 17
+
+/**
+ * @brief Both sides of a pseudo-terminal, what is written to one side can be read from the other
+ *
+ */
+PosixSerial *gateway;
+PosixSerial *device;
+
+void setUp(void)
+{
+    gateway = new PosixSerial();
+    device = new PosixSerial();
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    TEST_ASSERT_TRUE_MESSAGE(master >= 0, "Pseudo-terminal could not be created");
+    TEST_ASSERT_EQUAL(0, grantpt(master));
+    TEST_ASSERT_EQUAL(0, unlockpt(master));
+    TEST_ASSERT_TRUE_MESSAGE(gateway->Open(ptsname(master), 115200), "Slave side could not be opened");
+    TEST_ASSERT_TRUE_MESSAGE(device->Open(master, 115200), "Master side could not be configured");
+}
+
+void tearDown(void)
+{
+    delete gateway;
+    delete device;
+}
+
+void test_Open(void)
+{
+    PosixSerial serial;
+    TEST_ASSERT_FALSE_MESSAGE(serial.Open("/nonexistent/tty", 9600), "Opening a missing device should fail");
+    TEST_ASSERT_FALSE_MESSAGE(serial.IsOpen(), "Port should not be open after a failure");
+    TEST_ASSERT_EQUAL_MESSAGE(0, serial.available(), "Closed port should have no data");
+    TEST_ASSERT_EQUAL_MESSAGE(-1, serial.read(), "Closed port should return -1");
+    TEST_ASSERT_EQUAL_MESSAGE(0, serial.write('A'), "Closed port should accept nothing");
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    grantpt(master);
+    unlockpt(master);
+    TEST_ASSERT_FALSE_MESSAGE(serial.Open(ptsname(master), 12345), "Non standard baudrate should fail");
+    TEST_ASSERT_FALSE(serial.Open(master, 12345));
+    TEST_ASSERT_TRUE_MESSAGE(fcntl(master, F_GETFD) >= 0, "File descriptor of the caller should stay open after a failure");
+    TEST_ASSERT_TRUE(serial.Open(ptsname(master), 19200, PosixParity::kEven, 2));
+    TEST_ASSERT_EQUAL_MESSAGE(12, serial.GetBitsPerCharacter(), "8E2 has 12 bits per character");
+
+    struct termios options;
+    TEST_ASSERT_EQUAL(0, tcgetattr(serial.GetFileDescriptor(), &options));
+    TEST_ASSERT_EQUAL_MESSAGE(B19200, cfgetospeed(&options), "Baudrate is not set");
+    // The pseudo-terminal driver forces 8 bits without parity, so only the speed and raw mode are checked
+    TEST_ASSERT_FALSE_MESSAGE(options.c_lflag & ICANON, "Port should be in raw mode");
+    close(master);
+}
+
+void test_ReadWrite(void)
+{
+    RS485Posix rs485(*gateway);
+    TEST_ASSERT_EQUAL_MESSAGE(87, rs485.GetCharacterTime(), "Frame format should be taken from the port");
+
+    // Reading without data does not block
+    TEST_ASSERT_EQUAL(0, rs485.available());
+    TEST_ASSERT_EQUAL(-1, rs485.read());
+    uint8_t buffer[600];
+    TEST_ASSERT_EQUAL(0, rs485.read(buffer, sizeof(buffer)));
+
+    uint8_t data[500];
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(data), rs485.Send(data, sizeof(data)), "Send should write the whole buffer");
+
+    size_t received = 0;
+    unsigned long start_time = millis();
+    while (received < sizeof(data) && millis() - start_time < 1000)
+    {
+        received += device->read(buffer + received, sizeof(buffer) - received);
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(data), received, "Not all bytes arrived");
+    TEST_ASSERT_EQUAL_MEMORY(data, buffer, sizeof(data));
+
+    // Byte by byte and bulk in the other direction
+    device->write(data, 300);
+    TEST_ASSERT_EQUAL_MESSAGE(300, rs485.read(buffer, 300, 1000), "Bulk read with timeout is not correct");
+    TEST_ASSERT_EQUAL_MEMORY(data, buffer, 300);
+    device->write('X');
+    delay(5);
+    TEST_ASSERT_EQUAL('X', rs485.peek());
+    TEST_ASSERT_EQUAL('X', rs485.read());
+}
+
+/**
+ * @brief A write larger than the kernel buffer waits for room instead of stopping at the first full buffer
+ *
+ */
+void test_WriteFullBuffer(void)
+{
+    static uint8_t data[65536];
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    static uint8_t buffer[sizeof(data)];
+    size_t received = 0;
+    std::thread reader([&received]()
+                       {
+                           unsigned long start_time = millis();
+                           while (received < sizeof(buffer) && millis() - start_time < 5000)
+                           {
+                               received += device->read(buffer + received, sizeof(buffer) - received);
+                           } });
+
+    size_t written = gateway->write(data, sizeof(data));
+    reader.join();
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(data), written, "Write should wait for room in the kernel buffer");
+    TEST_ASSERT_EQUAL_MESSAGE(sizeof(data), received, "Not all bytes arrived");
+    TEST_ASSERT_EQUAL_MEMORY(data, buffer, sizeof(data));
+}
+
+void test_DirectionControl(void)
+{
+    RS485Posix rs485(*gateway, PosixDirectionControl::kNone);
+    TEST_ASSERT_EQUAL(PosixDirectionControl::kNone, gateway->GetDirectionControl());
+
+    // A pseudo-terminal has no RTS line and no kernel RS485 mode, the control must stay unchanged
+    if (!gateway->SetDirectionControl(PosixDirectionControl::kRts))
+    {
+        TEST_ASSERT_EQUAL(PosixDirectionControl::kNone, gateway->GetDirectionControl());
+    }
+    if (!gateway->SetDirectionControl(PosixDirectionControl::kKernel))
+    {
+        TEST_ASSERT_NOT_EQUAL(PosixDirectionControl::kKernel, gateway->GetDirectionControl());
+    }
+
+    gateway->SetDirectionControl(PosixDirectionControl::kNone);
+    rs485.SetMode(7);
+    uint8_t data[100] = {};
+    rs485.write(data, sizeof(data));
+    TEST_ASSERT_TRUE_MESSAGE(rs485.GetRemainingTransmissionTime() > 0, "Invalid mode should be ignored, writing must still start a transmission");
+    rs485.flush();
+    delay(5);
+    uint8_t buffer[sizeof(data)];
+    TEST_ASSERT_EQUAL(sizeof(data), device->read(buffer, sizeof(buffer)));
+
+    rs485.BeginTransmission();
+    rs485.write('A');
+    rs485.EndTransmission();
+    delay(5);
+    TEST_ASSERT_EQUAL('A', device->read());
+}
+
+/**
+ * @brief The Modbus code used on the MCU runs unchanged on both sides of the pseudo-terminal
+ *
+ */
+void test_Modbus(void)
+{
+    RS485Posix master_rs485(*gateway);
+    RS485Posix slave_rs485(*device);
+
+    uint16_t holding[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    const ModbusBlock map[] = {
+        ModbusBlock(ModbusTable::kHoldingRegisters, 0, 10, holding),
+    };
+    uint8_t master_buffer[kModbusMaxFrameLength];
+    uint8_t slave_buffer[kModbusMaxFrameLength];
+    ModbusMaster master(master_rs485, master_buffer, sizeof(master_buffer));
+    ModbusSlave slave(slave_rs485, SLAVE_ADDRESS, map, 1, slave_buffer, sizeof(slave_buffer));
+
+    ModbusStatus status = master.BeginReadHoldingRegisters(SLAVE_ADDRESS, 2, 5);
+    TEST_ASSERT_EQUAL(ModbusStatus::kBusy, status);
+    while ((status = master.Poll()) == ModbusStatus::kBusy)
+    {
+        slave.Poll();
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(ModbusStatus::kOk, status, "Read over the pseudo-terminal failed");
+    for (uint16_t i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_EQUAL(i + 2, master.GetRegister(i));
+    }
+
+    TEST_ASSERT_EQUAL(ModbusStatus::kBusy, master.BeginWriteSingleRegister(SLAVE_ADDRESS, 9, 900));
+    while ((status = master.Poll()) == ModbusStatus::kBusy)
+    {
+        slave.Poll();
+    }
+    TEST_ASSERT_EQUAL(ModbusStatus::kOk, status);
+    TEST_ASSERT_EQUAL(900, holding[9]);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_Open);
+    RUN_TEST(test_ReadWrite);
+    RUN_TEST(test_WriteFullBuffer);
+    RUN_TEST(test_DirectionControl);
+    RUN_TEST(test_Modbus);
+
+    return UNITY_END();
+}
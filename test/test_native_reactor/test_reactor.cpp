@@ -0,0 +1,192 @@
+/**
+ * @file test_reactor.cpp
+ * @author rpvos (mr.rv.asd@gmail.com)
+ * @brief Unit tests and benchmark for the epoll reactor using pseudo-terminal pairs (pio test -e native)
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unity.h>
+#include <vector>
+#include "max485ttl_reactor.hpp"
+
+const size_t kFrameLength = 16;
+const unsigned long kBenchmarkDuration = 500;
+
+/**
+ * @brief A port of the gateway connected to a device through a pseudo-terminal
+ *
+ */
+struct PtyPort
+{
+    PtyPort(void) : rs485(nullptr), receiver(nullptr), frames(0), timeouts(0), send_time(0)
+    {
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        grantpt(master);
+        unlockpt(master);
+        gateway.Open(ptsname(master), 115200);
+        device.Open(master, 115200);
+        rs485 = new RS485Posix(gateway);
+        receiver = new RS485FrameReceiver(*rs485, buffer, sizeof(buffer));
+    }
+
+    ~PtyPort(void)
+    {
+        delete receiver;
+        delete rs485;
+    }
+
+    void SendFrame(void)
+    {
+        uint8_t frame[kFrameLength];
+        memset(frame, static_cast<int>(frames), sizeof(frame));
+        send_time = micros();
+        device.write(frame, sizeof(frame));
+    }
+
+    PosixSerial gateway;
+    PosixSerial device;
+    RS485Posix *rs485;
+    RS485FrameReceiver *receiver;
+    uint8_t buffer[64];
+
+    unsigned long frames;
+    unsigned long timeouts;
+    unsigned long send_time;
+    std::vector<unsigned long> latencies;
+};
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void RecordEvent(RS485Reactor &reactor, const size_t port, const RS485ReactorEvent event, void *context)
+{
+    (void)reactor;
+    (void)port;
+    PtyPort *pty = static_cast<PtyPort *>(context);
+    if (event == RS485ReactorEvent::kFrameComplete)
+    {
+        pty->frames++;
+        pty->latencies.push_back(micros() - pty->send_time);
+    }
+    else
+    {
+        pty->timeouts++;
+    }
+}
+
+void test_Events(void)
+{
+    PtyPort a;
+    PtyPort b;
+    RS485Reactor reactor;
+    int port_a = reactor.AddPort(*a.rs485, *a.receiver, RecordEvent, &a);
+    int port_b = reactor.AddPort(*b.rs485, *b.receiver, RecordEvent, &b);
+    TEST_ASSERT_EQUAL(0, port_a);
+    TEST_ASSERT_EQUAL(1, port_b);
+
+    // Nothing happens without data
+    TEST_ASSERT_EQUAL(0, reactor.RunOnce(10));
+
+    a.SendFrame();
+    unsigned long start_time = millis();
+    while (a.frames == 0 && millis() - start_time < 1000)
+    {
+        reactor.RunOnce(100);
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(1, a.frames, "Frame complete should be dispatched");
+    TEST_ASSERT_EQUAL_MESSAGE(0, b.frames, "Other port should not get a frame");
+    TEST_ASSERT_TRUE_MESSAGE(a.latencies[0] >= a.receiver->GetInterFrameTimeout(), "Frame completed before t3.5");
+    TEST_ASSERT_EQUAL_MESSAGE(0, a.receiver->GetFrameLength(), "Frame should be released after the callback");
+
+    // Response timeout only fires when nothing arrives
+    reactor.StartResponseTimeout(port_a, 20);
+    reactor.StartResponseTimeout(port_b, 20);
+    b.SendFrame();
+    start_time = millis();
+    while ((a.timeouts == 0 || b.frames == 0) && millis() - start_time < 1000)
+    {
+        reactor.RunOnce(100);
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(1, a.timeouts, "Response timeout should be dispatched");
+    TEST_ASSERT_EQUAL_MESSAGE(0, b.timeouts, "Response arrived, no timeout expected");
+    TEST_ASSERT_EQUAL_MESSAGE(1, b.frames, "Response should be dispatched as frame");
+
+    reactor.RemovePort(port_a);
+    a.SendFrame();
+    reactor.RunOnce(20);
+    TEST_ASSERT_EQUAL_MESSAGE(1, a.frames, "Removed port should not dispatch");
+}
+
+/**
+ * @brief Every frame received by the gateway triggers the next frame from the device on that port
+ *
+ */
+void PingPong(RS485Reactor &reactor, const size_t port, const RS485ReactorEvent event, void *context)
+{
+    RecordEvent(reactor, port, event, context);
+    static_cast<PtyPort *>(context)->SendFrame();
+}
+
+void test_BenchmarkPorts(void)
+{
+    const size_t port_counts[] = {1, 2, 4, 8, 16};
+    for (size_t n : port_counts)
+    {
+        RS485Reactor reactor;
+        std::vector<PtyPort *> ports;
+        for (size_t i = 0; i < n; i++)
+        {
+            ports.push_back(new PtyPort());
+            TEST_ASSERT_TRUE(reactor.AddPort(*ports[i]->rs485, *ports[i]->receiver, PingPong, ports[i]) >= 0);
+            ports[i]->SendFrame();
+        }
+
+        unsigned long start_time = millis();
+        while (millis() - start_time < kBenchmarkDuration)
+        {
+            reactor.RunOnce(10);
+        }
+        unsigned long duration = millis() - start_time;
+
+        unsigned long inter_frame_timeout = ports[0]->receiver->GetInterFrameTimeout();
+        std::vector<unsigned long> latencies;
+        unsigned long frames = 0;
+        for (PtyPort *port : ports)
+        {
+            frames += port->frames;
+            latencies.insert(latencies.end(), port->latencies.begin(), port->latencies.end());
+            delete port;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        unsigned long p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+
+        char output[128];
+        snprintf(output, sizeof(output), "reactor %2zu ports: %8.0f frames/s, p99 latency %lu us (t3.5 %lu us)",
+                 n, frames * 1000.0 / duration, p99, inter_frame_timeout);
+        TEST_MESSAGE(output);
+        TEST_ASSERT_TRUE_MESSAGE(frames > n, "Every port should receive frames");
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_Events);
+    RUN_TEST(test_BenchmarkPorts);
+
+    return UNITY_END();
+}